@@ -0,0 +1,58 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "arena.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace wccff {
+
+void *arena::allocate(std::size_t size, std::size_t alignment)
+{
+    auto address = reinterpret_cast<std::uintptr_t>(m_current);
+    auto padding = (alignment - address % alignment) % alignment;
+    if (m_current == nullptr || static_cast<std::size_t>(m_end - m_current) < padding + size)
+    {
+        // Objects bigger than a block get a block of their own
+        auto block_size = std::max(m_block_size, size + alignment);
+        m_blocks.emplace_back(new std::byte[block_size]);
+        m_current = m_blocks.back().get();
+        m_end = m_current + block_size;
+        address = reinterpret_cast<std::uintptr_t>(m_current);
+        padding = (alignment - address % alignment) % alignment;
+    }
+    auto *result = m_current + padding;
+    m_current = result + size;
+    m_bytes_used += padding + size;
+    return result;
+}
+
+void arena::release()
+{
+    if (m_blocks.empty())
+    {
+        return;
+    }
+    m_blocks.resize(1);
+    m_current = m_blocks.front().get();
+    m_end = m_current + m_block_size;
+    m_bytes_used = 0;
+}
+
+} // namespace wccff
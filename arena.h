@@ -0,0 +1,85 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace wccff {
+
+/**
+ * Bump allocator, the objects are carved one after the other out of big blocks.
+ * Nothing is freed individually, release() frees every object at once.
+ */
+class arena
+{
+  public:
+    static constexpr std::size_t default_block_size = 64 * 1024;
+
+    explicit arena(std::size_t block_size = default_block_size)
+      : m_block_size(block_size)
+    {
+    }
+    arena(const arena &) = delete;
+    arena &operator=(const arena &) = delete;
+
+    /**
+     * Constructs a T in the arena, it lives until the next release().
+     */
+    template<typename T, typename... Args>
+    T *create(Args &&...args)
+    {
+        // The destructors are never called
+        static_assert(std::is_trivially_destructible_v<T>);
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /**
+     * Returns size bytes aligned to alignment, which must be a power of two.
+     */
+    void *allocate(std::size_t size, std::size_t alignment);
+
+    /**
+     * Frees every object allocated so far. The first block is kept for the next allocations.
+     */
+    void release();
+
+    /**
+     * Number of bytes handed out since the last release, including the alignment padding.
+     */
+    [[nodiscard]] std::size_t bytes_used() const { return m_bytes_used; }
+    [[nodiscard]] std::size_t blocks() const { return m_blocks.size(); }
+
+  private:
+    std::size_t m_block_size;
+    std::vector<std::unique_ptr<std::byte[]>> m_blocks;
+    std::byte *m_current{ nullptr };
+    std::byte *m_end{ nullptr };
+    std::size_t m_bytes_used{ 0 };
+};
+
+} // namespace wccff
+
+#endif // ARENA_H
@@ -18,7 +18,12 @@
  */
 
 #include "assembly_generation.h"
+#include "trace.h"
 #include "visitor.h"
+#include <array>
+#include <fmt/format.h>
+#include <optional>
+#include <stdexcept>
 
 namespace wccff::assembly_generation {
 
@@ -76,11 +81,13 @@ std::vector<instruction> process_statement(const wccff::tacky::jump_statement &s
 }
 std::vector<instruction> process_statement(const wccff::tacky::jump_if_zero_statement &stmt)
 {
-    return { cmp{ immediate{ 0 }, process_val(stmt.condition) }, jmpcc{ E{}, process_identifier(stmt.target) } };
+    return { cmp{ immediate{ 0 }, process_val(stmt.condition) },
+             jmpcc{ cond_code::E, process_identifier(stmt.target) } };
 }
 std::vector<instruction> process_statement(const wccff::tacky::jump_if_not_zero_statement &stmt)
 {
-    return { cmp{ immediate{ 0 }, process_val(stmt.condition) }, jmpcc{ NE{}, process_identifier(stmt.target) } };
+    return { cmp{ immediate{ 0 }, process_val(stmt.condition) },
+             jmpcc{ cond_code::NE, process_identifier(stmt.target) } };
 }
 std::vector<instruction> process_statement(const wccff::tacky::label_statement &stmt)
 {
@@ -94,62 +101,105 @@ std::vector<instruction> process_statement(const wccff::tacky::return_statement
     return { mov, ret };
 }
 
-unary_operator process_unary_operator(const wccff::tacky::unary_operator &op)
+/**
+ * Indexed by tacky::unary_operator. The logical not is lowered to a comparison.
+ */
+constexpr std::array<std::optional<unary_operator>, 3> unary_operators_from_tacky{
+    unary_operator::complement,
+    unary_operator::negate,
+    std::nullopt,
+};
+
+/**
+ * Indexed by tacky::binary_operator. The division and the remainder are lowered to idiv, and the relational
+ * operators to a comparison.
+ */
+constexpr std::array<std::optional<binary_operator>, 16> binary_operators_from_tacky{
+    binary_operator::add,
+    binary_operator::sub,
+    binary_operator::mul,
+    std::nullopt,
+    std::nullopt,
+    binary_operator::binary_and,
+    binary_operator::binary_or,
+    binary_operator::binary_xor,
+    binary_operator::left_shift,
+    binary_operator::right_shift,
+    std::nullopt,
+    std::nullopt,
+    std::nullopt,
+    std::nullopt,
+    std::nullopt,
+    std::nullopt,
+};
+
+/**
+ * Indexed by tacky::binary_operator, only the relational operators have a condition code.
+ */
+constexpr std::array<std::optional<cond_code>, 16> cond_codes_from_tacky{
+    std::nullopt,
+    std::nullopt,
+    std::nullopt,
+    std::nullopt,
+    std::nullopt,
+    std::nullopt,
+    std::nullopt,
+    std::nullopt,
+    std::nullopt,
+    std::nullopt,
+    cond_code::E,
+    cond_code::NE,
+    cond_code::L,
+    cond_code::LE,
+    cond_code::G,
+    cond_code::GE,
+};
+
+static_assert(unary_operators_from_tacky.size() == tacky::unary_operators.size());
+static_assert(binary_operators_from_tacky.size() == tacky::binary_operators.size());
+static_assert(cond_codes_from_tacky.size() == tacky::binary_operators.size());
+
+unary_operator process_unary_operator(wccff::tacky::unary_operator op)
 {
-    return std::visit(visitor{
-                        [](const tacky::binary_complement_operator &) -> unary_operator { return not_op{}; },
-                        [](const tacky::negate_operator &) -> unary_operator { return neg_op{}; },
-                        [](const tacky::not_operator &) -> unary_operator {
-                            throw std::logic_error("logical not operator Not implemented");
-                        },
-                      },
-                      op);
+    auto converted = unary_operators_from_tacky[static_cast<std::size_t>(op)];
+    if (converted.has_value() == false)
+    {
+        auto name = tacky::info(op).name;
+        throw std::logic_error(fmt::format("{} operator is not converted into an unary operator", name));
+    }
+    return converted.value();
 }
 
-binary_operator process_binary_operator(const wccff::tacky::binary_operator &op)
+binary_operator process_binary_operator(wccff::tacky::binary_operator op)
 {
-    return std::visit(
-      visitor{
-        [](const tacky::plus_operator &) -> binary_operator { return add{}; },
-        [](const tacky::subtract_operator &) -> binary_operator { return sub{}; },
-        [](const tacky::multiply_operator &) -> binary_operator { return mul{}; },
-        [](const tacky::divide_operator &) -> binary_operator { return sub{}; },
-        [](const tacky::remainder_operator &) -> binary_operator { return mul{}; },
-        [](const tacky::binary_and_operator &) -> binary_operator { return binary_and{}; },
-        [](const tacky::binary_or_operator &) -> binary_operator { return binary_or{}; },
-        [](const tacky::binary_xor_operator &) -> binary_operator { return binary_xor{}; },
-        [](const tacky::left_shift_operator &) -> binary_operator { return left_shift{}; },
-        [](const tacky::right_shift_operator &) -> binary_operator { return right_shift{}; },
-        [](const tacky::equal_operator &) -> binary_operator {
-            throw std::logic_error("Equal operator is not converted into a binary operator");
-        },
-        [](const tacky::not_equal_operator &) -> binary_operator {
-            throw std::logic_error("Not Equal operator is not converted into a binary operator");
-        },
-        [](const tacky::less_than_operator &) -> binary_operator {
-            throw std::logic_error("Less Than operator is not converted into a binary operator");
-        },
-        [](const tacky::less_than_or_equal_operator &) -> binary_operator {
-            throw std::logic_error("Less Than or Equal operator is not converted into a binary operator");
-        },
-        [](const tacky::greater_than_operator &) -> binary_operator {
-            throw std::logic_error("Greater Than operator is not converted into a binary operator");
-        },
-        [](const tacky::greater_than_or_equal_operator &) -> binary_operator {
-            throw std::logic_error("Greater Than or Equal operator is not converted into a binary operator");
-        },
-      },
-      op);
+    auto converted = binary_operators_from_tacky[static_cast<std::size_t>(op)];
+    if (converted.has_value() == false)
+    {
+        auto name = tacky::info(op).name;
+        throw std::logic_error(fmt::format("{} operator is not converted into a binary operator", name));
+    }
+    return converted.value();
+}
+
+cond_code process_cond_code(wccff::tacky::binary_operator op)
+{
+    auto converted = cond_codes_from_tacky[static_cast<std::size_t>(op)];
+    if (converted.has_value() == false)
+    {
+        auto name = tacky::info(op).name;
+        throw std::logic_error(fmt::format("{} operator is not converted into a condition code", name));
+    }
+    return converted.value();
 }
 
 std::vector<instruction> process_statement(const wccff::tacky::unary_statement &stmt)
 {
     std::vector<instruction> instructions;
-    if (std::holds_alternative<tacky::not_operator>(stmt.op))
+    if (stmt.op == tacky::unary_operator::logical_not)
     {
         instructions.emplace_back(cmp{ operand{ immediate{ 0 } }, process_val(stmt.src) });
         instructions.emplace_back(mov_instruction{ immediate{ 0 }, process_val(stmt.dst) });
-        instructions.emplace_back(setcc{ E{}, process_val(stmt.dst) });
+        instructions.emplace_back(setcc{ cond_code::E, process_val(stmt.dst) });
         return instructions;
     }
 
@@ -161,45 +211,17 @@ std::vector<instruction> process_statement(const wccff::tacky::unary_statement &
 
 std::vector<instruction> process_statement(const wccff::tacky::binary_statement &stmt)
 {
-    auto is_relational_operator = [](tacky::binary_operator op) {
-        return std::visit(visitor{
-                            [](tacky::equal_operator) { return true; },
-                            [](tacky::not_equal_operator) { return true; },
-                            [](tacky::less_than_operator) { return true; },
-                            [](tacky::less_than_or_equal_operator) { return true; },
-                            [](tacky::greater_than_operator) { return true; },
-                            [](tacky::greater_than_or_equal_operator) { return true; },
-                            [](auto) { return false; },
-                          },
-                          op);
-    };
-
-    auto convert_tacky_op = [](tacky::binary_operator op) {
-        return std::visit(visitor{
-                            [](tacky::equal_operator) -> cond_code { return E{}; },
-                            [](tacky::not_equal_operator) -> cond_code { return NE{}; },
-                            [](tacky::less_than_operator) -> cond_code { return L{}; },
-                            [](tacky::less_than_or_equal_operator) -> cond_code { return LE{}; },
-                            [](tacky::greater_than_operator) -> cond_code { return G{}; },
-                            [](tacky::greater_than_or_equal_operator) -> cond_code { return GE{}; },
-                            [](auto) -> cond_code {
-                                throw std::logic_error("Binary operator is not converted into a binary operator");
-                            },
-                          },
-                          op);
-    };
-
-    if (is_relational_operator(stmt.op))
+    if (tacky::info(stmt.op).relational)
     {
         std::vector<instruction> instructions;
         instructions.emplace_back(cmp{ process_val(stmt.src2), process_val(stmt.src1) });
         instructions.emplace_back(mov_instruction{ immediate{ 0 }, process_val(stmt.dst) });
-        instructions.emplace_back(setcc{ convert_tacky_op(stmt.op), process_val(stmt.dst) });
+        instructions.emplace_back(setcc{ process_cond_code(stmt.op), process_val(stmt.dst) });
 
         return instructions;
     }
 
-    if (std::holds_alternative<wccff::tacky::divide_operator>(stmt.op))
+    if (stmt.op == tacky::binary_operator::divide)
     {
         mov_instruction mov1{ process_val(stmt.src1), ax{} };
         idiv div{ process_val(stmt.src2) };
@@ -208,7 +230,7 @@ std::vector<instruction> process_statement(const wccff::tacky::binary_statement
         return { mov1, cdq{}, div, mov2 };
     }
 
-    if (std::holds_alternative<wccff::tacky::remainder_operator>(stmt.op))
+    if (stmt.op == tacky::binary_operator::remainder)
     {
         mov_instruction mov1{ process_val(stmt.src1), ax{} };
         idiv div{ process_val(stmt.src2) };
@@ -248,17 +270,24 @@ std::vector<instruction> process_statement(const std::vector<tacky::instruction>
     return ret_insts;
 }
 
-function process_function(const wccff::tacky::function_definition &f)
+function process_function(const wccff::tacky::function_definition &f, const symbol_interner &symbols)
 {
+    auto start = trace::clock::now();
     function asm_f;
     asm_f.name = process_identifier(f.name);
     asm_f.instructions = process_statement(f.instructions);
+    WCCFF_TRACE(codegen,
+                info,
+                "Generated {} instructions for function {} in {:.1f} us",
+                asm_f.instructions.size(),
+                symbols.text(asm_f.name.name),
+                trace::microseconds_since(start));
     return asm_f;
 }
 
-program process(const wccff::tacky::program &program)
+program process(const wccff::tacky::program &program, const symbol_interner &symbols)
 {
-    return { process_function(program.function) };
+    return { process_function(program.function, symbols) };
 }
 
 void replace_pseudo_registers_q(mov_instruction &i)
@@ -384,9 +413,9 @@ std::optional<std::vector<instruction>> fixing_up_instructions11(const cmp &n)
 
 std::optional<std::vector<instruction>> fixing_up_instructions_binary(const binary &n)
 {
-    if (std::holds_alternative<add>(n.op) || std::holds_alternative<sub>(n.op) ||
-        std::holds_alternative<binary_and>(n.op) || std::holds_alternative<binary_or>(n.op) ||
-        std::holds_alternative<binary_xor>(n.op))
+    const auto &op = info(n.op);
+    // The shifts and imul are fixed up below, the other operators take at most one memory operand
+    if (op.shift == false && op.register_destination == false)
     {
         if (std::holds_alternative<stack>(n.src) && std::holds_alternative<stack>(n.dst))
         {
@@ -399,7 +428,7 @@ std::optional<std::vector<instruction>> fixing_up_instructions_binary(const bina
         }
     }
 
-    if (std::holds_alternative<left_shift>(n.op) || std::holds_alternative<right_shift>(n.op))
+    if (op.shift)
     {
         std::vector<instruction> ret_insts;
         mov_instruction m1{ n.src, cx{} };
@@ -409,7 +438,7 @@ std::optional<std::vector<instruction>> fixing_up_instructions_binary(const bina
         return ret_insts;
     }
 
-    if (std::holds_alternative<mul>(n.op))
+    if (op.register_destination)
     {
         if (std::holds_alternative<stack>(n.dst))
         {
@@ -481,182 +510,217 @@ void fixing_up_instructions(std::vector<instruction> &node)
     node.swap(tmp);
 }
 
-void fixing_up_instructions(function &node)
+void fixing_up_instructions(function &node, const symbol_interner &symbols)
 {
+    auto start = trace::clock::now();
+    auto before = node.instructions.size();
     fixing_up_instructions(node.instructions);
+    WCCFF_TRACE(codegen,
+                debug,
+                "Fixed up function {} from {} to {} instructions in {:.1f} us",
+                symbols.text(node.name.name),
+                before,
+                node.instructions.size(),
+                trace::microseconds_since(start));
 }
 
-void fixing_up_instructions(program &node)
+void fixing_up_instructions(program &node, const symbol_interner &symbols)
 {
-    fixing_up_instructions(node.function);
+    fixing_up_instructions(node.function, symbols);
 }
 
-std::string pretty_print(const cmp &node)
+void pretty_print(print_context &context, const cmp &node)
 {
-    return fmt::format("Cmp({}, {})", pretty_print(node.lhs), pretty_print(node.lhs));
+    context.write("Cmp(");
+    pretty_print(context, node.lhs);
+    context.write(", ");
+    pretty_print(context, node.rhs);
+    context.write(")");
 }
 
-std::string pretty_print(const cond_code &node)
+void pretty_print(print_context &context, const cond_code &node)
 {
-    return std::visit(wccff::visitor{
-                        [](E) { return "E"; },
-                        [](NE) { return "NE"; },
-                        [](L) { return "L"; },
-                        [](LE) { return "LE"; },
-                        [](G) { return "G"; },
-                        [](GE) { return "GE"; },
-                      },
-                      node);
+    context.write("{}", info(node).name);
 }
-std::string pretty_print(const jmp &node)
+void pretty_print(print_context &context, const jmp &node)
 {
-    return fmt::format("Jmp({})", pretty_print(node.name));
+    context.write("Jmp(");
+    pretty_print(context, node.name);
+    context.write(")");
 }
-std::string pretty_print(const jmpcc &node)
+void pretty_print(print_context &context, const jmpcc &node)
 {
-    return fmt::format("JmpCC({}, {})", pretty_print(node.cond), pretty_print(node.name));
+    context.write("JmpCC(");
+    pretty_print(context, node.cond);
+    context.write(", ");
+    pretty_print(context, node.name);
+    context.write(")");
 }
-std::string pretty_print(const label &node)
+void pretty_print(print_context &context, const label &node)
 {
-    return fmt::format("Label({})", pretty_print(node.name));
+    context.write("Label(");
+    pretty_print(context, node.name);
+    context.write(")");
 }
-std::string pretty_print(const setcc &node)
+void pretty_print(print_context &context, const setcc &node)
 {
-    return fmt::format("SetCC({}, {})", pretty_print(node.cond), pretty_print(node.dst));
+    context.write("SetCC(");
+    pretty_print(context, node.cond);
+    context.write(", ");
+    pretty_print(context, node.dst);
+    context.write(")");
 }
 
-std::string pretty_print(const identifier &node)
+void pretty_print(print_context &context, const identifier &node)
 {
-    return fmt::format("{}", node.name);
+    context.write("{}", context.symbols.text(node.name));
 }
 
-std::string pretty_print(const binary_operator &node)
+void pretty_print(print_context &context, const binary_operator &node)
 {
-    return std::visit(visitor{
-                        [](const add &) { return "Add"; },
-                        [](const sub &) { return "Sub"; },
-                        [](const mul &) { return "Mul"; },
-                        [](const binary_and &) { return "Binary And"; },
-                        [](const binary_or &) { return "Binary Or"; },
-                        [](const binary_xor &) { return "Binary Xor"; },
-                        [](const left_shift &) { return "Left Shift"; },
-                        [](const right_shift &) { return "Right Shift"; },
-                      },
-                      node);
+    context.write("{}", info(node).name);
 }
-std::string pretty_print(const unary_operator &node)
+void pretty_print(print_context &context, const unary_operator &node)
 {
-    return std::visit(visitor{ [](const not_op &) { return "Complement"; }, [](const neg_op &) { return "Negate"; } },
-                      node);
+    context.write("{}", info(node).name);
 }
 
-std::string pretty_print(const immediate &node)
+void pretty_print(print_context &context, const immediate &node)
 {
-    return fmt::format("Imm({})", node.value);
+    context.write("Imm({})", node.value);
 }
 
-std::string pretty_print(const reg &node)
+void pretty_print(print_context &context, const reg &node)
 {
-    return std::visit(visitor{
-                        [](const ax &) { return "ax"; },
-                        [](const cx &) { return "cx"; },
-                        [](const dx &) { return "dx"; },
-                        [](const R10 &) { return "R10d"; },
-                        [](const R11 &) { return "R11d"; },
-                      },
-                      node);
+    auto name = std::visit(visitor{
+                             [](const ax &) { return "ax"; },
+                             [](const cx &) { return "cx"; },
+                             [](const dx &) { return "dx"; },
+                             [](const R10 &) { return "R10d"; },
+                             [](const R11 &) { return "R11d"; },
+                           },
+                           node);
+    context.write("{}", name);
 }
 
-std::string pretty_print(const pseudo &node)
+void pretty_print(print_context &context, const pseudo &node)
 {
-    return fmt::format("Pseudo({})", pretty_print(node.name));
+    context.write("Pseudo(");
+    pretty_print(context, node.name);
+    context.write(")");
 }
 
-std::string pretty_print(const stack &node)
+void pretty_print(print_context &context, const stack &node)
 {
-    return fmt::format("Stack({})", pretty_print(node.value));
+    context.write("Stack(");
+    pretty_print(context, node.value);
+    context.write(")");
 }
 
-std::string pretty_print(const operand &node)
+void pretty_print(print_context &context, const operand &node)
 {
-    return std::visit(visitor{ [](const immediate &n) { return pretty_print(n); },
-                               [](const reg &n) { return pretty_print(n); },
-                               [](const pseudo &n) { return pretty_print(n); },
-                               [](const stack &n) { return pretty_print(n); } },
-                      node);
+    std::visit(visitor{ [&context](const auto &n) { pretty_print(context, n); } }, node);
 }
 
-std::string pretty_print(const mov_instruction &node)
+void pretty_print(print_context &context, const mov_instruction &node)
 {
-    return fmt::format("Mov(src({}), dst({}))", pretty_print(node.src), pretty_print(node.dst));
+    context.write("Mov(src(");
+    pretty_print(context, node.src);
+    context.write("), dst(");
+    pretty_print(context, node.dst);
+    context.write("))");
 }
 
-std::string pretty_print(const unary &node)
+void pretty_print(print_context &context, const unary &node)
 {
-    return fmt::format("Unary(op({}), dst({}))", pretty_print(node.op), pretty_print(node.dst));
+    context.write("Unary(op(");
+    pretty_print(context, node.op);
+    context.write("), dst(");
+    pretty_print(context, node.dst);
+    context.write("))");
 }
 
-std::string pretty_print(const binary &node)
+void pretty_print(print_context &context, const binary &node)
 {
-    return fmt::format("Binary(op({}), src({}), dst({}))",
-                       pretty_print(node.op),
-                       pretty_print(node.src),
-                       pretty_print(node.dst));
+    context.write("Binary(op(");
+    pretty_print(context, node.op);
+    context.write("), src(");
+    pretty_print(context, node.src);
+    context.write("), dst(");
+    pretty_print(context, node.dst);
+    context.write("))");
 }
-std::string pretty_print(const idiv &node)
+void pretty_print(print_context &context, const idiv &node)
 {
-    return fmt::format("iDiv");
+    context.write("iDiv");
 }
-std::string pretty_print(const cdq &node)
+void pretty_print(print_context &context, const cdq &node)
 {
-    return fmt::format("CDQ");
+    context.write("CDQ");
 }
 
-std::string pretty_print(const allocate_stack &node)
+void pretty_print(print_context &context, const allocate_stack &node)
 {
-    return fmt::format("Stack({})", pretty_print(node.size));
+    context.write("Stack(");
+    pretty_print(context, node.size);
+    context.write(")");
 }
 
-std::string pretty_print(const ret_instruction &node)
+void pretty_print(print_context &context, const ret_instruction &node)
 {
-    return fmt::format("Ret");
+    context.write("Ret");
 }
 
-std::string pretty_print(const instruction &node)
+void pretty_print(print_context &context, const instruction &node)
 {
-    return std::visit(visitor{ [](const mov_instruction &n) { return pretty_print(n); },
-                               [](const unary &n) { return pretty_print(n); },
-                               [](const binary &n) { return pretty_print(n); },
-                               [](const cmp &n) { return pretty_print(n); },
-                               [](const idiv &n) { return pretty_print(n); },
-                               [](const cdq &n) { return pretty_print(n); },
-                               [](const jmp &n) { return pretty_print(n); },
-                               [](const jmpcc &n) { return pretty_print(n); },
-                               [](const setcc &n) { return pretty_print(n); },
-                               [](const label &n) { return pretty_print(n); },
-                               [](const allocate_stack &n) { return pretty_print(n); },
-                               [](const ret_instruction &n) { return pretty_print(n); } },
-                      node);
+    std::visit(visitor{ [&context](const auto &n) { pretty_print(context, n); } }, node);
 }
 
-std::string pretty_print(const std::vector<instruction> &node)
+void pretty_print(print_context &context, const std::vector<instruction> &node)
 {
-    std::string pretty;
     for (const auto &i : node)
     {
-        pretty += fmt::format("{}\n", pretty_print(i));
+        pretty_print(context, i);
+        context.write("\n");
     }
-    return pretty;
 }
 
-std::string pretty_print(const function &node)
+void pretty_print(print_context &context, const function &node)
+{
+    context.write("Function(name: ");
+    pretty_print(context, node.name);
+    context.write("\ninsts: ");
+    pretty_print(context, node.instructions);
+}
+
+void pretty_print(print_context &context, const program &node)
+{
+    pretty_print(context, node.function);
+}
+
+std::string pretty_print(const symbol_interner &symbols, const operand &node)
+{
+    return print_to_string(symbols, node);
+}
+
+std::string pretty_print(const symbol_interner &symbols, const instruction &node)
+{
+    return print_to_string(symbols, node);
+}
+
+std::string pretty_print(const symbol_interner &symbols, const std::vector<instruction> &node)
+{
+    return print_to_string(symbols, node);
+}
+
+std::string pretty_print(const symbol_interner &symbols, const function &node)
 {
-    return fmt::format("Function(name: {}\ninsts: {}", pretty_print(node.name), pretty_print(node.instructions));
+    return print_to_string(symbols, node);
 }
 
-std::string pretty_print(const program &node)
+std::string pretty_print(const symbol_interner &symbols, const program &node)
 {
-    return pretty_print(node.function);
+    return print_to_string(symbols, node);
 }
 
 } // namespace wccff::assembly_generation
@@ -21,9 +21,13 @@
 #define CODEGEN_H
 
 #include "parser.h"
+#include "symbol.h"
 #include "tacky.h"
+#include <array>
 #include <compare>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
@@ -31,7 +35,7 @@ namespace wccff::assembly_generation {
 
 struct identifier
 {
-    std::string name;
+    symbol name;
     bool operator==(const identifier &) const = default;
 };
 
@@ -68,61 +72,111 @@ struct stack
 };
 using operand = std::variant<immediate, reg, pseudo, stack>;
 
-struct neg_op
-{
-};
-struct not_op
+/**
+ * The operators and condition codes are a single byte, their properties are looked up in the tables below.
+ */
+enum class unary_operator : uint8_t
 {
+    complement,
+    negate,
 };
 
-using unary_operator = std::variant<not_op, neg_op>;
-
-struct add
+enum class binary_operator : uint8_t
 {
+    add,
+    sub,
+    mul,
+    binary_and,
+    binary_or,
+    binary_xor,
+    left_shift,
+    right_shift,
 };
 
-struct sub
+enum class cond_code : uint8_t
 {
+    E,
+    NE,
+    G,
+    GE,
+    L,
+    LE,
 };
-struct mul
-{
-};
-struct binary_and
-{
-};
-struct binary_or
-{
-};
-struct binary_xor
-{
-};
-struct left_shift
-{
-};
-struct right_shift
-{
-};
-using binary_operator = std::variant<add, sub, mul, binary_and, binary_or, binary_xor, left_shift, right_shift>;
 
-struct E
+struct unary_operator_info
 {
+    std::string_view name;
+    std::string_view mnemonic;
 };
-struct NE
+
+struct binary_operator_info
 {
+    std::string_view name;
+    std::string_view mnemonic;
+    bool commutative;
+    // The shift count can only be an immediate or the cl register
+    bool shift;
+    // imul can't write its result to memory
+    bool register_destination;
 };
-struct G
+
+struct cond_code_info
 {
+    std::string_view name;
+    // Suffix of the jcc and setcc mnemonics
+    std::string_view suffix;
 };
-struct GE
+
+/**
+ * Indexed by unary_operator.
+ */
+constexpr std::array<unary_operator_info, 2> unary_operators{ {
+  { "Complement", "notl" },
+  { "Negate", "negl" },
+} };
+
+/**
+ * Indexed by binary_operator.
+ */
+constexpr std::array<binary_operator_info, 8> binary_operators{ {
+  { "Add", "addl", true, false, false },
+  { "Sub", "subl", false, false, false },
+  { "Mul", "imull", true, false, true },
+  { "Binary And", "andl", true, false, false },
+  { "Binary Or", "orl", true, false, false },
+  { "Binary Xor", "xorl", true, false, false },
+  { "Left Shift", "sall", false, true, false },
+  { "Right Shift", "sarl", false, true, false },
+} };
+
+/**
+ * Indexed by cond_code.
+ */
+constexpr std::array<cond_code_info, 6> cond_codes{ {
+  { "E", "e" },
+  { "NE", "ne" },
+  { "G", "g" },
+  { "GE", "ge" },
+  { "L", "l" },
+  { "LE", "le" },
+} };
+
+static_assert(unary_operators.size() == static_cast<std::size_t>(unary_operator::negate) + 1);
+static_assert(binary_operators.size() == static_cast<std::size_t>(binary_operator::right_shift) + 1);
+static_assert(cond_codes.size() == static_cast<std::size_t>(cond_code::LE) + 1);
+
+constexpr const unary_operator_info &info(unary_operator op)
 {
-};
-struct L
+    return unary_operators[static_cast<std::size_t>(op)];
+}
+constexpr const binary_operator_info &info(binary_operator op)
 {
-};
-struct LE
+    return binary_operators[static_cast<std::size_t>(op)];
+}
+constexpr const cond_code_info &info(cond_code cond)
 {
-};
-using cond_code = std::variant<E, NE, G, GE, L, LE>;
+    return cond_codes[static_cast<std::size_t>(cond)];
+}
 
 struct unary
 {
@@ -203,37 +257,50 @@ std::vector<instruction> process_statement(const wccff::tacky::binary_statement
 std::vector<instruction> process_statement(const wccff::tacky::unary_statement &stmt);
 std::vector<instruction> process_statement(const tacky::instruction &i);
 std::vector<instruction> process_statement(const std::vector<tacky::instruction> &s);
-function process_function(const wccff::tacky::function_definition &f);
-program process(const wccff::tacky::program &program);
+function process_function(const wccff::tacky::function_definition &f, const symbol_interner &symbols);
+program process(const wccff::tacky::program &program, const symbol_interner &symbols);
 
 void replace_pseudo_registers(program &node);
 
 void fixing_up_instructions(std::vector<instruction> &node);
-void fixing_up_instructions(function &node);
-void fixing_up_instructions(program &program);
-
-std::string pretty_print(const cmp &node);
-std::string pretty_print(const cond_code &node);
-std::string pretty_print(const jmp &node);
-std::string pretty_print(const jmpcc &node);
-std::string pretty_print(const label &node);
-std::string pretty_print(const setcc &node);
-
-std::string pretty_print(const identifier &node);
-std::string pretty_print(const unary_operator &node);
-std::string pretty_print(const immediate &node);
-std::string pretty_print(const reg &node);
-std::string pretty_print(const pseudo &node);
-std::string pretty_print(const stack &node);
-std::string pretty_print(const operand &node);
-std::string pretty_print(const mov_instruction &node);
-std::string pretty_print(const unary &node);
-std::string pretty_print(const allocate_stack &node);
-std::string pretty_print(const ret_instruction &node);
-std::string pretty_print(const instruction &node);
-std::string pretty_print(const std::vector<instruction> &node);
-std::string pretty_print(const function &node);
-std::string pretty_print(const program &program);
+void fixing_up_instructions(function &node, const symbol_interner &symbols);
+void fixing_up_instructions(program &program, const symbol_interner &symbols);
+
+/**
+ * Everything is written inline, except the instructions of a function, one per line.
+ */
+void pretty_print(print_context &context, const cmp &node);
+void pretty_print(print_context &context, const cond_code &node);
+void pretty_print(print_context &context, const jmp &node);
+void pretty_print(print_context &context, const jmpcc &node);
+void pretty_print(print_context &context, const label &node);
+void pretty_print(print_context &context, const setcc &node);
+
+void pretty_print(print_context &context, const identifier &node);
+void pretty_print(print_context &context, const unary_operator &node);
+void pretty_print(print_context &context, const binary_operator &node);
+void pretty_print(print_context &context, const immediate &node);
+void pretty_print(print_context &context, const reg &node);
+void pretty_print(print_context &context, const pseudo &node);
+void pretty_print(print_context &context, const stack &node);
+void pretty_print(print_context &context, const operand &node);
+void pretty_print(print_context &context, const mov_instruction &node);
+void pretty_print(print_context &context, const unary &node);
+void pretty_print(print_context &context, const binary &node);
+void pretty_print(print_context &context, const idiv &node);
+void pretty_print(print_context &context, const cdq &node);
+void pretty_print(print_context &context, const allocate_stack &node);
+void pretty_print(print_context &context, const ret_instruction &node);
+void pretty_print(print_context &context, const instruction &node);
+void pretty_print(print_context &context, const std::vector<instruction> &node);
+void pretty_print(print_context &context, const function &node);
+void pretty_print(print_context &context, const program &node);
+
+std::string pretty_print(const symbol_interner &symbols, const operand &node);
+std::string pretty_print(const symbol_interner &symbols, const instruction &node);
+std::string pretty_print(const symbol_interner &symbols, const std::vector<instruction> &node);
+std::string pretty_print(const symbol_interner &symbols, const function &node);
+std::string pretty_print(const symbol_interner &symbols, const program &program);
 } // namespace wccff::assembly_generation
 
 #endif // CODEGEN_H
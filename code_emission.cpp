@@ -18,14 +18,15 @@
  */
 
 #include "code_emission.h"
+#include "trace.h"
 #include "visitor.h"
 #include <fstream>
 
 namespace wccff::code_emission {
 
-std::string process_identifier(const assembly_generation::identifier &identifier)
+std::string process_identifier(const assembly_generation::identifier &identifier, const symbol_interner &symbols)
 {
-    return fmt::format("_{}", identifier.name);
+    return fmt::format("_{}", symbols.text(identifier.name));
 }
 
 std::string process_immediate(const assembly_generation::immediate &immediate)
@@ -62,15 +63,7 @@ std::string process_stack(const assembly_generation::stack &node)
 
 std::string process_cond_code(assembly_generation::cond_code cond)
 {
-    return std::visit(visitor{
-                        [](const assembly_generation::E &) { return "e"; },
-                        [](const assembly_generation::NE &) { return "ne"; },
-                        [](const assembly_generation::L &) { return "l"; },
-                        [](const assembly_generation::LE &) { return "le"; },
-                        [](const assembly_generation::G &) { return "g"; },
-                        [](const assembly_generation::GE &) { return "ge"; },
-                      },
-                      cond);
+    return std::string{ assembly_generation::info(cond).suffix };
 }
 
 std::string process_operand(const assembly_generation::operand &operand, operand_size size = operand_size::four_bytes)
@@ -94,24 +87,12 @@ std::string process_ret_instruction(const assembly_generation::ret_instruction &
 
 std::string process_binary_operator(const assembly_generation::binary_operator &node)
 {
-    return std::visit(visitor{
-                        [](const assembly_generation::add &) { return "addl"; },
-                        [](const assembly_generation::sub &) { return "subl"; },
-                        [](const assembly_generation::mul &) { return "imull"; },
-                        [](const assembly_generation::binary_and &) { return "andl"; },
-                        [](const assembly_generation::binary_or &) { return "orl"; },
-                        [](const assembly_generation::binary_xor &) { return "xorl"; },
-                        [](const assembly_generation::left_shift &) { return "sall"; },
-                        [](const assembly_generation::right_shift &) { return "sarl"; },
-                      },
-                      node);
+    return std::string{ assembly_generation::info(node).mnemonic };
 }
 
 std::string process_unary_operator(const assembly_generation::unary_operator &node)
 {
-    return std::visit(visitor{ [](const assembly_generation::neg_op &) { return "negl"; },
-                               [](const assembly_generation::not_op &) { return "notl"; } },
-                      node);
+    return std::string{ assembly_generation::info(node).mnemonic };
 }
 std::string process_unary(const assembly_generation::unary &node)
 {
@@ -119,23 +100,12 @@ std::string process_unary(const assembly_generation::unary &node)
 }
 std::string process_binary(const assembly_generation::binary &node)
 {
-    auto op_size = [](const assembly_generation::binary_operator &op) {
-        if (std::holds_alternative<assembly_generation::left_shift>(op) ||
-            std::holds_alternative<assembly_generation::right_shift>(op))
-        {
-            return operand_size::one_byte;
-        }
-        return operand_size::four_bytes;
-    };
-
-    if (std::holds_alternative<assembly_generation::left_shift>(node.op) ||
-        std::holds_alternative<assembly_generation::right_shift>(node.op))
-    {
-    }
+    // The shift count is read from cl
+    auto src_size = assembly_generation::info(node.op).shift ? operand_size::one_byte : operand_size::four_bytes;
 
     return fmt::format("{} {}, {}",
                        process_binary_operator(node.op),
-                       process_operand(node.src, op_size(node.op)),
+                       process_operand(node.src, src_size),
                        process_operand(node.dst));
 }
 
@@ -152,28 +122,28 @@ std::string process_cdq(const assembly_generation::cdq &node)
 {
     return fmt::format("cdq");
 }
-std::string process_jmp(const assembly_generation::jmp &node)
+std::string process_jmp(const assembly_generation::jmp &node, const symbol_interner &symbols)
 {
-    return fmt::format("jmp L{}", process_identifier(node.name));
+    return fmt::format("jmp L{}", process_identifier(node.name, symbols));
 }
-std::string process_jmpcc(const assembly_generation::jmpcc &node)
+std::string process_jmpcc(const assembly_generation::jmpcc &node, const symbol_interner &symbols)
 {
-    return fmt::format("j{} L{}", process_cond_code(node.cond), process_identifier(node.name));
+    return fmt::format("j{} L{}", process_cond_code(node.cond), process_identifier(node.name, symbols));
 }
 std::string process_setcc(const assembly_generation::setcc &node)
 {
     return fmt::format("set{} {}", process_cond_code(node.cond), process_operand(node.dst, operand_size::one_byte));
 }
-std::string process_label(const assembly_generation::label &node)
+std::string process_label(const assembly_generation::label &node, const symbol_interner &symbols)
 {
-    return fmt::format("L{}:", process_identifier(node.name));
+    return fmt::format("L{}:", process_identifier(node.name, symbols));
 }
 std::string process_allocate_stack(const assembly_generation::allocate_stack &node)
 {
     return fmt::format("subq ${}, %rsp", -node.size.value);
 }
 
-std::string process_instruction(const assembly_generation::instruction &instruction)
+std::string process_instruction(const assembly_generation::instruction &instruction, const symbol_interner &symbols)
 {
     return std::visit(visitor{
                         [](const assembly_generation::mov_instruction &mov) { return process_mov_instruction(mov); },
@@ -182,37 +152,46 @@ std::string process_instruction(const assembly_generation::instruction &instruct
                         [](const assembly_generation::cmp &node) { return process_cmp(node); },
                         [](const assembly_generation::idiv &node) { return process_idiv(node); },
                         [](const assembly_generation::cdq &node) { return process_cdq(node); },
-                        [](const assembly_generation::jmp &node) { return process_jmp(node); },
-                        [](const assembly_generation::jmpcc &node) { return process_jmpcc(node); },
+                        [&symbols](const assembly_generation::jmp &node) { return process_jmp(node, symbols); },
+                        [&symbols](const assembly_generation::jmpcc &node) { return process_jmpcc(node, symbols); },
                         [](const assembly_generation::setcc &node) { return process_setcc(node); },
-                        [](const assembly_generation::label &node) { return process_label(node); },
+                        [&symbols](const assembly_generation::label &node) { return process_label(node, symbols); },
                         [](const assembly_generation::allocate_stack &node) { return process_allocate_stack(node); },
                         [](const assembly_generation::ret_instruction &ret) { return process_ret_instruction(ret); },
                       },
                       instruction);
 }
 
-std::string process_function(const assembly_generation::function &f)
+std::string process_function(const assembly_generation::function &f, const symbol_interner &symbols)
 {
-    auto function_name = process_identifier(f.name);
+    auto start = trace::clock::now();
+    auto function_name = process_identifier(f.name, symbols);
     auto result = fmt::format(".globl {}\n{}:\n", function_name, function_name);
     result += fmt::format("pushq %rbp\nmovq %rsp, %rbp\n");
     for (const auto &i : f.instructions)
     {
-        result += fmt::format("{}\n", process_instruction(i));
+        result += fmt::format("{}\n", process_instruction(i, symbols));
     }
+    WCCFF_TRACE(emit,
+                info,
+                "Emitted {} bytes for function {} in {:.1f} us",
+                result.size(),
+                symbols.text(f.name.name),
+                trace::microseconds_since(start));
     return result;
 }
-std::string process_program(const assembly_generation::program &p)
+std::string process_program(const assembly_generation::program &p, const symbol_interner &symbols)
 {
-    return process_function(p.function);
+    return process_function(p.function, symbols);
 }
 
-void process(const std::filesystem::path &output_file, const assembly_generation::program &p)
+void process(const std::filesystem::path &output_file,
+             const assembly_generation::program &p,
+             const symbol_interner &symbols)
 {
-    auto asm_listing = process_program(p);
-    fmt::print("ASM: {}", asm_listing);
+    auto asm_listing = process_program(p, symbols);
 
+    WCCFF_TRACE(emit, debug, "Writing {}", output_file.string());
     std::ofstream out(output_file);
     out << asm_listing << std::endl;
 }
@@ -30,7 +30,12 @@ enum class operand_size
     one_byte,
     four_bytes,
 };
-void process(const std::filesystem::path &output_file, const assembly_generation::program &p);
+/**
+ * Writes the assembly of the program, the names are looked up in symbols.
+ */
+void process(const std::filesystem::path &output_file,
+             const assembly_generation::program &p,
+             const symbol_interner &symbols);
 
 } // namespace wccff::code_emission
 
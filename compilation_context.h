@@ -0,0 +1,41 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPILATION_CONTEXT_H
+#define COMPILATION_CONTEXT_H
+
+#include "arena.h"
+#include "symbol.h"
+
+namespace wccff {
+
+/**
+ * The state of a single compilation, compile() owns it and passes it to the phases.
+ * Nothing in it outlives the compilation, so the next one starts from scratch.
+ */
+struct compilation_context
+{
+    symbol_interner symbols;
+    // Owns every node of the AST, they are all freed at once with the context
+    arena ast;
+};
+
+} // namespace wccff
+
+#endif // COMPILATION_CONTEXT_H
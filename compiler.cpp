@@ -20,60 +20,184 @@
 #include "compiler.h"
 #include "assembly_generation.h"
 #include "code_emission.h"
+#include "compilation_context.h"
 #include "lexer.h"
 #include "parser.h"
+#include "symbol.h"
 #include "tacky.h"
+#include "utils.h"
+#include <array>
+#include <cstdio>
 #include <filesystem>
 #include <fmt/core.h>
-#include <iostream>
+#include <fstream>
 
 namespace wccff {
-bool compile(const std::filesystem::path &source_filename,
-             const std::filesystem::path &output_filename,
-             stop_phase stop)
+static void print_lexer_error(const std::filesystem::path &source_filename, const lexer::lexer_error &error)
 {
-    auto r = lexer::read_file(source_filename);
+    fmt::print("Failed to lexer file {} with message({})\n", source_filename.c_str(), error.message);
+    fmt::print("Error on line: {}:{}\n", error.location.line, error.location.column);
+    fmt::print("With the input: {}\n", error.input);
+}
 
-    if (r.has_value() == false)
+/**
+ * Writes the dump of a stage, when it was asked for, straight from the buffer the printers write to.
+ */
+template<typename Node>
+static bool dump(const std::optional<std::filesystem::path> &target, const symbol_interner &symbols, const Node &node)
+{
+    if (target.has_value() == false)
+    {
+        return true;
+    }
+
+    fmt::memory_buffer out;
+    print_context context{ out, symbols };
+    pretty_print(context, node);
+    if (out.size() != 0 && out[out.size() - 1] != '\n')
+    {
+        out.push_back('\n');
+    }
+
+    if (target->empty())
+    {
+        std::fwrite(out.data(), 1, out.size(), stdout);
+        return true;
+    }
+    std::ofstream file(target.value(), std::ios::binary);
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    if (file.good() == false)
     {
-        fmt::print("Failed to read file {} with message ({})\n", source_filename.c_str(), r.error().message());
+        fmt::print("Failed to write the dump to {}\n", target->c_str());
         return false;
     }
+    return true;
+}
 
-    auto le = lexer::lexer(r.value());
-    if (le.has_value() == false)
+/**
+ * Small sources are lexed as the parser consumes the tokens.
+ * The big ones are lexed up front, so the lexing can be split among several threads.
+ */
+static std::expected<parser::tokens, lexer::lexer_error> make_tokens(const lexer::source_buffer &source)
+{
+    if (source.view().size() < 2 * lexer::parallel_lexer_chunk_size)
+    {
+        return parser::tokens{ lexer::token_stream::padded(source.view()) };
+    }
+    auto buffer = lexer::lexer(source);
+    if (buffer.has_value() == false)
+    {
+        return std::unexpected(buffer.error());
+    }
+    return parser::tokens{ std::move(buffer.value()) };
+}
+
+/**
+ * Runs the compilation from the TACKY to the emission of the assembly.
+ */
+static bool compile_tacky(const tacky::program &tacky_result,
+                          compilation_context &context,
+                          const std::filesystem::path &output_filename,
+                          stop_phase stop,
+                          const dump_options &dumps)
+{
+    if (dump(dumps.tacky, context.symbols, tacky_result) == false)
     {
-        auto error = le.error();
-        fmt::print("Failed to lexer file {} with message({})\n", source_filename.c_str(), error.message);
-        fmt::print("Error on line: {}:{}\n", error.location.line, error.location.column);
-        fmt::print("With the input: {}\n", error.input);
         return false;
     }
-    for (const auto i : le.value())
+    if (stop == stop_phase::tacky)
     {
-        std::cout << "Type: " << i.type << "Value: " << i.text << std::endl;
+        return true;
     }
 
-    if (stop == stop_phase::lexer)
+    //
+    // Codegen
+    //
+
+    auto dump_assembly = [&dumps, &context](asm_stage stage, const assembly_generation::program &program) {
+        return stage != dumps.assembly_stage || dump(dumps.assembly, context.symbols, program);
+    };
+    auto codegen_result = assembly_generation::process(tacky_result, context.symbols);
+    if (dump_assembly(asm_stage::generated, codegen_result) == false)
+    {
+        return false;
+    }
+    replace_pseudo_registers(codegen_result);
+    if (dump_assembly(asm_stage::pseudo_registers_replaced, codegen_result) == false)
+    {
+        return false;
+    }
+    fixing_up_instructions(codegen_result, context.symbols);
+    if (dump_assembly(asm_stage::fixed_up, codegen_result) == false)
+    {
+        return false;
+    }
+
+    if (stop == stop_phase::codegen)
     {
         return true;
     }
 
+    //
+    // Emit Assembly code
+    //
+
+    code_emission::process(output_filename, codegen_result, context.symbols);
+
+    return true;
+}
+
+/**
+ * Runs the compilation from the parser to the emission of the assembly.
+ */
+static bool compile_tokens(parser::tokens &tokens,
+                           compilation_context &context,
+                           const std::filesystem::path &source_filename,
+                           const std::filesystem::path &output_filename,
+                           stop_phase stop,
+                           const parser::options &parser_options,
+                           const dump_options &dumps)
+{
+    if (parser_options.lower_while_parsing)
+    {
+        // The TACKY comes straight from the parser, there's no AST to dump
+        auto lowered = tacky::parse_and_lower(tokens, context);
+        if (tokens.error().has_value())
+        {
+            print_lexer_error(source_filename, tokens.error().value());
+            return false;
+        }
+        if (lowered.has_value() == false)
+        {
+            fmt::print("Failed to parse file {}\n", lowered.error().message);
+            return false;
+        }
+        if (stop == stop_phase::parser)
+        {
+            return true;
+        }
+        return compile_tacky(lowered.value(), context, output_filename, stop, dumps);
+    }
+
     //
     // Parser
     //
 
-    parser::tokens tokens{ le.value() };
-    auto parse_result = parse(tokens);
+    auto parse_result = parse(tokens, context, parser_options);
+    if (tokens.error().has_value())
+    {
+        print_lexer_error(source_filename, tokens.error().value());
+        return false;
+    }
     if (parse_result.has_value() == false)
     {
         fmt::print("Failed to parse file {}\n", parse_result.error().message);
         return false;
     }
-    fmt::print("PARSER PRETTY PRINT BEGIN\n");
-    fmt::print("{}", pretty_print(parse_result.value()));
-
-    fmt::print("\nPARSER PRETTY PRINT END\n");
+    if (dump(dumps.ast, context.symbols, parse_result.value()) == false)
+    {
+        return false;
+    }
     if (stop == stop_phase::parser)
     {
         return true;
@@ -82,40 +206,152 @@ bool compile(const std::filesystem::path &source_filename,
     //
     // TACKY
     //
-    auto tacky_result = tacky::process(parse_result.value());
-    fmt::print("{}", pretty_print(tacky_result));
-    if (stop == stop_phase::tacky)
+    return compile_tacky(tacky::process(parse_result.value(), context.symbols), context, output_filename, stop, dumps);
+}
+
+/**
+ * The tokens are lexed up front to be dumped, then the parser reads them from the buffer.
+ * --lex stops after the dump, which goes to the standard output unless a file was given.
+ */
+static bool compile_dumped_tokens(lexer::token_buffer buffer,
+                                  compilation_context &context,
+                                  const std::filesystem::path &source_filename,
+                                  const std::filesystem::path &output_filename,
+                                  stop_phase stop,
+                                  const parser::options &parser_options,
+                                  const dump_options &dumps)
+{
+    if (stop == stop_phase::lexer)
     {
-        return true;
+        return dump(std::optional{ dumps.tokens.value_or(std::filesystem::path{}) }, context.symbols, buffer);
+    }
+    if (dump(dumps.tokens, context.symbols, buffer) == false)
+    {
+        return false;
     }
+    parser::tokens tokens{ std::move(buffer) };
+    return compile_tokens(tokens, context, source_filename, output_filename, stop, parser_options, dumps);
+}
 
-    //
-    // Codegen
-    //
+/**
+ * Standard input and pipes can't be memory mapped, and don't need to fit in memory.
+ */
+static bool is_stream(const std::filesystem::path &source_filename)
+{
+    std::error_code ec;
+    return source_filename == "-" || (std::filesystem::exists(source_filename, ec) &&
+                                      std::filesystem::is_regular_file(source_filename, ec) == false);
+}
 
-    fmt::print("\nStart Assembly Generation\n");
-    auto codegen_result = assembly_generation::process(tacky_result);
-    fmt::print("{}\n", pretty_print(codegen_result));
-    fmt::print("Stop Assembly Generation");
-    fmt::print("\nReplace Pseudo Register\n");
-    replace_pseudo_registers(codegen_result);
-    fmt::print("{}\n", pretty_print(codegen_result));
+/**
+ * Streams are lexed while they are read, through a window of fixed size, so any amount of input is compiled with the
+ * same memory for the lexer. The preprocessor needs the whole source, so their input is taken as already preprocessed.
+ */
+static bool compile_stream(const std::filesystem::path &source_filename,
+                           compilation_context &context,
+                           const std::filesystem::path &output_filename,
+                           stop_phase stop,
+                           const parser::options &parser_options,
+                           const dump_options &dumps)
+{
+    auto stream = lexer::input_stream::open(source_filename);
+    if (stream.has_value() == false)
+    {
+        fmt::print("Failed to read file {} with message ({})\n", source_filename.c_str(), stream.error().message());
+        return false;
+    }
+    lexer::streaming_lexer lexer{ std::move(stream.value()) };
+
+    if (stop == stop_phase::lexer || dumps.tokens.has_value())
+    {
+        // The tokens of a stream are copied into the buffer, so the whole input is kept while it's compiled
+        lexer::token_buffer buffer;
+        while (true)
+        {
+            auto found = lexer.next(buffer);
+            if (found.has_value() == false)
+            {
+                print_lexer_error(source_filename, found.error());
+                return false;
+            }
+            if (found.value() == false)
+            {
+                break;
+            }
+        }
+        return compile_dumped_tokens(
+          std::move(buffer), context, source_filename, output_filename, stop, parser_options, dumps);
+    }
 
-    fmt::print("Fixup instructions\n");
-    fixing_up_instructions(codegen_result);
-    fmt::print("{}\n", pretty_print(codegen_result));
+    parser::tokens tokens{ std::move(lexer) };
+    return compile_tokens(tokens, context, source_filename, output_filename, stop, parser_options, dumps);
+}
 
-    if (stop == stop_phase::codegen)
+static bool compile_file(const std::filesystem::path &source_filename,
+                         compilation_context &context,
+                         const std::filesystem::path &output_filename,
+                         stop_phase stop,
+                         const preprocessor::options &preprocessor_options,
+                         const parser::options &parser_options,
+                         const dump_options &dumps)
+{
+    if (is_stream(source_filename))
     {
-        return true;
+        return compile_stream(source_filename, context, output_filename, stop, parser_options, dumps);
     }
 
-    //
-    // Emit Assembly code
-    //
+    auto r = preprocessor::preprocess(source_filename, preprocessor_options);
 
-    code_emission::process(output_filename, codegen_result);
+    if (r.has_value() == false)
+    {
+        fmt::print("Failed to preprocess file {}\n", r.error().message);
+        return false;
+    }
 
-    return true;
+    if (stop == stop_phase::lexer || dumps.tokens.has_value())
+    {
+        auto buffer = lexer::lexer(r.value());
+        if (buffer.has_value() == false)
+        {
+            print_lexer_error(source_filename, buffer.error());
+            return false;
+        }
+        return compile_dumped_tokens(
+          std::move(buffer.value()), context, source_filename, output_filename, stop, parser_options, dumps);
+    }
+
+    auto tokens = make_tokens(r.value());
+    if (tokens.has_value() == false)
+    {
+        print_lexer_error(source_filename, tokens.error());
+        return false;
+    }
+    return compile_tokens(tokens.value(), context, source_filename, output_filename, stop, parser_options, dumps);
+}
+
+std::optional<asm_stage> asm_stage_from_string(std::string_view name)
+{
+    // Indexed by asm_stage
+    static constexpr std::array<std::string_view, 3> names{ "generated", "pseudo-replaced", "fixed-up" };
+    for (std::size_t i = 0; i < names.size(); i++)
+    {
+        if (names[i] == name)
+        {
+            return static_cast<asm_stage>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+bool compile(const std::filesystem::path &source_filename,
+             const std::filesystem::path &output_filename,
+             stop_phase stop,
+             const preprocessor::options &preprocessor_options,
+             const parser::options &parser_options,
+             const dump_options &dumps)
+{
+    // Owns the symbols and the AST of this compilation, they are all freed when it ends
+    compilation_context context;
+    return compile_file(source_filename, context, output_filename, stop, preprocessor_options, parser_options, dumps);
 }
 } // namespace wccff
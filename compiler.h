@@ -20,7 +20,11 @@
 #ifndef COMPILER_H
 #define COMPILER_H
 
+#include "parser.h"
+#include "preprocessor.h"
 #include <filesystem>
+#include <optional>
+#include <string_view>
 
 namespace wccff {
 enum class stop_phase
@@ -32,8 +36,36 @@ enum class stop_phase
     codegen
 };
 
+/**
+ * The stages of the assembly generation, the assembly can be dumped after any of them.
+ */
+enum class asm_stage
+{
+    generated,
+    pseudo_registers_replaced,
+    fixed_up,
+};
+
+/**
+ * The intermediate representations to dump, and where. An empty path is the standard output.
+ * Nothing is formatted for the representations that aren't dumped.
+ */
+struct dump_options
+{
+    std::optional<std::filesystem::path> tokens;
+    std::optional<std::filesystem::path> ast;
+    std::optional<std::filesystem::path> tacky;
+    std::optional<std::filesystem::path> assembly;
+    asm_stage assembly_stage = asm_stage::fixed_up;
+};
+
+std::optional<asm_stage> asm_stage_from_string(std::string_view name);
+
 bool compile(const std::filesystem::path &source_filename,
              const std::filesystem::path &output_filename,
-             stop_phase stop);
+             stop_phase stop,
+             const preprocessor::options &preprocessor_options = {},
+             const parser::options &parser_options = {},
+             const dump_options &dumps = {});
 } // namespace wccff
 #endif // COMPILER_H
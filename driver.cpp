@@ -18,50 +18,44 @@
  */
 
 #include "compiler.h"
+#include "trace.h"
 #include <cxxopts.hpp>
 #include <filesystem>
 #include <fmt/core.h>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
 
-std::filesystem::path get_preprocessor_path(const std::filesystem::path &source_file)
-{
-    return source_file.parent_path() / fmt::format("{}.i", source_file.filename().stem().c_str());
-}
+// The output of the standard input is named like gcc does
 std::filesystem::path get_assembly_path(const std::filesystem::path &source_file)
 {
+    if (source_file == "-")
+    {
+        return "a.s";
+    }
     return source_file.parent_path() / fmt::format("{}.s", source_file.filename().stem().c_str());
 }
 std::filesystem::path get_binary_path(const std::filesystem::path &source_file)
 {
-    return source_file.parent_path() / fmt::format("{}", source_file.filename().stem().c_str());
-}
-int run_preprocessor(const std::filesystem::path &source_file)
-{
-    auto dst_file = get_preprocessor_path(source_file);
-
-    auto cmd = fmt::format("gcc -E -P {} -o {}", source_file.c_str(), dst_file.c_str());
-    std::cout << cmd << std::endl;
-
-    auto result = system(cmd.c_str());
-    if (result != 0)
+    if (source_file == "-")
     {
-        std::cerr << "Error while running the preprocessor" << std::endl;
+        return "a.out";
     }
-
-    return result;
+    return source_file.parent_path() / fmt::format("{}", source_file.filename().stem().c_str());
 }
-
-int run_compiler(const std::filesystem::path &source_file, wccff::stop_phase stop_phase)
+int run_compiler(const std::filesystem::path &source_file,
+                 wccff::stop_phase stop_phase,
+                 const wccff::preprocessor::options &preprocessor_options,
+                 const wccff::parser::options &parser_options,
+                 const wccff::dump_options &dumps)
 {
-    auto src_file = get_preprocessor_path(source_file);
     auto dst_file = get_assembly_path(source_file);
 
-    if (wccff::compile(src_file, dst_file, stop_phase) == false)
+    if (wccff::compile(source_file, dst_file, stop_phase, preprocessor_options, parser_options, dumps) == false)
     {
-        std::filesystem::remove_all(src_file);
         return 1;
     }
-    std::filesystem::remove_all(src_file);
 
     return 0;
 }
@@ -78,7 +72,7 @@ int run_assembler_and_linker(const std::filesystem::path &source_file, wccff::st
 
     auto dst_file = get_binary_path(source_file);
     auto cmd = fmt::format("gcc {} -o {}", src_file.c_str(), dst_file.c_str());
-    std::cout << cmd << std::endl;
+    WCCFF_TRACE(driver, info, "{}", cmd);
 
     auto result = system(cmd.c_str());
     if (result != 0)
@@ -90,6 +84,67 @@ int run_assembler_and_linker(const std::filesystem::path &source_file, wccff::st
     return result;
 }
 
+bool configure_trace(const cxxopts::ParseResult &result)
+{
+    auto trace_level = wccff::trace::level_from_string(result["trace"].as<std::string>());
+    if (trace_level.has_value() == false)
+    {
+        std::cout << "Unknown trace level " << result["trace"].as<std::string>() << std::endl;
+        return false;
+    }
+
+    if (result.count("trace-categories") == 0)
+    {
+        wccff::trace::set_level(trace_level.value());
+        return true;
+    }
+
+    for (const auto &name : result["trace-categories"].as<std::vector<std::string>>())
+    {
+        auto category = wccff::trace::category_from_string(name);
+        if (category.has_value() == false)
+        {
+            std::cout << "Unknown trace category " << name << std::endl;
+            return false;
+        }
+        wccff::trace::set_level(category.value(), trace_level.value());
+    }
+    return true;
+}
+
+// The dumps go to the standard output, unless a file is given with --dump-ast=FILE, or --dump-asm=STAGE:FILE
+bool configure_dumps(const cxxopts::ParseResult &result, wccff::dump_options &dumps)
+{
+    if (result.count("dump-tokens"))
+    {
+        dumps.tokens = result["dump-tokens"].as<std::string>();
+    }
+    if (result.count("dump-ast"))
+    {
+        dumps.ast = result["dump-ast"].as<std::string>();
+    }
+    if (result.count("dump-tacky"))
+    {
+        dumps.tacky = result["dump-tacky"].as<std::string>();
+    }
+    if (result.count("dump-asm") == 0)
+    {
+        return true;
+    }
+
+    auto value = result["dump-asm"].as<std::string>();
+    auto separator = value.find(':');
+    auto stage = wccff::asm_stage_from_string(std::string_view{ value }.substr(0, separator));
+    if (stage.has_value() == false)
+    {
+        std::cout << "Unknown assembly stage " << value.substr(0, separator) << std::endl;
+        return false;
+    }
+    dumps.assembly_stage = stage.value();
+    dumps.assembly = separator == std::string::npos ? std::string{} : value.substr(separator + 1);
+    return true;
+}
+
 int main(int argc, char *argv[])
 {
     cxxopts::Options options("iwccfl", "The compiler driver");
@@ -101,7 +156,19 @@ int main(int argc, char *argv[])
     ("tacky","Run the tacky",cxxopts::value<bool>()->implicit_value("true"))
     ("codegen", "Run the codegen", cxxopts::value<bool>()->implicit_value("true"))
     ("S","Generate Assembly file",cxxopts::value<bool>()->implicit_value("true"))
-    ("sourcefile", "The source file to process", cxxopts::value<std::string>())
+    ("I,include", "Add a directory to the include search path", cxxopts::value<std::vector<std::string>>())
+    ("D,define", "Define a macro, as NAME or NAME=VALUE", cxxopts::value<std::vector<std::string>>())
+    ("fold-constants", "Replace the operators on constants by their result while parsing", cxxopts::value<bool>()->implicit_value("true"))
+    ("share-subexpressions", "Build the identical subexpressions once, and compute them once", cxxopts::value<bool>()->implicit_value("true"))
+    ("fast", "Lower the program to TACKY while parsing it, without building the AST nor optimizing it", cxxopts::value<bool>()->implicit_value("true"))
+    ("header-cache", "Directory where the tokens of the headers are cached between compilations", cxxopts::value<std::string>())
+    ("dump-tokens", "Dump the tokens, to the standard output or to the given file", cxxopts::value<std::string>()->implicit_value(""))
+    ("dump-ast", "Dump the AST, to the standard output or to the given file", cxxopts::value<std::string>()->implicit_value(""))
+    ("dump-tacky", "Dump the TACKY, to the standard output or to the given file", cxxopts::value<std::string>()->implicit_value(""))
+    ("dump-asm", "Dump the assembly after a stage: generated, pseudo-replaced or fixed-up, as STAGE or STAGE:FILE", cxxopts::value<std::string>()->implicit_value("fixed-up"))
+    ("trace", "Trace level: off, error, info, debug or verbose", cxxopts::value<std::string>()->default_value("off"))
+    ("trace-categories", "Categories to trace (driver, preprocessor, lexer, parser, tacky, codegen, emit), all by default", cxxopts::value<std::vector<std::string>>())
+    ("sourcefile", "The source file to process, - reads an already preprocessed source from stdin", cxxopts::value<std::string>())
     ("h,help", "Print usage");
     // clang-format on
 
@@ -115,6 +182,11 @@ int main(int argc, char *argv[])
         return 0;
     }
 
+    if (configure_trace(result) == false)
+    {
+        return 1;
+    }
+
     if (result.count("sourcefile") == 0)
     {
         std::cout << "No source file given" << std::endl;
@@ -140,17 +212,52 @@ int main(int argc, char *argv[])
     }
 
     auto source_filename = result["sourcefile"].as<std::string>();
-    if (source_filename.ends_with(".c") == false)
+    if (source_filename != "-" && source_filename.ends_with(".c") == false)
     {
         std::cout << "The filename is wrong" << std::endl;
         return 1;
     }
 
-    if (auto r = run_preprocessor(source_filename) != 0)
+    wccff::preprocessor::options preprocessor_options;
+    if (result.count("include"))
     {
-        return r;
+        for (const auto &path : result["include"].as<std::vector<std::string>>())
+        {
+            preprocessor_options.include_paths.emplace_back(path);
+        }
     }
-    if (auto r = run_compiler(source_filename, stop_phase) != 0)
+    if (result.count("define"))
+    {
+        preprocessor_options.defines = result["define"].as<std::vector<std::string>>();
+    }
+    if (result.count("header-cache"))
+    {
+        preprocessor_options.header_cache_directory = result["header-cache"].as<std::string>();
+    }
+
+    wccff::parser::options parser_options;
+    parser_options.fold_constants = result["fold-constants"].as<bool>();
+    parser_options.share_subexpressions = result["share-subexpressions"].as<bool>();
+    parser_options.lower_while_parsing = result["fast"].as<bool>();
+    if (parser_options.lower_while_parsing && (parser_options.fold_constants || parser_options.share_subexpressions))
+    {
+        std::cout << "--fast doesn't optimize, it can't be used with --fold-constants or --share-subexpressions"
+                  << std::endl;
+        return 1;
+    }
+
+    wccff::dump_options dumps;
+    if (configure_dumps(result, dumps) == false)
+    {
+        return 1;
+    }
+    if (parser_options.lower_while_parsing && dumps.ast.has_value())
+    {
+        std::cout << "The AST isn't built with --fast, it can't be dumped" << std::endl;
+        return 1;
+    }
+
+    if (auto r = run_compiler(source_filename, stop_phase, preprocessor_options, parser_options, dumps) != 0)
     {
         return r;
     }
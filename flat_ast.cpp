@@ -0,0 +1,172 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "flat_ast.h"
+#include "utils.h"
+#include "visitor.h"
+#include <fmt/core.h>
+#include <utility>
+
+namespace wccff::parser {
+
+flat_expression::index flat_expression::add(node_kind kind, uint8_t op, uint32_t first, uint32_t second)
+{
+    m_kinds.push_back(kind);
+    m_operators.push_back(op);
+    m_first.push_back(first);
+    m_second.push_back(second);
+    return static_cast<index>(m_kinds.size() - 1);
+}
+
+flat_expression::index flat_expression::add_constant(int32_t value)
+{
+    return add(node_kind::constant, 0, static_cast<uint32_t>(value), 0);
+}
+
+flat_expression::index flat_expression::add_unary(unary_operator op, index operand)
+{
+    return add(node_kind::unary, static_cast<uint8_t>(op), operand, 0);
+}
+
+flat_expression::index flat_expression::add_binary(binary_operator op, index left, index right)
+{
+    return add(node_kind::binary, static_cast<uint8_t>(op), left, right);
+}
+
+std::expected<flat_expression, parser_error> parse_flat_expression(tokens &tokens)
+{
+    flat_expression expression;
+    flat_builder builder{ expression };
+    auto root = parse_expression(tokens, builder);
+    if (root.has_value() == false)
+    {
+        return std::unexpected{ root.error() };
+    }
+    return expression;
+}
+
+flat_expression flatten(const expression &node)
+{
+    // Post-order walk with a stack on the heap, an operator is visited before and after its operands
+    struct frame
+    {
+        expression node;
+        bool operands_done;
+    };
+    flat_expression output;
+    std::vector<flat_expression::index> operands;
+    std::vector<frame> stack{ { node, false } };
+    while (stack.empty() == false)
+    {
+        auto [current, operands_done] = stack.back();
+        stack.pop_back();
+        std::visit(wccff::visitor{ [&](const int_constant &n) { operands.push_back(output.add_constant(n.value)); },
+                                   [&](const unary_node *n) {
+                                       if (operands_done == false)
+                                       {
+                                           stack.push_back({ current, true });
+                                           stack.push_back({ n->exp, false });
+                                           return;
+                                       }
+                                       operands.back() = output.add_unary(n->op, operands.back());
+                                   },
+                                   [&](const binary_node *n) {
+                                       if (operands_done == false)
+                                       {
+                                           stack.push_back({ current, true });
+                                           stack.push_back({ n->right, false });
+                                           stack.push_back({ n->left, false });
+                                           return;
+                                       }
+                                       auto right = operands.back();
+                                       operands.pop_back();
+                                       operands.back() = output.add_binary(n->op, operands.back(), right);
+                                   } },
+                   current);
+    }
+    return output;
+}
+
+void pretty_print(print_context &context, const flat_expression &node)
+{
+    if (node.empty())
+    {
+        return;
+    }
+
+    // A pre-order walk with an explicit stack, the text of an operator is split around the text of its operands
+    enum class action : uint8_t
+    {
+        open,
+        separator,
+        close,
+    };
+    struct step
+    {
+        action what;
+        flat_expression::index node;
+        int32_t indent;
+    };
+    auto indent = context.indent;
+    std::vector<step> pending{ { action::open, node.root(), indent } };
+    while (pending.empty() == false)
+    {
+        auto current = pending.back();
+        pending.pop_back();
+        context.indent = current.indent;
+        if (current.what == action::separator)
+        {
+            context.write("\n");
+            continue;
+        }
+        if (current.what == action::close)
+        {
+            context.write("\n");
+            context.write_indented(")");
+            continue;
+        }
+        auto i = current.node;
+        switch (node.kind(i))
+        {
+            case node_kind::constant:
+                context.write_indented("Constant({})", node.value(i));
+                break;
+            case node_kind::unary:
+                context.write_indented("Unary({}\n", info(node.unary_op(i)).name);
+                pending.push_back({ action::close, i, current.indent });
+                pending.push_back({ action::open, node.operand(i), current.indent + 6 });
+                break;
+            case node_kind::binary:
+                context.write_indented("Binary({}\n", info(node.binary_op(i)).name);
+                pending.push_back({ action::close, i, current.indent });
+                pending.push_back({ action::open, node.right(i), current.indent + 7 });
+                pending.push_back({ action::separator, i, current.indent });
+                pending.push_back({ action::open, node.left(i), current.indent + 7 });
+                break;
+        }
+    }
+    context.indent = indent;
+}
+
+std::string pretty_print(const flat_expression &node, int32_t ident)
+{
+    return print_to_string(node, ident);
+}
+
+} // namespace wccff::parser
@@ -0,0 +1,107 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+
+#include "parser.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace wccff::parser {
+
+enum class node_kind : uint8_t
+{
+    constant,
+    unary,
+    binary,
+};
+
+/**
+ * Data oriented layout of an expression, an alternative to the tree of nodes.
+ * Every node is an index into parallel arrays, and the nodes are stored in post-order: the operands come before their
+ * operator, the right operand is always the node right before its binary operator, and the root is the last node.
+ * So a pass that needs the operands first is a single forward scan over the arrays.
+ */
+class flat_expression
+{
+  public:
+    using index = uint32_t;
+
+    index add_constant(int32_t value);
+    index add_unary(unary_operator op, index operand);
+    index add_binary(binary_operator op, index left, index right);
+
+    [[nodiscard]] std::size_t size() const { return m_kinds.size(); }
+    [[nodiscard]] bool empty() const { return m_kinds.empty(); }
+    [[nodiscard]] index root() const { return static_cast<index>(m_kinds.size() - 1); }
+
+    [[nodiscard]] node_kind kind(index node) const { return m_kinds[node]; }
+    [[nodiscard]] int32_t value(index node) const { return static_cast<int32_t>(m_first[node]); }
+    [[nodiscard]] unary_operator unary_op(index node) const { return static_cast<unary_operator>(m_operators[node]); }
+    [[nodiscard]] binary_operator binary_op(index node) const
+    {
+        return static_cast<binary_operator>(m_operators[node]);
+    }
+    [[nodiscard]] index operand(index node) const { return m_first[node]; }
+    [[nodiscard]] index left(index node) const { return m_first[node]; }
+    [[nodiscard]] index right(index node) const { return m_second[node]; }
+
+  private:
+    index add(node_kind kind, uint8_t op, uint32_t first, uint32_t second);
+
+    std::vector<node_kind> m_kinds;
+    // The unary or binary operator, both are a single byte
+    std::vector<uint8_t> m_operators;
+    // The operand, or the left operand, or the bits of the value of a constant
+    std::vector<uint32_t> m_first;
+    std::vector<uint32_t> m_second;
+};
+
+/**
+ * Builds the expressions directly in the flat layout, see parse_expression.
+ */
+struct flat_builder
+{
+    using node = flat_expression::index;
+
+    node constant(int32_t value) { return expression.add_constant(value); }
+    node unary(unary_operator op, node operand) { return expression.add_unary(op, operand); }
+    node binary(binary_operator op, node left, node right) { return expression.add_binary(op, left, right); }
+
+    flat_expression &expression;
+};
+
+std::expected<flat_expression, parser_error> parse_flat_expression(tokens &tokens);
+
+/**
+ * Converts a tree of nodes into the flat layout.
+ */
+flat_expression flatten(const expression &node);
+
+/**
+ * Same output as the pretty print of the equivalent tree.
+ */
+void pretty_print(print_context &context, const flat_expression &node);
+std::string pretty_print(const flat_expression &node, int32_t ident);
+
+} // namespace wccff::parser
+
+#endif // FLAT_AST_H
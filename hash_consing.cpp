@@ -0,0 +1,99 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "hash_consing.h"
+#include "visitor.h"
+#include <functional>
+
+namespace wccff::parser {
+
+/**
+ * Constants are compared by value, the nodes by address.
+ */
+static std::size_t identity(const expression &e)
+{
+    return std::visit(wccff::visitor{
+                        [](const int_constant &n) { return static_cast<std::size_t>(static_cast<uint32_t>(n.value)); },
+                        [](const unary_node *n) { return std::hash<const void *>{}(n); },
+                        [](const binary_node *n) { return std::hash<const void *>{}(n); },
+                      },
+                      e);
+}
+
+static bool same(const expression &lhs, const expression &rhs)
+{
+    if (lhs.index() != rhs.index())
+    {
+        return false;
+    }
+    if (std::holds_alternative<int_constant>(lhs))
+    {
+        return std::get<int_constant>(lhs).value == std::get<int_constant>(rhs).value;
+    }
+    return identity(lhs) == identity(rhs);
+}
+
+std::size_t hash_consing_builder::key_hash::operator()(const key &k) const
+{
+    auto h = static_cast<std::size_t>(k.kind) << 8 | k.op;
+    h = h * 31 + k.first.index();
+    h = h * 1000003 + identity(k.first);
+    h = h * 31 + k.second.index();
+    h = h * 1000003 + identity(k.second);
+    return h;
+}
+
+bool hash_consing_builder::key_equal::operator()(const key &lhs, const key &rhs) const
+{
+    return lhs.kind == rhs.kind && lhs.op == rhs.op && same(lhs.first, rhs.first) && same(lhs.second, rhs.second);
+}
+
+hash_consing_builder::node hash_consing_builder::unary(unary_operator op, node operand)
+{
+    key k{ node_kind::unary, static_cast<uint8_t>(op), operand, int_constant{ 0 } };
+    auto it = m_nodes.find(k);
+    if (it != m_nodes.end())
+    {
+        return m_tree.share(it->second);
+    }
+    return remember(k, m_tree.unary(op, operand));
+}
+
+hash_consing_builder::node hash_consing_builder::binary(binary_operator op, node left, node right)
+{
+    key k{ node_kind::binary, static_cast<uint8_t>(op), left, right };
+    auto it = m_nodes.find(k);
+    if (it != m_nodes.end())
+    {
+        return m_tree.share(it->second);
+    }
+    return remember(k, m_tree.binary(op, left, right));
+}
+
+hash_consing_builder::node hash_consing_builder::remember(const key &k, node built)
+{
+    // A folded constant isn't a node, the same constant is simply built again
+    if (std::holds_alternative<int_constant>(built) == false)
+    {
+        m_nodes.emplace(k, built);
+    }
+    return built;
+}
+
+} // namespace wccff::parser
@@ -0,0 +1,83 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HASH_CONSING_H
+#define HASH_CONSING_H
+
+#include "flat_ast.h"
+#include "parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+namespace wccff::parser {
+
+/**
+ * Builds the expressions as a DAG in the arena: structurally identical subexpressions are only created once, and
+ * then shared by every expression that contains them. The nodes that are reused are marked as shared, so the lowering
+ * computes their value once.
+ * The expressions have no side effects, so any subexpression can be shared.
+ */
+class hash_consing_builder
+{
+  public:
+    using node = expression;
+
+    explicit hash_consing_builder(arena &nodes, bool fold_constants = false)
+      : m_tree{ nodes, fold_constants }
+    {
+    }
+
+    node constant(int32_t value) { return m_tree.constant(value); }
+    node unary(unary_operator op, node operand);
+    node binary(binary_operator op, node left, node right);
+    node share(node n) { return m_tree.share(n); }
+
+    /**
+     * Number of distinct operator nodes built so far.
+     */
+    [[nodiscard]] std::size_t size() const { return m_nodes.size(); }
+
+  private:
+    // The operands are already unique, so a node is identified by its operator and the identity of its operands
+    struct key
+    {
+        node_kind kind;
+        uint8_t op;
+        expression first;
+        expression second;
+    };
+    struct key_hash
+    {
+        std::size_t operator()(const key &k) const;
+    };
+    struct key_equal
+    {
+        bool operator()(const key &lhs, const key &rhs) const;
+    };
+
+    node remember(const key &k, node built);
+
+    tree_builder m_tree;
+    std::unordered_map<key, expression, key_hash, key_equal> m_nodes;
+};
+
+} // namespace wccff::parser
+
+#endif // HASH_CONSING_H
@@ -0,0 +1,224 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "header_cache.h"
+#include "trace.h"
+#include <array>
+#include <cstring>
+#include <fmt/format.h>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+namespace wccff::preprocessor {
+
+constexpr std::array<char, 8> entry_magic{ 'W', 'C', 'C', 'F', 'F', 'P', 'P', 'C' };
+constexpr uint32_t entry_version = 2;
+
+/**
+ * Layout of an entry: the header, one record per token, the path of the header and the text of all the tokens.
+ */
+struct entry_header
+{
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t token_count;
+    uint64_t file_size;
+    int64_t modification_time;
+    uint32_t path_size;
+    uint32_t text_size;
+};
+
+struct token_record
+{
+    uint32_t offset;
+    uint32_t length;
+    int32_t line;
+    int32_t column;
+    pp_token_type type;
+    uint8_t flags;
+    uint16_t unused;
+};
+
+constexpr uint8_t at_line_start_flag = 1;
+constexpr uint8_t has_space_flag = 2;
+
+/**
+ * FNV-1a, the names of the entries need to be the same in every run, which std::hash doesn't guarantee.
+ */
+static uint64_t hash_path(std::string_view path)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    for (auto c : path)
+    {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3;
+    }
+    return hash;
+}
+
+struct file_stamp
+{
+    uint64_t size;
+    int64_t modification_time;
+};
+
+static std::optional<file_stamp> stamp(const std::filesystem::path &file)
+{
+    std::error_code ec;
+    auto size = std::filesystem::file_size(file, ec);
+    if (ec)
+    {
+        return std::nullopt;
+    }
+    auto time = std::filesystem::last_write_time(file, ec);
+    if (ec)
+    {
+        return std::nullopt;
+    }
+    return file_stamp{ size, static_cast<int64_t>(time.time_since_epoch().count()) };
+}
+
+std::filesystem::path header_cache::entry_path(const std::filesystem::path &header) const
+{
+    return m_directory / fmt::format("{:016x}.wpp", hash_path(header.string()));
+}
+
+std::optional<cached_header> header_cache::load(const std::filesystem::path &header, uint32_t file) const
+{
+    auto current = stamp(header);
+    if (current.has_value() == false)
+    {
+        return std::nullopt;
+    }
+    auto buffer = lexer::source_buffer::open(entry_path(header));
+    if (buffer.has_value() == false)
+    {
+        WCCFF_TRACE(preprocessor, debug, "Header cache miss {}", header.string());
+        return std::nullopt;
+    }
+
+    auto data = buffer->view();
+    entry_header h{};
+    if (data.size() < sizeof(h))
+    {
+        return std::nullopt;
+    }
+    std::memcpy(&h, data.data(), sizeof(h));
+    auto path = header.string();
+    auto records_size = static_cast<std::size_t>(h.token_count) * sizeof(token_record);
+    if (h.magic != entry_magic || h.version != entry_version || h.file_size != current->size ||
+        h.modification_time != current->modification_time || h.path_size != path.size() ||
+        data.size() != sizeof(h) + records_size + h.path_size + h.text_size)
+    {
+        WCCFF_TRACE(preprocessor, debug, "Header cache entry of {} is stale", header.string());
+        return std::nullopt;
+    }
+    auto text = data.substr(sizeof(h) + records_size);
+    if (text.substr(0, h.path_size) != path)
+    {
+        return std::nullopt;
+    }
+    text.remove_prefix(h.path_size);
+
+    cached_header result{ std::move(buffer.value()), {} };
+    // The view still points into the same mapping after the buffer is moved
+    result.tokens.reserve(h.token_count);
+    for (uint32_t i = 0; i < h.token_count; i++)
+    {
+        token_record r{};
+        std::memcpy(&r, data.data() + sizeof(h) + i * sizeof(token_record), sizeof(r));
+        if (static_cast<uint64_t>(r.offset) + r.length > text.size())
+        {
+            return std::nullopt;
+        }
+        result.tokens.push_back({ r.type,
+                                  text.substr(r.offset, r.length),
+                                  (r.flags & at_line_start_flag) != 0,
+                                  (r.flags & has_space_flag) != 0,
+                                  r.line,
+                                  file,
+                                  {},
+                                  r.column,
+                                  false });
+    }
+    WCCFF_TRACE(preprocessor, debug, "Header cache hit {}", header.string());
+    return result;
+}
+
+void header_cache::store(const std::filesystem::path &header, const std::vector<pp_token> &tokens) const
+{
+    auto current = stamp(header);
+    if (current.has_value() == false)
+    {
+        return;
+    }
+
+    std::vector<token_record> records;
+    records.reserve(tokens.size());
+    std::string text;
+    for (const auto &t : tokens)
+    {
+        auto flags = (t.at_line_start ? at_line_start_flag : 0) | (t.has_space ? has_space_flag : 0);
+        records.push_back({ static_cast<uint32_t>(text.size()),
+                            static_cast<uint32_t>(t.text.size()),
+                            t.line,
+                            t.column,
+                            t.type,
+                            static_cast<uint8_t>(flags),
+                            0 });
+        text.append(t.text);
+    }
+    auto path = header.string();
+    entry_header h{ entry_magic,
+                    entry_version,
+                    static_cast<uint32_t>(records.size()),
+                    current->size,
+                    current->modification_time,
+                    static_cast<uint32_t>(path.size()),
+                    static_cast<uint32_t>(text.size()) };
+
+    std::error_code ec;
+    std::filesystem::create_directories(m_directory, ec);
+    // Written to a temporary file first, so a compiler running at the same time never sees a partial entry
+    auto entry = entry_path(header);
+    auto temporary = entry;
+    temporary += fmt::format(".{}.tmp", ::getpid());
+    {
+        std::ofstream out{ temporary, std::ios::binary | std::ios::trunc };
+        out.write(reinterpret_cast<const char *>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char *>(records.data()),
+                  static_cast<std::streamsize>(records.size() * sizeof(token_record)));
+        out.write(path.data(), static_cast<std::streamsize>(path.size()));
+        out.write(text.data(), static_cast<std::streamsize>(text.size()));
+        if (out.good() == false)
+        {
+            std::filesystem::remove(temporary, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, entry, ec);
+    if (ec)
+    {
+        std::filesystem::remove(temporary, ec);
+        return;
+    }
+    WCCFF_TRACE(preprocessor, debug, "Stored {} in the header cache", header.string());
+}
+
+} // namespace wccff::preprocessor
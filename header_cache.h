@@ -0,0 +1,77 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADER_CACHE_H
+#define HEADER_CACHE_H
+
+#include "pp_tokens.h"
+#include "source_buffer.h"
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace wccff::preprocessor {
+
+/**
+ * Tokens of a header loaded from the cache, their text references the buffer.
+ */
+struct cached_header
+{
+    lexer::source_buffer buffer;
+    std::vector<pp_token> tokens;
+};
+
+/**
+ * Persistent cache of the preprocessing tokens of the headers, one file per header in the cache directory.
+ * The tokens are stored before the macros are expanded, so they don't depend on the macros defined when the header
+ * is included, and an entry is valid while the header keeps its size and modification time.
+ * The entries are memory mapped when loaded, the tokens reference their text without copying it.
+ */
+class header_cache
+{
+  public:
+    explicit header_cache(std::filesystem::path directory)
+      : m_directory(std::move(directory))
+    {
+    }
+
+    /**
+     * Returns the tokens of the header, or nothing when there isn't a valid entry for it.
+     * file is the index set in the tokens.
+     */
+    std::optional<cached_header> load(const std::filesystem::path &header, uint32_t file) const;
+
+    /**
+     * Stores the tokens of the header, replacing an existing entry.
+     * Failing to write the cache isn't an error, the header is just tokenized again the next time.
+     */
+    void store(const std::filesystem::path &header, const std::vector<pp_token> &tokens) const;
+
+    /**
+     * Path of the entry of the header, named after a hash of the header's path.
+     */
+    [[nodiscard]] std::filesystem::path entry_path(const std::filesystem::path &header) const;
+
+  private:
+    std::filesystem::path m_directory;
+};
+
+} // namespace wccff::preprocessor
+
+#endif // HEADER_CACHE_H
@@ -0,0 +1,261 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "integer_literal.h"
+#include <bit>
+#include <cstring>
+
+namespace wccff::lexer {
+
+constexpr uint64_t ones = 0x0101010101010101;
+constexpr uint64_t high_bits = ones * 0x80;
+
+/**
+ * Loads 8 chars, the first one in the lowest byte.
+ */
+static uint64_t load_8_chars(const char *chars)
+{
+    uint64_t v;
+    std::memcpy(&v, chars, sizeof(v));
+    if constexpr (std::endian::native == std::endian::big)
+    {
+        v = std::byteswap(v);
+    }
+    return v;
+}
+
+/**
+ * Sets the high bit of every byte between lo and hi, the high bit of the bytes needs to be clear.
+ */
+static uint64_t bytes_in_range(uint64_t v, uint8_t lo, uint8_t hi)
+{
+    auto greater_or_equal = (v | high_bits) - ones * lo;
+    auto less_or_equal = ones * (hi + 0x80u) - v;
+    return greater_or_equal & less_or_equal & high_bits;
+}
+
+static bool are_8_decimal_digits(uint64_t v)
+{
+    auto ascii = ~v & high_bits;
+    return (bytes_in_range(v & ~high_bits, '0', '9') & ascii) == high_bits;
+}
+
+static bool are_8_hex_digits(uint64_t v)
+{
+    auto ascii = ~v & high_bits;
+    auto digits = bytes_in_range(v & ~high_bits, '0', '9');
+    auto letters = bytes_in_range((v & ~high_bits) | ones * 0x20, 'a', 'f');
+    return ((digits | letters) & ascii) == high_bits;
+}
+
+/**
+ * Combines 8 decimal digits into their value, with 3 multiplications.
+ */
+static uint32_t decode_8_decimal_digits(uint64_t v)
+{
+    v -= ones * '0';
+    // Each byte pair now holds the value of two digits
+    v = (v * 10) + (v >> 8);
+    v = (((v & 0x000000FF000000FF) * (100 + (1000000ULL << 32))) +
+         (((v >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >>
+        32;
+    return static_cast<uint32_t>(v);
+}
+
+/**
+ * Combines 8 hexadecimal digits into their value.
+ */
+static uint32_t decode_8_hex_digits(uint64_t v)
+{
+    // The letters have bit 0x40 set, and their low nibble is 9 less than their value
+    v = (v & ones * 0x0F) + ((v >> 6) & ones) * 9;
+    v = ((v << 4) | (v >> 8)) & 0x00FF00FF00FF00FF;
+    v = ((v << 8) | (v >> 16)) & 0x0000FFFF0000FFFF;
+    v = ((v << 16) | (v >> 32)) & 0x00000000FFFFFFFF;
+    return static_cast<uint32_t>(v);
+}
+
+static int digit_value(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * Appends digits to value, returns false when the result doesn't fit in 64 bits.
+ */
+static bool append_digits(uint64_t &value, uint64_t multiplier, uint64_t digits)
+{
+    return __builtin_mul_overflow(value, multiplier, &value) == false &&
+           __builtin_add_overflow(value, digits, &value) == false;
+}
+
+static std::expected<integer_suffix, integer_literal_error> decode_suffix(std::string_view text)
+{
+    bool is_unsigned = false;
+    int longs = 0;
+    auto consume_unsigned = [&]() {
+        if (text.empty() == false && (text.front() == 'u' || text.front() == 'U'))
+        {
+            is_unsigned = true;
+            text.remove_prefix(1);
+        }
+    };
+    auto consume_long = [&]() {
+        // LL needs both letters with the same case
+        if (text.starts_with("ll") || text.starts_with("LL"))
+        {
+            longs = 2;
+            text.remove_prefix(2);
+        }
+        else if (text.empty() == false && (text.front() == 'l' || text.front() == 'L'))
+        {
+            longs = 1;
+            text.remove_prefix(1);
+        }
+    };
+
+    consume_unsigned();
+    consume_long();
+    if (is_unsigned == false)
+    {
+        consume_unsigned();
+    }
+    if (text.empty() == false)
+    {
+        return std::unexpected(integer_literal_error::invalid_suffix);
+    }
+    constexpr integer_suffix signed_suffixes[] = { integer_suffix::none, integer_suffix::l, integer_suffix::ll };
+    constexpr integer_suffix unsigned_suffixes[] = { integer_suffix::u, integer_suffix::ul, integer_suffix::ull };
+    return is_unsigned ? unsigned_suffixes[longs] : signed_suffixes[longs];
+}
+
+std::expected<integer_literal, integer_literal_error> decode_integer_literal(std::string_view text)
+{
+    integer_literal literal;
+    std::size_t pos = 0;
+    if (text.size() >= 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X'))
+    {
+        literal.base = 16;
+        pos = 2;
+    }
+    else if (text.size() >= 2 && text[0] == '0' && (text[1] == 'b' || text[1] == 'B'))
+    {
+        literal.base = 2;
+        pos = 2;
+    }
+    else if (text.size() >= 2 && text[0] == '0' && text[1] >= '0' && text[1] <= '9')
+    {
+        literal.base = 8;
+        pos = 1;
+    }
+
+    auto digits_begin = pos;
+    if (literal.base == 10)
+    {
+        while (pos + 8 <= text.size())
+        {
+            auto chunk = load_8_chars(text.data() + pos);
+            if (are_8_decimal_digits(chunk) == false)
+            {
+                break;
+            }
+            if (append_digits(literal.value, 100000000, decode_8_decimal_digits(chunk)) == false)
+            {
+                return std::unexpected(integer_literal_error::overflow);
+            }
+            pos += 8;
+        }
+    }
+    else if (literal.base == 16)
+    {
+        while (pos + 8 <= text.size())
+        {
+            auto chunk = load_8_chars(text.data() + pos);
+            if (are_8_hex_digits(chunk) == false)
+            {
+                break;
+            }
+            if (append_digits(literal.value, uint64_t{ 1 } << 32, decode_8_hex_digits(chunk)) == false)
+            {
+                return std::unexpected(integer_literal_error::overflow);
+            }
+            pos += 8;
+        }
+    }
+
+    // The digits left, and all the octal and binary ones
+    for (; pos < text.size(); pos++)
+    {
+        auto digit = digit_value(text[pos]);
+        if (digit < 0 || (literal.base != 16 && text[pos] > '9'))
+        {
+            break;
+        }
+        if (digit >= literal.base)
+        {
+            return std::unexpected(integer_literal_error::invalid_digit);
+        }
+        if (append_digits(literal.value, literal.base, static_cast<uint64_t>(digit)) == false)
+        {
+            return std::unexpected(integer_literal_error::overflow);
+        }
+    }
+    if (pos == digits_begin)
+    {
+        return std::unexpected(integer_literal_error::missing_digits);
+    }
+
+    auto suffix = decode_suffix(text.substr(pos));
+    if (suffix.has_value() == false)
+    {
+        return std::unexpected(suffix.error());
+    }
+    literal.suffix = suffix.value();
+    return literal;
+}
+
+std::string_view to_string(integer_literal_error error)
+{
+    switch (error)
+    {
+        case integer_literal_error::missing_digits:
+            return "Integer constant without digits";
+        case integer_literal_error::invalid_digit:
+            return "Invalid digit in integer constant";
+        case integer_literal_error::invalid_suffix:
+            return "Invalid suffix on integer constant";
+        case integer_literal_error::overflow:
+            return "Integer constant is too large";
+    }
+    return "Invalid integer constant";
+}
+
+} // namespace wccff::lexer
@@ -0,0 +1,66 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef INTEGER_LITERAL_H
+#define INTEGER_LITERAL_H
+
+#include <cstdint>
+#include <expected>
+#include <string_view>
+
+namespace wccff::lexer {
+
+enum class integer_suffix : uint8_t
+{
+    none,
+    u,
+    l,
+    ul,
+    ll,
+    ull,
+};
+
+struct integer_literal
+{
+    uint64_t value{ 0 };
+    uint8_t base{ 10 };
+    integer_suffix suffix{ integer_suffix::none };
+};
+
+enum class integer_literal_error : uint8_t
+{
+    missing_digits,
+    invalid_digit,
+    invalid_suffix,
+    overflow,
+};
+
+/**
+ * Decodes a C integer literal: decimal, hexadecimal (0x), octal (0) or binary (0b), with an optional U, L or LL
+ * suffix.
+ * Decimal and hexadecimal digits are decoded 8 at a time, overflow is reported when the value doesn't fit in
+ * 64 bits.
+ */
+std::expected<integer_literal, integer_literal_error> decode_integer_literal(std::string_view text);
+
+std::string_view to_string(integer_literal_error error);
+
+} // namespace wccff::lexer
+
+#endif // INTEGER_LITERAL_H
@@ -18,622 +18,578 @@
  */
 
 #include "lexer.h"
+#include "integer_literal.h"
+#include "lexer_simd.h"
+#include "trace.h"
 #include <algorithm>
 #include <array>
-#include <ctre.hpp>
-#include <fstream>
-#include <iostream>
-#include <iterator>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
 
 namespace wccff::lexer {
 
-constexpr auto identifier_pattern{ R"(([a-zA-Z_]\w*\b))" };
-constexpr auto constant_pattern{ R"(([0-9]+\b))" };
-constexpr auto open_parenthesis_pattern{ R"((\())" };
-constexpr auto close_parenthesis_pattern{ R"((\)))" };
-constexpr auto open_brace_pattern{ R"((\{))" };
-constexpr auto close_brace_pattern{ R"((\}))" };
-constexpr auto semicolon_pattern{ "(;)" };
-constexpr auto decrement_operator_pattern{ "(--)" };
-constexpr auto negate_operator_pattern{ "(-)" };
-constexpr auto bitwise_complement_operator_pattern{ "(~)" };
-constexpr auto plus_operator_pattern{ R"((\+))" };
-constexpr auto multiplication_operator_pattern{ R"((\*))" };
-constexpr auto division_operator_pattern{ "(/)" };
-constexpr auto remainder_operator_pattern{ "(%)" };
-constexpr auto bitwise_and_operator_pattern{ "(&)" };
-constexpr auto bitwise_or_operator_pattern{ R"((\|))" };
-constexpr auto bitwise_xor_operator_pattern{ R"((\^))" };
-constexpr auto left_shift_operator_pattern{ R"((<<))" };
-constexpr auto right_shift_operator_pattern{ R"((>>))" };
-constexpr auto not_operator_pattern{ R"((!))" };
-constexpr auto and_operator_pattern{ R"((&&))" };
-constexpr auto or_operator_pattern{ R"((\|\|))" };
-constexpr auto equals_operator_pattern{ R"((==))" };
-constexpr auto not_equals_operator_pattern{ R"((!=))" };
-constexpr auto less_than_operator_pattern{ R"((<))" };
-constexpr auto less_than_or_equal_operator_pattern{ R"((<=))" };
-constexpr auto greater_than_operator_pattern{ R"((>))" };
-constexpr auto greater_than_or_equal_operator_pattern{ R"((>=))" };
-constexpr auto assignment_operator_pattern{ R"((=))" };
-
-constexpr auto get_patters()
-{
-    return std::array{
-        identifier_pattern,
-        constant_pattern,
-        open_parenthesis_pattern,
-        close_parenthesis_pattern,
-        open_brace_pattern,
-        close_brace_pattern,
-        semicolon_pattern,
-        // Two chars operators
-        and_operator_pattern,
-        or_operator_pattern,
-        equals_operator_pattern,
-        not_equals_operator_pattern,
-        decrement_operator_pattern,
-        less_than_or_equal_operator_pattern,
-        greater_than_or_equal_operator_pattern,
-        left_shift_operator_pattern,
-        right_shift_operator_pattern,
-        // One char Operator
-        negate_operator_pattern,
-        not_operator_pattern,
-        bitwise_complement_operator_pattern,
-        plus_operator_pattern,
-        multiplication_operator_pattern,
-        division_operator_pattern,
-        remainder_operator_pattern,
-        bitwise_and_operator_pattern,
-        bitwise_or_operator_pattern,
-        bitwise_xor_operator_pattern,
-        less_than_operator_pattern,
-        greater_than_operator_pattern,
-        assignment_operator_pattern,
-    };
+enum class char_class : uint8_t
+{
+    invalid,
+    whitespace,
+    identifier_start,
+    digit,
+    punctuator,
+};
+
+/**
+ * Classifies every possible input byte, so the scanner can dispatch on the first character of a token
+ * with a single table lookup.
+ */
+constexpr std::array<char_class, 256> char_classes = [] {
+    std::array<char_class, 256> table{};
+    for (auto c : std::string_view{ " \t\n\v\f\r" })
+    {
+        table[static_cast<unsigned char>(c)] = char_class::whitespace;
+    }
+    for (auto c = 'a'; c <= 'z'; c++)
+    {
+        table[static_cast<unsigned char>(c)] = char_class::identifier_start;
+    }
+    for (auto c = 'A'; c <= 'Z'; c++)
+    {
+        table[static_cast<unsigned char>(c)] = char_class::identifier_start;
+    }
+    table['_'] = char_class::identifier_start;
+    for (auto c = '0'; c <= '9'; c++)
+    {
+        table[static_cast<unsigned char>(c)] = char_class::digit;
+    }
+    for (auto c : std::string_view{ "(){};-~+*/%&|^!=<>" })
+    {
+        table[static_cast<unsigned char>(c)] = char_class::punctuator;
+    }
+    return table;
+}();
+
+/**
+ * Describes the tokens that can start with a given punctuator character.
+ * The two chars operators are listed in follow, and are preferred over the single char token (maximal munch).
+ */
+struct punctuator
+{
+    token_type single{};
+    std::array<std::pair<char, token_type>, 2> follow{};
+    std::size_t follow_count{ 0 };
+};
+
+constexpr std::array<punctuator, 256> punctuators = [] {
+    using enum token_type;
+    std::array<punctuator, 256> table{};
+    table['('] = { open_parenthesis };
+    table[')'] = { close_parenthesis };
+    table['{'] = { open_brace };
+    table['}'] = { close_brace };
+    table[';'] = { semicolon };
+    table['~'] = { bitwise_complement_operator };
+    table['+'] = { plus_operator };
+    table['*'] = { multiplication_operator };
+    table['/'] = { division_operator };
+    table['%'] = { remainder_operator };
+    table['^'] = { bitwise_xor_operator };
+    table['-'] = { negation_operator, { { { '-', decrement_operator } } }, 1 };
+    table['&'] = { bitwise_and_operator, { { { '&', and_operator } } }, 1 };
+    table['|'] = { bitwise_or_operator, { { { '|', or_operator } } }, 1 };
+    table['='] = { assignment_operator, { { { '=', equals_operator } } }, 1 };
+    table['!'] = { not_operator, { { { '=', not_equals_operator } } }, 1 };
+    table['<'] = { less_than_operator, { { { '<', left_shift_operator }, { '=', less_than_or_equal_operator } } }, 2 };
+    table['>'] = { greater_than_operator,
+                   { { { '>', right_shift_operator }, { '=', greater_than_or_equal_operator } } },
+                   2 };
+    return table;
+}();
+
+struct keyword
+{
+    std::string_view text;
+    token_type type;
+};
+
+constexpr std::array keywords{
+    keyword{ "int", token_type::int_keyword },
+    keyword{ "void", token_type::void_keyword },
+    keyword{ "return", token_type::return_keyword },
+};
+
+constexpr std::size_t keyword_table_size = 8;
+
+/**
+ * Perfect hash for the keywords, built from the first char and the length of the identifier.
+ * Adding a keyword that collides, breaks the static_assert below, and requires changing the hash or the table size.
+ */
+constexpr std::size_t keyword_hash(std::string_view text)
+{
+    return (static_cast<unsigned char>(text.front()) + text.size()) % keyword_table_size;
 }
 
-constexpr bool str_compare(const char *p1, const char *p2)
+consteval bool keyword_hash_is_perfect()
 {
-    while (*p1 || *p2)
+    std::array<bool, keyword_table_size> used{};
+    for (const auto &k : keywords)
     {
-        if (*p1 != *p2)
+        if (used[keyword_hash(k.text)])
         {
             return false;
         }
-        p1++;
-        p2++;
+        used[keyword_hash(k.text)] = true;
     }
     return true;
 }
-constexpr std::size_t calculate_final_pattern_size(auto patters)
+static_assert(keyword_hash_is_perfect(), "The keywords hash has collisions");
+
+constexpr std::array<std::optional<keyword>, keyword_table_size> keyword_table = [] {
+    std::array<std::optional<keyword>, keyword_table_size> table{};
+    for (const auto &k : keywords)
+    {
+        table[keyword_hash(k.text)] = k;
+    }
+    return table;
+}();
+
+static token_type identifier_or_keyword(std::string_view text)
 {
-    std::size_t length = 0;
-    for (const auto &p : patters)
+    const auto &entry = keyword_table[keyword_hash(text)];
+    if (entry.has_value() && entry->text == text)
     {
-        std::size_t j = 0;
-        while (p[j] != '\0')
-        {
-            length++;
-            j++;
-        }
+        return entry->type;
     }
-    // The final pattern contains all the patters plus a divider in between the patters
-    // So the size if the sum of the length for all patterns, plus the number of patterns minus one, plus the '\0' char.
-    // Note: the number of dividers is the number of patters - 1, there's no divider at the end.
-    return length + patters.size() - 1 + 1;
+    return token_type::identifier;
 }
 
-consteval auto create_regex_pattern()
+std::expected<int32_t, std::string_view> decode_constant(std::string_view text)
 {
-    constexpr auto patterns = get_patters();
-    std::array<char, calculate_final_pattern_size(patterns)> final_pattern;
+    auto literal = decode_integer_literal(text);
+    if (literal.has_value() == false)
+    {
+        return std::unexpected(to_string(literal.error()));
+    }
+    // int is the only integer type supported, the suffixes are accepted but don't change the type
+    if (literal->value > static_cast<uint64_t>(std::numeric_limits<int32_t>::max()))
+    {
+        return std::unexpected("Integer constant doesn't fit in an int");
+    }
+    return static_cast<int32_t>(literal->value);
+}
 
-    std::size_t index = 0;
-    for (const auto &b1 : patterns)
+token::token(token_type type_, std::string_view text_, file_location loc_)
+  : type(type_)
+  , text(text_)
+  , loc(loc_)
+  , value(0)
+{
+    if (type == token_type::constant)
     {
-        std::size_t j = 0;
-        while (b1[j] != '\0')
+        auto decoded = decode_constant(text);
+        if (decoded.has_value() == false)
         {
-            final_pattern[index] = b1[j];
-            index++;
-            j++;
+            throw std::invalid_argument(fmt::format("Invalid constant '{}': {}", text, decoded.error()));
         }
-        final_pattern[index++] = '|';
+        value = decoded.value();
     }
-    final_pattern[index - 1] = '\0';
-
-    return ctll::fixed_string{ final_pattern };
 }
 
-consteval std::ptrdiff_t get_identifier_position()
+token_buffer::token_buffer(const std::vector<token> &tokens)
+  : m_owns_source(true)
 {
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, identifier_pattern);
-    });
-    return std::distance(patterns.begin(), f) + 1;
+    for (const auto &t : tokens)
+    {
+        m_types.push_back(t.type);
+        m_offsets.push_back(static_cast<uint32_t>(m_owned_source.size()));
+        m_lengths.push_back(static_cast<uint32_t>(t.text.size()));
+        m_values.push_back(t.value);
+        m_owned_source.append(t.text);
+        m_owned_source.push_back(' ');
+    }
 }
-consteval std::ptrdiff_t get_constant_position()
-{
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, constant_pattern);
-    });
 
-    return std::distance(patterns.begin(), f) + 1;
-}
-consteval std::ptrdiff_t get_open_parenthesis_position()
+void token_buffer::push_back(token_type type, std::string_view text, int32_t value)
 {
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, open_parenthesis_pattern);
-    });
-
-    return std::distance(patterns.begin(), f) + 1;
+    m_types.push_back(type);
+    m_offsets.push_back(static_cast<uint32_t>(text.data() - source().data()));
+    m_lengths.push_back(static_cast<uint32_t>(text.size()));
+    m_values.push_back(value);
 }
-consteval std::ptrdiff_t get_close_parenthesis_position()
-{
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, close_parenthesis_pattern);
-    });
 
-    return std::distance(patterns.begin(), f) + 1;
-}
-consteval std::ptrdiff_t get_open_braces_position()
+void token_buffer::push_back_copy(token_type type, std::string_view text, file_location loc, int32_t value)
 {
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, open_brace_pattern);
-    });
-
-    return std::distance(patterns.begin(), f) + 1;
+    m_owns_source = true;
+    m_types.push_back(type);
+    m_offsets.push_back(static_cast<uint32_t>(m_owned_source.size()));
+    m_lengths.push_back(static_cast<uint32_t>(text.size()));
+    m_values.push_back(value);
+    m_locations.push_back(loc);
+    m_owned_source.append(text);
 }
-consteval std::ptrdiff_t get_close_braces_position()
-{
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, close_brace_pattern);
-    });
 
-    return std::distance(patterns.begin(), f) + 1;
-}
-consteval std::ptrdiff_t get_semicolon_position()
+void token_buffer::append(const token_buffer &other)
 {
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, semicolon_pattern);
-    });
-
-    return std::distance(patterns.begin(), f) + 1;
+    m_types.insert(m_types.end(), other.m_types.begin(), other.m_types.end());
+    m_offsets.insert(m_offsets.end(), other.m_offsets.begin(), other.m_offsets.end());
+    m_lengths.insert(m_lengths.end(), other.m_lengths.begin(), other.m_lengths.end());
+    m_values.insert(m_values.end(), other.m_values.begin(), other.m_values.end());
 }
-consteval std::ptrdiff_t get_and_operator_pattern_position()
-{
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, and_operator_pattern);
-    });
 
-    return std::distance(patterns.begin(), f) + 1;
-}
-consteval std::ptrdiff_t get_or_operator_pattern_position()
+void token_buffer::erase_front(std::size_t count)
 {
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, or_operator_pattern);
-    });
-
-    return std::distance(patterns.begin(), f) + 1;
+    auto erase = [count](auto &v) { v.erase(v.begin(), v.begin() + static_cast<std::ptrdiff_t>(count)); };
+    erase(m_types);
+    erase(m_offsets);
+    erase(m_lengths);
+    erase(m_values);
+    if (m_locations.empty() == false)
+    {
+        erase(m_locations);
+        // The copied text of the erased tokens isn't needed anymore, so it doesn't grow with the input
+        auto first = m_offsets.empty() ? static_cast<uint32_t>(m_owned_source.size()) : m_offsets.front();
+        m_owned_source.erase(0, first);
+        for (auto &offset : m_offsets)
+        {
+            offset -= first;
+        }
+    }
 }
-consteval std::ptrdiff_t get_equals_operator_pattern_position()
-{
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, equals_operator_pattern);
-    });
 
-    return std::distance(patterns.begin(), f) + 1;
-}
-consteval std::ptrdiff_t get_not_equals_operator_pattern_position()
+token token_buffer::at(std::size_t index) const
 {
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, not_equals_operator_pattern);
-    });
-
-    return std::distance(patterns.begin(), f) + 1;
+    if (index >= size())
+    {
+        throw std::out_of_range("Invalid token index");
+    }
+    token t{ type(index), text(index), loc(index) };
+    t.value = value(index);
+    return t;
 }
-consteval std::ptrdiff_t get_decrement_operator_position()
-{
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, decrement_operator_pattern);
-    });
 
-    return std::distance(patterns.begin(), f) + 1;
-}
-consteval std::ptrdiff_t get_negate_operator_position()
+file_location token_buffer::resolve_location(std::size_t offset) const
 {
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, negate_operator_pattern);
-    });
-
-    return std::distance(patterns.begin(), f) + 1;
+    if (m_lines.has_value() == false)
+    {
+        m_lines.emplace(source());
+    }
+    return m_lines->resolve_location(offset);
 }
-consteval std::ptrdiff_t get_not_operator_position()
-{
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, not_operator_pattern);
-    });
 
-    return std::distance(patterns.begin(), f) + 1;
-}
-consteval std::ptrdiff_t get_bitwise_complement_operator_position()
+/**
+ * Builds the error for the input at offset.
+ * Only the input before the error is indexed, since the token stream doesn't keep a line index.
+ */
+static lexer_error error_at(std::string_view input, std::size_t offset, std::string message = "Failed to find a match")
 {
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, bitwise_complement_operator_pattern);
-    });
-
-    return std::distance(patterns.begin(), f) + 1;
+    auto location = line_index{ input.substr(0, offset) }.resolve_location(offset);
+    return { location, input.substr(offset), std::move(message) };
 }
-consteval std::ptrdiff_t get_plus_operator_position()
-{
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, plus_operator_pattern);
-    });
 
-    return std::distance(patterns.begin(), f) + 1;
-}
-consteval std::ptrdiff_t get_multiplication_operator_position()
+token_stream::token_stream(std::string_view input, std::size_t begin) noexcept
+  : m_input(input)
+  , m_pos(begin)
 {
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, multiplication_operator_pattern);
-    });
-
-    return std::distance(patterns.begin(), f) + 1;
 }
-consteval std::ptrdiff_t get_division_operator_position()
-{
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, division_operator_pattern);
-    });
 
-    return std::distance(patterns.begin(), f) + 1;
-}
-consteval std::ptrdiff_t get_remainder_operator_position()
-{
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, remainder_operator_pattern);
-    });
+static_assert(source_buffer::padding >= simd::padding_required);
 
-    return std::distance(patterns.begin(), f) + 1;
-}
-consteval std::ptrdiff_t get_bitwise_and_operator_position()
+token_stream token_stream::padded(std::string_view input, std::size_t begin) noexcept
 {
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, bitwise_and_operator_pattern);
-    });
-
-    return std::distance(patterns.begin(), f) + 1;
+    token_stream stream{ input, begin };
+    stream.m_padded = true;
+    return stream;
 }
-consteval std::ptrdiff_t get_bitwise_or_operator_position()
-{
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, bitwise_or_operator_pattern);
-    });
 
-    return std::distance(patterns.begin(), f) + 1;
-}
-consteval std::ptrdiff_t get_bitwise_xor_operator_position()
+struct scanned_token
 {
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, bitwise_xor_operator_pattern);
-    });
+    token_type type;
+    int32_t value;
+};
 
-    return std::distance(patterns.begin(), f) + 1;
-}
-consteval std::ptrdiff_t get_left_shift_operator_position()
+template<bool padded>
+static std::size_t identifier_length(const simd::kernels &kernels, std::string_view input, std::size_t pos)
 {
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, left_shift_operator_pattern);
-    });
-
-    return std::distance(patterns.begin(), f) + 1;
+    if constexpr (padded)
+    {
+        return kernels.identifier_length_padded(input.data() + pos);
+    }
+    else
+    {
+        return kernels.identifier_length(input.substr(pos));
+    }
 }
-consteval std::ptrdiff_t get_right_shift_operator_position()
-{
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, right_shift_operator_pattern);
-    });
 
-    return std::distance(patterns.begin(), f) + 1;
+/**
+ * Scans the token starting at pos, which can't be a white space, and moves pos to its end.
+ */
+template<bool padded>
+static std::expected<scanned_token, lexer_error> scan_token(std::string_view input, std::size_t &pos) noexcept
+{
+    const auto &kernels = simd::best_kernels();
+    auto start = pos;
+    token_type type{};
+    int32_t value{ 0 };
+    switch (char_classes[static_cast<unsigned char>(input[pos])])
+    {
+        case char_class::identifier_start:
+        {
+            pos += identifier_length<padded>(kernels, input, pos);
+            type = identifier_or_keyword(input.substr(start, pos - start));
+            break;
+        }
+        case char_class::digit:
+        {
+            // The constant extends to the next word boundary, so "123abc" is a constant with an invalid suffix
+            pos += identifier_length<padded>(kernels, input, pos);
+            auto constant = decode_constant(input.substr(start, pos - start));
+            if (constant.has_value() == false)
+            {
+                return std::unexpected(error_at(input, start, std::string{ constant.error() }));
+            }
+            type = token_type::constant;
+            value = constant.value();
+            break;
+        }
+        case char_class::punctuator:
+        {
+            const auto &p = punctuators[static_cast<unsigned char>(input[pos])];
+            type = p.single;
+            pos++;
+            for (std::size_t i = 0; i < p.follow_count; i++)
+            {
+                if (pos < input.size() && input[pos] == p.follow[i].first)
+                {
+                    type = p.follow[i].second;
+                    pos++;
+                    break;
+                }
+            }
+            break;
+        }
+        case char_class::whitespace:
+        case char_class::invalid:
+            return std::unexpected(error_at(input, start));
+    }
+    return scanned_token{ type, value };
 }
-consteval std::ptrdiff_t get_less_than_operator_pattern_position()
-{
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, less_than_operator_pattern);
-    });
 
-    return std::distance(patterns.begin(), f) + 1;
-}
-consteval std::ptrdiff_t get_less_than_or_equal_operator_pattern_position()
+std::expected<bool, lexer_error> token_stream::next(token_buffer &buffer) noexcept
 {
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, less_than_or_equal_operator_pattern);
-    });
-
-    return std::distance(patterns.begin(), f) + 1;
+    return m_padded ? scan<true>(buffer) : scan<false>(buffer);
 }
-consteval std::ptrdiff_t get_greater_than_operator_pattern_position()
-{
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, greater_than_operator_pattern);
-    });
 
-    return std::distance(patterns.begin(), f) + 1;
-}
-consteval std::ptrdiff_t get_greater_than_or_equal_operator_pattern_position()
+template<bool padded>
+std::expected<bool, lexer_error> token_stream::scan(token_buffer &buffer) noexcept
 {
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, greater_than_or_equal_operator_pattern);
-    });
+    // Remove trimming white spaces
+    if constexpr (padded)
+    {
+        // The bytes after the input can be white spaces, when it's a chunk of a bigger input
+        auto whitespace = simd::best_kernels().skip_whitespace_padded(m_input.data() + m_pos).length;
+        m_pos = std::min(m_pos + whitespace, m_input.size());
+    }
+    else
+    {
+        m_pos += simd::best_kernels().skip_whitespace(m_input.substr(m_pos)).length;
+    }
 
-    return std::distance(patterns.begin(), f) + 1;
-}
-consteval std::ptrdiff_t get_assignment_operator_pattern_position()
-{
-    auto patterns = get_patters();
-    auto f = std::find_if(patterns.begin(), patterns.end(), [](const char *i) {
-        return str_compare(i, assignment_operator_pattern);
-    });
+    if (m_pos == m_input.size())
+    {
+        return false;
+    }
+
+    auto start = m_pos;
+    auto scanned = scan_token<padded>(m_input, m_pos);
+    if (scanned.has_value() == false)
+    {
+        return std::unexpected(scanned.error());
+    }
 
-    return std::distance(patterns.begin(), f) + 1;
+    WCCFF_TRACE(
+      lexer, verbose, "Found {} '{}' at offset {}", scanned->type, m_input.substr(start, m_pos - start), start);
+    buffer.push_back(scanned->type, m_input.substr(start, m_pos - start), scanned->value);
+    return true;
 }
 
-std::expected<std::vector<token>, lexer_error> lexer(std::string_view input, file_location location) noexcept
+std::expected<bool, lexer_error> streaming_lexer::next(token_buffer &buffer)
 {
-    std::vector<token> result;
-
     while (true)
     {
-        // Remove trimming white spaces
-        while ((input.empty() == false) && std::isspace(input[0]))
+        auto input = m_stream.data();
+        auto whitespace = simd::best_kernels().skip_whitespace(input);
+        if (whitespace.newlines != 0)
         {
-            location.column++;
-            if (input[0] == '\n')
-            {
-                location.line++;
-                location.column = 0;
-            }
-            input = input.substr(1);
+            m_location.line += static_cast<int32_t>(whitespace.newlines);
+            m_location.column = static_cast<int32_t>(whitespace.length - whitespace.line_start);
         }
-
-        if (input.empty())
+        else
         {
-            return result;
+            m_location.column += static_cast<int32_t>(whitespace.length);
         }
+        m_stream.consume(whitespace.length);
+        input.remove_prefix(whitespace.length);
 
-        std::cout << "Input: " << input << '\n';
-        auto m = ctre::starts_with<create_regex_pattern()>(input);
-        if (m)
+        std::size_t pos = 0;
+        std::optional<std::expected<scanned_token, lexer_error>> scanned;
+        if (input.empty() == false)
+        {
+            scanned = scan_token<false>(input, pos);
+        }
+        // A token that reaches the end of the data may continue in the input not read yet
+        if (pos == input.size() && m_stream.at_end() == false)
         {
-            if (ctre::get<get_identifier_position()>(m))
+            if (m_stream.full())
             {
-                if (m == "int")
-                {
-                    std::cout << "int keyword" << '\n';
-                    result.emplace_back(token_type::int_keyword, m, location);
-                }
-                else if (m == "void")
-                {
-                    std::cout << "void keyword" << '\n';
-                    result.emplace_back(token_type::void_keyword, m, location);
-                }
-                else if (m == "return")
-                {
-                    std::cout << "return keyword" << '\n';
-                    result.emplace_back(token_type::return_keyword, m, location);
-                }
-                else
-                {
-                    std::cout << "Found identifier" << '\n';
-                    result.emplace_back(token_type::identifier, m, location);
-                }
+                return std::unexpected(lexer_error{ m_location, input, "Token doesn't fit in the input buffer" });
             }
-
-            if (ctre::get<get_constant_position()>(m))
+            if (auto read = m_stream.refill(); read.has_value() == false)
             {
-                std::cout << "Found Constan" << '\n';
-                result.emplace_back(token_type::constant, m, location);
+                return std::unexpected(lexer_error{ m_location, {}, read.error().message() });
             }
+            continue;
+        }
+        if (scanned.has_value() == false)
+        {
+            return false;
+        }
+        if (scanned->has_value() == false)
+        {
+            // The token is scanned from the start of the data, so the error is at the current location
+            auto error = scanned->error();
+            error.location = m_location;
+            return std::unexpected(error);
+        }
 
-            if (ctre::get<get_open_parenthesis_position()>(m))
-            {
-                std::cout << "Found Open Parenthesis" << '\n';
-                result.emplace_back(token_type::open_parenthesis, m, location);
-            }
+        auto token = scanned->value();
+        WCCFF_TRACE(lexer, verbose, "Found {} '{}' at {}", token.type, input.substr(0, pos), m_location);
+        buffer.push_back_copy(token.type, input.substr(0, pos), m_location, token.value);
+        m_location.column += static_cast<int32_t>(pos);
+        m_stream.consume(pos);
+        return true;
+    }
+}
 
-            if (ctre::get<get_close_parenthesis_position()>(m))
-            {
-                std::cout << "Found Close Parenthesis" << '\n';
-                result.emplace_back(token_type::close_parenthesis, m, location);
-            }
-            if (ctre::get<get_open_braces_position()>(m))
-            {
-                std::cout << "Found Open Brace" << '\n';
-                result.emplace_back(token_type::open_brace, m, location);
-            }
-            if (ctre::get<get_close_braces_position()>(m))
-            {
-                std::cout << "Found Close Brace" << '\n';
-                result.emplace_back(token_type::close_brace, m, location);
-            }
-            if (ctre::get<get_semicolon_position()>(m))
-            {
-                std::cout << "Found Semicolon" << '\n';
-                result.emplace_back(token_type::semicolon, m, location);
-            }
-            if (ctre::get<get_and_operator_pattern_position()>(m))
-            {
-                std::cout << "Found decrement Operator" << '\n';
-                result.emplace_back(token_type::and_operator, m, location);
-            }
-            if (ctre::get<get_or_operator_pattern_position()>(m))
-            {
-                std::cout << "Found decrement Operator" << '\n';
-                result.emplace_back(token_type::or_operator, m, location);
-            }
-            if (ctre::get<get_equals_operator_pattern_position()>(m))
-            {
-                std::cout << "Found decrement Operator" << '\n';
-                result.emplace_back(token_type::equals_operator, m, location);
-            }
-            if (ctre::get<get_not_equals_operator_pattern_position()>(m))
-            {
-                std::cout << "Found decrement Operator" << '\n';
-                result.emplace_back(token_type::not_equals_operator, m, location);
-            }
-            if (ctre::get<get_decrement_operator_position()>(m))
-            {
-                std::cout << "Found decrement Operator" << '\n';
-                result.emplace_back(token_type::decrement_operator, m, location);
-            }
-            if (ctre::get<get_negate_operator_position()>(m))
-            {
-                std::cout << "Found Negation Operator" << '\n';
-                result.emplace_back(token_type::negation_operator, m, location);
-            }
-            if (ctre::get<get_not_operator_position()>(m))
-            {
-                std::cout << "Found Not Operator" << '\n';
-                result.emplace_back(token_type::not_operator, m, location);
-            }
-            if (ctre::get<get_bitwise_complement_operator_position()>(m))
-            {
-                std::cout << "Found Bitwise Complement Operator" << '\n';
-                result.emplace_back(token_type::bitwise_complement_operator, m, location);
-            }
-            if (ctre::get<get_plus_operator_position()>(m))
-            {
-                std::cout << "Found Plus Operator" << '\n';
-                result.emplace_back(token_type::plus_operator, m, location);
-            }
-            if (ctre::get<get_multiplication_operator_position()>(m))
-            {
-                std::cout << "Found Multiplication Operator" << '\n';
-                result.emplace_back(token_type::multiplication_operator, m, location);
-            }
-            if (ctre::get<get_division_operator_position()>(m))
-            {
-                std::cout << "Found Division Operator" << '\n';
-                result.emplace_back(token_type::division_operator, m, location);
-            }
-            if (ctre::get<get_remainder_operator_position()>(m))
-            {
-                std::cout << "Found Remainder Operator" << '\n';
-                result.emplace_back(token_type::remainder_operator, m, location);
-            }
-            if (ctre::get<get_bitwise_and_operator_position()>(m))
-            {
-                std::cout << "Found Bitwise And Operator" << '\n';
-                result.emplace_back(token_type::bitwise_and_operator, m, location);
-            }
-            if (ctre::get<get_bitwise_or_operator_position()>(m))
-            {
-                std::cout << "Found Bitwise Or Operator" << '\n';
-                result.emplace_back(token_type::bitwise_or_operator, m, location);
-            }
-            if (ctre::get<get_bitwise_xor_operator_position()>(m))
-            {
-                std::cout << "Found Bitwise Xor Operator" << '\n';
-                result.emplace_back(token_type::bitwise_xor_operator, m, location);
-            }
-            if (ctre::get<get_left_shift_operator_position()>(m))
-            {
-                std::cout << "Found Left Shift Operator" << '\n';
-                result.emplace_back(token_type::left_shift_operator, m, location);
-            }
-            if (ctre::get<get_right_shift_operator_position()>(m))
-            {
-                std::cout << "Found Right Shift Operator" << '\n';
-                result.emplace_back(token_type::right_shift_operator, m, location);
-            }
-            if (ctre::get<get_less_than_operator_pattern_position()>(m))
-            {
-                std::cout << "Found Less Than Operator" << '\n';
-                result.emplace_back(token_type::less_than_operator, m, location);
-            }
-            if (ctre::get<get_less_than_or_equal_operator_pattern_position()>(m))
-            {
-                std::cout << "Found Less Than or Equal Operator" << '\n';
-                result.emplace_back(token_type::less_than_or_equal_operator, m, location);
-            }
-            if (ctre::get<get_greater_than_operator_pattern_position()>(m))
-            {
-                std::cout << "Found Greater Than Operator" << '\n';
-                result.emplace_back(token_type::greater_than_operator, m, location);
-            }
-            if (ctre::get<get_greater_than_or_equal_operator_pattern_position()>(m))
-            {
-                std::cout << "Found Greater Than or Equal Operator" << '\n';
-                result.emplace_back(token_type::greater_than_or_equal_operator, m, location);
-            }
-            if (ctre::get<get_assignment_operator_pattern_position()>(m))
-            {
-                std::cout << "Found Assignment Operator" << '\n';
-                result.emplace_back(token_type::assignment_operator, m, location);
-            }
+/**
+ * Lexes the tokens of input between begin and end, the offsets of the tokens are relative to input.
+ * end is always after a newline or at the end of the input, so a padded input can use the padded scanner.
+ */
+static std::expected<token_buffer, lexer_error> lex_range(std::string_view input,
+                                                          std::size_t begin,
+                                                          std::size_t end,
+                                                          bool padded)
+{
+    token_buffer result{ input };
+    auto stream =
+      padded ? token_stream::padded(input.substr(0, end), begin) : token_stream{ input.substr(0, end), begin };
+    while (true)
+    {
+        auto found = stream.next(result);
+        if (found.has_value() == false)
+        {
+            return std::unexpected(found.error());
+        }
+        if (found.value() == false)
+        {
+            return result;
+        }
+    }
+}
 
-            if (result.empty())
-            {
-                return std::unexpected(lexer_error{ location, m, "Unhandled match" });
-            }
+static std::expected<token_buffer, lexer_error> parallel_lexer(std::string_view input, std::size_t chunks, bool padded);
+
+static std::expected<token_buffer, lexer_error> lex(std::string_view input, bool padded)
+{
+    auto chunks = std::min<std::size_t>(std::thread::hardware_concurrency(), input.size() / parallel_lexer_chunk_size);
+    if (chunks > 1)
+    {
+        return parallel_lexer(input, chunks, padded);
+    }
+    return lex_range(input, 0, input.size(), padded);
+}
 
-            location.column += m.size();
+std::expected<token_buffer, lexer_error> lexer(std::string_view input)
+{
+    return lex(input, false);
+}
 
-            input = input.substr(m.size());
-            continue;
-        }
+std::expected<token_buffer, lexer_error> lexer(const source_buffer &source)
+{
+    return lex(source.view(), true);
+}
 
-        return std::unexpected(lexer_error{ location, input, "Failed to find a match" });
+/**
+ * Returns the offsets where each chunk begins, followed by the end of the input.
+ */
+static std::vector<std::size_t> chunk_boundaries(std::string_view input, std::size_t chunks)
+{
+    std::vector<std::size_t> boundaries{ 0 };
+    for (std::size_t i = 1; i < chunks; i++)
+    {
+        auto newline = input.find('\n', std::max(input.size() / chunks * i, boundaries.back()));
+        if (newline == std::string_view::npos)
+        {
+            break;
+        }
+        boundaries.push_back(newline + 1);
     }
+    boundaries.push_back(input.size());
+    return boundaries;
 }
 
-std::expected<std::string, std::error_code> read_file(const std::filesystem::path &file_name)
+std::expected<token_buffer, lexer_error> parallel_lexer(std::string_view input, std::size_t chunks)
 {
-    std::cout << file_name << '\n';
+    return parallel_lexer(input, chunks, false);
+}
 
-    std::ifstream file{ file_name, std::ios::ate };
-    if (file.is_open() == false)
+static std::expected<token_buffer, lexer_error> parallel_lexer(std::string_view input, std::size_t chunks, bool padded)
+{
+    auto boundaries = chunk_boundaries(input, chunks);
+    std::vector<std::optional<std::expected<token_buffer, lexer_error>>> results(boundaries.size() - 1);
     {
-        return std::unexpected(std::error_code(errno, std::generic_category()));
+        std::vector<std::jthread> workers;
+        for (std::size_t i = 1; i < results.size(); i++)
+        {
+            workers.emplace_back([&, i] { results[i] = lex_range(input, boundaries[i], boundaries[i + 1], padded); });
+        }
+        results[0] = lex_range(input, boundaries[0], boundaries[1], padded);
     }
+    WCCFF_TRACE(lexer, debug, "Lexed {} bytes in {} chunks", input.size(), results.size());
 
-    auto file_size = file.tellg();
+    auto &result = results[0].value();
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        auto &chunk = results[i].value();
+        if (chunk.has_value() == false)
+        {
+            // The input of the error stops at the end of the chunk, lexing up to the end of the input finds the same
+            // error with the rest of the input, like a sequential run
+            auto rest = lex_range(input, boundaries[i], input.size(), padded);
+            return std::unexpected(rest.has_value() ? chunk.error() : rest.error());
+        }
+        if (i != 0)
+        {
+            result->append(chunk.value());
+        }
+    }
+    return std::move(result);
+}
 
-    std::string content(file_size, '\0');
+std::expected<source_buffer, std::error_code> read_file(const std::filesystem::path &file_name)
+{
+    WCCFF_TRACE(lexer, info, "Reading {}", file_name.string());
 
-    file.seekg(0);
-    file.read(content.data(), file_size);
+    return source_buffer::open(file_name);
+}
 
-    return content;
+void pretty_print(print_context &context, const token_buffer &tokens)
+{
+    for (std::size_t i = 0; i < tokens.size(); i++)
+    {
+        auto token = tokens[i];
+        auto loc = token.loc();
+        context.write_indented("{}:{}: {} '{}'\n", loc.line, loc.column, token.type(), token.text());
+    }
 }
 } // namespace wccff::lexer
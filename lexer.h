@@ -25,6 +25,9 @@
 #include <expected>
 #include <filesystem>
 #include <fmt/format.h>
+#include "line_index.h"
+#include "source_buffer.h"
+#include "utils.h"
 #include <optional>
 #include <ostream>
 #include <string>
@@ -33,14 +36,7 @@
 
 namespace wccff::lexer {
 
-struct file_location
-{
-    int32_t line{ 0 };
-    int32_t column{ 0 };
-    bool operator==(const file_location &) const = default;
-};
-
-enum class token_type
+enum class token_type : uint8_t
 {
     identifier,
     constant,
@@ -74,8 +70,13 @@ enum class token_type
     greater_than_operator,
     greater_than_or_equal_operator,
     assignment_operator,
+    // Sentinel after the last token, never produced by the lexers
+    end_of_file,
 };
 
+/**
+ * The input is a copy of the source from the error on, the streaming lexer reuses its window once the error is found.
+ */
 struct lexer_error
 {
     lexer_error(file_location location_, std::string_view input_, std::string message_ = "")
@@ -86,26 +87,250 @@ struct lexer_error
     }
 
     file_location location;
-    std::string_view input;
+    std::string input;
     std::string message;
 };
 
+/**
+ * Decodes the value of a constant token, the error says why the text isn't a constant that fits in an int.
+ */
+std::expected<int32_t, std::string_view> decode_constant(std::string_view text);
+
 struct token
 {
-    token(token_type type_, std::string_view text_, file_location loc_)
-      : type(type_)
-      , text(text_)
-      , loc(loc_)
-    {
-    }
+    /**
+     * Throws std::invalid_argument when the text of a constant isn't a valid constant, instead of making up a value.
+     */
+    token(token_type type_, std::string_view text_, file_location loc_);
     token_type type;
     std::string_view text;
     file_location loc;
+    int32_t value;
+};
+
+class token_buffer;
+
+/**
+ * Lightweight reference to one of the tokens stored in a token_buffer.
+ */
+class token_handle
+{
+  public:
+    token_handle(const token_buffer &buffer, std::size_t index)
+      : m_buffer(&buffer)
+      , m_index(static_cast<uint32_t>(index))
+    {
+    }
+
+    [[nodiscard]] token_type type() const;
+    [[nodiscard]] std::string_view text() const;
+    [[nodiscard]] file_location loc() const;
+    [[nodiscard]] int32_t value() const;
+
+  private:
+    const token_buffer *m_buffer;
+    uint32_t m_index;
+};
+
+/**
+ * Stores the tokens as a struct of arrays.
+ * The text of a token is kept as an offset and a length into the source, and constants are decoded only once,
+ * when the token is added.
+ * The locations aren't stored, they are resolved from the offset, with a line index built on first use.
+ * The offsets are 32 bits, so the source is limited to 4GB.
+ */
+class token_buffer
+{
+  public:
+    token_buffer() = default;
+    explicit token_buffer(std::string_view source)
+      : m_source(source)
+    {
+    }
+    /**
+     * Copies the tokens, their text is copied into a source owned by the buffer, separated by a space.
+     * The locations of the tokens are the ones in that source.
+     */
+    explicit token_buffer(const std::vector<token> &tokens);
+
+    /**
+     * Adds a token, its text needs to be part of the source.
+     */
+    void push_back(token_type type, std::string_view text, int32_t value = 0);
+    /**
+     * Adds a token whose text isn't part of the source, the text is copied into the buffer and the location is stored.
+     * Used for the tokens of a stream, whose input is overwritten after they are lexed. The buffer can't mix these
+     * tokens with the ones added by push_back.
+     */
+    void push_back_copy(token_type type, std::string_view text, file_location loc, int32_t value = 0);
+    /**
+     * Adds the tokens of other, which needs to have the same source.
+     */
+    void append(const token_buffer &other);
+
+    /**
+     * Removes the first count tokens, and the text copied for them.
+     */
+    void erase_front(std::size_t count);
+
+    [[nodiscard]] std::size_t size() const { return m_types.size(); }
+    [[nodiscard]] bool empty() const { return m_types.empty(); }
+    [[nodiscard]] std::string_view source() const { return m_owns_source ? m_owned_source : m_source; }
+
+    [[nodiscard]] token_type type(std::size_t index) const { return m_types[index]; }
+    [[nodiscard]] std::string_view text(std::size_t index) const
+    {
+        return source().substr(m_offsets[index], m_lengths[index]);
+    }
+    [[nodiscard]] std::size_t offset(std::size_t index) const { return m_offsets[index]; }
+    [[nodiscard]] file_location loc(std::size_t index) const
+    {
+        return m_locations.empty() ? resolve_location(m_offsets[index]) : m_locations[index];
+    }
+    [[nodiscard]] int32_t value(std::size_t index) const { return m_values[index]; }
+    /**
+     * True when the tokens were added with push_back_copy.
+     */
+    [[nodiscard]] bool stores_locations() const { return m_locations.empty() == false; }
+
+    [[nodiscard]] token_handle operator[](std::size_t index) const { return { *this, index }; }
+    /**
+     * Returns a copy of the token, throws std::out_of_range when index isn't valid.
+     */
+    [[nodiscard]] token at(std::size_t index) const;
+
+    /**
+     * Returns the line and column of an offset into the source.
+     */
+    [[nodiscard]] file_location resolve_location(std::size_t offset) const;
+
+  private:
+    std::string_view m_source;
+    // The view can't point into m_owned_source, since moving a short string moves its characters
+    std::string m_owned_source;
+    bool m_owns_source{ false };
+    std::vector<token_type> m_types;
+    std::vector<uint32_t> m_offsets;
+    std::vector<uint32_t> m_lengths;
+    std::vector<int32_t> m_values;
+    // Only used by the copied tokens
+    std::vector<file_location> m_locations;
+    mutable std::optional<line_index> m_lines;
+};
+
+inline token_type token_handle::type() const
+{
+    return m_buffer->type(m_index);
+}
+inline std::string_view token_handle::text() const
+{
+    return m_buffer->text(m_index);
+}
+inline file_location token_handle::loc() const
+{
+    return m_buffer->loc(m_index);
+}
+inline int32_t token_handle::value() const
+{
+    return m_buffer->value(m_index);
+}
+
+/**
+ * Lexes the input on demand.
+ * Each call to next() scans one token, so the tokens don't need to be stored before the parser consumes them.
+ */
+class token_stream
+{
+  public:
+    /**
+     * Scans the input starting at begin, the tokens before it aren't lexed.
+     */
+    explicit token_stream(std::string_view input, std::size_t begin = 0) noexcept;
+    /**
+     * Scans an input followed by, at least, simd::padding_required readable bytes that don't continue its last token,
+     * like the zeros after the content of a source_buffer.
+     * The scanner doesn't check for the end of the input while scanning the tokens, those bytes stop them.
+     */
+    static token_stream padded(std::string_view input, std::size_t begin = 0) noexcept;
+
+    /**
+     * Scans the next token and adds it to the buffer, the buffer's source needs to start with the input of the stream.
+     * Returns false when the end of the input was reached.
+     */
+    std::expected<bool, lexer_error> next(token_buffer &buffer) noexcept;
+
+    [[nodiscard]] std::string_view input() const { return m_input; }
+
+  private:
+    template<bool padded>
+    std::expected<bool, lexer_error> scan(token_buffer &buffer) noexcept;
+
+    std::string_view m_input;
+    std::size_t m_pos{ 0 };
+    bool m_padded{ false };
 };
 
-std::expected<std::vector<token>, lexer_error> lexer(std::string_view input, file_location location = {}) noexcept;
+/**
+ * Lexes an input_stream, for the inputs that can't be memory mapped, like stdin or a pipe.
+ * The tokens are copied into the buffer, since the window of the stream is reused once they are lexed, and their
+ * locations are tracked as the input is consumed. The input of an error points into the window, and is valid while
+ * the lexer exists.
+ */
+class streaming_lexer
+{
+  public:
+    explicit streaming_lexer(input_stream stream)
+      : m_stream(std::move(stream))
+    {
+    }
+
+    /**
+     * Scans the next token and adds it to the buffer with push_back_copy.
+     * Returns false when the end of the input was reached.
+     */
+    std::expected<bool, lexer_error> next(token_buffer &buffer);
 
-std::expected<std::string, std::error_code> read_file(const std::filesystem::path &file_name);
+    /**
+     * Location of the first byte that wasn't lexed yet.
+     */
+    [[nodiscard]] file_location location() const { return m_location; }
+
+  private:
+    input_stream m_stream;
+    // Location of the first byte of the stream's data
+    file_location m_location;
+};
+
+/**
+ * Inputs bigger than this are split into chunks lexed in parallel.
+ */
+constexpr std::size_t parallel_lexer_chunk_size = 256 * 1024;
+
+/**
+ * Lexes the whole input.
+ * Big inputs are lexed in parallel, with one chunk of at least parallel_lexer_chunk_size per hardware thread.
+ */
+std::expected<token_buffer, lexer_error> lexer(std::string_view input);
+/**
+ * Lexes the content of the buffer, with the padded scanner.
+ */
+std::expected<token_buffer, lexer_error> lexer(const source_buffer &source);
+
+/**
+ * Splits the input into, at most, chunks pieces and lexes them in parallel.
+ * The pieces end at newlines, which never are part of a token, so the result is the same as lexing sequentially.
+ */
+std::expected<token_buffer, lexer_error> parallel_lexer(std::string_view input, std::size_t chunks);
+
+/**
+ * Opens the source file, the content isn't copied when the file can be memory mapped.
+ */
+std::expected<source_buffer, std::error_code> read_file(const std::filesystem::path &file_name);
+
+/**
+ * One token per line, with its location and its type.
+ */
+void pretty_print(print_context &context, const token_buffer &tokens);
 
 } // namespace wccff::lexer
 
@@ -215,6 +440,9 @@ struct fmt::formatter<wccff::lexer::token_type> : formatter<string_view>
             case token_type::assignment_operator:
                 str = "Assignment Operator";
                 break;
+            case token_type::end_of_file:
+                str = "End of File";
+                break;
         }
         return formatter<string_view>::format(str, ctx);
     }
@@ -0,0 +1,364 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "lexer_simd.h"
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__)
+#define WCCFF_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace wccff::lexer::simd {
+
+constexpr bool is_whitespace(char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+constexpr bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+constexpr bool is_identifier_char(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || is_digit(c) || c == '_';
+}
+
+/**
+ * Adds the newlines found in one block to the run.
+ * block_offset is the offset of the block from the beginning of the run, and newlines has one bit per newline.
+ */
+static void account_newlines(whitespace_run &run, std::size_t block_offset, uint32_t newlines)
+{
+    if (newlines == 0)
+    {
+        return;
+    }
+    run.newlines += std::popcount(newlines);
+    run.line_start = block_offset + (31 - std::countl_zero(newlines)) + 1;
+}
+
+static whitespace_run skip_whitespace_scalar(std::string_view input)
+{
+    whitespace_run run;
+    while (run.length < input.size() && is_whitespace(input[run.length]))
+    {
+        if (input[run.length] == '\n')
+        {
+            run.newlines++;
+            run.line_start = run.length + 1;
+        }
+        run.length++;
+    }
+    return run;
+}
+
+static std::size_t identifier_length_scalar(std::string_view input)
+{
+    std::size_t length = 0;
+    while (length < input.size() && is_identifier_char(input[length]))
+    {
+        length++;
+    }
+    return length;
+}
+
+static whitespace_run skip_whitespace_padded_scalar(const char *input)
+{
+    whitespace_run run;
+    while (is_whitespace(input[run.length]))
+    {
+        if (input[run.length] == '\n')
+        {
+            run.newlines++;
+            run.line_start = run.length + 1;
+        }
+        run.length++;
+    }
+    return run;
+}
+
+static std::size_t identifier_length_padded_scalar(const char *input)
+{
+    std::size_t length = 0;
+    while (is_identifier_char(input[length]))
+    {
+        length++;
+    }
+    return length;
+}
+
+/**
+ * Finishes a whitespace run with the scalar kernel, once there isn't enough input left for a full block.
+ */
+static whitespace_run finish_whitespace_run(whitespace_run run, std::string_view input, std::size_t pos)
+{
+    auto tail = skip_whitespace_scalar(input.substr(pos));
+    run.length = pos + tail.length;
+    if (tail.newlines != 0)
+    {
+        run.newlines += tail.newlines;
+        run.line_start = pos + tail.line_start;
+    }
+    return run;
+}
+
+#ifdef WCCFF_X86_KERNELS
+
+// The comparisons are signed, so any byte above 0x7F is negative and never falls inside one of the ranges.
+static uint32_t whitespace_mask_sse2(__m128i v)
+{
+    auto space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    auto control =
+      _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(space, control)));
+}
+
+static uint32_t digits_mask_sse2(__m128i v)
+{
+    auto digits = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    return static_cast<uint32_t>(_mm_movemask_epi8(digits));
+}
+
+static uint32_t identifier_mask_sse2(__m128i v)
+{
+    // Setting bit 0x20 maps the upper case letters into the lower case ones
+    auto folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    auto letters =
+      _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(folded, _mm_set1_epi8('z' + 1)));
+    auto underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(letters, underscore))) | digits_mask_sse2(v);
+}
+
+static whitespace_run skip_whitespace_sse2(std::string_view input)
+{
+    constexpr std::size_t width = 16;
+    whitespace_run run;
+    std::size_t pos = 0;
+    while (pos + width <= input.size())
+    {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input.data() + pos));
+        auto whitespaces = whitespace_mask_sse2(v);
+        auto newlines = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+        if (whitespaces != 0xFFFF)
+        {
+            auto length = static_cast<std::size_t>(std::countr_one(whitespaces));
+            account_newlines(run, pos, newlines & ((1u << length) - 1));
+            run.length = pos + length;
+            return run;
+        }
+        account_newlines(run, pos, newlines);
+        pos += width;
+    }
+    return finish_whitespace_run(run, input, pos);
+}
+
+static std::size_t identifier_length_sse2(std::string_view input)
+{
+    constexpr std::size_t width = 16;
+    std::size_t pos = 0;
+    while (pos + width <= input.size())
+    {
+        auto mask = identifier_mask_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(input.data() + pos)));
+        if (mask != 0xFFFF)
+        {
+            return pos + std::countr_one(mask);
+        }
+        pos += width;
+    }
+    return pos + identifier_length_scalar(input.substr(pos));
+}
+
+static whitespace_run skip_whitespace_padded_sse2(const char *input)
+{
+    constexpr std::size_t width = 16;
+    whitespace_run run;
+    for (std::size_t pos = 0;; pos += width)
+    {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input + pos));
+        auto whitespaces = whitespace_mask_sse2(v);
+        auto newlines = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+        if (whitespaces != 0xFFFF)
+        {
+            auto length = static_cast<std::size_t>(std::countr_one(whitespaces));
+            account_newlines(run, pos, newlines & ((1u << length) - 1));
+            run.length = pos + length;
+            return run;
+        }
+        account_newlines(run, pos, newlines);
+    }
+}
+
+static std::size_t identifier_length_padded_sse2(const char *input)
+{
+    constexpr std::size_t width = 16;
+    for (std::size_t pos = 0;; pos += width)
+    {
+        auto mask = identifier_mask_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(input + pos)));
+        if (mask != 0xFFFF)
+        {
+            return pos + std::countr_one(mask);
+        }
+    }
+}
+
+#define WCCFF_AVX2 __attribute__((target("avx2")))
+
+WCCFF_AVX2 static uint32_t whitespace_mask_avx2(__m256i v)
+{
+    auto space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    auto control = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)),
+                                    _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(space, control)));
+}
+
+WCCFF_AVX2 static uint32_t digits_mask_avx2(__m256i v)
+{
+    auto digits = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                   _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(digits));
+}
+
+WCCFF_AVX2 static uint32_t identifier_mask_avx2(__m256i v)
+{
+    auto folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    auto letters = _mm256_and_si256(_mm256_cmpgt_epi8(folded, _mm256_set1_epi8('a' - 1)),
+                                    _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), folded));
+    auto underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(letters, underscore))) | digits_mask_avx2(v);
+}
+
+WCCFF_AVX2 static whitespace_run skip_whitespace_avx2(std::string_view input)
+{
+    constexpr std::size_t width = 32;
+    whitespace_run run;
+    std::size_t pos = 0;
+    while (pos + width <= input.size())
+    {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input.data() + pos));
+        auto whitespaces = whitespace_mask_avx2(v);
+        auto newlines = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+        if (whitespaces != 0xFFFFFFFF)
+        {
+            auto length = static_cast<std::size_t>(std::countr_one(whitespaces));
+            account_newlines(run, pos, newlines & static_cast<uint32_t>((uint64_t{ 1 } << length) - 1));
+            run.length = pos + length;
+            return run;
+        }
+        account_newlines(run, pos, newlines);
+        pos += width;
+    }
+    return finish_whitespace_run(run, input, pos);
+}
+
+WCCFF_AVX2 static std::size_t identifier_length_avx2(std::string_view input)
+{
+    constexpr std::size_t width = 32;
+    std::size_t pos = 0;
+    while (pos + width <= input.size())
+    {
+        auto mask = identifier_mask_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(input.data() + pos)));
+        if (mask != 0xFFFFFFFF)
+        {
+            return pos + std::countr_one(mask);
+        }
+        pos += width;
+    }
+    return pos + identifier_length_scalar(input.substr(pos));
+}
+
+WCCFF_AVX2 static whitespace_run skip_whitespace_padded_avx2(const char *input)
+{
+    constexpr std::size_t width = 32;
+    whitespace_run run;
+    for (std::size_t pos = 0;; pos += width)
+    {
+        auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + pos));
+        auto whitespaces = whitespace_mask_avx2(v);
+        auto newlines = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))));
+        if (whitespaces != 0xFFFFFFFF)
+        {
+            auto length = static_cast<std::size_t>(std::countr_one(whitespaces));
+            account_newlines(run, pos, newlines & static_cast<uint32_t>((uint64_t{ 1 } << length) - 1));
+            run.length = pos + length;
+            return run;
+        }
+        account_newlines(run, pos, newlines);
+    }
+}
+
+WCCFF_AVX2 static std::size_t identifier_length_padded_avx2(const char *input)
+{
+    constexpr std::size_t width = 32;
+    for (std::size_t pos = 0;; pos += width)
+    {
+        auto mask = identifier_mask_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(input + pos)));
+        if (mask != 0xFFFFFFFF)
+        {
+            return pos + std::countr_one(mask);
+        }
+    }
+}
+
+#endif // WCCFF_X86_KERNELS
+
+static std::vector<kernels> detect_kernels()
+{
+    std::vector<kernels> result;
+    result.push_back({ "scalar",
+                       skip_whitespace_scalar,
+                       identifier_length_scalar,
+                       skip_whitespace_padded_scalar,
+                       identifier_length_padded_scalar });
+#ifdef WCCFF_X86_KERNELS
+    // SSE2 is part of the x86-64 baseline
+    result.push_back({ "sse2",
+                       skip_whitespace_sse2,
+                       identifier_length_sse2,
+                       skip_whitespace_padded_sse2,
+                       identifier_length_padded_sse2 });
+    if (__builtin_cpu_supports("avx2"))
+    {
+        result.push_back({ "avx2",
+                           skip_whitespace_avx2,
+                           identifier_length_avx2,
+                           skip_whitespace_padded_avx2,
+                           identifier_length_padded_avx2 });
+    }
+#endif
+    return result;
+}
+
+std::span<const kernels> available_kernels()
+{
+    static const std::vector<kernels> detected = detect_kernels();
+    return detected;
+}
+
+const kernels &best_kernels()
+{
+    static const kernels &best = available_kernels().back();
+    return best;
+}
+
+} // namespace wccff::lexer::simd
@@ -0,0 +1,74 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LEXER_SIMD_H
+#define LEXER_SIMD_H
+
+#include <cstddef>
+#include <span>
+#include <string_view>
+
+namespace wccff::lexer::simd {
+
+/**
+ * Result of skipping a run of white spaces.
+ * line_start is the offset right after the last newline of the run, it's only meaningful when newlines isn't zero.
+ */
+struct whitespace_run
+{
+    std::size_t length{ 0 };
+    std::size_t newlines{ 0 };
+    std::size_t line_start{ 0 };
+};
+
+/**
+ * Number of zero bytes the padded kernels need after the end of the input, the size of the widest load.
+ */
+constexpr std::size_t padding_required = 32;
+
+/**
+ * Set of scanning kernels implemented with the same instruction set.
+ * All of them look at the beginning of input and return the length of the run they recognize.
+ *
+ * The padded ones need the input to be followed by, at least, padding_required zero bytes. The zeros stop every run,
+ * so those kernels don't check where the input ends and always do full width loads.
+ */
+struct kernels
+{
+    std::string_view name;
+    whitespace_run (*skip_whitespace)(std::string_view input);
+    std::size_t (*identifier_length)(std::string_view input);
+    whitespace_run (*skip_whitespace_padded)(const char *input);
+    std::size_t (*identifier_length_padded)(const char *input);
+};
+
+/**
+ * Returns all the kernels supported by the running CPU, ordered from the slowest (scalar) to the fastest.
+ */
+std::span<const kernels> available_kernels();
+
+/**
+ * Returns the fastest kernels supported by the running CPU.
+ * The selection happens once, on the first call.
+ */
+const kernels &best_kernels();
+
+} // namespace wccff::lexer::simd
+
+#endif // LEXER_SIMD_H
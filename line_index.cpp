@@ -0,0 +1,52 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "line_index.h"
+#include <algorithm>
+#include <cstring>
+
+namespace wccff::lexer {
+
+line_index::line_index(std::string_view source)
+{
+    m_line_starts.push_back(0);
+    const char *begin = source.data();
+    const char *end = begin + source.size();
+    const char *p = begin;
+    while (p != end)
+    {
+        const auto *newline = static_cast<const char *>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+        if (newline == nullptr)
+        {
+            break;
+        }
+        p = newline + 1;
+        m_line_starts.push_back(static_cast<uint32_t>(p - begin));
+    }
+}
+
+file_location line_index::resolve_location(std::size_t offset) const
+{
+    // The first line starting after offset, the line of offset is the one before
+    auto next_line = std::upper_bound(m_line_starts.begin(), m_line_starts.end(), offset);
+    auto line = std::distance(m_line_starts.begin(), next_line) - 1;
+    return { static_cast<int32_t>(line), static_cast<int32_t>(offset - m_line_starts[line]) };
+}
+
+} // namespace wccff::lexer
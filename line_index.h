@@ -0,0 +1,58 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace wccff::lexer {
+
+struct file_location
+{
+    int32_t line{ 0 };
+    int32_t column{ 0 };
+    bool operator==(const file_location &) const = default;
+};
+
+/**
+ * Offsets of the beginning of every line of a source.
+ * Tokens only store their offset, the line and column are computed when a diagnostic needs them.
+ */
+class line_index
+{
+  public:
+    explicit line_index(std::string_view source);
+
+    /**
+     * Returns the line and column of offset, both starting at zero.
+     */
+    [[nodiscard]] file_location resolve_location(std::size_t offset) const;
+    [[nodiscard]] std::size_t lines() const { return m_line_starts.size(); }
+
+  private:
+    std::vector<uint32_t> m_line_starts;
+};
+
+} // namespace wccff::lexer
+
+#endif // LINE_INDEX_H
@@ -18,112 +18,119 @@
  */
 
 #include "parser.h"
+#include "flat_ast.h"
+#include "hash_consing.h"
+#include "trace.h"
 #include "utils.h"
 #include "visitor.h"
-#include <charconv>
 #include <fmt/core.h>
 
 namespace wccff::parser {
 
-static parser_error generate_unexpected_end_of_tokens(const tokens &tokens)
+parser_error generate_unexpected_end_of_tokens(const tokens &tokens)
 {
+    if (tokens.at_beginning())
+    {
+        return { "Error: Unexpected end of tokens, the input is empty" };
+    }
     auto previous = tokens.previous_token();
-    auto msg = fmt::format("{}: Error: Unexpected end of tokens after '{}'", previous.loc, previous.text);
+    auto msg = fmt::format("{}: Error: Unexpected end of tokens after '{}'", previous.loc(), previous.text());
     return { msg };
 }
 
-int32_t int32_t_from_string(std::string_view str)
+parser_error tokens::unexpected_token(lexer::token_handle token, std::string_view expected) const
 {
-    int32_t value = 0;
-    std::from_chars(str.data(), str.data() + str.size(), value, 10);
-    // ToDo: Handle errors
-    return value;
+    if (token.type() == lexer::token_type::end_of_file)
+    {
+        return generate_unexpected_end_of_tokens(*this);
+    }
+    return { fmt::format("Parse failure at: {}. Expected {} found {}", token.loc(), expected, token.type()) };
 }
 
-std::expected<function, parser_error> parse_function(tokens &tokens)
+std::expected<identifier, parser_error> parse_function_header(tokens &tokens, compilation_context &context)
 {
-    auto t1 = tokens.get_next_token();
-    if (t1.has_value() == false)
+    auto int_keyword = tokens.expect(lexer::token_type::int_keyword, "int keyword");
+    if (int_keyword.has_value() == false)
     {
-        return std::unexpected{ generate_unexpected_end_of_tokens(tokens) };
-    }
-    if (t1->type != lexer::token_type::int_keyword)
-    {
-        auto msg = fmt::format("Parse failure at: {}. Expected int keyword found {}", t1->loc, t1->type);
-        return std::unexpected{ parser_error{ msg } };
+        return std::unexpected{ int_keyword.error() };
     }
-    auto function_name = parse_identifier(tokens);
+    auto function_name = parse_identifier(tokens, context);
     if (function_name.has_value() == false)
     {
         return std::unexpected{ function_name.error() };
     }
 
-    // At this point, we need at least 4 tokens until we get to the statement.
-    if (tokens.remaining_tokens() < 4)
-    {
-        return std::unexpected{ generate_unexpected_end_of_tokens(tokens) };
-    }
-
-    t1 = tokens.get_next_token_safe();
-    if (t1->type != lexer::token_type::open_parenthesis)
+    static constexpr std::pair<lexer::token_type, std::string_view> parameters[] = {
+        { lexer::token_type::open_parenthesis, "'('" },
+        { lexer::token_type::void_keyword, "void keyword" },
+        { lexer::token_type::close_parenthesis, "')'" },
+        { lexer::token_type::open_brace, "'{'" },
+    };
+    for (auto [type, expected] : parameters)
     {
-        auto msg = fmt::format("Parse failure at: {}. Expected '(' found {}", t1->loc, t1->type);
-        return std::unexpected{ parser_error{ msg } };
+        auto token = tokens.expect(type, expected);
+        if (token.has_value() == false)
+        {
+            return std::unexpected{ token.error() };
+        }
     }
+    return function_name;
+}
 
-    t1 = tokens.get_next_token_safe();
-    if (t1->type != lexer::token_type::void_keyword)
+std::expected<void, parser_error> parse_function_end(tokens &tokens)
+{
+    auto semicolon = tokens.expect(lexer::token_type::semicolon, "';'");
+    if (semicolon.has_value() == false)
     {
-        auto msg = fmt::format("Parse failure at: {}. Expected void keyword found {}", t1->loc, t1->type);
-        return std::unexpected{ parser_error{ msg } };
+        return std::unexpected{ semicolon.error() };
     }
-
-    t1 = tokens.get_next_token_safe();
-    if (t1->type != lexer::token_type::close_parenthesis)
+    auto close = tokens.expect(lexer::token_type::close_brace, "'}'");
+    if (close.has_value() == false)
     {
-        auto msg = fmt::format("Parse failure at: {}. Expected ')' found {}", t1->loc, t1->type);
-        return std::unexpected{ parser_error{ msg } };
+        return std::unexpected{ close.error() };
     }
+    return {};
+}
 
-    t1 = tokens.get_next_token_safe();
-    if (t1->type != lexer::token_type::open_brace)
+std::expected<function, parser_error> parse_function(tokens &tokens,
+                                                    compilation_context &context,
+                                                    const options &options)
+{
+    auto start = trace::clock::now();
+    auto bytes_before = context.ast.bytes_used();
+    auto function_name = parse_function_header(tokens, context);
+    if (function_name.has_value() == false)
     {
-        auto msg = fmt::format("Parse failure at: {}. Expected '{{' found {}", t1->loc, t1->type);
-        return std::unexpected{ parser_error{ msg } };
+        return std::unexpected{ function_name.error() };
     }
 
-    auto statement = parse_statement(tokens);
+    auto statement = parse_statement(tokens, context, options);
     if (statement.has_value() == false)
     {
         return std::unexpected{ statement.error() };
     }
 
-    // At this point, we need two more tokens
-    if (tokens.remaining_tokens() < 2)
-    {
-        return std::unexpected{ generate_unexpected_end_of_tokens(tokens) };
-    }
-    t1 = tokens.get_next_token_safe();
-    if (t1->type != lexer::token_type::semicolon)
-    {
-        auto msg = fmt::format("Parse failure at: {}. Expected ';' found {}", t1->loc, t1->type);
-        return std::unexpected{ parser_error{ msg } };
-    }
-
-    t1 = tokens.get_next_token_safe();
-    if (t1->type != lexer::token_type::close_brace)
+    auto end = parse_function_end(tokens);
+    if (end.has_value() == false)
     {
-        auto msg = fmt::format("Parse failure at: {}. Expected '}}' found {}", t1->loc, t1->type);
-        return std::unexpected{ parser_error{ msg } };
+        return std::unexpected{ end.error() };
     }
 
+    WCCFF_TRACE(parser,
+                info,
+                "Parsed function {} into {} bytes of nodes in {:.1f} us",
+                context.symbols.text(function_name->name),
+                context.ast.bytes_used() - bytes_before,
+                trace::microseconds_since(start));
     return function{ function_name.value(), std::move(statement.value()) };
 }
 
-std::expected<program, parser_error> parse_program(tokens &tokens)
+std::expected<program, parser_error> parse_program(tokens &tokens,
+                                                  compilation_context &context,
+                                                  const options &options)
 {
     program p;
-    auto function = parse_function(tokens);
+    auto function = parse_function(tokens, context, options);
     if (function.has_value() == false)
     {
         return std::unexpected{ function.error() };
@@ -132,20 +139,24 @@ std::expected<program, parser_error> parse_program(tokens &tokens)
     return p;
 }
 
-std::expected<return_node, parser_error> parse_return_node(tokens &tokens)
+std::expected<return_node, parser_error> parse_return_node(tokens &tokens,
+                                                          compilation_context &context,
+                                                          const options &options)
 {
-    auto t1 = tokens.get_next_token();
-    if (t1.has_value() == false)
+    auto keyword = tokens.expect(lexer::token_type::return_keyword, "return keyword");
+    if (keyword.has_value() == false)
     {
-        return std::unexpected{ generate_unexpected_end_of_tokens(tokens) };
+        return std::unexpected{ keyword.error() };
     }
-
-    if (t1->type != lexer::token_type::return_keyword)
-    {
-        auto msg = fmt::format("Parse failure at: {}. Expected return keyword found {}", t1->loc, t1->type);
-        return std::unexpected{ parser_error{ msg } };
-    }
-    auto e = parse_expression(tokens);
+    auto e = [&tokens, &context, &options] {
+        if (options.share_subexpressions)
+        {
+            hash_consing_builder builder{ context.ast, options.fold_constants };
+            return parse_expression(tokens, builder);
+        }
+        tree_builder builder{ context.ast, options.fold_constants };
+        return parse_expression(tokens, builder);
+    }();
     if (e.has_value() == false)
     {
         return std::unexpected{ e.error() };
@@ -154,360 +165,264 @@ std::expected<return_node, parser_error> parse_return_node(tokens &tokens)
     return return_node{ std::move(e.value()) };
 }
 
-std::expected<statement, parser_error> parse_statement(tokens &tokens)
+std::expected<statement, parser_error> parse_statement(tokens &tokens,
+                                                      compilation_context &context,
+                                                      const options &options)
 {
-    return parse_return_node(tokens);
+    return parse_return_node(tokens, context, options);
 }
 
 std::expected<binary_operator, parser_error> parse_binary_operator(tokens &tokens)
 {
-    auto t = tokens.get_next_token();
-    if (t.has_value() == false)
+    auto t = tokens.next();
+    auto op = operators_of(t.type()).binary;
+    if (op.has_value())
     {
-        return std::unexpected{ generate_unexpected_end_of_tokens(tokens) };
+        return op.value();
     }
-
-    switch (t->type)
+    if (t.type() == lexer::token_type::end_of_file)
     {
-        case lexer::token_type::bitwise_and_operator:
-            return bitwise_and_operator{};
-        case lexer::token_type::bitwise_or_operator:
-            return bitwise_or_operator{};
-        case lexer::token_type::bitwise_xor_operator:
-            return bitwise_xor_operator{};
-        case lexer::token_type::plus_operator:
-            return plus_operator{};
-        case lexer::token_type::negation_operator:
-            return subtract_operator{};
-        case lexer::token_type::multiplication_operator:
-            return multiply_operator{};
-        case lexer::token_type::division_operator:
-            return divide_operator{};
-        case lexer::token_type::remainder_operator:
-            return remainder_operator{};
-        case lexer::token_type::left_shift_operator:
-            return left_shift_operator{};
-        case lexer::token_type::right_shift_operator:
-            return right_shift_operator{};
-        case lexer::token_type::and_operator:
-            return logical_and_operator{};
-        case lexer::token_type::or_operator:
-            return logical_or_operator{};
-        case lexer::token_type::equals_operator:
-            return equals_operator{};
-        case lexer::token_type::not_equals_operator:
-            return not_equals_operator{};
-        case lexer::token_type::less_than_operator:
-            return less_than_operator{};
-        case lexer::token_type::less_than_or_equal_operator:
-            return less_than_or_equal_operator{};
-        case lexer::token_type::greater_than_operator:
-            return greater_than_operator{};
-        case lexer::token_type::greater_than_or_equal_operator:
-            return greater_than_or_equal_operator{};
-
-        default:
-            auto msg = fmt::format("Expected Binary Operator but found '{}'", t->text);
-            return std::unexpected{ parser_error{ msg } };
+        return std::unexpected{ generate_unexpected_end_of_tokens(tokens) };
     }
+    auto msg = fmt::format("Expected Binary Operator but found '{}'", t.text());
+    return std::unexpected{ parser_error{ msg } };
 }
-std::expected<std::unique_ptr<unary_node>, parser_error> parse_unary_node(tokens &tokens)
+std::expected<unary_operator, parser_error> parse_unary_operator(tokens &tokens)
 {
-    auto t = tokens.get_next_token();
-    if (t.has_value() == false)
+    auto t = tokens.next();
+    auto op = operators_of(t.type()).unary;
+    if (op.has_value())
+    {
+        return op.value();
+    }
+    if (t.type() == lexer::token_type::end_of_file)
     {
         return std::unexpected{ generate_unexpected_end_of_tokens(tokens) };
     }
-    unary_operator op;
-    switch (t->type)
+    auto msg =
+      fmt::format("Parse failure at: {}. Expected Unary Operator '~' or '-' but found {}", t.loc(), t.type());
+    return std::unexpected{ parser_error{ msg } };
+}
+
+std::expected<const unary_node *, parser_error> parse_unary_node(tokens &tokens, compilation_context &context)
+{
+    auto op = parse_unary_operator(tokens);
+    if (op.has_value() == false)
     {
-        case lexer::token_type::bitwise_complement_operator:
-            op = bitwise_complement_operator{};
-            break;
-        case lexer::token_type::negation_operator:
-            op = negate_operator{};
-            break;
-        case lexer::token_type::not_operator:
-            op = logical_not_operator{};
-            break;
-
-        default:
-            auto msg = fmt::format("Parse failure at: {}. Expected Unary Operator '~' or '-' but found {}",
-                                   t->loc,
-                                   t->type);
-            return std::unexpected{ parser_error{ msg } };
+        return std::unexpected{ op.error() };
     }
 
-    auto exp = parse_factor(tokens);
+    auto exp = parse_factor(tokens, context);
     if (exp.has_value() == false)
     {
         return std::unexpected{ exp.error() };
     }
 
-    return std::make_unique<unary_node>(op, std::move(exp.value()));
+    return context.ast.create<unary_node>(op.value(), exp.value());
 }
 
-std::expected<expression, parser_error> parse_factor(tokens &tokens)
+std::expected<expression, parser_error> parse_factor(tokens &tokens, compilation_context &context)
 {
-    auto next_toke = tokens.peek();
-    switch (next_toke.type)
-    {
-        case lexer::token_type::constant:
-        {
-            auto e = parse_constant(tokens);
-            if (e.has_value() == false)
-            {
-                return std::unexpected{ e.error() };
-            }
-
-            return e.value();
-        }
-        case lexer::token_type::bitwise_complement_operator:
-        case lexer::token_type::negation_operator:
-        case lexer::token_type::not_operator:
-        {
-            auto u = parse_unary_node(tokens);
-            if (u.has_value() == false)
-            {
-                return std::unexpected{ u.error() };
-            }
-            return std::move(u.value());
-        }
-        case lexer::token_type::open_parenthesis:
-        {
-            tokens.get_next_token_safe();
-            auto inner_expr = parse_expression(tokens);
-            auto n_t = tokens.get_next_token();
-            if (n_t.has_value() == false)
-            {
-                return std::unexpected{ generate_unexpected_end_of_tokens(tokens) };
-            }
-            if (n_t->type != lexer::token_type::close_parenthesis)
-            {
-                auto msg = fmt::format("Parse failure at: {}. Expected return keyword found {}", n_t->loc, n_t->type);
-                return std::unexpected{ parser_error{ msg } };
-            }
-            return inner_expr;
-        }
-        default:
-        {
-            auto msg = fmt::format("Parse failure at: Unexpected token '{}', expected an Expression", next_toke.text);
-            return std::unexpected{ parser_error{ msg } };
-        }
-    }
+    tree_builder builder{ context.ast };
+    return parse_factor(tokens, builder);
 }
 
-std::expected<expression, parser_error> parse_expression(tokens &tokens, int32_t min_precedence)
+std::optional<int32_t> fold_constant(unary_operator op, int32_t operand)
 {
-    auto is_binary_operator = [](lexer::token_type type) {
-        using enum lexer::token_type;
-        return type == plus_operator || type == negation_operator || type == multiplication_operator ||
-               type == division_operator || type == remainder_operator || type == bitwise_and_operator ||
-               type == bitwise_or_operator || type == bitwise_xor_operator || type == left_shift_operator ||
-               type == right_shift_operator || type == and_operator || type == or_operator || type == equals_operator ||
-               type == not_equals_operator || type == less_than_operator || type == less_than_or_equal_operator ||
-               type == greater_than_operator || type == greater_than_or_equal_operator;
-        ;
-    };
-
-    auto get_precedende = [](lexer::token_type type) {
-        using enum lexer::token_type;
-        switch (type)
-        {
-            case or_operator:
-                return 5;
-            case and_operator:
-                return 10;
-            case bitwise_or_operator:
-                return 15;
-            case bitwise_xor_operator:
-                return 20;
-            case bitwise_and_operator:
-                return 25;
-            case equals_operator:
-            case not_equals_operator:
-                return 30;
-            case less_than_operator:
-            case less_than_or_equal_operator:
-            case greater_than_operator:
-            case greater_than_or_equal_operator:
-                return 35;
-            case left_shift_operator:
-            case right_shift_operator:
-                return 40;
-            case plus_operator:
-            case negation_operator:
-                return 45;
-            case multiplication_operator:
-            case division_operator:
-            case remainder_operator:
-                return 50;
-        }
-        return 0;
-    };
-
-    auto left = parse_factor(tokens);
-    if (left.has_value() == false)
+    auto bits = static_cast<uint32_t>(operand);
+    switch (op)
     {
-        return std::unexpected{ left.error() };
+        case unary_operator::bitwise_complement:
+            return static_cast<int32_t>(~bits);
+        case unary_operator::negate:
+            return static_cast<int32_t>(0U - bits);
+        case unary_operator::logical_not:
+            return operand == 0 ? 1 : 0;
     }
+    return std::nullopt;
+}
 
-    auto next_token = tokens.peek();
-    while (is_binary_operator(next_token.type) && min_precedence < get_precedende(next_token.type))
+std::optional<int32_t> fold_constant(binary_operator op, int32_t left, int32_t right)
+{
+    // The arithmetic is done on the unsigned bits, which wrap around like the target's instructions
+    auto left_bits = static_cast<uint32_t>(left);
+    auto right_bits = static_cast<uint32_t>(right);
+    auto undefined_division = right == 0 || (left == std::numeric_limits<int32_t>::min() && right == -1);
+    auto undefined_shift = right < 0 || right >= 32;
+    switch (op)
     {
-        auto op = parse_binary_operator(tokens);
-        if (op.has_value() == false)
-        {
-            return std::unexpected{ op.error() };
-        }
-
-        auto right = parse_expression(tokens, get_precedende(next_token.type) + 1);
-        if (right.has_value() == false)
-        {
-            return std::unexpected{ right.error() };
-        }
-
-        left = std::make_unique<binary_node>(op.value(), std::move(left.value()), std::move(right.value()));
-        next_token = tokens.peek();
+        case binary_operator::plus:
+            return static_cast<int32_t>(left_bits + right_bits);
+        case binary_operator::subtract:
+            return static_cast<int32_t>(left_bits - right_bits);
+        case binary_operator::multiply:
+            return static_cast<int32_t>(left_bits * right_bits);
+        case binary_operator::divide:
+            return undefined_division ? std::nullopt : std::optional{ left / right };
+        case binary_operator::remainder:
+            return undefined_division ? std::nullopt : std::optional{ left % right };
+        case binary_operator::bitwise_and:
+            return left & right;
+        case binary_operator::bitwise_or:
+            return left | right;
+        case binary_operator::bitwise_xor:
+            return left ^ right;
+        case binary_operator::left_shift:
+            return undefined_shift ? std::nullopt : std::optional{ static_cast<int32_t>(left_bits << right) };
+        case binary_operator::right_shift:
+            // Arithmetic shift, like sarl
+            return undefined_shift ? std::nullopt : std::optional{ left >> right };
+        case binary_operator::logical_and:
+            return left != 0 && right != 0 ? 1 : 0;
+        case binary_operator::logical_or:
+            return left != 0 || right != 0 ? 1 : 0;
+        case binary_operator::equals:
+            return left == right ? 1 : 0;
+        case binary_operator::not_equals:
+            return left != right ? 1 : 0;
+        case binary_operator::less_than:
+            return left < right ? 1 : 0;
+        case binary_operator::less_than_or_equal:
+            return left <= right ? 1 : 0;
+        case binary_operator::greater_than:
+            return left > right ? 1 : 0;
+        case binary_operator::greater_than_or_equal:
+            return left >= right ? 1 : 0;
     }
-    return left;
+    return std::nullopt;
 }
 
-std::expected<identifier, parser_error> parse_identifier(tokens &tokens)
+std::expected<expression, parser_error> parse_expression(tokens &tokens,
+                                                        compilation_context &context,
+                                                        int32_t min_precedence)
 {
-    auto token = tokens.get_next_token();
-    if (token.has_value() == false)
-    {
-        return std::unexpected{ generate_unexpected_end_of_tokens(tokens) };
-    }
+    tree_builder builder{ context.ast };
+    return parse_expression(tokens, builder, min_precedence);
+}
 
-    if (token->type != lexer::token_type::identifier)
+std::expected<identifier, parser_error> parse_identifier(tokens &tokens, compilation_context &context)
+{
+    auto token = tokens.expect(lexer::token_type::identifier, "Identifier");
+    if (token.has_value() == false)
     {
-        auto msg = fmt::format("Parse failure at: {}. Expected Identifier found {}", token->loc, token->type);
-        return std::unexpected{ parser_error{ msg } };
+        return std::unexpected{ token.error() };
     }
 
     identifier c;
-    c.name = token->text;
+    c.name = context.symbols.intern(token->text());
     return c;
 }
 
 std::expected<int_constant, parser_error> parse_constant(tokens &tokens)
 {
-    auto token = tokens.get_next_token();
+    auto token = tokens.expect(lexer::token_type::constant, "Constant");
     if (token.has_value() == false)
     {
-        return std::unexpected{ generate_unexpected_end_of_tokens(tokens) };
+        return std::unexpected{ token.error() };
     }
 
-    if (token->type != lexer::token_type::constant)
-    {
-        auto msg = fmt::format("Parse failure at: {}. Expected Constant found {}", token->loc, token->type);
-        return std::unexpected{ parser_error{ msg } };
-    }
-
-    return int_constant{ int32_t_from_string(token->text) };
+    return int_constant{ token->value() };
 }
 
-std::expected<program, parser_error> parse(tokens &tokens)
+std::expected<void, parser_error> check_end_of_input(tokens &tokens, const std::optional<parser_error> &parse_error)
 {
-    auto p = parse_program(tokens);
-    if (p.has_value() == false)
+    // Lexes the next token, if any, so lexer errors after the program are also reported
+    auto has_trailing_tokens = tokens.has_tokens();
+    if (tokens.error().has_value())
+    {
+        // The lexer failed before the parser got to the end of the input
+        const auto &error = tokens.error().value();
+        auto msg = fmt::format("{}: Error: {} '{}'", error.location, error.message, error.input);
+        return std::unexpected{ parser_error{ msg } };
+    }
+    if (parse_error.has_value())
     {
-        return std::unexpected{ p.error() };
+        return std::unexpected{ parse_error.value() };
     }
 
-    if (tokens.remaining_tokens() != 0)
+    if (has_trailing_tokens)
     {
         // There are more tokens at the end of the program.
         // Which is invalid
         return std::unexpected{ parser_error{ "Unexpected tokens at the end of the input" } };
     }
+    return {};
+}
+
+std::expected<program, parser_error> parse(tokens &tokens, compilation_context &context, const options &options)
+{
+    auto p = parse_program(tokens, context, options);
+    auto end = check_end_of_input(tokens, p.has_value() ? std::nullopt : std::optional{ p.error() });
+    if (end.has_value() == false)
+    {
+        return std::unexpected{ end.error() };
+    }
     return p;
 }
 
-std::string pretty_print(const unary_operator &node, int32_t ident)
+void pretty_print(print_context &context, const unary_operator &node)
 {
-    return std::visit(
-      wccff::visitor{
-        [ident](const bitwise_complement_operator &) { return wccff::format_indented(ident, "Complement"); },
-        [ident](const negate_operator &) { return wccff::format_indented(ident, "Negate"); },
-        [ident](const logical_not_operator &) { return wccff::format_indented(ident, "Not"); },
-      },
-      node);
+    context.write_indented("{}", info(node).name);
 }
 
-std::string pretty_print(const binary_operator &node, int32_t ident)
+void pretty_print(print_context &context, const binary_operator &node)
+{
+    context.write_indented("{}", info(node).name);
+}
+
+void pretty_print(print_context &context, const expression &node)
+{
+    // The flat layout is printed without recursion, so deep expressions don't overflow the stack
+    pretty_print(context, flatten(node));
+}
+
+void pretty_print(print_context &context, const statement &node)
 {
-    return std::visit(
-      wccff::visitor{
-        [ident](const plus_operator &) { return wccff::format_indented(ident, "Plus"); },
-        [ident](const subtract_operator &) { return wccff::format_indented(ident, "Subtract"); },
-        [ident](const multiply_operator &) { return wccff::format_indented(ident, "Multiply"); },
-        [ident](const divide_operator &) { return wccff::format_indented(ident, "Divide"); },
-        [ident](const remainder_operator &) { return wccff::format_indented(ident, "Remainder"); },
-        [ident](const bitwise_and_operator &) { return wccff::format_indented(ident, "Bitwise And"); },
-        [ident](const bitwise_or_operator &) { return wccff::format_indented(ident, "Bitwise Or"); },
-        [ident](const bitwise_xor_operator &) { return wccff::format_indented(ident, "Bitwise Xor"); },
-        [ident](const left_shift_operator &) { return wccff::format_indented(ident, "Left Shift"); },
-        [ident](const right_shift_operator &) { return wccff::format_indented(ident, "Right Shift"); },
-        [ident](const logical_and_operator &) { return wccff::format_indented(ident, "Logic And"); },
-        [ident](const logical_or_operator &) { return wccff::format_indented(ident, "Logic Or"); },
-        [ident](const equals_operator &) { return wccff::format_indented(ident, "Equals"); },
-        [ident](const not_equals_operator &) { return wccff::format_indented(ident, "Not Equals"); },
-        [ident](const less_than_operator &) { return wccff::format_indented(ident, "Less Than"); },
-        [ident](const less_than_or_equal_operator &) { return wccff::format_indented(ident, "Less Than or Equals"); },
-        [ident](const greater_than_operator &) { return wccff::format_indented(ident, "Greater Than"); },
-        [ident](const greater_than_or_equal_operator &) {
-            return wccff::format_indented(ident, "Greater Than or Equals");
-        },
+    std::visit(
+      [&context](const return_node &n) {
+          context.write_indented("Return\n");
+          context.indent += 4;
+          pretty_print(context, n.e);
+          context.indent -= 4;
       },
       node);
 }
 
-std::string pretty_print(const std::unique_ptr<unary_node> &node, int32_t ident)
+void pretty_print(print_context &context, const function &node)
 {
-    auto prefix = wccff::format_indented(ident, "Unary({}", pretty_print(node->op, 0));
-    auto inner = wccff::format_indented(0, "{}", pretty_print(node->exp, ident + 6));
-    auto sufix = wccff::format_indented(ident, ")");
-
-    return fmt::format("{}\n{}\n{}", prefix, inner, sufix);
+    context.write_indented("Function({})\n", context.symbols.text(node.function_name.name));
+    context.indent += 4;
+    pretty_print(context, node.body);
+    context.indent -= 4;
 }
 
-std::string pretty_print(const std::unique_ptr<binary_node> &node, int32_t ident)
+void pretty_print(print_context &context, const program &node)
 {
-    auto prefix = wccff::format_indented(ident, "Binary({}", pretty_print(node->op, 0));
-    auto left = wccff::format_indented(0, "{}", pretty_print(node->left, ident + 7));
-    auto right = wccff::format_indented(0, "{}", pretty_print(node->right, ident + 7));
-    auto sufix = wccff::format_indented(ident, ")");
+    pretty_print(context, node.f);
+}
 
-    return fmt::format("{}\n{}\n{}\n{}", prefix, left, right, sufix);
+std::string pretty_print(const unary_operator &node, int32_t ident)
+{
+    return print_to_string(node, ident);
 }
-std::string pretty_print(const expression &node, int32_t ident)
+
+std::string pretty_print(const binary_operator &node, int32_t ident)
 {
-    return std::visit(
-      wccff::visitor{ [ident](const int_constant &n) { return wccff::format_indented(ident, "Constant({})", n.value); },
-                      [ident](const std::unique_ptr<unary_node> &n) { return pretty_print(n, ident); },
-                      [ident](const std::unique_ptr<binary_node> &n) { return pretty_print(n, ident); } },
-      node);
+    return print_to_string(node, ident);
 }
-std::string pretty_print(const statement &node, int32_t ident)
+
+std::string pretty_print(const expression &node, int32_t ident)
 {
-    return std::visit(
-      [ident](const return_node &n) {
-          return wccff::format_indented(ident, "Return\n{}", pretty_print(n.e, ident + 4));
-      },
-      node);
+    return print_to_string(node, ident);
 }
-std::string pretty_print(const function &node, int32_t ident)
+
+std::string pretty_print(const symbol_interner &symbols, const function &node, int32_t ident)
 {
-    return wccff::format_indented(ident,
-                                  "Function({})\n{}",
-                                  node.function_name.name,
-                                  pretty_print(node.body, ident + 4));
+    return print_to_string(symbols, node, ident);
 }
-std::string pretty_print(const program &node, int32_t ident)
+
+std::string pretty_print(const symbol_interner &symbols, const program &node, int32_t ident)
 {
-    return pretty_print(node.f, ident);
+    return print_to_string(symbols, node, ident);
 }
 } // namespace wccff::parser
@@ -20,137 +20,353 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include "arena.h"
+#include "compilation_context.h"
 #include "lexer.h"
+#include "symbol.h"
+#include "utils.h"
+#include "visitor.h"
+#include <array>
+#include <cstdint>
+#include <fmt/core.h>
+#include <limits>
+#include <optional>
 #include <span>
+#include <string_view>
 #include <variant>
 #include <vector>
 
 namespace wccff::parser {
 
+struct parser_error
+{
+    std::string message;
+};
+
 /**
  * Abstract a list of tokens.
  * Makes it easier for the parser to navigate said list.
+ *
+ * The tokens either come from a vector, or from a token_stream or a streaming_lexer that is only lexed as far as the
+ * parser looked ahead.
+ * In the later case, the tokens already consumed are dropped from the buffer from time to time.
+ * The handles returned are valid until the next token is lexed.
+ *
+ * Once the input is exhausted, or the lexer fails, the buffer ends with an end_of_file token. Looking ahead past the
+ * last token returns it, so the parser never needs to check how many tokens are left.
  */
 class tokens
 {
   public:
-    explicit tokens(std::vector<wccff::lexer::token> tokens_)
-      : m_tokens(std::move(tokens_))
+    explicit tokens(const std::vector<wccff::lexer::token> &tokens_)
+      : m_buffer(tokens_)
+    {
+        push_end_of_file();
+    }
+    explicit tokens(wccff::lexer::token_buffer buffer_)
+      : m_buffer(std::move(buffer_))
+    {
+        push_end_of_file();
+    }
+    explicit tokens(wccff::lexer::token_stream stream_)
+      : m_buffer(stream_.input())
+      , m_stream(std::move(stream_))
+    {
+    }
+    explicit tokens(wccff::lexer::streaming_lexer stream_)
+      : m_stream(std::move(stream_))
     {
     }
 
-    [[nodiscard]] std::size_t remaining_tokens() const { return m_tokens.size() - m_index; }
-    wccff::lexer::token get_next_token_safe() { return m_tokens.at(m_index++); }
-    std::optional<wccff::lexer::token> get_next_token()
+    /**
+     * Returns the token ahead tokens after the current one, or the end_of_file token.
+     */
+    [[nodiscard]] wccff::lexer::token_handle peek(std::size_t ahead = 0)
+    {
+        if (fill(ahead + 1) == false)
+        {
+            return m_buffer[m_buffer.size() - 1];
+        }
+        return m_buffer[m_index + ahead];
+    }
+    /**
+     * Consumes the current token and returns it, the end_of_file token is never consumed.
+     */
+    wccff::lexer::token_handle next()
+    {
+        auto token = peek();
+        if (token.type() != wccff::lexer::token_type::end_of_file)
+        {
+            m_index++;
+        }
+        return token;
+    }
+    /**
+     * Consumes the current token when it's of the given type.
+     */
+    bool accept(wccff::lexer::token_type type)
+    {
+        if (peek().type() != type)
+        {
+            return false;
+        }
+        m_index++;
+        return true;
+    }
+    /**
+     * Consumes the current token, which needs to be of the given type. Otherwise, the error says what was expected.
+     */
+    std::expected<wccff::lexer::token_handle, parser_error> expect(wccff::lexer::token_type type,
+                                                                   std::string_view expected)
     {
-        if (m_index >= m_tokens.size())
+        auto token = peek();
+        if (token.type() != type)
         {
-            return std::nullopt;
+            return std::unexpected{ unexpected_token(token, expected) };
         }
-        return m_tokens[m_index++];
+        m_index++;
+        return token;
     }
 
-    [[nodiscard]] wccff::lexer::token peek() const { return m_tokens.at(m_index); }
-    [[nodiscard]] wccff::lexer::token previous_token() const { return m_tokens.at(m_index - 1); }
+    /**
+     * Returns true when there are, at least, count tokens left, not counting the end_of_file token.
+     */
+    [[nodiscard]] bool has_tokens(std::size_t count = 1) { return fill(count); }
+    [[nodiscard]] wccff::lexer::token_handle previous_token() const { return m_buffer[m_index - 1]; }
+    /**
+     * True when no token was consumed yet, so there's no previous token.
+     */
+    [[nodiscard]] bool at_beginning() const { return m_index == 0; }
+
+    /**
+     * The error found while lexing the tokens, the parser sees it as the end of the tokens.
+     */
+    [[nodiscard]] const std::optional<wccff::lexer::lexer_error> &error() const { return m_error; }
 
   private:
-    std::vector<wccff::lexer::token> m_tokens;
-    std::size_t m_index{ 0 };
-};
+    // Number of consumed tokens kept before the buffer is compacted
+    static constexpr std::size_t compaction_threshold = 256;
 
-struct parser_error
-{
-    std::string message;
+    bool fill(std::size_t count)
+    {
+        if (m_buffer.size() - m_index >= count + (m_stream.has_value() ? 0 : 1))
+        {
+            return true;
+        }
+        if (m_stream.has_value() == false)
+        {
+            return false;
+        }
+        compact();
+        while (m_buffer.size() - m_index < count)
+        {
+            auto found = std::visit([this](auto &stream) { return stream.next(m_buffer); }, m_stream.value());
+            if (found.has_value() == false || found.value() == false)
+            {
+                if (found.has_value() == false)
+                {
+                    m_error = found.error();
+                }
+                push_end_of_file();
+                m_stream.reset();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Adds the end_of_file token, an empty token at the end of the input.
+     */
+    void push_end_of_file()
+    {
+        using wccff::lexer::token_type;
+        if (m_stream.has_value() && std::holds_alternative<wccff::lexer::streaming_lexer>(m_stream.value()))
+        {
+            const auto &stream = std::get<wccff::lexer::streaming_lexer>(m_stream.value());
+            m_buffer.push_back_copy(token_type::end_of_file, "", stream.location());
+            return;
+        }
+        if (m_buffer.stores_locations())
+        {
+            m_buffer.push_back_copy(token_type::end_of_file, "", m_buffer.loc(m_buffer.size() - 1));
+            return;
+        }
+        auto source = m_buffer.source();
+        m_buffer.push_back(token_type::end_of_file, source.substr(source.size()));
+    }
+
+    /**
+     * Drops the consumed tokens, except the previous one.
+     */
+    void compact()
+    {
+        if (m_index > compaction_threshold)
+        {
+            m_buffer.erase_front(m_index - 1);
+            m_index = 1;
+        }
+    }
+
+    parser_error unexpected_token(wccff::lexer::token_handle token, std::string_view expected) const;
+
+    wccff::lexer::token_buffer m_buffer;
+    std::size_t m_index{ 0 };
+    std::optional<std::variant<wccff::lexer::token_stream, wccff::lexer::streaming_lexer>> m_stream;
+    std::optional<wccff::lexer::lexer_error> m_error;
 };
 
 struct identifier
 {
-    std::string name;
+    symbol name;
 };
 
-struct bitwise_complement_operator
-{
-};
-struct bitwise_and_operator
-{
-};
-struct bitwise_or_operator
-{
-};
-struct bitwise_xor_operator
-{
-};
-struct equals_operator
-{
-};
-struct greater_than_operator
-{
-};
-struct greater_than_or_equal_operator
-{
-};
-struct less_than_operator
-{
-};
-struct less_than_or_equal_operator
-{
-};
-struct logical_and_operator
-{
-};
-struct logical_not_operator
-{
-};
-struct logical_or_operator
-{
-};
-struct negate_operator
+/**
+ * The operators are a single byte, their properties are looked up in the tables below.
+ */
+enum class unary_operator : uint8_t
 {
+    bitwise_complement,
+    negate,
+    logical_not,
 };
-struct not_equals_operator
+
+enum class binary_operator : uint8_t
 {
+    plus,
+    subtract,
+    multiply,
+    divide,
+    remainder,
+    bitwise_and,
+    bitwise_or,
+    bitwise_xor,
+    left_shift,
+    right_shift,
+    logical_and,
+    logical_or,
+    equals,
+    not_equals,
+    less_than,
+    less_than_or_equal,
+    greater_than,
+    greater_than_or_equal,
 };
-struct plus_operator
+
+enum class associativity : uint8_t
 {
+    left,
+    right,
 };
-struct subtract_operator
+
+struct unary_operator_info
 {
+    std::string_view name;
 };
-struct multiply_operator
+
+struct binary_operator_info
 {
+    std::string_view name;
+    int32_t precedence;
+    associativity grouping;
+    bool relational;
+    bool commutative;
+    // The right operand is only evaluated when the left one doesn't decide the result
+    bool short_circuit;
 };
-struct divide_operator
+
+/**
+ * Indexed by unary_operator.
+ */
+constexpr std::array<unary_operator_info, 3> unary_operators{ {
+  { "Complement" },
+  { "Negate" },
+  { "Not" },
+} };
+
+/**
+ * Indexed by binary_operator.
+ */
+constexpr std::array<binary_operator_info, 18> binary_operators{ {
+  { "Plus", 45, associativity::left, false, true, false },
+  { "Subtract", 45, associativity::left, false, false, false },
+  { "Multiply", 50, associativity::left, false, true, false },
+  { "Divide", 50, associativity::left, false, false, false },
+  { "Remainder", 50, associativity::left, false, false, false },
+  { "Bitwise And", 25, associativity::left, false, true, false },
+  { "Bitwise Or", 15, associativity::left, false, true, false },
+  { "Bitwise Xor", 20, associativity::left, false, true, false },
+  { "Left Shift", 40, associativity::left, false, false, false },
+  { "Right Shift", 40, associativity::left, false, false, false },
+  { "Logic And", 10, associativity::left, false, false, true },
+  { "Logic Or", 5, associativity::left, false, false, true },
+  { "Equals", 30, associativity::left, true, true, false },
+  { "Not Equals", 30, associativity::left, true, true, false },
+  { "Less Than", 35, associativity::left, true, false, false },
+  { "Less Than or Equals", 35, associativity::left, true, false, false },
+  { "Greater Than", 35, associativity::left, true, false, false },
+  { "Greater Than or Equals", 35, associativity::left, true, false, false },
+} };
+
+static_assert(unary_operators.size() == static_cast<std::size_t>(unary_operator::logical_not) + 1);
+static_assert(binary_operators.size() == static_cast<std::size_t>(binary_operator::greater_than_or_equal) + 1);
+
+constexpr const unary_operator_info &info(unary_operator op)
 {
-};
-struct remainder_operator
+    return unary_operators[static_cast<std::size_t>(op)];
+}
+constexpr const binary_operator_info &info(binary_operator op)
 {
-};
-struct left_shift_operator
+    return binary_operators[static_cast<std::size_t>(op)];
+}
+
+/**
+ * The operators a token stands for, the same token can be both an unary and a binary operator.
+ */
+struct token_operators
 {
+    std::optional<unary_operator> unary;
+    std::optional<binary_operator> binary;
 };
-struct right_shift_operator
+
+/**
+ * Indexed by lexer::token_type.
+ */
+constexpr auto operators_by_token = [] {
+    using enum lexer::token_type;
+    std::array<token_operators, static_cast<std::size_t>(end_of_file) + 1> table{};
+    auto at = [&table](lexer::token_type type) -> token_operators & { return table[static_cast<std::size_t>(type)]; };
+
+    at(bitwise_complement_operator).unary = unary_operator::bitwise_complement;
+    at(negation_operator).unary = unary_operator::negate;
+    at(not_operator).unary = unary_operator::logical_not;
+
+    at(plus_operator).binary = binary_operator::plus;
+    at(negation_operator).binary = binary_operator::subtract;
+    at(multiplication_operator).binary = binary_operator::multiply;
+    at(division_operator).binary = binary_operator::divide;
+    at(remainder_operator).binary = binary_operator::remainder;
+    at(bitwise_and_operator).binary = binary_operator::bitwise_and;
+    at(bitwise_or_operator).binary = binary_operator::bitwise_or;
+    at(bitwise_xor_operator).binary = binary_operator::bitwise_xor;
+    at(left_shift_operator).binary = binary_operator::left_shift;
+    at(right_shift_operator).binary = binary_operator::right_shift;
+    at(and_operator).binary = binary_operator::logical_and;
+    at(or_operator).binary = binary_operator::logical_or;
+    at(equals_operator).binary = binary_operator::equals;
+    at(not_equals_operator).binary = binary_operator::not_equals;
+    at(less_than_operator).binary = binary_operator::less_than;
+    at(less_than_or_equal_operator).binary = binary_operator::less_than_or_equal;
+    at(greater_than_operator).binary = binary_operator::greater_than;
+    at(greater_than_or_equal_operator).binary = binary_operator::greater_than_or_equal;
+    return table;
+}();
+
+constexpr const token_operators &operators_of(lexer::token_type type)
 {
-};
-using unary_operator = std::variant<bitwise_complement_operator, negate_operator, logical_not_operator>;
+    return operators_by_token[static_cast<std::size_t>(type)];
+}
 
-using binary_operator = std::variant<plus_operator,
-                                     subtract_operator,
-                                     multiply_operator,
-                                     divide_operator,
-                                     remainder_operator,
-                                     bitwise_and_operator,
-                                     bitwise_or_operator,
-                                     bitwise_xor_operator,
-                                     left_shift_operator,
-                                     right_shift_operator,
-                                     logical_and_operator,
-                                     logical_or_operator,
-                                     equals_operator,
-                                     not_equals_operator,
-                                     less_than_operator,
-                                     less_than_or_equal_operator,
-                                     greater_than_operator,
-                                     greater_than_or_equal_operator>;
 struct binary_node;
 struct unary_node;
 
@@ -158,7 +374,10 @@ struct int_constant
 {
     int32_t value;
 };
-using expression = std::variant<int_constant, std::unique_ptr<unary_node>, std::unique_ptr<binary_node>>;
+/**
+ * The operator nodes live in the arena of the compilation context, the expressions only point to them.
+ */
+using expression = std::variant<int_constant, const unary_node *, const binary_node *>;
 
 struct unary_node
 {
@@ -168,6 +387,8 @@ struct unary_node
     {
     }
     unary_operator op;
+    // Set when the node is reused by other expressions, see hash_consing_builder
+    mutable bool shared = false;
     expression exp;
 };
 
@@ -181,6 +402,8 @@ struct binary_node
     }
 
     binary_operator op;
+    // Set when the node is reused by other expressions, see hash_consing_builder
+    mutable bool shared = false;
     expression left;
     expression right;
 };
@@ -203,18 +426,295 @@ struct program
     function f;
 };
 
+struct options
+{
+    /**
+     * The operators whose operands are all constants are replaced by their result while parsing.
+     */
+    bool fold_constants = false;
+    /**
+     * The identical subexpressions are built once and shared, so they are also computed once.
+     */
+    bool share_subexpressions = false;
+    /**
+     * The TACKY is emitted while parsing and no AST is built, see tacky::parse_and_lower. The other options don't
+     * apply then.
+     */
+    bool lower_while_parsing = false;
+};
+
+/**
+ * The result of the operator applied to constants, with the semantics of the target: the arithmetic wraps around.
+ * Nothing is returned when the result isn't defined, like a division by zero, INT_MIN / -1 or a shift by a negative
+ * count, or by 32 or more. Those are left to the target.
+ */
+std::optional<int32_t> fold_constant(unary_operator op, int32_t operand);
+std::optional<int32_t> fold_constant(binary_operator op, int32_t left, int32_t right);
+
+/**
+ * Builds the expressions as trees of nodes allocated in the arena.
+ */
+struct tree_builder
+{
+    using node = expression;
+
+    node constant(int32_t value) { return int_constant{ value }; }
+    node unary(unary_operator op, node operand)
+    {
+        if (fold_constants && std::holds_alternative<int_constant>(operand))
+        {
+            auto folded = fold_constant(op, std::get<int_constant>(operand).value);
+            if (folded.has_value())
+            {
+                return int_constant{ folded.value() };
+            }
+        }
+        return nodes.create<unary_node>(op, operand);
+    }
+    node binary(binary_operator op, node left, node right)
+    {
+        if (fold_constants && std::holds_alternative<int_constant>(left) && std::holds_alternative<int_constant>(right))
+        {
+            auto folded = fold_constant(op, std::get<int_constant>(left).value, std::get<int_constant>(right).value);
+            if (folded.has_value())
+            {
+                return int_constant{ folded.value() };
+            }
+        }
+        return nodes.create<binary_node>(op, left, right);
+    }
+    /**
+     * Marks the node as used by several expressions, so its value is computed once, see tacky::process_expression.
+     */
+    node share(node n) const
+    {
+        std::visit(visitor{
+                     [](const int_constant &) {},
+                     [](const auto *operator_node) { operator_node->shared = true; },
+                   },
+                   n);
+        return n;
+    }
+
+    arena &nodes;
+    bool fold_constants = false;
+};
+
+parser_error generate_unexpected_end_of_tokens(const tokens &tokens);
+
+constexpr bool is_binary_operator(lexer::token_type type)
+{
+    return operators_of(type).binary.has_value();
+}
+/**
+ * The precedence of the binary operator of the token, 0 when it isn't one.
+ */
+constexpr int32_t get_precedence(lexer::token_type type)
+{
+    auto op = operators_of(type).binary;
+    return op.has_value() ? info(op.value()).precedence : 0;
+}
+
 std::expected<int_constant, parser_error> parse_constant(tokens &tokens);
-std::expected<identifier, parser_error> parse_identifier(tokens &tokens);
-std::expected<expression, parser_error> parse_expression(tokens &tokens, int32_t min_precedence = 0);
-std::expected<expression, parser_error> parse_factor(tokens &tokens);
-std::expected<statement, parser_error> parse_statement(tokens &tokens);
-std::expected<std::unique_ptr<unary_node>, parser_error> parse_unary_node(tokens &tokens);
+std::expected<identifier, parser_error> parse_identifier(tokens &tokens, compilation_context &context);
+std::expected<unary_operator, parser_error> parse_unary_operator(tokens &tokens);
+std::expected<binary_operator, parser_error> parse_binary_operator(tokens &tokens);
+std::expected<expression, parser_error> parse_expression(tokens &tokens,
+                                                        compilation_context &context,
+                                                        int32_t min_precedence = 0);
+std::expected<expression, parser_error> parse_factor(tokens &tokens, compilation_context &context);
+std::expected<statement, parser_error> parse_statement(tokens &tokens,
+                                                      compilation_context &context,
+                                                      const options &options = {});
+std::expected<const unary_node *, parser_error> parse_unary_node(tokens &tokens, compilation_context &context);
+
+/**
+ * The names are interned in the symbols of the context and the nodes are allocated in its arena.
+ */
+std::expected<program, parser_error> parse(tokens &tokens, compilation_context &context, const options &options = {});
+
+/**
+ * The tokens of a function up to its body: int keyword, name, parameters and open brace.
+ */
+std::expected<identifier, parser_error> parse_function_header(tokens &tokens, compilation_context &context);
+/**
+ * The tokens after the statement of the function body: semicolon and close brace.
+ */
+std::expected<void, parser_error> parse_function_end(tokens &tokens);
+/**
+ * Checks the input after a parse of the program. A lexer error is reported first, then the error of the parse, if
+ * any, and then the tokens left after the program.
+ */
+std::expected<void, parser_error> check_end_of_input(tokens &tokens, const std::optional<parser_error> &parse_error);
 
-std::expected<program, parser_error> parse(tokens &tokens);
+/**
+ * The printers append to the buffer of the context, the string overloads are for the callers that need a string.
+ */
+void pretty_print(print_context &context, const unary_operator &node);
+void pretty_print(print_context &context, const binary_operator &node);
+void pretty_print(print_context &context, const expression &node);
+void pretty_print(print_context &context, const statement &node);
+void pretty_print(print_context &context, const function &node);
+void pretty_print(print_context &context, const program &node);
 
+std::string pretty_print(const unary_operator &node, int32_t ident);
+std::string pretty_print(const binary_operator &node, int32_t ident);
 std::string pretty_print(const expression &node, int32_t ident);
-std::string pretty_print(const function &node, int32_t ident);
-std::string pretty_print(const program &node, int32_t ident = 0);
+std::string pretty_print(const symbol_interner &symbols, const function &node, int32_t ident);
+std::string pretty_print(const symbol_interner &symbols, const program &node, int32_t ident = 0);
+
+/*
+ * The expression grammar is a template on the builder of the nodes, so the same parser can produce different
+ * representations of the expressions. A builder has a node type, and the members:
+ *   node constant(int32_t value);
+ *   node unary(unary_operator op, node operand);
+ *   node binary(binary_operator op, node left, node right);
+ * The builder is called in post-order, the operands are always built before their operator. A builder can also have
+ *   void begin_right_operand(binary_operator op, node left);
+ * which is called once the left operand of a binary operator is built, before its right operand is parsed.
+ *
+ * The parser doesn't recurse, the pending operators and operands are kept in stacks on the heap. So the nesting of
+ * the parentheses and operators is only limited by the available memory, not by the size of the thread's stack.
+ */
+
+/**
+ * Parses an expression, it stops before the first binary operator whose precedence isn't above min_precedence
+ * that isn't inside parentheses.
+ */
+template<typename Builder>
+std::expected<typename Builder::node, parser_error> parse_expression(tokens &tokens,
+                                                                     Builder &builder,
+                                                                     int32_t min_precedence = 0)
+{
+    struct pending_operator
+    {
+        enum class kind : uint8_t
+        {
+            unary,
+            binary,
+            parenthesis,
+        };
+        kind type;
+        int32_t precedence;
+        unary_operator unary;
+        binary_operator binary;
+    };
+    using kind = typename pending_operator::kind;
+
+    std::vector<pending_operator> operators;
+    std::vector<typename Builder::node> operands;
+    std::size_t open_parentheses = 0;
+
+    // Builds the operators on top of the stack, down to the first parenthesis or binary operator that binds less
+    // than precedence, or as much for the right associative ones. The unary operators always bind more than the
+    // binary ones.
+    auto reduce = [&](int32_t precedence) {
+        while (operators.empty() == false && operators.back().type != kind::parenthesis)
+        {
+            const auto &top = operators.back();
+            if (top.type == kind::unary)
+            {
+                auto operand = operands.back();
+                operands.back() = builder.unary(top.unary, operand);
+            }
+            else
+            {
+                if (top.precedence < precedence ||
+                    (top.precedence == precedence && info(top.binary).grouping == associativity::right))
+                {
+                    break;
+                }
+                auto right = operands.back();
+                operands.pop_back();
+                auto left = operands.back();
+                operands.back() = builder.binary(top.binary, left, right);
+            }
+            operators.pop_back();
+        }
+    };
+
+    while (true)
+    {
+        // An operand, preceded by any number of unary operators and open parentheses
+        auto token = tokens.peek();
+        switch (token.type())
+        {
+            case lexer::token_type::constant:
+                tokens.next();
+                operands.push_back(builder.constant(token.value()));
+                break;
+            case lexer::token_type::bitwise_complement_operator:
+            case lexer::token_type::negation_operator:
+            case lexer::token_type::not_operator:
+            {
+                auto op = parse_unary_operator(tokens);
+                if (op.has_value() == false)
+                {
+                    return std::unexpected{ op.error() };
+                }
+                operators.push_back({ kind::unary, 0, op.value(), {} });
+                continue;
+            }
+            case lexer::token_type::open_parenthesis:
+                tokens.next();
+                operators.push_back({ kind::parenthesis, 0, {}, {} });
+                open_parentheses++;
+                continue;
+            case lexer::token_type::end_of_file:
+                return std::unexpected{ generate_unexpected_end_of_tokens(tokens) };
+            default:
+            {
+                auto msg = fmt::format("Parse failure at: Unexpected token '{}', expected an Expression", token.text());
+                return std::unexpected{ parser_error{ msg } };
+            }
+        }
+
+        // The operand is followed by any number of close parentheses, and then a binary operator or the end
+        while (open_parentheses > 0 && tokens.peek().type() == lexer::token_type::close_parenthesis)
+        {
+            tokens.next();
+            reduce(std::numeric_limits<int32_t>::min());
+            operators.pop_back();
+            open_parentheses--;
+        }
+
+        auto next_type = tokens.peek().type();
+        auto precedence = get_precedence(next_type);
+        if (is_binary_operator(next_type) == false || (open_parentheses == 0 && precedence <= min_precedence))
+        {
+            if (open_parentheses > 0)
+            {
+                auto close = tokens.expect(lexer::token_type::close_parenthesis, "')'");
+                return std::unexpected{ close.error() };
+            }
+            reduce(std::numeric_limits<int32_t>::min());
+            return operands.back();
+        }
+
+        // The operators of the same precedence are grouped as the table says
+        reduce(precedence);
+        auto op = parse_binary_operator(tokens);
+        if (op.has_value() == false)
+        {
+            return std::unexpected{ op.error() };
+        }
+        if constexpr (requires { builder.begin_right_operand(op.value(), operands.back()); })
+        {
+            builder.begin_right_operand(op.value(), operands.back());
+        }
+        operators.push_back({ kind::binary, precedence, {}, op.value() });
+    }
+}
+
+/**
+ * Parses a constant, an unary operator applied to a factor, or an expression inside parentheses.
+ */
+template<typename Builder>
+std::expected<typename Builder::node, parser_error> parse_factor(tokens &tokens, Builder &builder)
+{
+    // No binary operator outside of the parentheses has a precedence that high
+    return parse_expression(tokens, builder, std::numeric_limits<int32_t>::max());
+}
 } // namespace wccff::parser
 
 #endif // PARSER_H
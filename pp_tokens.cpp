@@ -0,0 +1,270 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "pp_tokens.h"
+#include <algorithm>
+#include <array>
+#include <fmt/format.h>
+#include <optional>
+
+namespace wccff::preprocessor {
+
+// Ordered so the longest punctuators are matched first
+constexpr std::array<std::string_view, 23> punctuators{ "...", "<<=", ">>=", "->", "++", "--", "<<", ">>",
+                                                        "<=",  ">=",  "==",  "!=", "&&", "||", "*=", "/=",
+                                                        "%=",  "+=",  "-=",  "&=", "^=", "|=", "##" };
+
+constexpr std::string_view single_char_punctuators{ "[](){}.&*+-~!/%<>^|?:;=,#" };
+
+constexpr bool is_identifier_start(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+constexpr bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+constexpr bool is_identifier_char(char c)
+{
+    return is_identifier_start(c) || is_digit(c);
+}
+
+constexpr bool is_horizontal_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r';
+}
+
+/**
+ * Removes the backslash-newline pairs.
+ * The removed newlines are added back after the next newline, so the following lines keep their number.
+ */
+static std::string remove_line_splices(std::string_view source)
+{
+    std::string result;
+    result.reserve(source.size());
+    std::size_t pending_newlines = 0;
+    for (std::size_t i = 0; i < source.size(); i++)
+    {
+        if (source[i] == '\\')
+        {
+            auto next = i + 1;
+            if (next < source.size() && source[next] == '\r')
+            {
+                next++;
+            }
+            if (next < source.size() && source[next] == '\n')
+            {
+                pending_newlines++;
+                i = next;
+                continue;
+            }
+        }
+        result.push_back(source[i]);
+        if (source[i] == '\n')
+        {
+            result.append(pending_newlines, '\n');
+            pending_newlines = 0;
+        }
+    }
+    result.append(pending_newlines, '\n');
+    return result;
+}
+
+/**
+ * End of the character or string literal whose opening quote is at pos, nothing when it isn't closed on its line.
+ */
+static std::optional<std::size_t> literal_end(std::string_view source, std::size_t pos)
+{
+    auto quote = source[pos];
+    auto end = pos + 1;
+    while (end < source.size() && source[end] != quote && source[end] != '\n')
+    {
+        end += source[end] == '\\' && end + 1 < source.size() && source[end + 1] != '\n' ? 2 : 1;
+    }
+    if (end < source.size() && source[end] == quote)
+    {
+        return end + 1;
+    }
+    return std::nullopt;
+}
+
+/**
+ * The encoding prefixes of the character and string literals.
+ */
+static bool is_encoding_prefix(std::string_view text)
+{
+    return text == "L" || text == "u" || text == "U" || text == "u8";
+}
+
+static std::size_t punctuator_length(std::string_view input)
+{
+    for (auto p : punctuators)
+    {
+        if (input.starts_with(p))
+        {
+            return p.size();
+        }
+    }
+    return single_char_punctuators.find(input.front()) != std::string_view::npos ? 1 : 0;
+}
+
+std::expected<std::vector<pp_token>, preprocessor_error> tokenize(std::string_view source,
+                                                                  uint32_t file,
+                                                                  std::string_view file_name,
+                                                                  std::deque<std::string> &storage)
+{
+    if (source.find("\\\n") != std::string_view::npos || source.find("\\\r\n") != std::string_view::npos)
+    {
+        source = storage.emplace_back(remove_line_splices(source));
+    }
+
+    auto error = [&](int32_t line, std::string_view message) {
+        return std::unexpected(preprocessor_error{ fmt::format("{}:{}: Error: {}", file_name, line, message) });
+    };
+
+    std::vector<pp_token> tokens;
+    int32_t line = 1;
+    std::size_t line_begin = 0;
+    bool at_line_start = true;
+    bool has_space = false;
+    std::size_t pos = 0;
+    while (pos < source.size())
+    {
+        auto c = source[pos];
+        if (c == '\n')
+        {
+            line++;
+            at_line_start = true;
+            has_space = false;
+            pos++;
+            line_begin = pos;
+            continue;
+        }
+        if (is_horizontal_space(c))
+        {
+            has_space = true;
+            pos++;
+            continue;
+        }
+        if (source.substr(pos).starts_with("//"))
+        {
+            pos = std::min(source.find('\n', pos), source.size());
+            has_space = true;
+            continue;
+        }
+        if (source.substr(pos).starts_with("/*"))
+        {
+            auto end = source.find("*/", pos + 2);
+            if (end == std::string_view::npos)
+            {
+                return error(line, "Unterminated comment");
+            }
+            // The comment is a single space, its newlines don't end the line
+            for (auto i = pos; i < end; i++)
+            {
+                if (source[i] == '\n')
+                {
+                    line++;
+                    line_begin = i + 1;
+                }
+            }
+            pos = end + 2;
+            has_space = true;
+            continue;
+        }
+
+        auto start = pos;
+        auto type = pp_token_type::other;
+        if (is_identifier_start(c))
+        {
+            type = pp_token_type::identifier;
+            while (pos < source.size() && is_identifier_char(source[pos]))
+            {
+                pos++;
+            }
+            // L'\0' or u8"text" is a single literal
+            if (pos < source.size() && (source[pos] == '\'' || source[pos] == '"') &&
+                is_encoding_prefix(source.substr(start, pos - start)))
+            {
+                if (auto end = literal_end(source, pos); end.has_value())
+                {
+                    type = source[pos] == '"' ? pp_token_type::string : pp_token_type::character;
+                    pos = end.value();
+                }
+            }
+        }
+        else if (is_digit(c) || (c == '.' && pos + 1 < source.size() && is_digit(source[pos + 1])))
+        {
+            type = pp_token_type::number;
+            pos++;
+            while (pos < source.size())
+            {
+                auto n = source[pos];
+                auto is_exponent = n == 'e' || n == 'E' || n == 'p' || n == 'P';
+                if (is_exponent && pos + 1 < source.size() && (source[pos + 1] == '+' || source[pos + 1] == '-'))
+                {
+                    pos += 2;
+                }
+                else if (is_identifier_char(n) || n == '.')
+                {
+                    pos++;
+                }
+                else
+                {
+                    break;
+                }
+            }
+        }
+        else if (c == '\'' || c == '"')
+        {
+            // An unterminated quote is a single character token, it may be in a group that is skipped, like an
+            // apostrophe inside #if 0. The lexer reports it otherwise.
+            if (auto end = literal_end(source, pos); end.has_value())
+            {
+                type = c == '"' ? pp_token_type::string : pp_token_type::character;
+                pos = end.value();
+            }
+            else
+            {
+                pos++;
+            }
+        }
+        else if (auto length = punctuator_length(source.substr(pos)); length != 0)
+        {
+            type = pp_token_type::punctuator;
+            pos += length;
+        }
+        else
+        {
+            pos++;
+        }
+
+        auto column = static_cast<int32_t>(start - line_begin);
+        tokens.push_back(
+          { type, source.substr(start, pos - start), at_line_start, has_space, line, file, {}, column, false });
+        at_line_start = false;
+        has_space = false;
+    }
+    tokens.push_back({ pp_token_type::end_of_file, {}, true, false, line, file, {}, 0, false });
+    return tokens;
+}
+
+} // namespace wccff::preprocessor
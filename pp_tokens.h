@@ -0,0 +1,84 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PP_TOKENS_H
+#define PP_TOKENS_H
+
+#include "symbol.h"
+#include <cstdint>
+#include <deque>
+#include <expected>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace wccff::preprocessor {
+
+struct preprocessor_error
+{
+    std::string message;
+};
+
+enum class pp_token_type : uint8_t
+{
+    identifier,
+    number,
+    character,
+    string,
+    punctuator,
+    other,
+    end_of_file,
+};
+
+struct pp_token
+{
+    pp_token_type type{ pp_token_type::other };
+    std::string_view text;
+    bool at_line_start{ false };
+    bool has_space{ false };
+    int32_t line{ 0 };
+    uint32_t file{ 0 };
+    /**
+     * Sorted names of the macros that can't be expanded by this token anymore.
+     */
+    std::vector<symbol> hideset;
+    /**
+     * Column of the token in its line, starting at 0, or -1 when it doesn't come from the source.
+     */
+    int32_t column{ -1 };
+    /**
+     * Set for the tokens produced by a macro expansion.
+     */
+    bool expanded{ false };
+};
+
+/**
+ * Splits a source into preprocessing tokens, the translation phases 1 to 3.
+ * Line splices are removed, and the comments become white space.
+ * The text of the tokens references source, or a copy added to storage when the source has line splices.
+ * The last token is always an end_of_file token.
+ */
+std::expected<std::vector<pp_token>, preprocessor_error> tokenize(std::string_view source,
+                                                                  uint32_t file,
+                                                                  std::string_view file_name,
+                                                                  std::deque<std::string> &storage);
+
+} // namespace wccff::preprocessor
+
+#endif // PP_TOKENS_H
@@ -0,0 +1,1602 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "preprocessor.h"
+#include "header_cache.h"
+#include "integer_literal.h"
+#include "trace.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fmt/format.h>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace wccff::preprocessor {
+
+// Stops a header that includes itself without an include guard
+constexpr std::size_t max_include_depth = 200;
+
+struct macro
+{
+    std::vector<std::string_view> parameters;
+    std::vector<pp_token> body;
+    bool function_like{ false };
+    bool variadic{ false };
+};
+
+struct conditional
+{
+    bool taken{ false };
+    bool in_else{ false };
+};
+
+struct found_include
+{
+    std::filesystem::path path;
+    // Position in the include directories, nothing when the header wasn't found in them
+    std::optional<std::size_t> directory;
+};
+
+struct string_hash
+{
+    using is_transparent = void;
+    std::size_t operator()(std::string_view text) const noexcept { return std::hash<std::string_view>{}(text); }
+};
+
+using result = std::expected<void, preprocessor_error>;
+
+static bool is_punctuator(const pp_token &t, std::string_view text)
+{
+    return t.type == pp_token_type::punctuator && t.text == text;
+}
+
+static pp_token pop(std::vector<pp_token> &stack)
+{
+    auto t = std::move(stack.back());
+    stack.pop_back();
+    return t;
+}
+
+/**
+ * Pushes tokens into a stack of tokens, so the first one is the next to be popped.
+ */
+static void push_front(std::vector<pp_token> &stack, std::vector<pp_token> tokens)
+{
+    stack.insert(stack.end(), std::make_move_iterator(tokens.rbegin()), std::make_move_iterator(tokens.rend()));
+}
+
+static std::vector<symbol> hideset_union(const std::vector<symbol> &a, const std::vector<symbol> &b)
+{
+    std::vector<symbol> result;
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+    return result;
+}
+
+static std::vector<symbol> hideset_intersection(const std::vector<symbol> &a, const std::vector<symbol> &b)
+{
+    std::vector<symbol> result;
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+    return result;
+}
+
+/**
+ * Value of a character constant, the multi-char ones are combined like gcc does.
+ */
+static std::optional<int64_t> character_value(std::string_view text)
+{
+    auto chars = text.substr(1, text.size() - 2);
+    if (chars.empty())
+    {
+        return std::nullopt;
+    }
+    int64_t value = 0;
+    while (chars.empty() == false)
+    {
+        int64_t c = static_cast<unsigned char>(chars.front());
+        chars.remove_prefix(1);
+        if (c == '\\' && chars.empty() == false)
+        {
+            c = static_cast<unsigned char>(chars.front());
+            chars.remove_prefix(1);
+            switch (c)
+            {
+                case 'n':
+                    c = '\n';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                case 'r':
+                    c = '\r';
+                    break;
+                case 'a':
+                    c = '\a';
+                    break;
+                case 'b':
+                    c = '\b';
+                    break;
+                case 'f':
+                    c = '\f';
+                    break;
+                case 'v':
+                    c = '\v';
+                    break;
+                case 'x':
+                    c = 0;
+                    while (chars.empty() == false && std::isxdigit(static_cast<unsigned char>(chars.front())))
+                    {
+                        auto digit = chars.front();
+                        c = c * 16 + (std::isdigit(static_cast<unsigned char>(digit)) ? digit - '0'
+                                                                                       : (digit | 0x20) - 'a' + 10);
+                        chars.remove_prefix(1);
+                    }
+                    break;
+                default:
+                    if (c >= '0' && c <= '7')
+                    {
+                        c -= '0';
+                        for (int i = 0; i < 2 && chars.empty() == false && chars.front() >= '0' && chars.front() <= '7';
+                             i++)
+                        {
+                            c = c * 8 + (chars.front() - '0');
+                            chars.remove_prefix(1);
+                        }
+                    }
+                    break;
+            }
+        }
+        value = value * 256 + (c & 0xFF);
+    }
+    return value;
+}
+
+/**
+ * Identifies a file independently of the path used to include it.
+ */
+static std::string file_key(const std::filesystem::path &file)
+{
+    std::error_code ec;
+    auto canonical = std::filesystem::weakly_canonical(file, ec);
+    return ec ? file.string() : canonical.string();
+}
+
+/**
+ * Returns the macro of the include guard, when everything in the file is inside #ifndef MACRO ... #endif or
+ * #if !defined MACRO ... #endif.
+ * Including the file again while that macro is defined doesn't produce anything, so the file doesn't need to be read.
+ */
+static std::optional<std::string_view> include_guard(const std::vector<pp_token> &tokens)
+{
+    // The token after a # is always valid, the last token is the end of file
+    auto directive_name = [&tokens](std::size_t i) -> std::string_view {
+        if (tokens[i].at_line_start && is_punctuator(tokens[i], "#") && tokens[i + 1].at_line_start == false)
+        {
+            return tokens[i + 1].text;
+        }
+        return {};
+    };
+
+    std::size_t i = 2;
+    auto name = directive_name(0);
+    if (name == "if" && is_punctuator(tokens[i], "!") && tokens[i + 1].text == "defined")
+    {
+        i += 2;
+        if (is_punctuator(tokens[i], "(") && i + 2 < tokens.size() && is_punctuator(tokens[i + 2], ")"))
+        {
+            i++;
+        }
+    }
+    else if (name != "ifndef")
+    {
+        return std::nullopt;
+    }
+    if (tokens[i].type != pp_token_type::identifier || tokens[i].at_line_start)
+    {
+        return std::nullopt;
+    }
+    auto guard = tokens[i].text;
+
+    int depth = 1;
+    for (i++; tokens[i].type != pp_token_type::end_of_file; i++)
+    {
+        name = directive_name(i);
+        if (name == "if" || name == "ifdef" || name == "ifndef")
+        {
+            depth++;
+        }
+        else if ((name == "elif" || name == "else") && depth == 1)
+        {
+            return std::nullopt;
+        }
+        else if (name == "endif" && --depth == 0)
+        {
+            // Nothing but the end of the line can follow the last #endif
+            for (i++; tokens[i].at_line_start == false; i++)
+            {
+            }
+            return tokens[i].type == pp_token_type::end_of_file ? std::optional{ guard } : std::nullopt;
+        }
+    }
+    return std::nullopt;
+}
+
+/**
+ * Value of a #if expression, which has the type intmax_t or uintmax_t (C11 6.10.1p4).
+ */
+struct pp_value
+{
+    uint64_t bits{ 0 };
+    bool is_unsigned{ false };
+
+    int64_t as_signed() const { return static_cast<int64_t>(bits); }
+};
+
+/**
+ * Precedence of the binary operators allowed in #if, 0 for everything else.
+ */
+static int precedence(const pp_token &t)
+{
+    if (t.type != pp_token_type::punctuator)
+    {
+        return 0;
+    }
+    constexpr std::array<std::pair<std::string_view, int>, 19> operators{ {
+      { "?", 1 },  { "||", 2 }, { "&&", 3 }, { "|", 4 },  { "^", 5 },  { "&", 6 },  { "==", 7 },
+      { "!=", 7 }, { "<", 8 },  { ">", 8 },  { "<=", 8 }, { ">=", 8 }, { "<<", 9 }, { ">>", 9 },
+      { "+", 10 }, { "-", 10 }, { "*", 11 }, { "/", 11 }, { "%", 11 },
+    } };
+    for (const auto &[text, value] : operators)
+    {
+        if (t.text == text)
+        {
+            return value;
+        }
+    }
+    return 0;
+}
+
+class preprocessor
+{
+  public:
+    explicit preprocessor(const options &options)
+      : m_options(options)
+    {
+        if (options.header_cache_directory.has_value())
+        {
+            m_cache.emplace(options.header_cache_directory.value());
+        }
+    }
+
+    std::expected<std::string, preprocessor_error> run(std::string_view source, const std::filesystem::path &file_name);
+
+  private:
+    preprocessor_error error_at(const pp_token &t, std::string_view message) const
+    {
+        return { fmt::format("{}:{}: Error: {}", m_files[t.file].string(), t.line, message) };
+    }
+
+    result push_file(std::string_view source, const std::filesystem::path &file_name);
+    void enter_file(std::vector<pp_token> tokens);
+    std::expected<std::vector<pp_token>, preprocessor_error> read_header(const std::filesystem::path &header,
+                                                                         const pp_token &directive);
+    std::vector<pp_token> read_line();
+    void emit(const pp_token &t);
+
+    result directive();
+    result define(std::span<const pp_token> tokens, const pp_token &directive);
+    result define_from_option(std::string_view definition);
+    result include(std::span<const pp_token> tokens, const pp_token &directive);
+    std::optional<found_include> find_include(const std::filesystem::path &name, bool quoted, uint32_t from, bool next);
+    result enter_conditional(bool value);
+    result skip_group();
+    bool in_conditional() const { return m_conditionals.size() > m_file_conditionals.back(); }
+
+    std::expected<bool, preprocessor_error> evaluate(std::span<const pp_token> tokens, const pp_token &directive);
+    std::expected<pp_value, preprocessor_error> evaluate_unary(std::span<const pp_token> tokens,
+                                                               std::size_t &pos,
+                                                               bool evaluated,
+                                                               const pp_token &directive);
+    std::expected<pp_value, preprocessor_error> evaluate_binary(std::span<const pp_token> tokens,
+                                                                std::size_t &pos,
+                                                                int min_precedence,
+                                                                bool evaluated,
+                                                                const pp_token &directive);
+
+    std::expected<bool, preprocessor_error> expand_macro(const pp_token &t, std::vector<pp_token> &stack);
+    std::expected<std::vector<pp_token>, preprocessor_error> expand_tokens(std::vector<pp_token> tokens);
+    std::expected<std::vector<std::vector<pp_token>>, preprocessor_error> read_arguments(const macro &m,
+                                                                                         const pp_token &invocation,
+                                                                                         std::vector<pp_token> &stack,
+                                                                                         pp_token &close);
+    std::expected<std::vector<pp_token>, preprocessor_error> substitute(
+      const macro &m,
+      const std::vector<std::vector<pp_token>> &arguments);
+    pp_token stringify(const std::vector<pp_token> &argument, const pp_token &hash);
+    std::expected<pp_token, preprocessor_error> paste(const pp_token &lhs, const pp_token &rhs);
+    const pp_token &stored_token(pp_token_type type, std::string text, const pp_token &position);
+
+    const options &m_options;
+    std::optional<header_cache> m_cache;
+    std::deque<lexer::source_buffer> m_buffers;
+    std::deque<std::string> m_storage;
+    std::deque<pp_token> m_stored_tokens;
+    std::vector<std::filesystem::path> m_files;
+    // Index of the include directory where each header was found, counting the include paths then the system ones
+    std::unordered_map<uint32_t, std::size_t> m_found_in;
+    std::unordered_map<std::string, macro, string_hash, std::equal_to<>> m_macros;
+    // The names of the macros in the hidesets, they aren't used after the preprocessing
+    symbol_interner m_macro_names;
+    // The files with #pragma once, and the include guards of the other headers, by file_key
+    std::unordered_set<std::string, string_hash, std::equal_to<>> m_once;
+    std::unordered_map<std::string, std::string, string_hash, std::equal_to<>> m_guards;
+    // The tokens still to process, the next one is at the back
+    std::vector<pp_token> m_pending;
+    std::vector<conditional> m_conditionals;
+    // Size of m_conditionals when each of the open files started
+    std::vector<std::size_t> m_file_conditionals;
+    std::string m_output;
+    uint32_t m_output_file{ 0 };
+    int32_t m_output_line{ 1 };
+    int32_t m_output_column{ 0 };
+    // Column where the previous token ended in the source, -1 when it came from a macro expansion
+    int32_t m_previous_end{ -1 };
+};
+
+std::expected<std::string, preprocessor_error> preprocessor::run(std::string_view source,
+                                                                 const std::filesystem::path &file_name)
+{
+    m_files.emplace_back("<command line>");
+    // The generated code is always x86-64, so the system headers need to see that target
+    for (std::string_view definition :
+         { "__STDC__=1", "__STDC_VERSION__=201710L", "__STDC_HOSTED__=1", "__x86_64__=1" })
+    {
+        if (auto r = define_from_option(definition); r.has_value() == false)
+        {
+            return std::unexpected(r.error());
+        }
+    }
+    for (const auto &definition : m_options.defines)
+    {
+        if (auto r = define_from_option(definition); r.has_value() == false)
+        {
+            return std::unexpected(r.error());
+        }
+    }
+
+    m_output_file = static_cast<uint32_t>(m_files.size());
+    if (auto r = push_file(source, file_name); r.has_value() == false)
+    {
+        return std::unexpected(r.error());
+    }
+
+    while (m_pending.empty() == false)
+    {
+        auto t = pop(m_pending);
+        if (t.type == pp_token_type::end_of_file)
+        {
+            if (in_conditional())
+            {
+                return std::unexpected(error_at(t, "Unterminated conditional directive"));
+            }
+            m_file_conditionals.pop_back();
+            continue;
+        }
+        if (t.at_line_start && is_punctuator(t, "#"))
+        {
+            if (auto r = directive(); r.has_value() == false)
+            {
+                return std::unexpected(r.error());
+            }
+            continue;
+        }
+        auto expanded = expand_macro(t, m_pending);
+        if (expanded.has_value() == false)
+        {
+            return std::unexpected(expanded.error());
+        }
+        if (expanded.value() == false)
+        {
+            emit(t);
+        }
+    }
+    m_output.push_back('\n');
+    return std::move(m_output);
+}
+
+result preprocessor::push_file(std::string_view source, const std::filesystem::path &file_name)
+{
+    auto index = static_cast<uint32_t>(m_files.size());
+    m_files.push_back(file_name);
+    auto tokens = tokenize(source, index, file_name.string(), m_storage);
+    if (tokens.has_value() == false)
+    {
+        return std::unexpected(tokens.error());
+    }
+    enter_file(std::move(tokens.value()));
+    return {};
+}
+
+void preprocessor::enter_file(std::vector<pp_token> tokens)
+{
+    m_file_conditionals.push_back(m_conditionals.size());
+    push_front(m_pending, std::move(tokens));
+}
+
+/**
+ * Returns the tokens of a header, from the header cache when it's enabled and has them.
+ */
+std::expected<std::vector<pp_token>, preprocessor_error> preprocessor::read_header(const std::filesystem::path &header,
+                                                                                   const pp_token &directive)
+{
+    auto index = static_cast<uint32_t>(m_files.size());
+    m_files.push_back(header);
+    // The entries are found by the canonical path, the same relative path can be a different header in another run
+    std::filesystem::path cache_key{ file_key(header) };
+    if (m_cache.has_value())
+    {
+        if (auto cached = m_cache->load(cache_key, index); cached.has_value())
+        {
+            m_buffers.emplace_back(std::move(cached->buffer));
+            return std::move(cached->tokens);
+        }
+    }
+
+    auto buffer = lexer::source_buffer::open(header);
+    if (buffer.has_value() == false)
+    {
+        return std::unexpected(error_at(directive, fmt::format("{}: {}", header.string(), buffer.error().message())));
+    }
+    const auto &stored = m_buffers.emplace_back(std::move(buffer.value()));
+    auto tokens = tokenize(stored.view(), index, header.string(), m_storage);
+    if (tokens.has_value() && m_cache.has_value())
+    {
+        m_cache->store(cache_key, tokens.value());
+    }
+    return tokens;
+}
+
+/**
+ * Pops the tokens until the end of the current line.
+ */
+std::vector<pp_token> preprocessor::read_line()
+{
+    std::vector<pp_token> line;
+    while (m_pending.empty() == false && m_pending.back().at_line_start == false)
+    {
+        line.push_back(pop(m_pending));
+    }
+    return line;
+}
+
+/**
+ * Writes a token to the output.
+ * The newlines of the source are kept while the tokens come from the same file, and the tokens are padded to their
+ * column, so the locations reported by the lexer still match the source until a macro expansion makes a line longer.
+ * Only tokens that were next to each other in the source are written without white space between them, so two
+ * tokens are never merged by the lexer.
+ */
+void preprocessor::emit(const pp_token &t)
+{
+    auto new_line = m_output.empty();
+    if (t.file != m_output_file || t.line < m_output_line)
+    {
+        m_output.push_back('\n');
+        new_line = true;
+    }
+    else if (t.line > m_output_line)
+    {
+        m_output.append(static_cast<std::size_t>(t.line - m_output_line), '\n');
+        new_line = true;
+    }
+    if (new_line)
+    {
+        m_output_column = 0;
+    }
+
+    if (t.column > m_output_column)
+    {
+        m_output.append(static_cast<std::size_t>(t.column - m_output_column), ' ');
+        m_output_column = t.column;
+    }
+    else if (new_line == false && (t.expanded || t.column != m_previous_end))
+    {
+        m_output.push_back(' ');
+        m_output_column++;
+    }
+    m_output_file = t.file;
+    m_output_line = t.line;
+    m_output_column += static_cast<int32_t>(t.text.size());
+    m_previous_end = t.expanded ? -1 : t.column + static_cast<int32_t>(t.text.size());
+    m_output.append(t.text);
+}
+
+result preprocessor::directive()
+{
+    auto line = read_line();
+    if (line.empty())
+    {
+        return {};
+    }
+    const auto &name = line.front();
+    auto arguments = std::span<const pp_token>{ line }.subspan(1);
+    WCCFF_TRACE(preprocessor, debug, "{}:{}: #{}", m_files[name.file].string(), name.line, name.text);
+
+    if (name.text == "define")
+    {
+        return define(arguments, name);
+    }
+    if (name.text == "undef")
+    {
+        if (arguments.empty() || arguments.front().type != pp_token_type::identifier)
+        {
+            return std::unexpected(error_at(name, "Macro names must be identifiers"));
+        }
+        m_macros.erase(std::string{ arguments.front().text });
+        return {};
+    }
+    if (name.text == "include" || name.text == "include_next")
+    {
+        return include(arguments, name);
+    }
+    if (name.text == "if")
+    {
+        auto value = evaluate(arguments, name);
+        if (value.has_value() == false)
+        {
+            return std::unexpected(value.error());
+        }
+        return enter_conditional(value.value());
+    }
+    if (name.text == "ifdef" || name.text == "ifndef")
+    {
+        if (arguments.empty() || arguments.front().type != pp_token_type::identifier)
+        {
+            return std::unexpected(error_at(name, "Macro names must be identifiers"));
+        }
+        return enter_conditional(m_macros.contains(arguments.front().text) == (name.text == "ifdef"));
+    }
+    if (name.text == "elif")
+    {
+        if (in_conditional() == false)
+        {
+            return std::unexpected(error_at(name, "#elif without #if"));
+        }
+        if (m_conditionals.back().in_else)
+        {
+            return std::unexpected(error_at(name, "#elif after #else"));
+        }
+        if (m_conditionals.back().taken)
+        {
+            return skip_group();
+        }
+        auto value = evaluate(arguments, name);
+        if (value.has_value() == false)
+        {
+            return std::unexpected(value.error());
+        }
+        m_conditionals.back().taken = value.value();
+        return value.value() ? result{} : skip_group();
+    }
+    if (name.text == "else")
+    {
+        if (in_conditional() == false)
+        {
+            return std::unexpected(error_at(name, "#else without #if"));
+        }
+        if (m_conditionals.back().in_else)
+        {
+            return std::unexpected(error_at(name, "#else after #else"));
+        }
+        m_conditionals.back().in_else = true;
+        if (m_conditionals.back().taken)
+        {
+            return skip_group();
+        }
+        m_conditionals.back().taken = true;
+        return {};
+    }
+    if (name.text == "endif")
+    {
+        if (in_conditional() == false)
+        {
+            return std::unexpected(error_at(name, "#endif without #if"));
+        }
+        m_conditionals.pop_back();
+        return {};
+    }
+    if (name.text == "error" || name.text == "warning")
+    {
+        std::string message;
+        for (const auto &t : arguments)
+        {
+            message += message.empty() ? "" : " ";
+            message += t.text;
+        }
+        if (name.text == "error")
+        {
+            return std::unexpected(error_at(name, fmt::format("#error {}", message)));
+        }
+        fmt::print(stderr, "{}:{}: Warning: #warning {}\n", m_files[name.file].string(), name.line, message);
+        return {};
+    }
+    if (name.text == "pragma")
+    {
+        if (arguments.empty() == false && arguments.front().text == "once")
+        {
+            m_once.insert(file_key(m_files[name.file]));
+        }
+        return {};
+    }
+    if (name.text == "line")
+    {
+        return {};
+    }
+    return std::unexpected(error_at(name, fmt::format("Invalid preprocessing directive #{}", name.text)));
+}
+
+result preprocessor::define(std::span<const pp_token> tokens, const pp_token &directive)
+{
+    if (tokens.empty() || tokens.front().type != pp_token_type::identifier)
+    {
+        return std::unexpected(error_at(directive, "Macro names must be identifiers"));
+    }
+    const auto &name = tokens.front();
+    if (name.text == "defined")
+    {
+        return std::unexpected(error_at(name, "\"defined\" cannot be used as a macro name"));
+    }
+
+    macro m;
+    std::size_t i = 1;
+    // The parameters need to follow the name without white space, otherwise they are part of the body
+    if (i < tokens.size() && is_punctuator(tokens[i], "(") && tokens[i].has_space == false)
+    {
+        m.function_like = true;
+        i++;
+        while (true)
+        {
+            if (i < tokens.size() && is_punctuator(tokens[i], ")") && m.parameters.empty())
+            {
+                i++;
+                break;
+            }
+            if (i < tokens.size() && is_punctuator(tokens[i], "..."))
+            {
+                m.variadic = true;
+                m.parameters.emplace_back("__VA_ARGS__");
+                i++;
+            }
+            else if (i < tokens.size() && tokens[i].type == pp_token_type::identifier)
+            {
+                m.parameters.push_back(tokens[i].text);
+                i++;
+            }
+            else
+            {
+                return std::unexpected(error_at(name, "Invalid macro parameter list"));
+            }
+
+            if (i < tokens.size() && is_punctuator(tokens[i], ")"))
+            {
+                i++;
+                break;
+            }
+            if (i >= tokens.size() || is_punctuator(tokens[i], ",") == false || m.variadic)
+            {
+                return std::unexpected(error_at(name, "Expected ',' or ')' in the macro parameter list"));
+            }
+            i++;
+        }
+    }
+
+    m.body.assign(tokens.begin() + static_cast<std::ptrdiff_t>(i), tokens.end());
+    if (m.body.empty() == false)
+    {
+        m.body.front().has_space = false;
+        if (is_punctuator(m.body.front(), "##") || is_punctuator(m.body.back(), "##"))
+        {
+            return std::unexpected(error_at(name, "'##' cannot appear at either end of a macro expansion"));
+        }
+    }
+    WCCFF_TRACE(preprocessor, verbose, "Defined {}", name.text);
+    m_macros.insert_or_assign(std::string{ name.text }, std::move(m));
+    return {};
+}
+
+/**
+ * Defines a macro given as NAME or NAME=VALUE.
+ */
+result preprocessor::define_from_option(std::string_view definition)
+{
+    std::string source{ definition };
+    if (auto equal = source.find('='); equal != std::string::npos)
+    {
+        source[equal] = ' ';
+    }
+    else
+    {
+        source += " 1";
+    }
+    const auto &stored = m_storage.emplace_back(std::move(source));
+    auto tokens = tokenize(stored, 0, m_files.front().string(), m_storage);
+    if (tokens.has_value() == false)
+    {
+        return std::unexpected(tokens.error());
+    }
+    // The value needs to be separated from the name, so NAME=(1) doesn't become a function-like macro
+    tokens->pop_back();
+    if (tokens->size() > 1)
+    {
+        (*tokens)[1].has_space = true;
+    }
+    return define(tokens.value(), tokens->front());
+}
+
+result preprocessor::include(std::span<const pp_token> tokens, const pp_token &directive)
+{
+    // The name can also come from a macro
+    std::vector<pp_token> expanded;
+    if (tokens.empty() == false && tokens.front().type != pp_token_type::string &&
+        is_punctuator(tokens.front(), "<") == false)
+    {
+        auto e = expand_tokens({ tokens.begin(), tokens.end() });
+        if (e.has_value() == false)
+        {
+            return std::unexpected(e.error());
+        }
+        expanded = std::move(e.value());
+        tokens = expanded;
+    }
+
+    std::string name;
+    bool quoted = false;
+    if (tokens.empty() == false && tokens.front().type == pp_token_type::string)
+    {
+        name = tokens.front().text.substr(1, tokens.front().text.size() - 2);
+        quoted = true;
+    }
+    else if (tokens.empty() == false && is_punctuator(tokens.front(), "<"))
+    {
+        std::size_t i = 1;
+        for (; i < tokens.size() && is_punctuator(tokens[i], ">") == false; i++)
+        {
+            name += i > 1 && tokens[i].has_space ? " " : "";
+            name += tokens[i].text;
+        }
+        if (i == tokens.size())
+        {
+            return std::unexpected(error_at(directive, "Missing terminating > character"));
+        }
+    }
+    else
+    {
+        return std::unexpected(error_at(directive, "#include expects \"FILENAME\" or <FILENAME>"));
+    }
+
+    if (m_file_conditionals.size() >= max_include_depth)
+    {
+        return std::unexpected(error_at(directive, "#include nested too deeply"));
+    }
+    auto found = find_include(name, quoted, directive.file, directive.text == "include_next");
+    if (found.has_value() == false)
+    {
+        return std::unexpected(error_at(directive, fmt::format("{}: No such file or directory", name)));
+    }
+    const auto &path = found->path;
+    auto key = file_key(path);
+    if (m_once.contains(key))
+    {
+        WCCFF_TRACE(preprocessor, debug, "Skipping {}, it has #pragma once", path.string());
+        return {};
+    }
+    if (auto guard = m_guards.find(key); guard != m_guards.end() && m_macros.contains(guard->second))
+    {
+        WCCFF_TRACE(preprocessor, debug, "Skipping {}, {} is defined", path.string(), guard->second);
+        return {};
+    }
+
+    WCCFF_TRACE(preprocessor, info, "Including {}", path.string());
+    auto header = read_header(path, directive);
+    if (header.has_value() == false)
+    {
+        return std::unexpected(header.error());
+    }
+    if (found->directory.has_value())
+    {
+        m_found_in.insert_or_assign(static_cast<uint32_t>(m_files.size() - 1), found->directory.value());
+    }
+    if (auto guard = include_guard(header.value()); guard.has_value())
+    {
+        m_guards.insert_or_assign(std::move(key), std::string{ guard.value() });
+    }
+    enter_file(std::move(header.value()));
+    return {};
+}
+
+/**
+ * Asks gcc where its builtin headers are, it prints the name back unchanged when it doesn't know.
+ * gcc only runs the first time a header isn't found in the include paths, most sources never need it.
+ */
+static const std::optional<std::filesystem::path> &gcc_include_path()
+{
+    static const auto path = []() -> std::optional<std::filesystem::path> {
+        WCCFF_TRACE(preprocessor, debug, "Asking gcc for its builtin headers");
+        auto *pipe = popen("gcc -print-file-name=include 2>/dev/null", "r");
+        if (pipe == nullptr)
+        {
+            return std::nullopt;
+        }
+        std::string output;
+        std::array<char, 256> chunk{};
+        while (std::fgets(chunk.data(), static_cast<int>(chunk.size()), pipe) != nullptr)
+        {
+            output += chunk.data();
+        }
+        pclose(pipe);
+        while (output.empty() == false && std::isspace(static_cast<unsigned char>(output.back())) != 0)
+        {
+            output.pop_back();
+        }
+        std::filesystem::path result{ output };
+        std::error_code error;
+        if (result.is_absolute() == false || std::filesystem::is_directory(result, error) == false)
+        {
+            return std::nullopt;
+        }
+        return result;
+    }();
+    return path;
+}
+
+/**
+ * The quoted includes are first searched next to the file including them.
+ * #include_next searches the include directories after the one where the including file was found, like gcc, so a
+ * header can wrap the header with the same name in a later directory.
+ */
+std::optional<found_include> preprocessor::find_include(const std::filesystem::path &name,
+                                                        bool quoted,
+                                                        uint32_t from,
+                                                        bool next)
+{
+    std::error_code ec;
+    if (name.is_absolute())
+    {
+        return std::filesystem::is_regular_file(name, ec) ? std::optional{ found_include{ name, std::nullopt } }
+                                                          : std::nullopt;
+    }
+    auto after = next ? m_found_in.find(from) : m_found_in.end();
+    if (quoted && after == m_found_in.end())
+    {
+        auto candidate = m_files[from].parent_path() / name;
+        if (std::filesystem::is_regular_file(candidate, ec))
+        {
+            return found_include{ std::move(candidate), std::nullopt };
+        }
+    }
+    std::size_t index = 0;
+    for (const auto *paths : { &m_options.include_paths, &m_options.system_include_paths })
+    {
+        for (const auto &directory : *paths)
+        {
+            if (after != m_found_in.end() && index <= after->second)
+            {
+                index++;
+                continue;
+            }
+            auto candidate = directory / name;
+            if (std::filesystem::is_regular_file(candidate, ec))
+            {
+                return found_include{ std::move(candidate), index };
+            }
+            index++;
+        }
+    }
+    // The builtin headers of gcc come last, after all the include directories
+    if (after == m_found_in.end() || after->second < index)
+    {
+        if (const auto &gcc = gcc_include_path(); gcc.has_value())
+        {
+            auto candidate = gcc.value() / name;
+            if (std::filesystem::is_regular_file(candidate, ec))
+            {
+                return found_include{ std::move(candidate), index };
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+result preprocessor::enter_conditional(bool value)
+{
+    m_conditionals.push_back({ value, false });
+    return value ? result{} : skip_group();
+}
+
+/**
+ * Drops the tokens until the #elif, #else or #endif that ends the current group.
+ * That directive is left to be processed next.
+ */
+result preprocessor::skip_group()
+{
+    int depth = 0;
+    while (m_pending.empty() == false && m_pending.back().type != pp_token_type::end_of_file)
+    {
+        auto t = pop(m_pending);
+        if (t.at_line_start == false || is_punctuator(t, "#") == false || m_pending.back().at_line_start)
+        {
+            continue;
+        }
+        auto name = m_pending.back().text;
+        if (name == "if" || name == "ifdef" || name == "ifndef")
+        {
+            depth++;
+        }
+        else if (name == "elif" || name == "else" || name == "endif")
+        {
+            if (depth == 0)
+            {
+                m_pending.push_back(std::move(t));
+                return {};
+            }
+            depth -= name == "endif" ? 1 : 0;
+        }
+    }
+    // The end of the file reports the missing #endif
+    return {};
+}
+
+std::expected<bool, preprocessor_error> preprocessor::evaluate(std::span<const pp_token> tokens,
+                                                               const pp_token &directive)
+{
+    // defined needs to be replaced before the macros are expanded
+    std::vector<pp_token> replaced;
+    for (std::size_t i = 0; i < tokens.size(); i++)
+    {
+        if (tokens[i].type != pp_token_type::identifier || tokens[i].text != "defined")
+        {
+            replaced.push_back(tokens[i]);
+            continue;
+        }
+        auto j = i + 1;
+        auto parenthesis = j < tokens.size() && is_punctuator(tokens[j], "(");
+        j += parenthesis ? 1 : 0;
+        if (j >= tokens.size() || tokens[j].type != pp_token_type::identifier)
+        {
+            return std::unexpected(error_at(tokens[i], "Macro names must be identifiers"));
+        }
+        auto defined = m_macros.contains(tokens[j].text);
+        if (parenthesis)
+        {
+            j++;
+            if (j >= tokens.size() || is_punctuator(tokens[j], ")") == false)
+            {
+                return std::unexpected(error_at(tokens[i], "Missing ')' after \"defined\""));
+            }
+        }
+        auto value = tokens[i];
+        value.type = pp_token_type::number;
+        value.text = defined ? "1" : "0";
+        replaced.push_back(value);
+        i = j;
+    }
+
+    auto expanded = expand_tokens(std::move(replaced));
+    if (expanded.has_value() == false)
+    {
+        return std::unexpected(expanded.error());
+    }
+    if (expanded->empty())
+    {
+        return std::unexpected(error_at(directive, fmt::format("#{} with no expression", directive.text)));
+    }
+    std::size_t pos = 0;
+    auto value = evaluate_binary(expanded.value(), pos, 1, true, directive);
+    if (value.has_value() == false)
+    {
+        return std::unexpected(value.error());
+    }
+    if (pos != expanded->size())
+    {
+        return std::unexpected(
+          error_at(directive, fmt::format("Missing binary operator before token \"{}\"", (*expanded)[pos].text)));
+    }
+    return value->bits != 0;
+}
+
+std::expected<pp_value, preprocessor_error> preprocessor::evaluate_unary(std::span<const pp_token> tokens,
+                                                                         std::size_t &pos,
+                                                                         bool evaluated,
+                                                                         const pp_token &directive)
+{
+    if (pos >= tokens.size())
+    {
+        return std::unexpected(error_at(directive, "Expected value in expression"));
+    }
+    const auto &t = tokens[pos++];
+    if (is_punctuator(t, "("))
+    {
+        auto value = evaluate_binary(tokens, pos, 1, evaluated, directive);
+        if (value.has_value() && (pos >= tokens.size() || is_punctuator(tokens[pos++], ")") == false))
+        {
+            return std::unexpected(error_at(directive, "Missing ')' in expression"));
+        }
+        return value;
+    }
+    if (is_punctuator(t, "+") || is_punctuator(t, "-") || is_punctuator(t, "~") || is_punctuator(t, "!"))
+    {
+        auto value = evaluate_unary(tokens, pos, evaluated, directive);
+        if (value.has_value() == false)
+        {
+            return value;
+        }
+        auto [v, is_unsigned] = value.value();
+        switch (t.text.front())
+        {
+            case '-':
+                return pp_value{ 0 - v, is_unsigned };
+            case '~':
+                return pp_value{ ~v, is_unsigned };
+            case '!':
+                return pp_value{ v == 0 ? 1U : 0U, false };
+            default:
+                return value;
+        }
+    }
+    if (t.type == pp_token_type::number)
+    {
+        auto literal = lexer::decode_integer_literal(t.text);
+        if (literal.has_value() == false)
+        {
+            auto message = fmt::format("{} \"{}\"", lexer::to_string(literal.error()), t.text);
+            return std::unexpected(error_at(directive, message));
+        }
+        // The literals too big for intmax_t are unsigned, like those with the u suffix
+        auto suffix = literal->suffix;
+        auto is_unsigned = suffix == lexer::integer_suffix::u || suffix == lexer::integer_suffix::ul ||
+                           suffix == lexer::integer_suffix::ull ||
+                           literal->value > static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+        return pp_value{ literal->value, is_unsigned };
+    }
+    if (t.type == pp_token_type::character)
+    {
+        auto value = character_value(t.text);
+        if (value.has_value() == false)
+        {
+            return std::unexpected(error_at(directive, "Empty character constant"));
+        }
+        return pp_value{ static_cast<uint64_t>(value.value()), false };
+    }
+    // The identifiers left after expanding the macros are 0
+    if (t.type == pp_token_type::identifier)
+    {
+        return pp_value{};
+    }
+    return std::unexpected(
+      error_at(directive, fmt::format("Token \"{}\" is not valid in preprocessor expressions", t.text)));
+}
+
+/**
+ * Evaluates the operators with, at least, min_precedence, by precedence climbing.
+ * Nothing is reported for the operands that aren't evaluated, like the right side of 0 && (1 / 0).
+ */
+std::expected<pp_value, preprocessor_error> preprocessor::evaluate_binary(std::span<const pp_token> tokens,
+                                                                          std::size_t &pos,
+                                                                          int min_precedence,
+                                                                          bool evaluated,
+                                                                          const pp_token &directive)
+{
+    auto left = evaluate_unary(tokens, pos, evaluated, directive);
+    while (left.has_value() && pos < tokens.size())
+    {
+        const auto &op = tokens[pos];
+        auto op_precedence = precedence(op);
+        if (op_precedence == 0 || op_precedence < min_precedence)
+        {
+            break;
+        }
+        pos++;
+        auto l = left.value();
+
+        if (op.text == "?")
+        {
+            auto middle = evaluate_binary(tokens, pos, 1, evaluated && l.bits != 0, directive);
+            if (middle.has_value() == false)
+            {
+                return middle;
+            }
+            if (pos >= tokens.size() || is_punctuator(tokens[pos++], ":") == false)
+            {
+                return std::unexpected(error_at(directive, "Expected ':' in expression"));
+            }
+            // The conditional operator is right associative
+            auto right = evaluate_binary(tokens, pos, op_precedence, evaluated && l.bits == 0, directive);
+            if (right.has_value() == false)
+            {
+                return right;
+            }
+            // The second and third operands are converted to their common type
+            left = pp_value{ l.bits != 0 ? middle->bits : right->bits, middle->is_unsigned || right->is_unsigned };
+            continue;
+        }
+
+        auto evaluate_right = evaluated;
+        if (op.text == "&&")
+        {
+            evaluate_right = evaluated && l.bits != 0;
+        }
+        else if (op.text == "||")
+        {
+            evaluate_right = evaluated && l.bits == 0;
+        }
+        auto right = evaluate_binary(tokens, pos, op_precedence + 1, evaluate_right, directive);
+        if (right.has_value() == false)
+        {
+            return right;
+        }
+        auto r = right.value();
+
+        // The usual arithmetic conversions make both operands unsigned if either of them is, the shifts keep the
+        // type of the left operand and the comparisons give a signed 0 or 1
+        auto is_unsigned = l.is_unsigned || r.is_unsigned;
+        auto less = is_unsigned ? l.bits < r.bits : l.as_signed() < r.as_signed();
+        auto greater = is_unsigned ? l.bits > r.bits : l.as_signed() > r.as_signed();
+        // The arithmetic wraps around, instead of being undefined
+        if (op.text == "/" || op.text == "%")
+        {
+            uint64_t value = 0;
+            if (r.bits == 0)
+            {
+                if (evaluated)
+                {
+                    return std::unexpected(error_at(directive, "Division by zero in preprocessor expression"));
+                }
+            }
+            else if (is_unsigned)
+            {
+                value = op.text == "/" ? l.bits / r.bits : l.bits % r.bits;
+            }
+            else if (r.as_signed() == -1)
+            {
+                value = op.text == "/" ? 0 - l.bits : 0;
+            }
+            else
+            {
+                auto quotient = op.text == "/" ? l.as_signed() / r.as_signed() : l.as_signed() % r.as_signed();
+                value = static_cast<uint64_t>(quotient);
+            }
+            left = pp_value{ value, is_unsigned };
+        }
+        else if (op.text == "*")
+        {
+            left = pp_value{ l.bits * r.bits, is_unsigned };
+        }
+        else if (op.text == "+")
+        {
+            left = pp_value{ l.bits + r.bits, is_unsigned };
+        }
+        else if (op.text == "-")
+        {
+            left = pp_value{ l.bits - r.bits, is_unsigned };
+        }
+        else if (op.text == "<<")
+        {
+            left = pp_value{ l.bits << (r.bits & 63), l.is_unsigned };
+        }
+        else if (op.text == ">>")
+        {
+            auto shift = r.bits & 63;
+            auto value = l.is_unsigned ? l.bits >> shift : static_cast<uint64_t>(l.as_signed() >> shift);
+            left = pp_value{ value, l.is_unsigned };
+        }
+        else if (op.text == "<")
+        {
+            left = pp_value{ less ? 1U : 0U, false };
+        }
+        else if (op.text == ">")
+        {
+            left = pp_value{ greater ? 1U : 0U, false };
+        }
+        else if (op.text == "<=")
+        {
+            left = pp_value{ greater ? 0U : 1U, false };
+        }
+        else if (op.text == ">=")
+        {
+            left = pp_value{ less ? 0U : 1U, false };
+        }
+        else if (op.text == "==")
+        {
+            left = pp_value{ l.bits == r.bits ? 1U : 0U, false };
+        }
+        else if (op.text == "!=")
+        {
+            left = pp_value{ l.bits != r.bits ? 1U : 0U, false };
+        }
+        else if (op.text == "&")
+        {
+            left = pp_value{ l.bits & r.bits, is_unsigned };
+        }
+        else if (op.text == "^")
+        {
+            left = pp_value{ l.bits ^ r.bits, is_unsigned };
+        }
+        else if (op.text == "|")
+        {
+            left = pp_value{ l.bits | r.bits, is_unsigned };
+        }
+        else if (op.text == "&&")
+        {
+            left = pp_value{ l.bits != 0 && r.bits != 0 ? 1U : 0U, false };
+        }
+        else if (op.text == "||")
+        {
+            left = pp_value{ l.bits != 0 || r.bits != 0 ? 1U : 0U, false };
+        }
+    }
+    return left;
+}
+
+/**
+ * Expands t when it's a macro, the expansion is pushed into the stack to be rescanned with the tokens after it.
+ * Returns false when t isn't a macro that can be expanded.
+ */
+std::expected<bool, preprocessor_error> preprocessor::expand_macro(const pp_token &t, std::vector<pp_token> &stack)
+{
+    if (t.type != pp_token_type::identifier)
+    {
+        return false;
+    }
+    if (t.text == "__LINE__")
+    {
+        stack.push_back(stored_token(pp_token_type::number, std::to_string(t.line), t));
+        return true;
+    }
+    if (t.text == "__FILE__")
+    {
+        auto name = fmt::format("\"{}\"", m_files[t.file].string());
+        stack.push_back(stored_token(pp_token_type::string, std::move(name), t));
+        return true;
+    }
+
+    auto it = m_macros.find(t.text);
+    if (it == m_macros.end())
+    {
+        return false;
+    }
+    auto name = m_macro_names.intern(t.text);
+    if (std::binary_search(t.hideset.begin(), t.hideset.end(), name))
+    {
+        return false;
+    }
+    const auto &m = it->second;
+
+    std::vector<pp_token> expansion;
+    std::vector<symbol> hideset;
+    if (m.function_like == false)
+    {
+        // No arguments, the body goes through the substitution for its ## operators
+        auto substituted = substitute(m, {});
+        if (substituted.has_value() == false)
+        {
+            return std::unexpected(substituted.error());
+        }
+        expansion = std::move(substituted.value());
+        hideset = hideset_union(t.hideset, { name });
+    }
+    else
+    {
+        // A function-like macro name that isn't followed by arguments isn't expanded
+        if (stack.empty() || is_punctuator(stack.back(), "(") == false)
+        {
+            return false;
+        }
+        stack.pop_back();
+        pp_token close;
+        auto arguments = read_arguments(m, t, stack, close);
+        if (arguments.has_value() == false)
+        {
+            return std::unexpected(arguments.error());
+        }
+        auto substituted = substitute(m, arguments.value());
+        if (substituted.has_value() == false)
+        {
+            return std::unexpected(substituted.error());
+        }
+        expansion = std::move(substituted.value());
+        hideset = hideset_union(hideset_intersection(t.hideset, close.hideset), { name });
+    }
+
+    for (auto &e : expansion)
+    {
+        e.hideset = hideset_union(e.hideset, hideset);
+        e.at_line_start = false;
+        e.line = t.line;
+        e.file = t.file;
+        e.column = -1;
+        e.expanded = true;
+    }
+    if (expansion.empty() == false)
+    {
+        expansion.front().has_space = t.has_space;
+        expansion.front().column = t.column;
+    }
+    push_front(stack, std::move(expansion));
+    return true;
+}
+
+/**
+ * Expands all the macros in tokens, the macros can't take arguments from outside them.
+ */
+std::expected<std::vector<pp_token>, preprocessor_error> preprocessor::expand_tokens(std::vector<pp_token> tokens)
+{
+    std::vector<pp_token> stack;
+    push_front(stack, std::move(tokens));
+    std::vector<pp_token> result;
+    while (stack.empty() == false)
+    {
+        auto t = pop(stack);
+        auto expanded = expand_macro(t, stack);
+        if (expanded.has_value() == false)
+        {
+            return std::unexpected(expanded.error());
+        }
+        if (expanded.value() == false)
+        {
+            result.push_back(std::move(t));
+        }
+    }
+    return result;
+}
+
+/**
+ * Reads the arguments of a function-like macro, the open parenthesis was already consumed.
+ */
+std::expected<std::vector<std::vector<pp_token>>, preprocessor_error> preprocessor::read_arguments(
+  const macro &m,
+  const pp_token &invocation,
+  std::vector<pp_token> &stack,
+  pp_token &close)
+{
+    std::vector<std::vector<pp_token>> arguments(1);
+    int depth = 0;
+    while (true)
+    {
+        if (stack.empty() || stack.back().type == pp_token_type::end_of_file)
+        {
+            return std::unexpected(
+              error_at(invocation, fmt::format("Unterminated argument list invoking macro \"{}\"", invocation.text)));
+        }
+        auto t = pop(stack);
+        if (depth == 0 && is_punctuator(t, ")"))
+        {
+            close = std::move(t);
+            break;
+        }
+        // The commas of the variable arguments are part of __VA_ARGS__
+        if (depth == 0 && is_punctuator(t, ",") && (m.variadic == false || arguments.size() < m.parameters.size()))
+        {
+            arguments.emplace_back();
+            continue;
+        }
+        depth += is_punctuator(t, "(") ? 1 : 0;
+        depth -= is_punctuator(t, ")") ? 1 : 0;
+        t.at_line_start = false;
+        arguments.back().push_back(std::move(t));
+    }
+
+    if (m.parameters.empty() && arguments.size() == 1 && arguments.front().empty())
+    {
+        arguments.clear();
+    }
+    if (m.variadic && arguments.size() + 1 == m.parameters.size())
+    {
+        arguments.emplace_back();
+    }
+    if (arguments.size() != m.parameters.size())
+    {
+        return std::unexpected(error_at(invocation,
+                                        fmt::format("Macro \"{}\" requires {} arguments, but {} given",
+                                                    invocation.text,
+                                                    m.parameters.size(),
+                                                    arguments.size())));
+    }
+    return arguments;
+}
+
+/**
+ * Replaces the parameters in the body of a macro, and applies its ## operators.
+ * The arguments of # and ## are used as written, the other ones are fully expanded first.
+ */
+std::expected<std::vector<pp_token>, preprocessor_error> preprocessor::substitute(
+  const macro &m,
+  const std::vector<std::vector<pp_token>> &arguments)
+{
+    auto parameter = [&m](const pp_token &t) -> std::optional<std::size_t> {
+        if (t.type != pp_token_type::identifier)
+        {
+            return std::nullopt;
+        }
+        auto it = std::find(m.parameters.begin(), m.parameters.end(), t.text);
+        if (it == m.parameters.end())
+        {
+            return std::nullopt;
+        }
+        return static_cast<std::size_t>(std::distance(m.parameters.begin(), it));
+    };
+    auto append = [](std::vector<pp_token> &result, std::vector<pp_token> tokens, bool has_space) {
+        if (tokens.empty() == false)
+        {
+            tokens.front().has_space = has_space;
+        }
+        result.insert(result.end(), std::make_move_iterator(tokens.begin()), std::make_move_iterator(tokens.end()));
+    };
+
+    std::vector<pp_token> result;
+    // Set when the left side of the next ## is an empty argument
+    bool placemarker = false;
+    const auto &body = m.body;
+    for (std::size_t i = 0; i < body.size(); i++)
+    {
+        const auto &t = body[i];
+        if (is_punctuator(t, "#") && i + 1 < body.size() && parameter(body[i + 1]).has_value())
+        {
+            result.push_back(stringify(arguments[parameter(body[i + 1]).value()], t));
+            placemarker = false;
+            i++;
+            continue;
+        }
+        if (is_punctuator(t, "##"))
+        {
+            const auto &next = body[++i];
+            auto index = parameter(next);
+            auto right = index.has_value() ? arguments[index.value()] : std::vector<pp_token>{ next };
+            if (right.empty())
+            {
+                continue;
+            }
+            if (placemarker)
+            {
+                append(result, std::move(right), next.has_space);
+                placemarker = false;
+                continue;
+            }
+            auto pasted = paste(result.back(), right.front());
+            if (pasted.has_value() == false)
+            {
+                return std::unexpected(pasted.error());
+            }
+            result.back() = std::move(pasted.value());
+            result.insert(
+              result.end(), std::make_move_iterator(right.begin() + 1), std::make_move_iterator(right.end()));
+            continue;
+        }
+
+        placemarker = false;
+        auto index = parameter(t);
+        if (index.has_value() == false)
+        {
+            result.push_back(t);
+            continue;
+        }
+        const auto &argument = arguments[index.value()];
+        if (i + 1 < body.size() && is_punctuator(body[i + 1], "##"))
+        {
+            placemarker = argument.empty();
+            append(result, argument, t.has_space);
+            continue;
+        }
+        auto expanded = expand_tokens(argument);
+        if (expanded.has_value() == false)
+        {
+            return std::unexpected(expanded.error());
+        }
+        append(result, std::move(expanded.value()), t.has_space);
+    }
+    return result;
+}
+
+pp_token preprocessor::stringify(const std::vector<pp_token> &argument, const pp_token &hash)
+{
+    std::string text = "\"";
+    for (const auto &t : argument)
+    {
+        if (&t != &argument.front() && t.has_space)
+        {
+            text += ' ';
+        }
+        auto is_literal = t.type == pp_token_type::string || t.type == pp_token_type::character;
+        for (auto c : t.text)
+        {
+            if (is_literal && (c == '"' || c == '\\'))
+            {
+                text += '\\';
+            }
+            text += c;
+        }
+    }
+    text += '"';
+    return stored_token(pp_token_type::string, std::move(text), hash);
+}
+
+std::expected<pp_token, preprocessor_error> preprocessor::paste(const pp_token &lhs, const pp_token &rhs)
+{
+    const auto &text = m_storage.emplace_back(fmt::format("{}{}", lhs.text, rhs.text));
+    auto tokens = tokenize(text, lhs.file, m_files[lhs.file].string(), m_storage);
+    // A valid paste is a single token followed by the end of file
+    if (tokens.has_value() == false || tokens->size() != 2 || tokens->front().has_space)
+    {
+        return std::unexpected(error_at(
+          lhs, fmt::format("Pasting \"{}\" and \"{}\" does not give a valid preprocessing token", lhs.text, rhs.text)));
+    }
+    auto t = std::move(tokens->front());
+    t.at_line_start = false;
+    t.has_space = lhs.has_space;
+    t.line = lhs.line;
+    t.hideset = lhs.hideset;
+    t.column = lhs.column;
+    t.expanded = true;
+    return t;
+}
+
+/**
+ * Creates a token with a new text, kept alive until the end of the preprocessing.
+ */
+const pp_token &preprocessor::stored_token(pp_token_type type, std::string text, const pp_token &position)
+{
+    const auto &stored = m_storage.emplace_back(std::move(text));
+    return m_stored_tokens.emplace_back(
+      pp_token{ type, stored, false, position.has_space, position.line, position.file, {}, position.column, true });
+}
+
+std::expected<lexer::source_buffer, preprocessor_error> preprocess(const std::filesystem::path &file_name,
+                                                                   const options &options)
+{
+    WCCFF_TRACE(preprocessor, info, "Preprocessing {}", file_name.string());
+    auto buffer = lexer::source_buffer::open(file_name);
+    if (buffer.has_value() == false)
+    {
+        auto message = fmt::format("{}: {}", file_name.string(), buffer.error().message());
+        return std::unexpected(preprocessor_error{ message });
+    }
+    auto output = preprocess(buffer->view(), file_name, options);
+    if (output.has_value() == false)
+    {
+        return std::unexpected(output.error());
+    }
+    return lexer::source_buffer{ std::move(output.value()) };
+}
+
+std::expected<std::string, preprocessor_error> preprocess(std::string_view source,
+                                                          const std::filesystem::path &file_name,
+                                                          const options &options)
+{
+    preprocessor p{ options };
+    return p.run(source, file_name);
+}
+
+} // namespace wccff::preprocessor
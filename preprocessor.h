@@ -0,0 +1,77 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PREPROCESSOR_H
+#define PREPROCESSOR_H
+
+#include "pp_tokens.h"
+#include "source_buffer.h"
+#include <expected>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace wccff::preprocessor {
+
+struct options
+{
+    /**
+     * Searched by #include, in order, before the system include paths.
+     */
+    std::vector<std::filesystem::path> include_paths;
+    /**
+     * When a header isn't found in any of them, it's searched among the builtin headers of gcc, like stddef.h.
+     */
+    std::vector<std::filesystem::path> system_include_paths{ "/usr/local/include",
+#if defined(__linux__) && defined(__x86_64__)
+                                                             "/usr/include/x86_64-linux-gnu",
+#endif
+                                                             "/usr/include" };
+    /**
+     * Macros defined before the source is processed, as NAME or NAME=VALUE like the -D flag.
+     */
+    std::vector<std::string> defines;
+    /**
+     * Directory of the header cache, the headers are always tokenized when it isn't set.
+     */
+    std::optional<std::filesystem::path> header_cache_directory;
+};
+
+/**
+ * Preprocesses a source file, replacing the external preprocessor.
+ * Supports object-like and function-like macros, #include, #include_next, the conditional directives and the # and ##
+ * operators.
+ * The tokens are written as text into the buffer, one line for each line of the source and at their column, so the
+ * locations reported by the compiler still match the source, up to the first macro expansion of a line.
+ */
+std::expected<lexer::source_buffer, preprocessor_error> preprocess(const std::filesystem::path &file_name,
+                                                                   const options &options = {});
+
+/**
+ * Preprocesses a source already in memory, file_name is used in the diagnostics and to find the quoted includes.
+ */
+std::expected<std::string, preprocessor_error> preprocess(std::string_view source,
+                                                          const std::filesystem::path &file_name,
+                                                          const options &options = {});
+
+} // namespace wccff::preprocessor
+
+#endif // PREPROCESSOR_H
@@ -0,0 +1,415 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "serialized_ast.h"
+#include "visitor.h"
+#include <array>
+#include <bit>
+#include <cstring>
+#include <fmt/format.h>
+#include <fstream>
+#include <optional>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace wccff::parser {
+
+static_assert(std::endian::native == std::endian::little, "The header is written in the native byte order");
+
+constexpr std::array<char, 8> serialized_ast_magic{ 'W', 'C', 'C', 'F', 'F', 'A', 'S', 'T' };
+
+struct serialized_header
+{
+    std::array<char, 8> magic;
+    uint32_t version;
+    uint32_t identifier_count;
+    uint32_t identifiers_size;
+    uint32_t body_size;
+};
+
+// The kinds of statements
+constexpr uint8_t return_statement_kind = 0;
+
+// Set in the kind of a node that is used by several expressions
+constexpr uint8_t shared_node_flag = 0x80;
+// The kind of a use of a shared node written before, it's followed by the offset of the node
+constexpr uint8_t reference_kind = 3;
+
+static void write_varint(std::string &out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static uint32_t zigzag(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+    return static_cast<int32_t>((value >> 1) ^ (0U - (value & 1)));
+}
+
+/**
+ * Reads a varint, nothing is returned when it doesn't fit in the bytes or in 32 bits.
+ */
+static std::optional<uint32_t> read_varint(std::string_view bytes, std::size_t &offset)
+{
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if (offset >= bytes.size())
+        {
+            return std::nullopt;
+        }
+        auto byte = static_cast<uint8_t>(bytes[offset++]);
+        if (shift == 28 && byte > 0x0F)
+        {
+            return std::nullopt;
+        }
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return value;
+        }
+    }
+    return std::nullopt;
+}
+
+/**
+ * Pre-order walk of the expression with a stack on the heap, like the rest of the expression passes.
+ * A shared node is written the first time it's reached, and every later use of it is a reference. In pre-order the
+ * whole node is written by then, since a node can't contain itself.
+ */
+static void write_expression(std::string &out, const expression &root)
+{
+    auto start = out.size();
+    std::unordered_map<const void *, uint32_t> shared_offsets;
+    // Writes the kind of the node, or a reference when the shared node was already written
+    auto write_kind = [&](node_kind kind, const auto *node) {
+        if (node->shared == false)
+        {
+            out.push_back(static_cast<char>(kind));
+            return true;
+        }
+        auto [it, inserted] = shared_offsets.try_emplace(node, static_cast<uint32_t>(out.size() - start));
+        if (inserted == false)
+        {
+            out.push_back(static_cast<char>(reference_kind));
+            write_varint(out, it->second);
+            return false;
+        }
+        out.push_back(static_cast<char>(static_cast<uint8_t>(kind) | shared_node_flag));
+        return true;
+    };
+
+    std::vector<expression> stack{ root };
+    while (stack.empty() == false)
+    {
+        auto current = stack.back();
+        stack.pop_back();
+        std::visit(wccff::visitor{
+                     [&out](const int_constant &n) {
+                         out.push_back(static_cast<char>(node_kind::constant));
+                         write_varint(out, zigzag(n.value));
+                     },
+                     [&](const unary_node *n) {
+                         if (write_kind(node_kind::unary, n))
+                         {
+                             out.push_back(static_cast<char>(n->op));
+                             stack.push_back(n->exp);
+                         }
+                     },
+                     [&](const binary_node *n) {
+                         if (write_kind(node_kind::binary, n))
+                         {
+                             out.push_back(static_cast<char>(n->op));
+                             stack.push_back(n->right);
+                             stack.push_back(n->left);
+                         }
+                     },
+                   },
+                   current);
+    }
+}
+
+std::string serialize(const program &program, const symbol_interner &symbols)
+{
+    std::vector<symbol> identifiers;
+    std::unordered_map<symbol, uint32_t> indexes;
+    auto index_of = [&](symbol s) {
+        auto [it, inserted] = indexes.try_emplace(s, static_cast<uint32_t>(identifiers.size()));
+        if (inserted)
+        {
+            identifiers.push_back(s);
+        }
+        return it->second;
+    };
+
+    std::string body;
+    write_varint(body, index_of(program.f.function_name.name));
+    body.push_back(static_cast<char>(return_statement_kind));
+    write_expression(body, std::get<return_node>(program.f.body).e);
+
+    std::string table;
+    for (auto s : identifiers)
+    {
+        auto text = symbols.text(s);
+        write_varint(table, static_cast<uint32_t>(text.size()));
+        table.append(text);
+    }
+
+    serialized_header h{ serialized_ast_magic,
+                         serialized_ast_version,
+                         static_cast<uint32_t>(identifiers.size()),
+                         static_cast<uint32_t>(table.size()),
+                         static_cast<uint32_t>(body.size()) };
+    std::string out(sizeof(h), '\0');
+    std::memcpy(out.data(), &h, sizeof(h));
+    out.append(table);
+    out.append(body);
+    return out;
+}
+
+/**
+ * Checks that the bytes are exactly one well formed expression.
+ * A reference must be to a shared node that was completely read before it, so the expression has no cycles.
+ */
+static std::optional<serialized_ast_error> check_expression(std::string_view bytes)
+{
+    struct pending_operator
+    {
+        uint32_t offset;
+        bool shared;
+        uint8_t missing_operands;
+    };
+    std::vector<pending_operator> operators;
+    std::unordered_set<uint32_t> shared_nodes;
+    std::size_t offset = 0;
+    while (true)
+    {
+        if (offset >= bytes.size())
+        {
+            return serialized_ast_error{ "The expression is truncated" };
+        }
+        auto start = static_cast<uint32_t>(offset);
+        auto byte = static_cast<uint8_t>(bytes[offset++]);
+        auto shared = (byte & shared_node_flag) != 0;
+        auto kind = static_cast<node_kind>(byte & ~shared_node_flag);
+        if (byte == reference_kind)
+        {
+            auto target = read_varint(bytes, offset);
+            if (target.has_value() == false || shared_nodes.contains(target.value()) == false)
+            {
+                return serialized_ast_error{ "Invalid reference" };
+            }
+        }
+        else if (byte == static_cast<uint8_t>(node_kind::constant))
+        {
+            if (read_varint(bytes, offset).has_value() == false)
+            {
+                return serialized_ast_error{ "Invalid constant" };
+            }
+        }
+        else if (kind == node_kind::unary || kind == node_kind::binary)
+        {
+            if (offset >= bytes.size())
+            {
+                return serialized_ast_error{ "The expression is truncated" };
+            }
+            auto op = static_cast<uint8_t>(bytes[offset++]);
+            auto operator_count = kind == node_kind::unary ? unary_operators.size() : binary_operators.size();
+            if (op >= operator_count)
+            {
+                return serialized_ast_error{ fmt::format("Invalid operator {}", op) };
+            }
+            operators.push_back({ start, shared, static_cast<uint8_t>(kind == node_kind::unary ? 1 : 2) });
+            continue;
+        }
+        else
+        {
+            return serialized_ast_error{ fmt::format("Invalid node kind {}", byte) };
+        }
+
+        // Every operator whose last operand was just read is complete
+        while (operators.empty() == false && --operators.back().missing_operands == 0)
+        {
+            if (operators.back().shared)
+            {
+                shared_nodes.insert(operators.back().offset);
+            }
+            operators.pop_back();
+        }
+        if (operators.empty())
+        {
+            break;
+        }
+    }
+    if (offset != bytes.size())
+    {
+        return serialized_ast_error{ "Unexpected bytes after the expression" };
+    }
+    return std::nullopt;
+}
+
+std::expected<serialized_program, serialized_ast_error> serialized_program::open(std::string_view bytes)
+{
+    serialized_header h{};
+    if (bytes.size() < sizeof(h))
+    {
+        return std::unexpected{ serialized_ast_error{ "The header is truncated" } };
+    }
+    std::memcpy(&h, bytes.data(), sizeof(h));
+    if (h.magic != serialized_ast_magic)
+    {
+        return std::unexpected{ serialized_ast_error{ "Not a serialized AST" } };
+    }
+    if (h.version != serialized_ast_version)
+    {
+        return std::unexpected{ serialized_ast_error{
+          fmt::format("Unsupported version {}, expected {}", h.version, serialized_ast_version) } };
+    }
+    if (bytes.size() != sizeof(h) + static_cast<uint64_t>(h.identifiers_size) + h.body_size)
+    {
+        return std::unexpected{ serialized_ast_error{ "The size doesn't match the header" } };
+    }
+
+    serialized_program program;
+    auto table = bytes.substr(sizeof(h), h.identifiers_size);
+    std::size_t offset = 0;
+    for (uint32_t i = 0; i < h.identifier_count; i++)
+    {
+        auto size = read_varint(table, offset);
+        if (size.has_value() == false || size.value() > table.size() - offset)
+        {
+            return std::unexpected{ serialized_ast_error{ "The identifiers are truncated" } };
+        }
+        program.m_identifiers.push_back(table.substr(offset, size.value()));
+        offset += size.value();
+    }
+    if (offset != table.size())
+    {
+        return std::unexpected{ serialized_ast_error{ "Unexpected bytes after the identifiers" } };
+    }
+
+    auto body = bytes.substr(sizeof(h) + h.identifiers_size);
+    offset = 0;
+    auto name = read_varint(body, offset);
+    if (name.has_value() == false || name.value() >= program.m_identifiers.size())
+    {
+        return std::unexpected{ serialized_ast_error{ "Invalid function name" } };
+    }
+    program.m_function_name = name.value();
+    if (offset >= body.size() || static_cast<uint8_t>(body[offset++]) != return_statement_kind)
+    {
+        return std::unexpected{ serialized_ast_error{ "Invalid statement" } };
+    }
+    program.m_expression = body.substr(offset);
+    if (auto error = check_expression(program.m_expression); error.has_value())
+    {
+        return std::unexpected{ error.value() };
+    }
+    return program;
+}
+
+serialized_node expression_reader::next()
+{
+    auto offset = static_cast<uint32_t>(m_offset);
+    auto byte = static_cast<uint8_t>(m_bytes[m_offset++]);
+    if (byte == reference_kind)
+    {
+        // The kind and the operator are the ones of the shared node
+        auto target = read_varint(m_bytes, m_offset).value();
+        auto kind = static_cast<node_kind>(static_cast<uint8_t>(m_bytes[target]) & ~shared_node_flag);
+        return { kind, static_cast<uint8_t>(m_bytes[target + 1]), 0, target, true, true };
+    }
+    serialized_node node{
+        static_cast<node_kind>(byte & ~shared_node_flag), 0, 0, offset, (byte & shared_node_flag) != 0, false
+    };
+    if (node.kind == node_kind::constant)
+    {
+        node.value = unzigzag(read_varint(m_bytes, m_offset).value());
+    }
+    else
+    {
+        node.op = static_cast<uint8_t>(m_bytes[m_offset++]);
+    }
+    return node;
+}
+
+std::expected<void, serialized_ast_error> store(const std::filesystem::path &file,
+                                                const program &program,
+                                                const symbol_interner &symbols)
+{
+    auto bytes = serialize(program, symbols);
+    // Written to a temporary file first, so a reader never sees a partial file
+    auto temporary = file;
+    temporary += fmt::format(".{}.tmp", ::getpid());
+    std::error_code ec;
+    {
+        std::ofstream out{ temporary, std::ios::binary | std::ios::trunc };
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if (out.good() == false)
+        {
+            std::filesystem::remove(temporary, ec);
+            return std::unexpected{ serialized_ast_error{ fmt::format("Failed to write {}", file.string()) } };
+        }
+    }
+    std::filesystem::rename(temporary, file, ec);
+    if (ec)
+    {
+        std::filesystem::remove(temporary, ec);
+        return std::unexpected{ serialized_ast_error{ fmt::format("Failed to write {}", file.string()) } };
+    }
+    return {};
+}
+
+std::expected<mapped_program, serialized_ast_error> load(const std::filesystem::path &file)
+{
+    auto buffer = lexer::source_buffer::open(file);
+    if (buffer.has_value() == false)
+    {
+        return std::unexpected{ serialized_ast_error{
+          fmt::format("Failed to read {} with message ({})", file.string(), buffer.error().message()) } };
+    }
+    auto program = serialized_program::open(buffer->view());
+    if (program.has_value() == false)
+    {
+        return std::unexpected{ program.error() };
+    }
+    // The view still points into the same mapping after the buffer is moved
+    return mapped_program{ std::move(buffer.value()), std::move(program.value()) };
+}
+
+program deserialize(const serialized_program &serialized, compilation_context &context)
+{
+    tree_builder builder{ context.ast };
+    program p;
+    p.f.function_name = identifier{ context.symbols.intern(serialized.function_name()) };
+    p.f.body = return_node{ replay(serialized.return_expression(), builder) };
+    return p;
+}
+
+} // namespace wccff::parser
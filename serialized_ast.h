@@ -0,0 +1,204 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SERIALIZED_AST_H
+#define SERIALIZED_AST_H
+
+#include "flat_ast.h"
+#include "parser.h"
+#include "source_buffer.h"
+#include <cstdint>
+#include <expected>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace wccff::parser {
+
+/*
+ * Binary form of a program, made to be memory mapped and read in place.
+ *
+ * Layout, the integers of the header are little endian and the others are LEB128 varints:
+ *   header: the magic, the version, the number of identifiers and the size in bytes of the identifiers and the body
+ *   identifiers: the length and the text of each distinct identifier, in order of first use
+ *   body: the index of the function's name, the kind of its statement, and the expression
+ * The expression is stored in pre-order, every node is a node_kind byte followed by an operator byte for the operators,
+ * or by the zigzag encoded value for the constants. The shared nodes of a DAG, see hash_consing_builder, are stored once
+ * with the high bit of their kind set, their other uses are a reference byte followed by the offset of the node in the
+ * expression. So the size of a DAG is linear in its number of nodes.
+ */
+
+struct serialized_ast_error
+{
+    std::string message;
+};
+
+/**
+ * A node of a serialized expression, the operator is the byte of the unary_operator or binary_operator.
+ */
+struct serialized_node
+{
+    node_kind kind;
+    uint8_t op;
+    int32_t value;
+    // Where the node starts in the expression, for a reference it's where the shared node it stands for starts
+    uint32_t offset;
+    // Used by several expressions, its other uses are references to it
+    bool shared;
+    // A use of the shared node at offset, which was read before, its operands aren't read again
+    bool reference;
+};
+
+/**
+ * Reads the nodes of a serialized expression in pre-order, an operator comes before its operands.
+ * The bytes were validated when the program was opened, so they are read without checks.
+ */
+class expression_reader
+{
+  public:
+    explicit expression_reader(std::string_view bytes)
+      : m_bytes(bytes)
+    {
+    }
+
+    serialized_node next();
+
+    /**
+     * A reader of the node at offset and its operands, used to read a shared node again.
+     */
+    [[nodiscard]] expression_reader at(uint32_t offset) const
+    {
+        expression_reader reader{ m_bytes };
+        reader.m_offset = offset;
+        return reader;
+    }
+
+  private:
+    std::string_view m_bytes;
+    std::size_t m_offset{ 0 };
+};
+
+/**
+ * A view of a serialized program, it references the bytes without copying them.
+ */
+class serialized_program
+{
+  public:
+    /**
+     * Checks the header and the structure of the whole program, so it can be walked without further checks.
+     */
+    static std::expected<serialized_program, serialized_ast_error> open(std::string_view bytes);
+
+    [[nodiscard]] std::size_t identifier_count() const { return m_identifiers.size(); }
+    [[nodiscard]] std::string_view identifier(std::size_t index) const { return m_identifiers[index]; }
+    [[nodiscard]] std::string_view function_name() const { return m_identifiers[m_function_name]; }
+    [[nodiscard]] expression_reader return_expression() const { return expression_reader{ m_expression }; }
+
+  private:
+    std::vector<std::string_view> m_identifiers;
+    std::size_t m_function_name{ 0 };
+    std::string_view m_expression;
+};
+
+/**
+ * A serialized program loaded from a file, the view references the mapping of the file.
+ */
+struct mapped_program
+{
+    lexer::source_buffer buffer;
+    serialized_program program;
+};
+
+constexpr uint32_t serialized_ast_version = 2;
+
+std::string serialize(const program &program, const symbol_interner &symbols);
+std::expected<void, serialized_ast_error> store(const std::filesystem::path &file,
+                                                const program &program,
+                                                const symbol_interner &symbols);
+std::expected<mapped_program, serialized_ast_error> load(const std::filesystem::path &file);
+
+/**
+ * Builds the serialized expression with the builder, see parse_expression. Only the pending operators and the shared
+ * nodes are kept in memory, not the whole expression. A shared node is built once, builder.share marks each reuse.
+ */
+template<typename Builder>
+typename Builder::node replay(expression_reader reader, Builder &builder)
+{
+    struct pending_operator
+    {
+        serialized_node node;
+        uint8_t missing_operands;
+    };
+    std::vector<pending_operator> operators;
+    std::vector<typename Builder::node> operands;
+    std::unordered_map<uint32_t, typename Builder::node> shared;
+    while (true)
+    {
+        auto node = reader.next();
+        if (node.reference)
+        {
+            operands.push_back(builder.share(shared.at(node.offset)));
+        }
+        else if (node.kind != node_kind::constant)
+        {
+            operators.push_back({ node, static_cast<uint8_t>(node.kind == node_kind::unary ? 1 : 2) });
+            continue;
+        }
+        else
+        {
+            operands.push_back(builder.constant(node.value));
+        }
+
+        // Every operator whose last operand was just built is built in turn
+        while (operators.empty() == false && --operators.back().missing_operands == 0)
+        {
+            auto op = operators.back().node;
+            operators.pop_back();
+            if (op.kind == node_kind::unary)
+            {
+                operands.back() = builder.unary(static_cast<unary_operator>(op.op), operands.back());
+            }
+            else
+            {
+                auto right = operands.back();
+                operands.pop_back();
+                operands.back() = builder.binary(static_cast<binary_operator>(op.op), operands.back(), right);
+            }
+            if (op.shared)
+            {
+                shared.emplace(op.offset, operands.back());
+            }
+        }
+        if (operators.empty())
+        {
+            return operands.back();
+        }
+    }
+}
+
+/**
+ * Rebuilds the program in the arena of the context, the identifiers are interned in its symbols.
+ */
+program deserialize(const serialized_program &serialized, compilation_context &context);
+
+} // namespace wccff::parser
+
+#endif // SERIALIZED_AST_H
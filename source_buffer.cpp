@@ -0,0 +1,260 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "source_buffer.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace wccff::lexer {
+
+/**
+ * Closes the file descriptor when leaving the scope.
+ */
+struct file_descriptor
+{
+    explicit file_descriptor(int fd_)
+      : fd(fd_)
+    {
+    }
+    ~file_descriptor()
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+    file_descriptor(const file_descriptor &) = delete;
+    file_descriptor &operator=(const file_descriptor &) = delete;
+
+    int fd;
+};
+
+static std::error_code last_error()
+{
+    return { errno, std::generic_category() };
+}
+
+/**
+ * Used when the file can't be mapped, for example pipes, where the size isn't known before reading all the data.
+ */
+static std::expected<std::string, std::error_code> read_all(int fd)
+{
+    std::string content;
+    std::size_t used = 0;
+    content.resize(64 * 1024);
+    while (true)
+    {
+        auto r = ::read(fd, content.data() + used, content.size() - used);
+        if (r < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return std::unexpected(last_error());
+        }
+        if (r == 0)
+        {
+            break;
+        }
+        used += static_cast<std::size_t>(r);
+        if (used == content.size())
+        {
+            content.resize(content.size() * 2);
+        }
+    }
+    content.resize(used);
+    return content;
+}
+
+source_buffer::source_buffer(std::string content)
+  : m_size(content.size())
+  , m_content(std::move(content))
+{
+    m_content.append(padding, '\0');
+}
+
+source_buffer::~source_buffer()
+{
+    release();
+}
+
+source_buffer::source_buffer(source_buffer &&other) noexcept
+  : m_mapping(std::exchange(other.m_mapping, nullptr))
+  , m_mapping_size(std::exchange(other.m_mapping_size, 0))
+  , m_size(std::exchange(other.m_size, 0))
+  , m_content(std::move(other.m_content))
+{
+}
+
+source_buffer &source_buffer::operator=(source_buffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        m_mapping = std::exchange(other.m_mapping, nullptr);
+        m_mapping_size = std::exchange(other.m_mapping_size, 0);
+        m_size = std::exchange(other.m_size, 0);
+        m_content = std::move(other.m_content);
+    }
+    return *this;
+}
+
+void source_buffer::release() noexcept
+{
+    if (m_mapping != nullptr)
+    {
+        ::munmap(m_mapping, m_mapping_size);
+        m_mapping = nullptr;
+    }
+}
+
+std::expected<source_buffer, std::error_code> source_buffer::open(const std::filesystem::path &file_name)
+{
+    file_descriptor file{ ::open(file_name.c_str(), O_RDONLY) };
+    if (file.fd < 0)
+    {
+        return std::unexpected(last_error());
+    }
+
+    struct stat info
+    {
+    };
+    if (::fstat(file.fd, &info) != 0)
+    {
+        return std::unexpected(last_error());
+    }
+
+    if (S_ISREG(info.st_mode) == false)
+    {
+        auto content = read_all(file.fd);
+        if (content.has_value() == false)
+        {
+            return std::unexpected(content.error());
+        }
+        return source_buffer{ std::move(content.value()) };
+    }
+
+    source_buffer buffer;
+    if (info.st_size == 0)
+    {
+        // mmap doesn't accept empty mappings
+        return buffer;
+    }
+
+    auto size = static_cast<std::size_t>(info.st_size);
+    auto page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    auto mapping_size = (size + padding + page_size - 1) / page_size * page_size;
+    // The padding pages are anonymous memory, full of zeros, reserved before mapping the file over their beginning.
+    // The rest of the file's last page is also filled with zeros by the kernel.
+    auto *mapping = ::mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        return std::unexpected(last_error());
+    }
+    if (::mmap(mapping, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, file.fd, 0) == MAP_FAILED)
+    {
+        auto error = last_error();
+        ::munmap(mapping, mapping_size);
+        return std::unexpected(error);
+    }
+    // The lexer reads the file from the beginning to the end, only once
+    ::madvise(mapping, size, MADV_SEQUENTIAL);
+
+    buffer.m_mapping = mapping;
+    buffer.m_mapping_size = mapping_size;
+    buffer.m_size = size;
+    return buffer;
+}
+
+input_stream::input_stream(int fd, bool owned, std::size_t capacity)
+  : m_fd(fd)
+  , m_owned(owned)
+  , m_window(capacity, '\0')
+{
+}
+
+input_stream::~input_stream()
+{
+    if (m_owned && m_fd >= 0)
+    {
+        ::close(m_fd);
+    }
+}
+
+input_stream::input_stream(input_stream &&other) noexcept
+  : m_fd(std::exchange(other.m_fd, -1))
+  , m_owned(other.m_owned)
+  , m_at_end(other.m_at_end)
+  , m_window(std::move(other.m_window))
+  , m_begin(other.m_begin)
+  , m_end(other.m_end)
+{
+}
+
+std::expected<input_stream, std::error_code> input_stream::open(const std::filesystem::path &file_name,
+                                                                std::size_t capacity)
+{
+    if (file_name == "-")
+    {
+        return input_stream{ STDIN_FILENO, false, capacity };
+    }
+    auto fd = ::open(file_name.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return std::unexpected(last_error());
+    }
+    return input_stream{ fd, true, capacity };
+}
+
+std::expected<std::size_t, std::error_code> input_stream::refill()
+{
+    if (m_begin != 0)
+    {
+        std::memmove(m_window.data(), m_window.data() + m_begin, m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+    }
+    if (m_at_end || m_end == m_window.size())
+    {
+        return 0;
+    }
+    while (true)
+    {
+        auto r = ::read(m_fd, m_window.data() + m_end, m_window.size() - m_end);
+        if (r < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return std::unexpected(last_error());
+        }
+        m_at_end = r == 0;
+        m_end += static_cast<std::size_t>(r);
+        return static_cast<std::size_t>(r);
+    }
+}
+
+} // namespace wccff::lexer
@@ -0,0 +1,134 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOURCE_BUFFER_H
+#define SOURCE_BUFFER_H
+
+#include <cstddef>
+#include <expected>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace wccff::lexer {
+
+/**
+ * Owns the content of a source file.
+ * Regular files are memory mapped, everything else (pipes, character devices, ...) is read into memory.
+ * The tokens and the identifiers reference the content of the buffer, so it needs to outlive them.
+ *
+ * The content is always followed by, at least, padding zero bytes, so the lexer can scan it without checking where
+ * it ends.
+ */
+class source_buffer
+{
+  public:
+    static constexpr std::size_t padding = 64;
+
+    source_buffer()
+      : source_buffer(std::string{})
+    {
+    }
+    explicit source_buffer(std::string content);
+    ~source_buffer();
+
+    source_buffer(const source_buffer &) = delete;
+    source_buffer &operator=(const source_buffer &) = delete;
+    source_buffer(source_buffer &&other) noexcept;
+    source_buffer &operator=(source_buffer &&other) noexcept;
+
+    static std::expected<source_buffer, std::error_code> open(const std::filesystem::path &file_name);
+
+    [[nodiscard]] std::string_view view() const
+    {
+        if (m_mapping != nullptr)
+        {
+            return { static_cast<const char *>(m_mapping), m_size };
+        }
+        return { m_content.data(), m_size };
+    }
+    [[nodiscard]] bool is_mapped() const { return m_mapping != nullptr; }
+
+  private:
+    void release() noexcept;
+
+    void *m_mapping{ nullptr };
+    // Includes the pages reserved for the padding
+    std::size_t m_mapping_size{ 0 };
+    std::size_t m_size{ 0 };
+    std::string m_content;
+};
+
+/**
+ * Reads a file that can't be memory mapped, like stdin or a pipe, through a fixed size window.
+ * Only the data not consumed yet is kept, it's moved to the beginning of the window when refilling, so the memory
+ * doesn't depend on the size of the input.
+ */
+class input_stream
+{
+  public:
+    static constexpr std::size_t default_capacity = 64 * 1024;
+
+    /**
+     * Reads from fd, which is closed by the stream when owned is true.
+     */
+    input_stream(int fd, bool owned, std::size_t capacity = default_capacity);
+    ~input_stream();
+
+    input_stream(const input_stream &) = delete;
+    input_stream &operator=(const input_stream &) = delete;
+    input_stream(input_stream &&other) noexcept;
+    input_stream &operator=(input_stream &&other) = delete;
+
+    /**
+     * Opens the file, - is the standard input.
+     */
+    static std::expected<input_stream, std::error_code> open(const std::filesystem::path &file_name,
+                                                             std::size_t capacity = default_capacity);
+
+    /**
+     * The data read and not consumed yet.
+     */
+    [[nodiscard]] std::string_view data() const { return { m_window.data() + m_begin, m_end - m_begin }; }
+    /**
+     * Drops the first count bytes of data().
+     */
+    void consume(std::size_t count) { m_begin += count; }
+    /**
+     * Reads more data into the free space of the window, blocking until some data is available.
+     * Returns the number of bytes read, which is 0 when the input ended or the window is full.
+     */
+    std::expected<std::size_t, std::error_code> refill();
+
+    [[nodiscard]] bool at_end() const { return m_at_end; }
+    [[nodiscard]] bool full() const { return m_end - m_begin == m_window.size(); }
+
+  private:
+    int m_fd;
+    bool m_owned;
+    bool m_at_end{ false };
+    std::string m_window;
+    std::size_t m_begin{ 0 };
+    std::size_t m_end{ 0 };
+};
+
+} // namespace wccff::lexer
+
+#endif // SOURCE_BUFFER_H
@@ -0,0 +1,43 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "symbol.h"
+
+namespace wccff {
+
+symbol symbol_interner::intern(std::string_view text)
+{
+    auto it = m_symbols.find(text);
+    if (it != m_symbols.end())
+    {
+        return it->second;
+    }
+    symbol s{ static_cast<uint32_t>(m_texts.size()) };
+    const auto &stored = m_texts.emplace_back(text);
+    m_symbols.emplace(stored, s);
+    return s;
+}
+
+void symbol_interner::clear()
+{
+    m_symbols.clear();
+    m_texts.clear();
+}
+
+} // namespace wccff
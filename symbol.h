@@ -0,0 +1,72 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace wccff {
+
+/**
+ * Interned name, all the IRs use it for identifiers and labels.
+ * Two symbols from the same interner are equal when their text is equal.
+ */
+struct symbol
+{
+    uint32_t id{ 0 };
+    auto operator<=>(const symbol &) const = default;
+};
+
+class symbol_interner
+{
+  public:
+    /**
+     * Returns the symbol of text, the first time a text is seen it's copied into the interner.
+     */
+    symbol intern(std::string_view text);
+    /**
+     * Returns the text of a symbol, it's valid until the interner is cleared.
+     */
+    [[nodiscard]] std::string_view text(symbol s) const { return m_texts[s.id]; }
+    [[nodiscard]] std::size_t size() const { return m_texts.size(); }
+    void clear();
+
+  private:
+    // A deque never moves its elements, so the keys of m_symbols stay valid
+    std::deque<std::string> m_texts;
+    std::unordered_map<std::string_view, symbol> m_symbols;
+};
+
+} // namespace wccff
+
+template<>
+struct std::hash<wccff::symbol>
+{
+    std::size_t operator()(wccff::symbol s) const noexcept { return std::hash<uint32_t>{}(s.id); }
+};
+
+#endif // SYMBOL_H
@@ -18,40 +18,46 @@
  */
 
 #include "tacky.h"
+#include "trace.h"
 #include "utils.h"
 #include "visitor.h"
+#include <array>
 #include <fmt/format.h>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
 
 namespace wccff::tacky {
 
-std::string get_temporary_name()
+symbol get_temporary_name(symbol_interner &symbols)
 {
     static int counter = 0;
-    return fmt::format("tacky-{}", ++counter);
+    return symbols.intern(fmt::format("tacky-{}", ++counter));
 }
 
-identifier get_and_false_label()
+identifier get_and_false_label(symbol_interner &symbols)
 {
     static int counter = 0;
-    return { fmt::format("and_false_{}", ++counter) };
+    return { symbols.intern(fmt::format("and_false_{}", ++counter)) };
 }
 
-identifier get_and_end_label()
+identifier get_and_end_label(symbol_interner &symbols)
 {
     static int counter = 0;
-    return { fmt::format("and_end_{}", ++counter) };
+    return { symbols.intern(fmt::format("and_end_{}", ++counter)) };
 }
 
-identifier get_or_false_label()
+identifier get_or_false_label(symbol_interner &symbols)
 {
     static int counter = 0;
-    return { fmt::format("or_true_{}", ++counter) };
+    return { symbols.intern(fmt::format("or_true_{}", ++counter)) };
 }
 
-identifier get_or_end_label()
+identifier get_or_end_label(symbol_interner &symbols)
 {
     static int counter = 0;
-    return { fmt::format("or_end_{}", ++counter) };
+    return { symbols.intern(fmt::format("or_end_{}", ++counter)) };
 }
 
 identifier process_identifier(const parser::identifier &id)
@@ -64,260 +70,716 @@ constant process_int_constant(const parser::int_constant &int_con)
     return { int_con.value };
 }
 
-unary_operator process_unary_operator(const parser::unary_operator &op)
-{
-    return std::visit(
-      visitor{
-        [](const parser::bitwise_complement_operator &) -> unary_operator { return binary_complement_operator{}; },
-        [](const parser::negate_operator &) -> unary_operator { return negate_operator{}; },
-        [](const parser::logical_not_operator &) -> unary_operator { return not_operator{}; },
-      },
-      op);
-}
-
-binary_operator process_binary_operator(const parser::binary_operator &op)
-{
-    return std::visit(
-      visitor{
-        [](const parser::plus_operator &) -> binary_operator { return plus_operator{}; },
-        [](const parser::subtract_operator &) -> binary_operator { return subtract_operator{}; },
-        [](const parser::multiply_operator &) -> binary_operator { return multiply_operator{}; },
-        [](const parser::divide_operator &) -> binary_operator { return divide_operator{}; },
-        [](const parser::remainder_operator &) -> binary_operator { return remainder_operator{}; },
-        [](const parser::bitwise_and_operator &) -> binary_operator { return binary_and_operator{}; },
-        [](const parser::bitwise_or_operator &) -> binary_operator { return binary_or_operator{}; },
-        [](const parser::bitwise_xor_operator &) -> binary_operator { return binary_xor_operator{}; },
-        [](const parser::left_shift_operator &) -> binary_operator { return left_shift_operator{}; },
-        [](const parser::right_shift_operator &) -> binary_operator { return right_shift_operator{}; },
-        [](const parser::logical_and_operator &) -> binary_operator {
-            throw std::logic_error("logical and operator Not implemented");
-        },
-        [](const parser::logical_or_operator &) -> binary_operator {
-            throw std::logic_error("logical or operator Not implemented");
-        },
-        [](const parser::equals_operator &) -> binary_operator { return equal_operator{}; },
-        [](const parser::not_equals_operator &) -> binary_operator { return not_equal_operator{}; },
-        [](const parser::less_than_operator &) -> binary_operator { return less_than_operator{}; },
-        [](const parser::less_than_or_equal_operator &) -> binary_operator { return less_than_or_equal_operator{}; },
-        [](const parser::greater_than_operator &) -> binary_operator { return greater_than_operator{}; },
-        [](const parser::greater_than_or_equal_operator &) -> binary_operator {
-            return greater_than_or_equal_operator{};
-        },
-      },
-      op);
-}
-
-val process_unary_node(const std::unique_ptr<parser::unary_node> &node, std::vector<instruction> &instructions)
-{
-    auto src = process_expression(node->exp, instructions);
-    auto dst = var{ get_temporary_name() };
-    auto op = process_unary_operator(node->op);
-    instructions.emplace_back(unary_statement{ op, src, dst });
-    return dst;
+/**
+ * Indexed by parser::unary_operator.
+ */
+constexpr std::array<unary_operator, 3> unary_operators_from_parser{
+    unary_operator::complement,
+    unary_operator::negate,
+    unary_operator::logical_not,
+};
+
+/**
+ * Indexed by parser::binary_operator. The logical operators are lowered to jumps, they have no TACKY operator.
+ */
+constexpr std::array<std::optional<binary_operator>, 18> binary_operators_from_parser{
+    binary_operator::plus,
+    binary_operator::subtract,
+    binary_operator::multiply,
+    binary_operator::divide,
+    binary_operator::remainder,
+    binary_operator::bitwise_and,
+    binary_operator::bitwise_or,
+    binary_operator::bitwise_xor,
+    binary_operator::left_shift,
+    binary_operator::right_shift,
+    std::nullopt,
+    std::nullopt,
+    binary_operator::equal,
+    binary_operator::not_equal,
+    binary_operator::less_than,
+    binary_operator::less_than_or_equal,
+    binary_operator::greater_than,
+    binary_operator::greater_than_or_equal,
+};
+
+static_assert(unary_operators_from_parser.size() == parser::unary_operators.size());
+static_assert(binary_operators_from_parser.size() == parser::binary_operators.size());
+
+unary_operator process_unary_operator(parser::unary_operator op)
+{
+    return unary_operators_from_parser[static_cast<std::size_t>(op)];
 }
 
-val process_binary_and(const std::unique_ptr<parser::binary_node> &node, std::vector<instruction> &instructions)
+binary_operator process_binary_operator(parser::binary_operator op)
 {
-    auto false_end_label = get_and_false_label();
-    auto end_label = get_and_end_label();
-    auto dst = var{ get_temporary_name() };
+    auto converted = binary_operators_from_parser[static_cast<std::size_t>(op)];
+    if (converted.has_value() == false)
+    {
+        auto name = parser::info(op).name;
+        throw std::logic_error(fmt::format("{} operator is not converted into a binary operator", name));
+    }
+    return converted.value();
+}
 
-    auto v1 = process_expression(node->left, instructions);
-    instructions.emplace_back(jump_if_zero_statement{ v1, false_end_label });
-    auto v2 = process_expression(node->right, instructions);
-    instructions.emplace_back(jump_if_zero_statement{ v2, false_end_label });
-    instructions.emplace_back(copy_statement{ constant{ 1 }, dst });
-    instructions.emplace_back(jump_statement{ end_label });
-    instructions.emplace_back(label_statement{ false_end_label });
-    instructions.emplace_back(copy_statement{ constant{ 0 }, dst });
-    instructions.emplace_back(label_statement{ end_label });
-    return dst;
+/**
+ * The address of the node when it's shared by several expressions, nullptr otherwise.
+ */
+static const void *shared_node(const parser::expression &node)
+{
+    return std::visit(visitor{
+                        [](const parser::int_constant &) -> const void * { return nullptr; },
+                        [](const auto *n) -> const void * { return n->shared ? n : nullptr; },
+                      },
+                      node);
+}
+
+/**
+ * Jumps to label when value alone decides the result of the && or ||, 0 for && and anything else for ||.
+ */
+static void jump_if_decided(parser::binary_operator op,
+                            const val &value,
+                            const identifier &label,
+                            std::vector<instruction> &instructions)
+{
+    if (op == parser::binary_operator::logical_and)
+    {
+        instructions.emplace_back(jump_if_zero_statement{ value, label });
+    }
+    else
+    {
+        instructions.emplace_back(jump_if_not_zero_statement{ value, label });
+    }
 }
 
-val process_binary_or(const std::unique_ptr<parser::binary_node> &node, std::vector<instruction> &instructions)
+/**
+ * Starts the lowering of a && or || once its left operand is lowered, the right operand is skipped when left
+ * decides the result. All the lowerings share it, so they emit the same instructions.
+ */
+static short_circuit_labels begin_short_circuit(parser::binary_operator op,
+                                                const val &left,
+                                                std::vector<instruction> &instructions,
+                                                symbol_interner &symbols)
 {
-    auto false_end_label = get_or_false_label();
-    auto end_label = get_or_end_label();
-    auto dst = var{ get_temporary_name() };
+    auto is_and = op == parser::binary_operator::logical_and;
+    short_circuit_labels labels{ is_and ? get_and_false_label(symbols) : get_or_false_label(symbols),
+                                 is_and ? get_and_end_label(symbols) : get_or_end_label(symbols) };
+    jump_if_decided(op, left, labels.false_label, instructions);
+    return labels;
+}
 
-    auto v1 = process_expression(node->left, instructions);
-    instructions.emplace_back(jump_if_not_zero_statement{ v1, false_end_label });
-    auto v2 = process_expression(node->right, instructions);
-    instructions.emplace_back(jump_if_not_zero_statement{ v2, false_end_label });
-    instructions.emplace_back(copy_statement{ constant{ 0 }, dst });
-    instructions.emplace_back(jump_statement{ end_label });
-    instructions.emplace_back(label_statement{ false_end_label });
-    instructions.emplace_back(copy_statement{ constant{ 1 }, dst });
-    instructions.emplace_back(label_statement{ end_label });
+/**
+ * Finishes the lowering of a && or || once its right operand is lowered, returns the variable with the result.
+ */
+static var end_short_circuit(parser::binary_operator op,
+                             const val &right,
+                             const short_circuit_labels &labels,
+                             std::vector<instruction> &instructions,
+                             symbol_interner &symbols)
+{
+    auto is_and = op == parser::binary_operator::logical_and;
+    auto dst = var{ get_temporary_name(symbols) };
+    jump_if_decided(op, right, labels.false_label, instructions);
+    instructions.emplace_back(copy_statement{ constant{ is_and ? 1 : 0 }, dst });
+    instructions.emplace_back(jump_statement{ labels.end_label });
+    instructions.emplace_back(label_statement{ labels.false_label });
+    instructions.emplace_back(copy_statement{ constant{ is_and ? 0 : 1 }, dst });
+    instructions.emplace_back(label_statement{ labels.end_label });
     return dst;
 }
 
-val process_binary_node(const std::unique_ptr<parser::binary_node> &node, std::vector<instruction> &instructions)
+val process_unary_node(const parser::unary_node *node,
+                       std::vector<instruction> &instructions,
+                       symbol_interner &symbols)
+{
+    return process_expression(node, instructions, symbols);
+}
+
+val process_binary_node(const parser::binary_node *node,
+                        std::vector<instruction> &instructions,
+                        symbol_interner &symbols)
+{
+    return process_expression(node, instructions, symbols);
+}
+
+/**
+ * The tree is walked in post-order with a stack on the heap, so deep expressions don't overflow the thread's stack.
+ * A node is visited once before its operands, and once after each of them.
+ *
+ * The nodes shared by several expressions, see parser::hash_consing_builder, are computed once and their value is
+ * reused. A value computed in the right operand of && or || is only reused inside it, since that code may be skipped.
+ */
+val process_expression(const wccff::parser::expression &exp,
+                       std::vector<instruction> &instructions,
+                       symbol_interner &symbols)
 {
-    if (std::holds_alternative<parser::logical_and_operator>(node->op))
+    enum class stage : uint8_t
+    {
+        enter,
+        after_left,
+        after_right,
+    };
+    struct frame
+    {
+        parser::expression node;
+        stage next;
+        // Only used by && and ||
+        short_circuit_labels labels{};
+    };
+
+    std::vector<frame> stack;
+    std::vector<val> values;
+
+    std::unordered_map<const void *, val> shared_values;
+    // The shared nodes in the order they were computed, and where each pending right operand of && or || starts
+    std::vector<const void *> computed;
+    std::vector<std::size_t> conditional_scopes;
+    auto remember = [&](const parser::expression &node) {
+        if (const auto *shared = shared_node(node); shared != nullptr)
+        {
+            shared_values.emplace(shared, values.back());
+            computed.push_back(shared);
+        }
+    };
+
+    stack.push_back({ exp, stage::enter });
+    while (stack.empty() == false)
     {
-        return process_binary_and(node, instructions);
+        auto &f = stack.back();
+        if (f.next == stage::enter)
+        {
+            auto found = shared_values.find(shared_node(f.node));
+            if (found != shared_values.end())
+            {
+                values.push_back(found->second);
+                stack.pop_back();
+                continue;
+            }
+        }
+        if (std::holds_alternative<parser::int_constant>(f.node))
+        {
+            values.emplace_back(process_int_constant(std::get<parser::int_constant>(f.node)));
+            stack.pop_back();
+        }
+        else if (std::holds_alternative<const parser::unary_node *>(f.node))
+        {
+            const auto *node = std::get<const parser::unary_node *>(f.node);
+            if (f.next == stage::enter)
+            {
+                f.next = stage::after_left;
+                stack.push_back({ node->exp, stage::enter });
+                continue;
+            }
+            auto dst = var{ get_temporary_name(symbols) };
+            auto op = process_unary_operator(node->op);
+            instructions.emplace_back(unary_statement{ op, values.back(), dst });
+            values.back() = dst;
+            remember(f.node);
+            stack.pop_back();
+        }
+        else
+        {
+            const auto *node = std::get<const parser::binary_node *>(f.node);
+            auto short_circuit = parser::info(node->op).short_circuit;
+            switch (f.next)
+            {
+                case stage::enter:
+                    f.next = stage::after_left;
+                    stack.push_back({ node->left, stage::enter });
+                    continue;
+                case stage::after_left:
+                    if (short_circuit)
+                    {
+                        f.labels = begin_short_circuit(node->op, values.back(), instructions, symbols);
+                        values.pop_back();
+                        conditional_scopes.push_back(computed.size());
+                    }
+                    f.next = stage::after_right;
+                    stack.push_back({ node->right, stage::enter });
+                    continue;
+                case stage::after_right:
+                    break;
+            }
+
+            if (short_circuit)
+            {
+                // The values computed by the right operand don't exist when it's skipped
+                for (auto i = conditional_scopes.back(); i < computed.size(); i++)
+                {
+                    shared_values.erase(computed[i]);
+                }
+                computed.resize(conditional_scopes.back());
+                conditional_scopes.pop_back();
+                values.back() = end_short_circuit(node->op, values.back(), f.labels, instructions, symbols);
+            }
+            else
+            {
+                auto v2 = values.back();
+                values.pop_back();
+                auto v1 = values.back();
+                auto dst = var{ get_temporary_name(symbols) };
+                auto op = process_binary_operator(node->op);
+                instructions.emplace_back(binary_statement{ op, v1, v2, dst });
+                values.back() = dst;
+            }
+            remember(f.node);
+            stack.pop_back();
+        }
     }
-    if (std::holds_alternative<parser::logical_or_operator>(node->op))
+    return values.back();
+}
+
+val process_expression(const wccff::parser::flat_expression &exp,
+                       std::vector<instruction> &instructions,
+                       symbol_interner &symbols)
+{
+    using index = parser::flat_expression::index;
+    constexpr auto none = std::numeric_limits<index>::max();
+
+    // && and || jump right after their left operand, which is the node before the first node of the right operand
+    std::vector<index> short_circuit(exp.size(), none);
+    for (index i = 0; i < exp.size(); i++)
     {
-        return process_binary_or(node, instructions);
+        if (exp.kind(i) == parser::node_kind::binary)
+        {
+            if (parser::info(exp.binary_op(i)).short_circuit)
+            {
+                short_circuit[exp.left(i)] = i;
+            }
+        }
     }
 
-    auto v1 = process_expression(node->left, instructions);
-    auto v2 = process_expression(node->right, instructions);
-    auto dst = var{ get_temporary_name() };
-    auto op = process_binary_operator(node->op);
-    instructions.emplace_back(binary_statement{ op, v1, v2, dst });
-    return dst;
+    std::vector<val> values(exp.size());
+    std::vector<short_circuit_labels> logical_labels;
+    for (index i = 0; i < exp.size(); i++)
+    {
+        switch (exp.kind(i))
+        {
+            case parser::node_kind::constant:
+                values[i] = constant{ exp.value(i) };
+                break;
+            case parser::node_kind::unary:
+            {
+                auto dst = var{ get_temporary_name(symbols) };
+                instructions.emplace_back(unary_statement{ process_unary_operator(exp.unary_op(i)),
+                                                           values[exp.operand(i)],
+                                                           dst });
+                values[i] = dst;
+                break;
+            }
+            case parser::node_kind::binary:
+            {
+                auto op = exp.binary_op(i);
+                if (parser::info(op).short_circuit)
+                {
+                    // The operators still waiting for their right operand are nested, the innermost is the last
+                    values[i] = end_short_circuit(op,
+                                                  values[exp.right(i)],
+                                                  logical_labels.back(),
+                                                  instructions,
+                                                  symbols);
+                    logical_labels.pop_back();
+                    break;
+                }
+                auto dst = var{ get_temporary_name(symbols) };
+                instructions.emplace_back(
+                  binary_statement{ process_binary_operator(op), values[exp.left(i)], values[exp.right(i)], dst });
+                values[i] = dst;
+                break;
+            }
+        }
+
+        if (short_circuit[i] != none)
+        {
+            logical_labels.push_back(
+              begin_short_circuit(exp.binary_op(short_circuit[i]), values[i], instructions, symbols));
+        }
+    }
+    return values[exp.root()];
 }
 
-val process_expression(const wccff::parser::expression &exp, std::vector<instruction> &instructions)
+/**
+ * Like the lowering of the tree, the value of a shared node is reused, unless it was computed in the right operand of a
+ * && or || that is finished. Then the node is read again from where it starts, and lowered again.
+ */
+val process_expression(wccff::parser::expression_reader exp,
+                       std::vector<instruction> &instructions,
+                       symbol_interner &symbols)
 {
-    return std::visit(visitor{ [](const parser::int_constant &c) -> val { return process_int_constant(c); },
-                               [&instructions](const std::unique_ptr<parser::unary_node> &n) -> val {
-                                   return process_unary_node(n, instructions);
-                               },
-                               [&instructions](const std::unique_ptr<parser::binary_node> &n) -> val {
-                                   return process_binary_node(n, instructions);
-                               } },
-                      exp);
+    struct pending_operator
+    {
+        parser::serialized_node node;
+        uint8_t missing_operands;
+        // Only used by && and ||
+        short_circuit_labels labels{};
+    };
+    // A shared node that is read again, its operators are the ones after base
+    struct shared_reader
+    {
+        parser::expression_reader reader;
+        std::size_t base;
+    };
+
+    std::vector<pending_operator> operators;
+    std::vector<val> values;
+    std::vector<shared_reader> rereads;
+
+    std::unordered_map<uint32_t, val> shared_values;
+    // The shared nodes in the order they were computed, and where each pending right operand of && or || starts
+    std::vector<uint32_t> computed;
+    std::vector<std::size_t> conditional_scopes;
+    auto remember = [&](const parser::serialized_node &node) {
+        if (node.shared)
+        {
+            shared_values.emplace(node.offset, values.back());
+            computed.push_back(node.offset);
+        }
+    };
+
+    while (true)
+    {
+        auto node = rereads.empty() ? exp.next() : rereads.back().reader.next();
+        if (node.reference)
+        {
+            auto found = shared_values.find(node.offset);
+            if (found == shared_values.end())
+            {
+                rereads.push_back({ exp.at(node.offset), operators.size() });
+                continue;
+            }
+            values.push_back(found->second);
+        }
+        else if (node.kind == parser::node_kind::unary)
+        {
+            operators.push_back({ node, 1 });
+            continue;
+        }
+        else if (node.kind == parser::node_kind::binary)
+        {
+            operators.push_back({ node, 2 });
+            continue;
+        }
+        else
+        {
+            values.emplace_back(constant{ node.value });
+        }
+
+        // Every operator whose last operand was just lowered is lowered in turn
+        while (operators.empty() == false)
+        {
+            if (rereads.empty() == false && rereads.back().base == operators.size())
+            {
+                rereads.pop_back();
+                continue;
+            }
+            auto &top = operators.back();
+            top.missing_operands--;
+            if (top.node.kind == parser::node_kind::unary)
+            {
+                auto dst = var{ get_temporary_name(symbols) };
+                auto op = process_unary_operator(static_cast<parser::unary_operator>(top.node.op));
+                instructions.emplace_back(unary_statement{ op, values.back(), dst });
+                values.back() = dst;
+                remember(top.node);
+                operators.pop_back();
+                continue;
+            }
+
+            auto op = static_cast<parser::binary_operator>(top.node.op);
+            if (parser::info(op).short_circuit)
+            {
+                if (top.missing_operands > 0)
+                {
+                    top.labels = begin_short_circuit(op, values.back(), instructions, symbols);
+                    values.pop_back();
+                    conditional_scopes.push_back(computed.size());
+                    break;
+                }
+                // The values computed by the right operand don't exist when it's skipped
+                for (auto i = conditional_scopes.back(); i < computed.size(); i++)
+                {
+                    shared_values.erase(computed[i]);
+                }
+                computed.resize(conditional_scopes.back());
+                conditional_scopes.pop_back();
+                values.back() = end_short_circuit(op, values.back(), top.labels, instructions, symbols);
+                remember(top.node);
+                operators.pop_back();
+                continue;
+            }
+            if (top.missing_operands > 0)
+            {
+                break;
+            }
+            auto v2 = values.back();
+            values.pop_back();
+            auto dst = var{ get_temporary_name(symbols) };
+            instructions.emplace_back(binary_statement{ process_binary_operator(op), values.back(), v2, dst });
+            values.back() = dst;
+            remember(top.node);
+            operators.pop_back();
+        }
+        if (operators.empty())
+        {
+            return values.back();
+        }
+    }
 }
 
-std::vector<instruction> process_return_node(const wccff::parser::return_node &stmt)
+std::vector<instruction> process_return_node(const wccff::parser::return_node &stmt, symbol_interner &symbols)
 {
     std::vector<instruction> instructions;
-    auto node = return_statement{ process_expression(stmt.e, instructions) };
+    auto node = return_statement{ process_expression(stmt.e, instructions, symbols) };
     instructions.emplace_back(return_statement{ node });
     return instructions;
 }
 
-std::vector<instruction> process_statement(const wccff::parser::statement &s)
+std::vector<instruction> process_statement(const wccff::parser::statement &s, symbol_interner &symbols)
 {
-    return process_return_node(std::get<wccff::parser::return_node>(s));
+    return process_return_node(std::get<wccff::parser::return_node>(s), symbols);
 }
-function_definition process_function_definition(const parser::function &f)
+function_definition process_function_definition(const parser::function &f, symbol_interner &symbols)
 {
-    return { process_identifier(f.function_name), process_statement(f.body) };
+    auto start = trace::clock::now();
+    function_definition result{ process_identifier(f.function_name), process_statement(f.body, symbols) };
+    WCCFF_TRACE(tacky,
+                info,
+                "Lowered function {} to {} instructions in {:.1f} us",
+                symbols.text(result.name.name),
+                result.instructions.size(),
+                trace::microseconds_since(start));
+    return result;
 }
 
-program process(const parser::program &input)
+program process(const parser::program &input, symbol_interner &symbols)
 {
-    return { process_function_definition(input.f) };
+    return { process_function_definition(input.f, symbols) };
 }
 
-std::string pretty_print(const unary_operator &op, int32_t ident)
+program process(const parser::serialized_program &input, symbol_interner &symbols)
 {
-    return std::visit(
-      visitor{
-        [ident](const binary_complement_operator &) { return wccff::format_indented(ident, "Complement"); },
-        [ident](const negate_operator &) { return wccff::format_indented(ident, "Negate"); },
-        [ident](const not_operator &) { return wccff::format_indented(ident, "Not"); },
-      },
-      op);
+    auto start = trace::clock::now();
+    std::vector<instruction> instructions;
+    auto value = process_expression(input.return_expression(), instructions, symbols);
+    instructions.emplace_back(return_statement{ value });
+    WCCFF_TRACE(tacky,
+                info,
+                "Lowered function {} to {} instructions in {:.1f} us",
+                input.function_name(),
+                instructions.size(),
+                trace::microseconds_since(start));
+    return { { identifier{ symbols.intern(input.function_name()) }, std::move(instructions) } };
 }
-std::string pretty_print(const binary_operator &op, int32_t ident)
+
+tacky_builder::node tacky_builder::constant(int32_t value)
 {
-    return std::visit(
-      visitor{
-        [ident](const plus_operator &) { return wccff::format_indented(ident, "Plus"); },
-        [ident](const subtract_operator &) { return wccff::format_indented(ident, "Subtract"); },
-        [ident](const multiply_operator &) { return wccff::format_indented(ident, "Multiply"); },
-        [ident](const divide_operator &) { return wccff::format_indented(ident, "Divide"); },
-        [ident](const remainder_operator &) { return wccff::format_indented(ident, "Remainder"); },
-        [ident](const binary_and_operator &) { return wccff::format_indented(ident, "Bitwise And"); },
-        [ident](const binary_or_operator &) { return wccff::format_indented(ident, "Bitwise Or"); },
-        [ident](const binary_xor_operator &) { return wccff::format_indented(ident, "Bitwise Xor"); },
-        [ident](const left_shift_operator &) { return wccff::format_indented(ident, "Left Shift"); },
-        [ident](const right_shift_operator &) { return wccff::format_indented(ident, "Right Shift"); },
-        [ident](const equal_operator &) { return wccff::format_indented(ident, "Equal"); },
-        [ident](const not_equal_operator &) { return wccff::format_indented(ident, "Not Equal"); },
-        [ident](const less_than_operator &) { return wccff::format_indented(ident, "Less Than"); },
-        [ident](const less_than_or_equal_operator &) { return wccff::format_indented(ident, "Less That or Equal"); },
-        [ident](const greater_than_operator &) { return wccff::format_indented(ident, "Greater Than"); },
-        [ident](const greater_than_or_equal_operator &) {
-            return wccff::format_indented(ident, "Greater That or Equal");
-        },
-      },
-      op);
+    return tacky::constant{ value };
 }
-std::string pretty_print(const constant &val, int32_t ident)
+
+tacky_builder::node tacky_builder::unary(parser::unary_operator op, node operand)
 {
-    return wccff::format_indented(ident, "Constant({})", val.value);
+    auto dst = var{ get_temporary_name(m_symbols) };
+    m_instructions.emplace_back(unary_statement{ process_unary_operator(op), operand, dst });
+    return dst;
 }
-std::string pretty_print(const var &var, int32_t ident)
+
+tacky_builder::node tacky_builder::binary(parser::binary_operator op, node left, node right)
 {
-    return wccff::format_indented(ident, "Var({})", var.id.name);
+    if (parser::info(op).short_circuit)
+    {
+        // The left operand was already tested by begin_right_operand
+        auto dst = end_short_circuit(op, right, m_short_circuits.back(), m_instructions, m_symbols);
+        m_short_circuits.pop_back();
+        return dst;
+    }
+    auto dst = var{ get_temporary_name(m_symbols) };
+    m_instructions.emplace_back(binary_statement{ process_binary_operator(op), left, right, dst });
+    return dst;
 }
-std::string pretty_print(const val &val, int32_t ident)
+
+void tacky_builder::begin_right_operand(parser::binary_operator op, node left)
 {
-    return std::visit(visitor{ [ident](const auto &n) { return pretty_print(n, ident); } }, val);
+    if (parser::info(op).short_circuit)
+    {
+        m_short_circuits.push_back(begin_short_circuit(op, left, m_instructions, m_symbols));
+    }
 }
-std::string pretty_print(const return_statement &instruction, int32_t ident)
+
+static std::expected<program, parser::parser_error> parse_and_lower_function(parser::tokens &tokens,
+                                                                             compilation_context &context)
 {
-    return wccff::format_indented(ident, "Return({})\n", pretty_print(instruction.val, 0));
+    auto start = trace::clock::now();
+    auto function_name = parser::parse_function_header(tokens, context);
+    if (function_name.has_value() == false)
+    {
+        return std::unexpected{ function_name.error() };
+    }
+    auto keyword = tokens.expect(lexer::token_type::return_keyword, "return keyword");
+    if (keyword.has_value() == false)
+    {
+        return std::unexpected{ keyword.error() };
+    }
+
+    std::vector<instruction> instructions;
+    tacky_builder builder{ instructions, context.symbols };
+    auto value = parser::parse_expression(tokens, builder);
+    if (value.has_value() == false)
+    {
+        return std::unexpected{ value.error() };
+    }
+    instructions.emplace_back(return_statement{ value.value() });
+
+    auto end = parser::parse_function_end(tokens);
+    if (end.has_value() == false)
+    {
+        return std::unexpected{ end.error() };
+    }
+    WCCFF_TRACE(tacky,
+                info,
+                "Lowered function {} to {} instructions while parsing it in {:.1f} us",
+                context.symbols.text(function_name->name),
+                instructions.size(),
+                trace::microseconds_since(start));
+    return program{ { process_identifier(function_name.value()), std::move(instructions) } };
 }
-std::string pretty_print(const unary_statement &i, int32_t ident)
+
+std::expected<program, parser::parser_error> parse_and_lower(parser::tokens &tokens, compilation_context &context)
 {
-    return wccff::format_indented(ident,
-                                  "Unary({}, {}, {})\n",
-                                  pretty_print(i.op, 0),
-                                  pretty_print(i.src, 0),
-                                  pretty_print(i.dst, 0));
+    auto p = parse_and_lower_function(tokens, context);
+    auto end = parser::check_end_of_input(tokens, p.has_value() ? std::nullopt : std::optional{ p.error() });
+    if (end.has_value() == false)
+    {
+        return std::unexpected{ end.error() };
+    }
+    return p;
 }
-std::string pretty_print(const binary_statement &i, int32_t ident)
+
+void pretty_print(print_context &context, const unary_operator &op)
 {
-    return wccff::format_indented(ident,
-                                  "Binary({}, {}, {}, {})\n",
-                                  pretty_print(i.op, 0),
-                                  pretty_print(i.src1, 0),
-                                  pretty_print(i.src2, 0),
-                                  pretty_print(i.dst, 0));
+    context.write("{}", info(op).name);
+}
+void pretty_print(print_context &context, const binary_operator &op)
+{
+    context.write("{}", info(op).name);
+}
+void pretty_print(print_context &context, const constant &val)
+{
+    context.write("Constant({})", val.value);
+}
+void pretty_print(print_context &context, const var &var)
+{
+    context.write("Var({})", context.symbols.text(var.id.name));
+}
+void pretty_print(print_context &context, const val &val)
+{
+    std::visit(visitor{ [&context](const auto &n) { pretty_print(context, n); } }, val);
+}
+void pretty_print(print_context &context, const return_statement &instruction)
+{
+    context.write_indented("Return(");
+    pretty_print(context, instruction.val);
+    context.write(")\n");
+}
+void pretty_print(print_context &context, const unary_statement &i)
+{
+    context.write_indented("Unary(");
+    pretty_print(context, i.op);
+    context.write(", ");
+    pretty_print(context, i.src);
+    context.write(", ");
+    pretty_print(context, i.dst);
+    context.write(")\n");
+}
+void pretty_print(print_context &context, const binary_statement &i)
+{
+    context.write_indented("Binary(");
+    pretty_print(context, i.op);
+    context.write(", ");
+    pretty_print(context, i.src1);
+    context.write(", ");
+    pretty_print(context, i.src2);
+    context.write(", ");
+    pretty_print(context, i.dst);
+    context.write(")\n");
 }
 
-std::string pretty_print(const copy_statement &i, int32_t ident)
+void pretty_print(print_context &context, const copy_statement &i)
 {
-    return wccff::format_indented(ident, "Copy({}, {})\n", pretty_print(i.src, 0), pretty_print(i.dst, 0));
+    context.write_indented("Copy(");
+    pretty_print(context, i.src);
+    context.write(", ");
+    pretty_print(context, i.dst);
+    context.write(")\n");
 }
-std::string pretty_print(const jump_statement &i, int32_t ident)
+void pretty_print(print_context &context, const jump_statement &i)
 {
-    return wccff::format_indented(ident, "Jump({})\n", i.target.name);
+    context.write_indented("Jump({})\n", context.symbols.text(i.target.name));
 }
-std::string pretty_print(const jump_if_zero_statement &i, int32_t ident)
+void pretty_print(print_context &context, const jump_if_zero_statement &i)
 {
-    return wccff::format_indented(ident, "JumpIfZero({}, {})\n", pretty_print(i.condition, 0), i.target.name);
+    context.write_indented("JumpIfZero(");
+    pretty_print(context, i.condition);
+    context.write(", {})\n", context.symbols.text(i.target.name));
 }
-std::string pretty_print(const jump_if_not_zero_statement &i, int32_t ident)
+void pretty_print(print_context &context, const jump_if_not_zero_statement &i)
 {
-    return wccff::format_indented(ident, "JumpIfNotZero({}, {})\n", pretty_print(i.condition, 0), i.target.name);
+    context.write_indented("JumpIfNotZero(");
+    pretty_print(context, i.condition);
+    context.write(", {})\n", context.symbols.text(i.target.name));
 }
-std::string pretty_print(const label_statement &i, int32_t ident)
+void pretty_print(print_context &context, const label_statement &i)
 {
-    return wccff::format_indented(ident, "Label({})\n", i.target.name);
+    context.write_indented("Label({})\n", context.symbols.text(i.target.name));
 }
 
-std::string pretty_print(const instruction &instruction, int32_t ident)
+void pretty_print(print_context &context, const instruction &instruction)
 {
-    return std::visit(visitor{ [ident](const auto &n) { return pretty_print(n, ident); } }, instruction);
+    std::visit(visitor{ [&context](const auto &n) { pretty_print(context, n); } }, instruction);
 }
 
-std::string pretty_print(const std::vector<instruction> &instructions, int32_t ident)
+void pretty_print(print_context &context, const std::vector<instruction> &instructions)
 {
-    std::string output;
     for (const auto &i : instructions)
     {
-        output += pretty_print(i, ident);
+        pretty_print(context, i);
     }
+}
 
-    return output;
+void pretty_print(print_context &context, const function_definition &f)
+{
+    context.write_indented("Function({})\n", context.symbols.text(f.name.name));
+    context.indent += 4;
+    pretty_print(context, f.instructions);
+    context.indent -= 4;
+}
+
+void pretty_print(print_context &context, const program &p)
+{
+    pretty_print(context, p.function);
+}
+
+std::string pretty_print(const symbol_interner &symbols, const val &val)
+{
+    return print_to_string(symbols, val);
+}
+
+std::string pretty_print(const symbol_interner &symbols, const instruction &instruction, int32_t ident)
+{
+    return print_to_string(symbols, instruction, ident);
+}
+
+std::string pretty_print(const symbol_interner &symbols, const std::vector<instruction> &instructions, int32_t ident)
+{
+    return print_to_string(symbols, instructions, ident);
 }
 
-std::string pretty_print(const function_definition &f, int ident)
+std::string pretty_print(const symbol_interner &symbols, const function_definition &f, int32_t ident)
 {
-    return wccff::format_indented(ident, "Function({})\n{}", f.name.name, pretty_print(f.instructions, ident + 4));
+    return print_to_string(symbols, f, ident);
 }
 
-std::string pretty_print(const program &p, int ident)
+std::string pretty_print(const symbol_interner &symbols, const program &p, int32_t ident)
 {
-    return pretty_print(p.function, ident);
+    return print_to_string(symbols, p, ident);
 }
 } // namespace wccff::tacky
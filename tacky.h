@@ -20,9 +20,16 @@
 #ifndef TACKY_H
 #define TACKY_H
 
+#include "compilation_context.h"
+#include "flat_ast.h"
 #include "parser.h"
+#include "serialized_ast.h"
+#include "symbol.h"
+#include <array>
 #include <cstdint>
+#include <expected>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -36,85 +43,95 @@ struct tacky_error
 
 struct identifier
 {
-    std::string name;
+    symbol name;
 };
 
-struct binary_and_operator
-{
-};
-struct binary_complement_operator
-{
-};
-struct binary_or_operator
-{
-};
-struct binary_xor_operator
-{
-};
-struct negate_operator
-{
-};
-struct not_operator
+/**
+ * The operators are a single byte, their properties are looked up in the tables below.
+ */
+enum class unary_operator : uint8_t
 {
+    complement,
+    negate,
+    logical_not,
 };
 
-struct plus_operator
-{
-};
-struct subtract_operator
-{
-};
-struct multiply_operator
-{
+enum class binary_operator : uint8_t
+{
+    plus,
+    subtract,
+    multiply,
+    divide,
+    remainder,
+    bitwise_and,
+    bitwise_or,
+    bitwise_xor,
+    left_shift,
+    right_shift,
+    equal,
+    not_equal,
+    less_than,
+    less_than_or_equal,
+    greater_than,
+    greater_than_or_equal,
 };
-struct divide_operator
-{
-};
-struct remainder_operator
-{
-};
-struct left_shift_operator
-{
-};
-struct right_shift_operator
-{
-};
-struct equal_operator
-{
-};
-struct not_equal_operator
-{
-};
-struct less_than_operator
+
+struct unary_operator_info
 {
+    std::string_view name;
 };
-struct less_than_or_equal_operator
+
+struct binary_operator_info
 {
+    std::string_view name;
+    // The result is 1 or 0, depending on the comparison of the operands
+    bool relational;
+    bool commutative;
 };
-struct greater_than_operator
+
+/**
+ * Indexed by unary_operator.
+ */
+constexpr std::array<unary_operator_info, 3> unary_operators{ {
+  { "Complement" },
+  { "Negate" },
+  { "Not" },
+} };
+
+/**
+ * Indexed by binary_operator.
+ */
+constexpr std::array<binary_operator_info, 16> binary_operators{ {
+  { "Plus", false, true },
+  { "Subtract", false, false },
+  { "Multiply", false, true },
+  { "Divide", false, false },
+  { "Remainder", false, false },
+  { "Bitwise And", false, true },
+  { "Bitwise Or", false, true },
+  { "Bitwise Xor", false, true },
+  { "Left Shift", false, false },
+  { "Right Shift", false, false },
+  { "Equal", true, true },
+  { "Not Equal", true, true },
+  { "Less Than", true, false },
+  { "Less That or Equal", true, false },
+  { "Greater Than", true, false },
+  { "Greater That or Equal", true, false },
+} };
+
+static_assert(unary_operators.size() == static_cast<std::size_t>(unary_operator::logical_not) + 1);
+static_assert(binary_operators.size() == static_cast<std::size_t>(binary_operator::greater_than_or_equal) + 1);
+
+constexpr const unary_operator_info &info(unary_operator op)
 {
-};
-struct greater_than_or_equal_operator
+    return unary_operators[static_cast<std::size_t>(op)];
+}
+constexpr const binary_operator_info &info(binary_operator op)
 {
-};
+    return binary_operators[static_cast<std::size_t>(op)];
+}
 
-using unary_operator = std::variant<binary_complement_operator, negate_operator, not_operator>;
-using binary_operator = std::variant<plus_operator,
-                                     subtract_operator,
-                                     multiply_operator,
-                                     divide_operator,
-                                     remainder_operator,
-                                     binary_and_operator,
-                                     binary_or_operator,
-                                     binary_xor_operator,
-                                     left_shift_operator,
-                                     right_shift_operator,
-                                     equal_operator,
-                                     not_equal_operator,
-                                     less_than_operator,
-                                     less_than_or_equal_operator,
-                                     greater_than_operator,
-                                     greater_than_or_equal_operator>;
 struct constant
 {
     int32_t value;
@@ -232,30 +249,111 @@ struct program
 
 identifier process_identifier(const parser::identifier &id);
 constant process_int_constant(const parser::int_constant &int_con);
-unary_operator process_unary_operator(const parser::unary_operator &op);
-binary_operator process_binary_operator(const parser::binary_operator &op);
-val process_binary_node(const std::unique_ptr<parser::binary_node> &node, std::vector<instruction> &instructions);
-val process_unary_node(const std::unique_ptr<parser::unary_node> &node, std::vector<instruction> &instructions);
-
-val process_expression(const wccff::parser::expression &exp, std::vector<instruction> &instructions);
-program process(const parser::program &input);
-
-std::string pretty_print(const unary_operator &val, int32_t ident = 0);
-std::string pretty_print(const constant &val, int32_t ident = 0);
-std::string pretty_print(const var &val, int32_t ident = 0);
-std::string pretty_print(const val &val, int32_t ident = 0);
-std::string pretty_print(const return_statement &instruction, int32_t ident = 0);
-std::string pretty_print(const unary_statement &instruction, int32_t ident = 0);
-std::string pretty_print(const binary_statement &i, int32_t ident = 0);
-std::string pretty_print(const copy_statement &i, int32_t ident = 0);
-std::string pretty_print(const jump_statement &i, int32_t ident = 0);
-std::string pretty_print(const jump_if_zero_statement &i, int32_t ident = 0);
-std::string pretty_print(const jump_if_not_zero_statement &i, int32_t ident = 0);
-std::string pretty_print(const label_statement &i, int32_t ident = 0);
-std::string pretty_print(const instruction &instruction, int32_t ident = 0);
-std::string pretty_print(const std::vector<instruction> &instructions, int32_t ident = 0);
-std::string pretty_print(const function_definition &f, int32_t ident = 0);
-std::string pretty_print(const program &p, int32_t ident = 0);
+unary_operator process_unary_operator(parser::unary_operator op);
+binary_operator process_binary_operator(parser::binary_operator op);
+val process_binary_node(const parser::binary_node *node,
+                        std::vector<instruction> &instructions,
+                        symbol_interner &symbols);
+val process_unary_node(const parser::unary_node *node,
+                       std::vector<instruction> &instructions,
+                       symbol_interner &symbols);
+
+/**
+ * The temporaries and the labels are interned in symbols.
+ */
+val process_expression(const wccff::parser::expression &exp,
+                       std::vector<instruction> &instructions,
+                       symbol_interner &symbols);
+/**
+ * Same instructions as the lowering of the equivalent tree, in a single forward scan over the nodes.
+ */
+val process_expression(const wccff::parser::flat_expression &exp,
+                       std::vector<instruction> &instructions,
+                       symbol_interner &symbols);
+/**
+ * Lowers the expression while it's read, without building it in memory first.
+ */
+val process_expression(wccff::parser::expression_reader exp,
+                       std::vector<instruction> &instructions,
+                       symbol_interner &symbols);
+program process(const parser::program &input, symbol_interner &symbols);
+
+/**
+ * Labels of a && or || whose right operand is being lowered.
+ */
+struct short_circuit_labels
+{
+    identifier false_label;
+    identifier end_label;
+};
+
+/**
+ * Emits the instructions of an expression while it's parsed, see parser::parse_expression, so no AST is built.
+ * The instructions are the ones of the lowering of the tree of the expression.
+ */
+class tacky_builder
+{
+  public:
+    using node = val;
+
+    tacky_builder(std::vector<instruction> &instructions, symbol_interner &symbols)
+      : m_instructions(instructions)
+      , m_symbols(symbols)
+    {
+    }
+
+    node constant(int32_t value);
+    node unary(parser::unary_operator op, node operand);
+    node binary(parser::binary_operator op, node left, node right);
+    /**
+     * && and || jump over their right operand, once the left one is computed.
+     */
+    void begin_right_operand(parser::binary_operator op, node left);
+
+  private:
+    std::vector<instruction> &m_instructions;
+    symbol_interner &m_symbols;
+    // The labels of the && and || whose right operand is being parsed, the innermost one last
+    std::vector<short_circuit_labels> m_short_circuits;
+};
+
+/**
+ * Parses the program and lowers it in the same pass, the errors are the ones of parser::parse.
+ */
+std::expected<program, parser::parser_error> parse_and_lower(parser::tokens &tokens, compilation_context &context);
+/**
+ * Lowers a serialized program in place, the same instructions as the lowering of the program it was made from.
+ */
+program process(const parser::serialized_program &input, symbol_interner &symbols);
+
+/**
+ * The operators and the values are written inline, the instructions are written one per indented line.
+ */
+void pretty_print(print_context &context, const unary_operator &op);
+void pretty_print(print_context &context, const binary_operator &op);
+void pretty_print(print_context &context, const constant &val);
+void pretty_print(print_context &context, const var &var);
+void pretty_print(print_context &context, const val &val);
+void pretty_print(print_context &context, const return_statement &instruction);
+void pretty_print(print_context &context, const unary_statement &i);
+void pretty_print(print_context &context, const binary_statement &i);
+void pretty_print(print_context &context, const copy_statement &i);
+void pretty_print(print_context &context, const jump_statement &i);
+void pretty_print(print_context &context, const jump_if_zero_statement &i);
+void pretty_print(print_context &context, const jump_if_not_zero_statement &i);
+void pretty_print(print_context &context, const label_statement &i);
+void pretty_print(print_context &context, const instruction &instruction);
+void pretty_print(print_context &context, const std::vector<instruction> &instructions);
+void pretty_print(print_context &context, const function_definition &f);
+void pretty_print(print_context &context, const program &p);
+
+std::string pretty_print(const symbol_interner &symbols, const val &val);
+std::string pretty_print(const symbol_interner &symbols, const instruction &instruction, int32_t ident = 0);
+std::string pretty_print(const symbol_interner &symbols,
+                         const std::vector<instruction> &instructions,
+                         int32_t ident = 0);
+std::string pretty_print(const symbol_interner &symbols, const function_definition &f, int32_t ident = 0);
+std::string pretty_print(const symbol_interner &symbols, const program &p, int32_t ident = 0);
 
 } // namespace wccff::tacky
 #endif // TACKY_H
@@ -0,0 +1,66 @@
+#include "../arena.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+
+namespace {
+struct point
+{
+    int32_t x;
+    int32_t y;
+};
+} // namespace
+
+TEST_CASE("Arena", "[arena]")
+{
+    wccff::arena arena{ 256 };
+
+    SECTION("Objects are constructed in place")
+    {
+        auto *a = arena.create<point>(1, 2);
+        auto *b = arena.create<point>(3, 4);
+        REQUIRE(a != b);
+        REQUIRE(a->x == 1);
+        REQUIRE(a->y == 2);
+        REQUIRE(b->x == 3);
+        REQUIRE(b->y == 4);
+    }
+
+    SECTION("Allocations are aligned")
+    {
+        arena.allocate(1, 1);
+        auto *p = arena.allocate(8, 8);
+        REQUIRE(reinterpret_cast<std::uintptr_t>(p) % 8 == 0);
+        auto *q = arena.allocate(3, 1);
+        auto *r = arena.allocate(16, 16);
+        REQUIRE(reinterpret_cast<std::uintptr_t>(r) % 16 == 0);
+        REQUIRE(static_cast<std::byte *>(q) > static_cast<std::byte *>(p));
+    }
+
+    SECTION("A new block is allocated when the current one is full")
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            REQUIRE(arena.create<point>(i, i)->x == i);
+        }
+        REQUIRE(arena.blocks() > 1);
+        REQUIRE(arena.bytes_used() == 100 * sizeof(point));
+
+        // Bigger than a block
+        auto *big = static_cast<std::byte *>(arena.allocate(1000, 8));
+        big[999] = std::byte{ 1 };
+        REQUIRE(arena.bytes_used() >= 100 * sizeof(point) + 1000);
+    }
+
+    SECTION("Release frees everything but the first block")
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            arena.create<point>(i, i);
+        }
+        arena.release();
+        REQUIRE(arena.blocks() == 1);
+        REQUIRE(arena.bytes_used() == 0);
+        REQUIRE(arena.create<point>(5, 6)->y == 6);
+    }
+}
@@ -5,12 +5,14 @@
 
 TEST_CASE("Binary Operations", "[assembly_generation]")
 {
+    wccff::compilation_context context;
+
     SECTION("binary_and")
     {
         wccff::tacky::constant src1{ 1 };
         wccff::tacky::constant src2{ 2 };
-        wccff::tacky::var dst{ "tacky-1" };
-        wccff::tacky::binary_statement stmt{ wccff::tacky::binary_and_operator{}, src1, src2, dst };
+        wccff::tacky::var dst{ context.symbols.intern("tacky-1") };
+        wccff::tacky::binary_statement stmt{ wccff::tacky::binary_operator::bitwise_and, src1, src2, dst };
 
         auto instructions = wccff::assembly_generation::process_statement(stmt);
         REQUIRE(instructions.size() == 2);
@@ -19,23 +21,25 @@ TEST_CASE("Binary Operations", "[assembly_generation]")
         REQUIRE(std::holds_alternative<wccff::assembly_generation::immediate>(inst1.src));
         REQUIRE(std::get<wccff::assembly_generation::immediate>(inst1.src).value == 1);
         REQUIRE(std::holds_alternative<wccff::assembly_generation::pseudo>(inst1.dst));
-        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst1.dst).name.name == "tacky-1");
+        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst1.dst).name.name ==
+                context.symbols.intern("tacky-1"));
 
         REQUIRE(std::holds_alternative<wccff::assembly_generation::binary>(instructions.at(1)));
         auto inst2 = std::get<wccff::assembly_generation::binary>(instructions.at(1));
-        REQUIRE(std::holds_alternative<wccff::assembly_generation::binary_and>(inst2.op));
+        REQUIRE(inst2.op == wccff::assembly_generation::binary_operator::binary_and);
         REQUIRE(std::holds_alternative<wccff::assembly_generation::immediate>(inst2.src));
         REQUIRE(std::get<wccff::assembly_generation::immediate>(inst2.src).value == 2);
         REQUIRE(std::holds_alternative<wccff::assembly_generation::pseudo>(inst2.dst));
-        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst2.dst).name.name == "tacky-1");
+        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst2.dst).name.name ==
+                context.symbols.intern("tacky-1"));
     }
 
     SECTION("binary_or")
     {
         wccff::tacky::constant src1{ 1 };
         wccff::tacky::constant src2{ 2 };
-        wccff::tacky::var dst{ "tacky-1" };
-        wccff::tacky::binary_statement stmt{ wccff::tacky::binary_or_operator{}, src1, src2, dst };
+        wccff::tacky::var dst{ context.symbols.intern("tacky-1") };
+        wccff::tacky::binary_statement stmt{ wccff::tacky::binary_operator::bitwise_or, src1, src2, dst };
 
         auto instructions = wccff::assembly_generation::process_statement(stmt);
         REQUIRE(instructions.size() == 2);
@@ -44,23 +48,25 @@ TEST_CASE("Binary Operations", "[assembly_generation]")
         REQUIRE(std::holds_alternative<wccff::assembly_generation::immediate>(inst1.src));
         REQUIRE(std::get<wccff::assembly_generation::immediate>(inst1.src).value == 1);
         REQUIRE(std::holds_alternative<wccff::assembly_generation::pseudo>(inst1.dst));
-        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst1.dst).name.name == "tacky-1");
+        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst1.dst).name.name ==
+                context.symbols.intern("tacky-1"));
 
         REQUIRE(std::holds_alternative<wccff::assembly_generation::binary>(instructions.at(1)));
         auto inst2 = std::get<wccff::assembly_generation::binary>(instructions.at(1));
-        REQUIRE(std::holds_alternative<wccff::assembly_generation::binary_or>(inst2.op));
+        REQUIRE(inst2.op == wccff::assembly_generation::binary_operator::binary_or);
         REQUIRE(std::holds_alternative<wccff::assembly_generation::immediate>(inst2.src));
         REQUIRE(std::get<wccff::assembly_generation::immediate>(inst2.src).value == 2);
         REQUIRE(std::holds_alternative<wccff::assembly_generation::pseudo>(inst2.dst));
-        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst2.dst).name.name == "tacky-1");
+        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst2.dst).name.name ==
+                context.symbols.intern("tacky-1"));
     }
 
     SECTION("binary_xor")
     {
         wccff::tacky::constant src1{ 1 };
         wccff::tacky::constant src2{ 2 };
-        wccff::tacky::var dst{ "tacky-1" };
-        wccff::tacky::binary_statement stmt{ wccff::tacky::binary_xor_operator{}, src1, src2, dst };
+        wccff::tacky::var dst{ context.symbols.intern("tacky-1") };
+        wccff::tacky::binary_statement stmt{ wccff::tacky::binary_operator::bitwise_xor, src1, src2, dst };
 
         auto instructions = wccff::assembly_generation::process_statement(stmt);
         REQUIRE(instructions.size() == 2);
@@ -69,23 +75,25 @@ TEST_CASE("Binary Operations", "[assembly_generation]")
         REQUIRE(std::holds_alternative<wccff::assembly_generation::immediate>(inst1.src));
         REQUIRE(std::get<wccff::assembly_generation::immediate>(inst1.src).value == 1);
         REQUIRE(std::holds_alternative<wccff::assembly_generation::pseudo>(inst1.dst));
-        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst1.dst).name.name == "tacky-1");
+        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst1.dst).name.name ==
+                context.symbols.intern("tacky-1"));
 
         REQUIRE(std::holds_alternative<wccff::assembly_generation::binary>(instructions.at(1)));
         auto inst2 = std::get<wccff::assembly_generation::binary>(instructions.at(1));
-        REQUIRE(std::holds_alternative<wccff::assembly_generation::binary_xor>(inst2.op));
+        REQUIRE(inst2.op == wccff::assembly_generation::binary_operator::binary_xor);
         REQUIRE(std::holds_alternative<wccff::assembly_generation::immediate>(inst2.src));
         REQUIRE(std::get<wccff::assembly_generation::immediate>(inst2.src).value == 2);
         REQUIRE(std::holds_alternative<wccff::assembly_generation::pseudo>(inst2.dst));
-        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst2.dst).name.name == "tacky-1");
+        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst2.dst).name.name ==
+                context.symbols.intern("tacky-1"));
     }
 
     SECTION("left_shift")
     {
         wccff::tacky::constant src1{ 1 };
         wccff::tacky::constant src2{ 2 };
-        wccff::tacky::var dst{ "tacky-1" };
-        wccff::tacky::binary_statement stmt{ wccff::tacky::left_shift_operator{}, src1, src2, dst };
+        wccff::tacky::var dst{ context.symbols.intern("tacky-1") };
+        wccff::tacky::binary_statement stmt{ wccff::tacky::binary_operator::left_shift, src1, src2, dst };
 
         auto instructions = wccff::assembly_generation::process_statement(stmt);
         REQUIRE(instructions.size() == 2);
@@ -94,23 +102,25 @@ TEST_CASE("Binary Operations", "[assembly_generation]")
         REQUIRE(std::holds_alternative<wccff::assembly_generation::immediate>(inst1.src));
         REQUIRE(std::get<wccff::assembly_generation::immediate>(inst1.src).value == 1);
         REQUIRE(std::holds_alternative<wccff::assembly_generation::pseudo>(inst1.dst));
-        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst1.dst).name.name == "tacky-1");
+        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst1.dst).name.name ==
+                context.symbols.intern("tacky-1"));
 
         REQUIRE(std::holds_alternative<wccff::assembly_generation::binary>(instructions.at(1)));
         auto inst2 = std::get<wccff::assembly_generation::binary>(instructions.at(1));
-        REQUIRE(std::holds_alternative<wccff::assembly_generation::left_shift>(inst2.op));
+        REQUIRE(inst2.op == wccff::assembly_generation::binary_operator::left_shift);
         REQUIRE(std::holds_alternative<wccff::assembly_generation::immediate>(inst2.src));
         REQUIRE(std::get<wccff::assembly_generation::immediate>(inst2.src).value == 2);
         REQUIRE(std::holds_alternative<wccff::assembly_generation::pseudo>(inst2.dst));
-        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst2.dst).name.name == "tacky-1");
+        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst2.dst).name.name ==
+                context.symbols.intern("tacky-1"));
     }
 
     SECTION("right_shift")
     {
         wccff::tacky::constant src1{ 1 };
         wccff::tacky::constant src2{ 2 };
-        wccff::tacky::var dst{ "tacky-1" };
-        wccff::tacky::binary_statement stmt{ wccff::tacky::right_shift_operator{}, src1, src2, dst };
+        wccff::tacky::var dst{ context.symbols.intern("tacky-1") };
+        wccff::tacky::binary_statement stmt{ wccff::tacky::binary_operator::right_shift, src1, src2, dst };
 
         auto instructions = wccff::assembly_generation::process_statement(stmt);
         REQUIRE(instructions.size() == 2);
@@ -119,15 +129,17 @@ TEST_CASE("Binary Operations", "[assembly_generation]")
         REQUIRE(std::holds_alternative<wccff::assembly_generation::immediate>(inst1.src));
         REQUIRE(std::get<wccff::assembly_generation::immediate>(inst1.src).value == 1);
         REQUIRE(std::holds_alternative<wccff::assembly_generation::pseudo>(inst1.dst));
-        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst1.dst).name.name == "tacky-1");
+        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst1.dst).name.name ==
+                context.symbols.intern("tacky-1"));
 
         REQUIRE(std::holds_alternative<wccff::assembly_generation::binary>(instructions.at(1)));
         auto inst2 = std::get<wccff::assembly_generation::binary>(instructions.at(1));
-        REQUIRE(std::holds_alternative<wccff::assembly_generation::right_shift>(inst2.op));
+        REQUIRE(inst2.op == wccff::assembly_generation::binary_operator::right_shift);
         REQUIRE(std::holds_alternative<wccff::assembly_generation::immediate>(inst2.src));
         REQUIRE(std::get<wccff::assembly_generation::immediate>(inst2.src).value == 2);
         REQUIRE(std::holds_alternative<wccff::assembly_generation::pseudo>(inst2.dst));
-        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst2.dst).name.name == "tacky-1");
+        REQUIRE(std::get<wccff::assembly_generation::pseudo>(inst2.dst).name.name ==
+                context.symbols.intern("tacky-1"));
     }
 
     SECTION("equal_operator")
@@ -135,8 +147,8 @@ TEST_CASE("Binary Operations", "[assembly_generation]")
         using namespace wccff;
         tacky::constant src1{ 1 };
         tacky::constant src2{ 2 };
-        tacky::var dst{ "tacky-1" };
-        tacky::binary_statement stmt{ tacky::equal_operator{}, src1, src2, dst };
+        tacky::var dst{ context.symbols.intern("tacky-1") };
+        tacky::binary_statement stmt{ tacky::binary_operator::equal, src1, src2, dst };
         auto instructions = assembly_generation::process_statement(stmt);
         REQUIRE(instructions.size() == 3);
 
@@ -152,23 +164,25 @@ TEST_CASE("Binary Operations", "[assembly_generation]")
         REQUIRE(std::holds_alternative<assembly_generation::immediate>(inst2.src));
         REQUIRE(std::get<assembly_generation::immediate>(inst2.src).value == 0);
         REQUIRE(std::holds_alternative<assembly_generation::pseudo>(inst2.dst));
-        REQUIRE(std::get<assembly_generation::pseudo>(inst2.dst).name.name == "tacky-1");
+        REQUIRE(std::get<assembly_generation::pseudo>(inst2.dst).name.name == context.symbols.intern("tacky-1"));
 
         REQUIRE(std::holds_alternative<assembly_generation::setcc>(instructions.at(2)));
         auto inst3 = std::get<assembly_generation::setcc>(instructions.at(2));
-        REQUIRE(std::holds_alternative<assembly_generation::E>(inst3.cond));
-        REQUIRE(std::get<assembly_generation::pseudo>(inst3.dst).name.name == "tacky-1");
+        REQUIRE(inst3.cond == assembly_generation::cond_code::E);
+        REQUIRE(std::get<assembly_generation::pseudo>(inst3.dst).name.name == context.symbols.intern("tacky-1"));
     }
 }
 
 TEST_CASE("Unary Operations", "[assembly_generation]")
 {
+    wccff::compilation_context context;
+
     using namespace wccff;
     SECTION("not_operator")
     {
         tacky::constant src1{ 1 };
-        tacky::var dst{ "tacky-1" };
-        tacky::unary_statement stmt{ tacky::not_operator{}, src1, dst };
+        tacky::var dst{ context.symbols.intern("tacky-1") };
+        tacky::unary_statement stmt{ tacky::unary_operator::logical_not, src1, dst };
         auto instructions = assembly_generation::process_statement(stmt);
         REQUIRE(instructions.size() == 3);
 
@@ -184,11 +198,11 @@ TEST_CASE("Unary Operations", "[assembly_generation]")
         REQUIRE(std::holds_alternative<assembly_generation::immediate>(inst2.src));
         REQUIRE(std::get<assembly_generation::immediate>(inst2.src).value == 0);
         REQUIRE(std::holds_alternative<assembly_generation::pseudo>(inst2.dst));
-        REQUIRE(std::get<assembly_generation::pseudo>(inst2.dst).name.name == "tacky-1");
+        REQUIRE(std::get<assembly_generation::pseudo>(inst2.dst).name.name == context.symbols.intern("tacky-1"));
 
         REQUIRE(std::holds_alternative<assembly_generation::setcc>(instructions.at(2)));
         auto inst3 = std::get<assembly_generation::setcc>(instructions.at(2));
-        REQUIRE(std::holds_alternative<assembly_generation::E>(inst3.cond));
-        REQUIRE(std::get<assembly_generation::pseudo>(inst3.dst).name.name == "tacky-1");
+        REQUIRE(inst3.cond == assembly_generation::cond_code::E);
+        REQUIRE(std::get<assembly_generation::pseudo>(inst3.dst).name.name == context.symbols.intern("tacky-1"));
     }
 }
@@ -0,0 +1,68 @@
+#include "../flat_ast.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+
+static wccff::parser::tokens make_tokens(std::string_view source)
+{
+    return wccff::parser::tokens{ wccff::lexer::token_stream{ source } };
+}
+
+TEST_CASE("Flat expressions are stored in post-order", "[flat_ast]")
+{
+    using wccff::parser::node_kind;
+
+    auto tokens = make_tokens("1 + 2 * -3");
+    auto flat = wccff::parser::parse_flat_expression(tokens);
+    REQUIRE(flat.has_value());
+    REQUIRE(flat->size() == 6);
+
+    REQUIRE(flat->kind(0) == node_kind::constant);
+    REQUIRE(flat->value(0) == 1);
+    REQUIRE(flat->value(1) == 2);
+    REQUIRE(flat->value(2) == 3);
+    REQUIRE(flat->kind(3) == node_kind::unary);
+    REQUIRE(flat->unary_op(3) == wccff::parser::unary_operator::negate);
+    REQUIRE(flat->operand(3) == 2);
+    REQUIRE(flat->kind(4) == node_kind::binary);
+    REQUIRE(flat->binary_op(4) == wccff::parser::binary_operator::multiply);
+    REQUIRE(flat->left(4) == 1);
+    REQUIRE(flat->right(4) == 3);
+    REQUIRE(flat->root() == 5);
+    REQUIRE(flat->binary_op(5) == wccff::parser::binary_operator::plus);
+    REQUIRE(flat->left(5) == 0);
+    REQUIRE(flat->right(5) == 4);
+}
+
+TEST_CASE("Flat expressions print like the trees", "[flat_ast]")
+{
+    for (std::string_view source : { "42",
+                                     "-2147483647",
+                                     "1 + 2 * -3",
+                                     "-(-(~(!7)))",
+                                     "(1 && 2) || !(3 < 4) && ~5",
+                                     "1 || 2 || 3 && 4 && (5 || 0)",
+                                     "1 << 2 >> 3 & 4 ^ 5 | 6 == 7 != 8 <= 9 >= 10 > 11 < 12 % 13 / 14 - 15" })
+    {
+        INFO(source);
+        auto tree_tokens = make_tokens(source);
+        wccff::compilation_context context;
+        auto tree = wccff::parser::parse_expression(tree_tokens, context);
+        REQUIRE(tree.has_value());
+        auto flat_tokens = make_tokens(source);
+        auto flat = wccff::parser::parse_flat_expression(flat_tokens);
+        REQUIRE(flat.has_value());
+
+        auto expected = wccff::parser::pretty_print(tree.value(), 4);
+        REQUIRE(wccff::parser::pretty_print(flat.value(), 4) == expected);
+        REQUIRE(wccff::parser::pretty_print(wccff::parser::flatten(tree.value()), 4) == expected);
+    }
+}
+
+TEST_CASE("Flat expression errors", "[flat_ast]")
+{
+    auto tokens = make_tokens("1 + ");
+    auto flat = wccff::parser::parse_flat_expression(tokens);
+    REQUIRE(flat.has_value() == false);
+    REQUIRE(flat.error().message.find("Unexpected end of tokens") != std::string::npos);
+}
@@ -0,0 +1,63 @@
+#include "../hash_consing.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+
+static std::expected<wccff::parser::expression, wccff::parser::parser_error> parse_shared(
+  std::string_view source,
+  wccff::parser::hash_consing_builder &builder)
+{
+    wccff::parser::tokens tokens{ wccff::lexer::token_stream{ source } };
+    return wccff::parser::parse_expression(tokens, builder);
+}
+
+TEST_CASE("Identical subexpressions are built once", "[hash_consing]")
+{
+    using namespace wccff::parser;
+    wccff::compilation_context context;
+
+    hash_consing_builder builder{ context.ast };
+    auto e = parse_shared("(1 + 2) * (1 + 2) - -(1 + 2)", builder);
+    REQUIRE(e.has_value());
+    // 1 + 2, the product, the negation and the difference
+    REQUIRE(builder.size() == 4);
+
+    const auto *difference = std::get<const binary_node *>(e.value());
+    const auto *product = std::get<const binary_node *>(difference->left);
+    const auto *negation = std::get<const unary_node *>(difference->right);
+    REQUIRE(std::get<const binary_node *>(product->left) == std::get<const binary_node *>(product->right));
+    REQUIRE(std::get<const binary_node *>(negation->exp) == std::get<const binary_node *>(product->left));
+    REQUIRE(std::get<const binary_node *>(product->left)->shared);
+    REQUIRE(product->shared == false);
+    REQUIRE(difference->shared == false);
+
+    // The DAG prints like the tree it stands for
+    wccff::parser::tokens tokens{ wccff::lexer::token_stream{ "(1 + 2) * (1 + 2) - -(1 + 2)" } };
+    auto tree = parse_expression(tokens, context);
+    REQUIRE(tree.has_value());
+    REQUIRE(pretty_print(e.value(), 0) == pretty_print(tree.value(), 0));
+}
+
+TEST_CASE("Different subexpressions aren't shared", "[hash_consing]")
+{
+    using namespace wccff::parser;
+    wccff::compilation_context context;
+
+    hash_consing_builder builder{ context.ast };
+    auto e = parse_shared("(1 - 2) + (2 - 1) + -(1 - 2) + ~(1 - 2) + (1 - 3)", builder);
+    REQUIRE(e.has_value());
+    // 1 - 2, 2 - 1, 1 - 3, the negation, the complement and the four sums
+    REQUIRE(builder.size() == 9);
+}
+
+TEST_CASE("Shared subexpressions are folded", "[hash_consing]")
+{
+    using namespace wccff::parser;
+    wccff::compilation_context context;
+
+    hash_consing_builder builder{ context.ast, true };
+    auto e = parse_shared("(1 + 2) * (1 + 2)", builder);
+    REQUIRE(e.has_value());
+    REQUIRE(std::get<int_constant>(e.value()).value == 9);
+    REQUIRE(builder.size() == 0);
+}
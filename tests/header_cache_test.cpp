@@ -0,0 +1,99 @@
+#include "../header_cache.h"
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+TEST_CASE("Header cache", "[preprocessor]")
+{
+    auto directory = std::filesystem::temp_directory_path() / "wccff_header_cache";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    auto header = directory / "header.h";
+    std::ofstream{ header } << "#define A(x) x\nint a = A(1);\\\n int b;\n";
+
+    std::deque<std::string> storage;
+    auto tokens = wccff::preprocessor::tokenize(
+      wccff::lexer::source_buffer::open(header).value().view(), 3, header.string(), storage);
+    REQUIRE(tokens.has_value());
+
+    wccff::preprocessor::header_cache cache{ directory / "cache" };
+    REQUIRE(cache.load(header, 3).has_value() == false);
+    cache.store(header, tokens.value());
+
+    SECTION("Loaded tokens are the stored ones")
+    {
+        auto cached = cache.load(header, 3);
+        REQUIRE(cached.has_value());
+        REQUIRE(cached->buffer.is_mapped());
+        REQUIRE(cached->tokens.size() == tokens->size());
+        for (std::size_t i = 0; i < tokens->size(); i++)
+        {
+            const auto &expected = (*tokens)[i];
+            const auto &t = cached->tokens[i];
+            REQUIRE(t.type == expected.type);
+            REQUIRE(t.text == expected.text);
+            REQUIRE(t.at_line_start == expected.at_line_start);
+            REQUIRE(t.has_space == expected.has_space);
+            REQUIRE(t.line == expected.line);
+            REQUIRE(t.column == expected.column);
+            REQUIRE(t.file == 3);
+        }
+    }
+
+    SECTION("Modified headers aren't loaded")
+    {
+        std::ofstream{ header, std::ios::app } << "int c;\n";
+        std::filesystem::last_write_time(header, std::filesystem::last_write_time(header) + std::chrono::seconds(1));
+        REQUIRE(cache.load(header, 3).has_value() == false);
+    }
+
+    SECTION("Corrupted entries aren't loaded")
+    {
+        std::filesystem::resize_file(cache.entry_path(header), 20);
+        REQUIRE(cache.load(header, 3).has_value() == false);
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Header cache benchmark", "[.][benchmark]")
+{
+    auto directory = std::filesystem::temp_directory_path() / "wccff_header_cache_benchmark";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    auto header = directory / "header.h";
+    {
+        // Shaped like a libc header, mostly comments, declarations and macros
+        std::ofstream out{ header };
+        for (int i = 0; i < 5000; i++)
+        {
+            out << "/* Returns the value number " << i << " of the table,\n   or -1 when it's missing. */\n"
+                << "extern int value_" << i << " (const char *__name, unsigned long int __size) __THROW;\n"
+                << "#define VALUE_" << i << "(x) (value_" << i << " ((x), sizeof (x)))\n";
+        }
+    }
+    wccff::preprocessor::header_cache cache{ directory / "cache" };
+    {
+        std::deque<std::string> storage;
+        auto source = wccff::lexer::source_buffer::open(header).value();
+        cache.store(header, wccff::preprocessor::tokenize(source.view(), 1, header.string(), storage).value());
+    }
+
+    BENCHMARK("Tokenize the header")
+    {
+        std::deque<std::string> storage;
+        auto source = wccff::lexer::source_buffer::open(header).value();
+        return wccff::preprocessor::tokenize(source.view(), 1, header.string(), storage)->size();
+    };
+    BENCHMARK("Load the cache entry")
+    {
+        return cache.load(header, 1)->tokens.size();
+    };
+
+    std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,93 @@
+#include "../integer_literal.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <cstdint>
+#include <string>
+
+using wccff::lexer::decode_integer_literal;
+using wccff::lexer::integer_literal_error;
+using wccff::lexer::integer_suffix;
+
+TEST_CASE("Integer literals", "[lexer]")
+{
+    SECTION("Decimal")
+    {
+        REQUIRE(decode_integer_literal("0")->value == 0);
+        REQUIRE(decode_integer_literal("7")->value == 7);
+        REQUIRE(decode_integer_literal("12345678")->value == 12345678);
+        REQUIRE(decode_integer_literal("123456789")->value == 123456789);
+        REQUIRE(decode_integer_literal("2147483647")->value == 2147483647);
+        REQUIRE(decode_integer_literal("1234567890123456789")->value == 1234567890123456789);
+        REQUIRE(decode_integer_literal("18446744073709551615")->value == UINT64_MAX);
+        REQUIRE(decode_integer_literal("42")->base == 10);
+    }
+
+    SECTION("Decimal overflow")
+    {
+        REQUIRE(decode_integer_literal("18446744073709551616").error() == integer_literal_error::overflow);
+        REQUIRE(decode_integer_literal("99999999999999999999").error() == integer_literal_error::overflow);
+        REQUIRE(decode_integer_literal("100000000000000000000000").error() == integer_literal_error::overflow);
+    }
+
+    SECTION("Hexadecimal")
+    {
+        REQUIRE(decode_integer_literal("0x0")->value == 0);
+        REQUIRE(decode_integer_literal("0x1f")->value == 0x1f);
+        REQUIRE(decode_integer_literal("0XABCDEF")->value == 0xABCDEF);
+        REQUIRE(decode_integer_literal("0x12345678")->value == 0x12345678);
+        REQUIRE(decode_integer_literal("0xDeadBeef")->value == 0xDEADBEEF);
+        REQUIRE(decode_integer_literal("0x0123456789abcdef")->value == 0x0123456789ABCDEF);
+        REQUIRE(decode_integer_literal("0xFFFFFFFFFFFFFFFF")->value == UINT64_MAX);
+        REQUIRE(decode_integer_literal("0x10000000000000000").error() == integer_literal_error::overflow);
+        REQUIRE(decode_integer_literal("0x00000000000000001")->value == 1);
+        REQUIRE(decode_integer_literal("0x1f")->base == 16);
+    }
+
+    SECTION("Octal")
+    {
+        REQUIRE(decode_integer_literal("017")->value == 017);
+        REQUIRE(decode_integer_literal("01777777777777777777777")->value == UINT64_MAX);
+        REQUIRE(decode_integer_literal("02000000000000000000000").error() == integer_literal_error::overflow);
+        REQUIRE(decode_integer_literal("08").error() == integer_literal_error::invalid_digit);
+        REQUIRE(decode_integer_literal("017")->base == 8);
+    }
+
+    SECTION("Binary")
+    {
+        REQUIRE(decode_integer_literal("0b101")->value == 5);
+        REQUIRE(decode_integer_literal("0B1")->value == 1);
+        REQUIRE(decode_integer_literal("0b" + std::string(64, '1'))->value == UINT64_MAX);
+        REQUIRE(decode_integer_literal("0b1" + std::string(64, '0')).error() == integer_literal_error::overflow);
+        REQUIRE(decode_integer_literal("0b102").error() == integer_literal_error::invalid_digit);
+    }
+
+    SECTION("Suffixes")
+    {
+        REQUIRE(decode_integer_literal("1")->suffix == integer_suffix::none);
+        REQUIRE(decode_integer_literal("1u")->suffix == integer_suffix::u);
+        REQUIRE(decode_integer_literal("1L")->suffix == integer_suffix::l);
+        REQUIRE(decode_integer_literal("1uL")->suffix == integer_suffix::ul);
+        REQUIRE(decode_integer_literal("1lu")->suffix == integer_suffix::ul);
+        REQUIRE(decode_integer_literal("1ll")->suffix == integer_suffix::ll);
+        REQUIRE(decode_integer_literal("0x1FULL")->suffix == integer_suffix::ull);
+        REQUIRE(decode_integer_literal("0x1FULL")->value == 0x1F);
+        REQUIRE(decode_integer_literal("1LLu")->suffix == integer_suffix::ull);
+        REQUIRE(decode_integer_literal("123456789u")->value == 123456789);
+    }
+
+    SECTION("Invalid suffixes")
+    {
+        REQUIRE(decode_integer_literal("1lL").error() == integer_literal_error::invalid_suffix);
+        REQUIRE(decode_integer_literal("1uu").error() == integer_literal_error::invalid_suffix);
+        REQUIRE(decode_integer_literal("1lll").error() == integer_literal_error::invalid_suffix);
+        REQUIRE(decode_integer_literal("123abc").error() == integer_literal_error::invalid_suffix);
+        REQUIRE(decode_integer_literal("12345678_").error() == integer_literal_error::invalid_suffix);
+    }
+
+    SECTION("Missing digits")
+    {
+        REQUIRE(decode_integer_literal("0x").error() == integer_literal_error::missing_digits);
+        REQUIRE(decode_integer_literal("0b").error() == integer_literal_error::missing_digits);
+        REQUIRE(decode_integer_literal("0xg").error() == integer_literal_error::missing_digits);
+    }
+}
@@ -0,0 +1,111 @@
+#include "../lexer_simd.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+
+TEST_CASE("SIMD kernels match the scalar kernels", "[lexer]")
+{
+    const auto &scalar = wccff::lexer::simd::available_kernels().front();
+
+    SECTION("White spaces")
+    {
+        // Cover runs that end before, at and after the 16 and 32 bytes blocks.
+        for (std::size_t length = 0; length < 100; length++)
+        {
+            std::string input;
+            for (std::size_t i = 0; i < length; i++)
+            {
+                input += (i % 7 == 3) ? '\n' : ((i % 5 == 1) ? '\t' : ' ');
+            }
+            input += "return 2;";
+
+            auto expected = scalar.skip_whitespace(input);
+            REQUIRE(expected.length == length);
+            for (const auto &kernels : wccff::lexer::simd::available_kernels())
+            {
+                INFO(kernels.name << " with " << length << " white spaces");
+                auto run = kernels.skip_whitespace(input);
+                REQUIRE(run.length == expected.length);
+                REQUIRE(run.newlines == expected.newlines);
+                if (run.newlines != 0)
+                {
+                    REQUIRE(run.line_start == expected.line_start);
+                }
+            }
+        }
+    }
+
+    SECTION("Identifiers and constants")
+    {
+        for (std::size_t length = 1; length < 100; length++)
+        {
+            std::string identifier;
+            std::string digits;
+            for (std::size_t i = 0; i < length; i++)
+            {
+                identifier += "aZ_9"[i % 4];
+                digits += static_cast<char>('0' + i % 10);
+            }
+
+            for (const auto &kernels : wccff::lexer::simd::available_kernels())
+            {
+                INFO(kernels.name << " with " << length << " chars");
+                REQUIRE(kernels.identifier_length(identifier + "+1") == length);
+                REQUIRE(kernels.identifier_length(identifier) == length);
+                // The constants are scanned up to the end of the word too
+                REQUIRE(kernels.identifier_length(digits + ";") == length);
+                REQUIRE(kernels.identifier_length(digits) == length);
+            }
+        }
+    }
+
+    SECTION("Padded kernels")
+    {
+        for (std::size_t length = 0; length < 100; length++)
+        {
+            std::string whitespaces;
+            std::string identifier;
+            std::string digits;
+            for (std::size_t i = 0; i < length; i++)
+            {
+                whitespaces += (i % 7 == 3) ? '\n' : ' ';
+                identifier += "aZ_9"[i % 4];
+                digits += static_cast<char>('0' + i % 10);
+            }
+            auto expected = scalar.skip_whitespace(whitespaces);
+
+            for (const auto &kernels : wccff::lexer::simd::available_kernels())
+            {
+                INFO(kernels.name << " with " << length << " chars");
+                // The runs reaching the end of the input are stopped by the padding
+                for (const auto &input : { whitespaces + "+1", whitespaces })
+                {
+                    auto padded = input + std::string(wccff::lexer::simd::padding_required, '\0');
+                    auto run = kernels.skip_whitespace_padded(padded.data());
+                    REQUIRE(run.length == expected.length);
+                    REQUIRE(run.newlines == expected.newlines);
+                    if (run.newlines != 0)
+                    {
+                        REQUIRE(run.line_start == expected.line_start);
+                    }
+                }
+                auto padding = std::string(wccff::lexer::simd::padding_required, '\0');
+                REQUIRE(kernels.identifier_length_padded((identifier + "+1" + padding).data()) == length);
+                REQUIRE(kernels.identifier_length_padded((identifier + padding).data()) == length);
+                REQUIRE(kernels.identifier_length_padded((digits + ";" + padding).data()) == length);
+                REQUIRE(kernels.identifier_length_padded((digits + padding).data()) == length);
+            }
+        }
+    }
+
+    SECTION("Bytes outside ASCII stop the runs")
+    {
+        std::string input(40, 'a');
+        input[33] = '\xE9';
+        for (const auto &kernels : wccff::lexer::simd::available_kernels())
+        {
+            INFO(kernels.name);
+            REQUIRE(kernels.identifier_length(input) == 33);
+        }
+    }
+}
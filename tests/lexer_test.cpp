@@ -1,8 +1,17 @@
 #include "../compiler.h"
 #include "../lexer.h"
 
+#include <array>
+#include <catch2/benchmark/catch_benchmark.hpp>
 #include <catch2/catch_test_macros.hpp>
+#include <csignal>
+#include <optional>
+#include <stdexcept>
+#include <string>
 #include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 TEST_CASE("Lexer", "[lexer]")
 {
@@ -499,3 +508,369 @@ TEST_CASE("Other tokens", "[lexer]")
         REQUIRE(result.value().at(0).text == ")");
     }
 }
+
+TEST_CASE("Token sequences", "[lexer]")
+{
+    using wccff::lexer::token_type;
+
+    SECTION("Longest operator wins")
+    {
+        std::string_view input{ "a--b<<=c>=!=" };
+        auto result = wccff::lexer::lexer(input);
+        REQUIRE(result.has_value());
+        REQUIRE(result.value().size() == 8);
+        REQUIRE(result.value().at(1).type == token_type::decrement_operator);
+        REQUIRE(result.value().at(3).type == token_type::left_shift_operator);
+        REQUIRE(result.value().at(4).type == token_type::assignment_operator);
+        REQUIRE(result.value().at(6).type == token_type::greater_than_or_equal_operator);
+        REQUIRE(result.value().at(7).type == token_type::not_equals_operator);
+    }
+
+    SECTION("Keyword prefix is an identifier")
+    {
+        std::string_view input{ "integer returns voids" };
+        auto result = wccff::lexer::lexer(input);
+        REQUIRE(result.has_value());
+        REQUIRE(result.value().size() == 3);
+        REQUIRE(result.value().at(0).type == token_type::identifier);
+        REQUIRE(result.value().at(1).type == token_type::identifier);
+        REQUIRE(result.value().at(2).type == token_type::identifier);
+    }
+
+    SECTION("Location after long indentation")
+    {
+        std::string input = std::string(40, ' ') + "a" + std::string(20, '\n') + std::string(37, ' ') + "b";
+        auto result = wccff::lexer::lexer(input);
+        REQUIRE(result.has_value());
+        REQUIRE(result.value().size() == 2);
+        REQUIRE(result.value().at(0).loc == wccff::lexer::file_location{ 0, 40 });
+        REQUIRE(result.value().at(1).loc == wccff::lexer::file_location{ 20, 37 });
+    }
+
+    SECTION("Constant followed by letters")
+    {
+        std::string_view input{ "return 123abc;" };
+        auto result = wccff::lexer::lexer(input);
+        REQUIRE(result.has_value() == false);
+        REQUIRE(result.error().location == wccff::lexer::file_location{ 0, 7 });
+        REQUIRE(result.error().input == "123abc;");
+        REQUIRE(result.error().message == "Invalid suffix on integer constant");
+    }
+
+    SECTION("Constants in every base")
+    {
+        std::string_view input{ "10 0x10 010 0b10 10u 10L" };
+        auto result = wccff::lexer::lexer(input);
+        REQUIRE(result.has_value());
+        REQUIRE(result.value().size() == 6);
+        REQUIRE(result.value().value(0) == 10);
+        REQUIRE(result.value().value(1) == 16);
+        REQUIRE(result.value().value(2) == 8);
+        REQUIRE(result.value().value(3) == 2);
+        REQUIRE(result.value().value(4) == 10);
+        REQUIRE(result.value().value(5) == 10);
+    }
+
+    SECTION("Constant too large for an int")
+    {
+        std::string_view input{ "return 2147483648;" };
+        auto result = wccff::lexer::lexer(input);
+        REQUIRE(result.has_value() == false);
+        REQUIRE(result.error().location == wccff::lexer::file_location{ 0, 7 });
+        REQUIRE(result.error().message == "Integer constant doesn't fit in an int");
+    }
+
+    SECTION("Invalid character")
+    {
+        std::string_view input{ "int @" };
+        auto result = wccff::lexer::lexer(input);
+        REQUIRE(result.has_value() == false);
+        REQUIRE(result.error().input == "@");
+    }
+}
+
+TEST_CASE("Token buffer", "[lexer]")
+{
+    using wccff::lexer::token_type;
+
+    SECTION("Constants are decoded while lexing")
+    {
+        std::string_view input{ "return 2147483647;" };
+        auto result = wccff::lexer::lexer(input);
+        REQUIRE(result.has_value());
+        REQUIRE(result.value().type(1) == token_type::constant);
+        REQUIRE(result.value().value(1) == 2147483647);
+        REQUIRE(result.value()[1].text() == "2147483647");
+    }
+
+    SECTION("Text references the source")
+    {
+        std::string_view input{ "int main" };
+        auto result = wccff::lexer::lexer(input);
+        REQUIRE(result.has_value());
+        REQUIRE(result.value().text(1).data() == input.data() + 4);
+    }
+
+    SECTION("Built from tokens")
+    {
+        std::vector<wccff::lexer::token> tokens;
+        tokens.emplace_back(token_type::identifier, "main", wccff::lexer::file_location{ 1, 2 });
+        tokens.emplace_back(token_type::constant, "42", wccff::lexer::file_location{ 1, 7 });
+        wccff::lexer::token_buffer buffer{ tokens };
+        auto moved = std::move(buffer);
+        REQUIRE(moved.size() == 2);
+        REQUIRE(moved.text(0) == "main");
+        REQUIRE(moved.text(1) == "42");
+        REQUIRE(moved.value(1) == 42);
+        REQUIRE(moved.loc(1) == wccff::lexer::file_location{ 0, 5 });
+    }
+
+    SECTION("Invalid constants aren't decoded to a made up value")
+    {
+        using wccff::lexer::file_location;
+        REQUIRE(wccff::lexer::decode_constant("0x1F").value() == 31);
+        REQUIRE(wccff::lexer::decode_constant("2147483648").has_value() == false);
+        REQUIRE(wccff::lexer::decode_constant("12ab").has_value() == false);
+        using wccff::lexer::token;
+        REQUIRE_THROWS_AS(token(token_type::constant, "2147483648", file_location{}), std::invalid_argument);
+        REQUIRE_THROWS_AS(token(token_type::constant, "08", file_location{}), std::invalid_argument);
+    }
+
+    SECTION("Erase the first tokens")
+    {
+        std::string_view input{ "a b c" };
+        auto result = wccff::lexer::lexer(input);
+        REQUIRE(result.has_value());
+        result.value().erase_front(2);
+        REQUIRE(result.value().size() == 1);
+        REQUIRE(result.value().text(0) == "c");
+    }
+}
+
+TEST_CASE("Parallel lexer", "[lexer]")
+{
+    std::string input;
+    for (int i = 0; i < 2000; i++)
+    {
+        input += "int main(void) {\n    return ~(a" + std::to_string(i) + " << 2) >= -" + std::to_string(i) + ";\n}\n";
+    }
+    auto sequential = wccff::lexer::parallel_lexer(input, 1);
+    REQUIRE(sequential.has_value());
+
+    SECTION("Same tokens as a sequential run")
+    {
+        for (std::size_t chunks : { 2, 3, 8, 64 })
+        {
+            auto parallel = wccff::lexer::parallel_lexer(input, chunks);
+            REQUIRE(parallel.has_value());
+            REQUIRE(parallel->size() == sequential->size());
+            for (std::size_t i = 0; i < sequential->size(); i++)
+            {
+                REQUIRE(parallel->type(i) == sequential->type(i));
+                REQUIRE(parallel->offset(i) == sequential->offset(i));
+                REQUIRE(parallel->value(i) == sequential->value(i));
+            }
+        }
+    }
+
+    SECTION("Input without newlines")
+    {
+        std::string_view line{ "int main(void) { return 1; }" };
+        auto parallel = wccff::lexer::parallel_lexer(line, 4);
+        REQUIRE(parallel.has_value());
+        REQUIRE(parallel->size() == 10);
+    }
+
+    SECTION("Same error as a sequential run")
+    {
+        input[input.size() / 2 + 3] = '@';
+        auto expected = wccff::lexer::parallel_lexer(input, 1);
+        auto parallel = wccff::lexer::parallel_lexer(input, 8);
+        REQUIRE(expected.has_value() == false);
+        REQUIRE(parallel.has_value() == false);
+        REQUIRE(parallel.error().location == expected.error().location);
+        REQUIRE(parallel.error().input == expected.error().input);
+    }
+}
+
+static std::expected<wccff::lexer::token_buffer, wccff::lexer::lexer_error> lex_all(
+  wccff::lexer::streaming_lexer &lexer)
+{
+    wccff::lexer::token_buffer result;
+    while (true)
+    {
+        auto found = lexer.next(result);
+        if (found.has_value() == false)
+        {
+            return std::unexpected(found.error());
+        }
+        if (found.value() == false)
+        {
+            return result;
+        }
+    }
+}
+
+/**
+ * Lexes the input from a pipe, written by another thread while it's read.
+ * The lexer stops reading at an error, so the rest of the input is drained before the writer is joined, and the read
+ * end is only closed after that.
+ */
+static std::expected<wccff::lexer::token_buffer, wccff::lexer::lexer_error> lex_pipe(std::string_view input,
+                                                                                   std::size_t capacity)
+{
+    // A write to a closed pipe fails with EPIPE instead of killing the tests
+    std::signal(SIGPIPE, SIG_IGN);
+    std::array<int, 2> fds{};
+    REQUIRE(::pipe(fds.data()) == 0);
+
+    std::optional<std::expected<wccff::lexer::token_buffer, wccff::lexer::lexer_error>> result;
+    {
+        std::jthread writer{ [&input, fd = fds[1]] {
+            for (std::size_t written = 0; written < input.size();)
+            {
+                auto r = ::write(fd, input.data() + written, std::min<std::size_t>(input.size() - written, 7));
+                if (r <= 0)
+                {
+                    break;
+                }
+                written += static_cast<std::size_t>(r);
+            }
+            ::close(fd);
+        } };
+
+        wccff::lexer::streaming_lexer lexer{ wccff::lexer::input_stream{ fds[0], false, capacity } };
+        result = lex_all(lexer);
+        std::array<char, 256> rest{};
+        while (::read(fds[0], rest.data(), rest.size()) > 0)
+        {
+        }
+    }
+    ::close(fds[0]);
+    return std::move(result.value());
+}
+
+TEST_CASE("Streaming lexer", "[lexer]")
+{
+    std::string input;
+    for (int i = 0; i < 200; i++)
+    {
+        input += "int main(void) {\n\treturn ~(a" + std::to_string(i) + " << 2) >= -" + std::to_string(i) + ";\n}\n";
+    }
+    input += "a>=b";
+    auto expected = wccff::lexer::lexer(input);
+    REQUIRE(expected.has_value());
+
+    SECTION("Tokens across refills")
+    {
+        for (std::size_t capacity : { 7, 13, 64, 4096 })
+        {
+            auto streamed = lex_pipe(input, capacity);
+            REQUIRE(streamed.has_value());
+            REQUIRE(streamed->size() == expected->size());
+            for (std::size_t i = 0; i < expected->size(); i++)
+            {
+                REQUIRE(streamed->type(i) == expected->type(i));
+                REQUIRE(streamed->text(i) == expected->text(i));
+                REQUIRE(streamed->value(i) == expected->value(i));
+                REQUIRE(streamed->loc(i) == expected->loc(i));
+            }
+        }
+    }
+
+    SECTION("Consumed tokens release their text")
+    {
+        auto streamed = lex_pipe(input, 64);
+        REQUIRE(streamed.has_value());
+        auto last = streamed->text(streamed->size() - 1);
+        streamed->erase_front(streamed->size() - 1);
+        REQUIRE(streamed->source() == last);
+        REQUIRE(streamed->loc(0) == expected->loc(expected->size() - 1));
+    }
+
+    SECTION("Errors")
+    {
+        input[input.size() / 2] = '@';
+        auto sequential = wccff::lexer::lexer(input);
+        auto streamed = lex_pipe(input, 16);
+        REQUIRE(sequential.has_value() == false);
+        REQUIRE(streamed.has_value() == false);
+        REQUIRE(streamed.error().location == sequential.error().location);
+        REQUIRE(streamed.error().message == sequential.error().message);
+        // The streaming lexer is gone, the error keeps its own copy of the input
+        REQUIRE(streamed.error().input.starts_with("@"));
+    }
+
+    SECTION("Token longer than the buffer")
+    {
+        auto streamed = lex_pipe("int a_very_long_identifier;", 16);
+        REQUIRE(streamed.has_value() == false);
+        REQUIRE(streamed.error().message == "Token doesn't fit in the input buffer");
+    }
+}
+
+static std::string generate_source(int functions)
+{
+    std::string source;
+    for (int i = 0; i < functions; i++)
+    {
+        source += "int main(void) {\n    return ~(identifier_" + std::to_string(i) + " << 2) >= -" + std::to_string(i) +
+                  " && a != 0x1F;\n}\n";
+    }
+    return source;
+}
+
+static std::size_t count_tokens(wccff::lexer::token_stream stream)
+{
+    wccff::lexer::token_buffer buffer{ stream.input() };
+    while (stream.next(buffer).value())
+    {
+    }
+    return buffer.size();
+}
+
+TEST_CASE("Padded lexer", "[lexer]")
+{
+    wccff::lexer::source_buffer source{ generate_source(300) + "a>=b" };
+    auto expected = wccff::lexer::parallel_lexer(source.view(), 1);
+    REQUIRE(expected.has_value());
+
+    SECTION("Same tokens as the bounded scanner")
+    {
+        auto padded = wccff::lexer::lexer(source);
+        REQUIRE(padded.has_value());
+        REQUIRE(padded->size() == expected->size());
+        for (std::size_t i = 0; i < expected->size(); i++)
+        {
+            REQUIRE(padded->type(i) == expected->type(i));
+            REQUIRE(padded->offset(i) == expected->offset(i));
+            REQUIRE(padded->value(i) == expected->value(i));
+        }
+        REQUIRE(count_tokens(wccff::lexer::token_stream::padded(source.view())) == expected->size());
+    }
+
+    SECTION("Same error as the bounded scanner")
+    {
+        wccff::lexer::source_buffer invalid{ generate_source(10) + "return 1 @ 2;" };
+        auto bounded = wccff::lexer::lexer(invalid.view());
+        auto padded = wccff::lexer::lexer(invalid);
+        REQUIRE(bounded.has_value() == false);
+        REQUIRE(padded.has_value() == false);
+        REQUIRE(padded.error().location == bounded.error().location);
+        REQUIRE(padded.error().input == bounded.error().input);
+    }
+}
+
+TEST_CASE("Padded lexer benchmark", "[.][benchmark]")
+{
+    wccff::lexer::source_buffer source{ generate_source(20000) };
+
+    BENCHMARK("Bounded scanner")
+    {
+        return count_tokens(wccff::lexer::token_stream{ source.view() });
+    };
+    BENCHMARK("Padded scanner")
+    {
+        return count_tokens(wccff::lexer::token_stream::padded(source.view()));
+    };
+}
@@ -0,0 +1,35 @@
+#include "../line_index.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <string_view>
+
+TEST_CASE("Line index", "[lexer]")
+{
+    using wccff::lexer::file_location;
+    using wccff::lexer::line_index;
+
+    SECTION("Empty source")
+    {
+        line_index index{ std::string_view{} };
+        REQUIRE(index.lines() == 1);
+        REQUIRE(index.resolve_location(0) == file_location{ 0, 0 });
+    }
+
+    SECTION("Single line")
+    {
+        line_index index{ "int main" };
+        REQUIRE(index.lines() == 1);
+        REQUIRE(index.resolve_location(4) == file_location{ 0, 4 });
+    }
+
+    SECTION("Offsets around newlines")
+    {
+        line_index index{ "ab\n\ncd\n" };
+        REQUIRE(index.lines() == 4);
+        REQUIRE(index.resolve_location(2) == file_location{ 0, 2 });
+        REQUIRE(index.resolve_location(3) == file_location{ 1, 0 });
+        REQUIRE(index.resolve_location(4) == file_location{ 2, 0 });
+        REQUIRE(index.resolve_location(5) == file_location{ 2, 1 });
+        REQUIRE(index.resolve_location(7) == file_location{ 3, 0 });
+    }
+}
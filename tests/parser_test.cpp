@@ -1,5 +1,8 @@
+#include "../flat_ast.h"
 #include "../parser.h"
 #include <catch2/catch_test_macros.hpp>
+#include <limits>
+#include <string>
 
 TEST_CASE("Parser", "[parser]")
 {
@@ -11,10 +14,11 @@ TEST_CASE("Parser", "[parser]")
 
         wccff::parser::tokens tokens{ tokens_vector };
 
-        auto r = wccff::parser::parse_identifier(tokens);
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse_identifier(tokens, context);
 
         REQUIRE(r.has_value());
-        REQUIRE(r.value().name == "main");
+        REQUIRE(context.symbols.text(r.value().name) == "main");
     }
 
     SECTION("Parse Constant")
@@ -40,10 +44,11 @@ TEST_CASE("Parser", "[parser]")
 
         wccff::parser::tokens tokens{ tokens_vector };
 
-        auto r = wccff::parser::parse_unary_node(tokens);
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse_unary_node(tokens, context);
 
         REQUIRE(r.has_value());
-        REQUIRE(std::holds_alternative<wccff::parser::negate_operator>(r.value()->op) == true);
+        REQUIRE(r.value()->op == wccff::parser::unary_operator::negate);
         REQUIRE(std::holds_alternative<wccff::parser::int_constant>(r.value()->exp) == true);
         REQUIRE(std::get<wccff::parser::int_constant>(r.value()->exp).value == 2);
     }
@@ -57,10 +62,11 @@ TEST_CASE("Parser", "[parser]")
 
         wccff::parser::tokens tokens{ tokens_vector };
 
-        auto r = wccff::parser::parse_unary_node(tokens);
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse_unary_node(tokens, context);
 
         REQUIRE(r.has_value());
-        REQUIRE(std::holds_alternative<wccff::parser::bitwise_complement_operator>(r.value()->op) == true);
+        REQUIRE(r.value()->op == wccff::parser::unary_operator::bitwise_complement);
         REQUIRE(std::holds_alternative<wccff::parser::int_constant>(r.value()->exp) == true);
         REQUIRE(std::get<wccff::parser::int_constant>(r.value()->exp).value == 2);
     }
@@ -77,14 +83,15 @@ TEST_CASE("Parser", "[parser]")
 
             wccff::parser::tokens tokens{ tokens_vector };
 
-            auto r = wccff::parser::parse_unary_node(tokens);
+            wccff::compilation_context context;
+            auto r = wccff::parser::parse_unary_node(tokens, context);
 
             REQUIRE(r.has_value());
-            REQUIRE(std::holds_alternative<wccff::parser::bitwise_complement_operator>(r.value()->op) == true);
-            REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::unary_node>>(r.value()->exp) == true);
+            REQUIRE(r.value()->op == wccff::parser::unary_operator::bitwise_complement);
+            REQUIRE(std::holds_alternative<const wccff::parser::unary_node *>(r.value()->exp) == true);
 
-            auto inner_expression = std::move(std::get<std::unique_ptr<wccff::parser::unary_node>>(r.value()->exp));
-            REQUIRE(std::holds_alternative<wccff::parser::bitwise_complement_operator>(inner_expression->op) == true);
+            auto inner_expression = std::move(std::get<const wccff::parser::unary_node *>(r.value()->exp));
+            REQUIRE(inner_expression->op == wccff::parser::unary_operator::bitwise_complement);
             REQUIRE(std::get<wccff::parser::int_constant>(inner_expression->exp).value == 2);
         }
 
@@ -98,14 +105,15 @@ TEST_CASE("Parser", "[parser]")
 
             wccff::parser::tokens tokens{ tokens_vector };
 
-            auto r = wccff::parser::parse_unary_node(tokens);
+            wccff::compilation_context context;
+            auto r = wccff::parser::parse_unary_node(tokens, context);
 
             REQUIRE(r.has_value());
-            REQUIRE(std::holds_alternative<wccff::parser::negate_operator>(r.value()->op) == true);
-            REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::unary_node>>(r.value()->exp) == true);
+            REQUIRE(r.value()->op == wccff::parser::unary_operator::negate);
+            REQUIRE(std::holds_alternative<const wccff::parser::unary_node *>(r.value()->exp) == true);
 
-            auto inner_expression = std::move(std::get<std::unique_ptr<wccff::parser::unary_node>>(r.value()->exp));
-            REQUIRE(std::holds_alternative<wccff::parser::bitwise_complement_operator>(inner_expression->op) == true);
+            auto inner_expression = std::move(std::get<const wccff::parser::unary_node *>(r.value()->exp));
+            REQUIRE(inner_expression->op == wccff::parser::unary_operator::bitwise_complement);
             REQUIRE(std::get<wccff::parser::int_constant>(inner_expression->exp).value == 2);
         }
     }
@@ -122,12 +130,13 @@ TEST_CASE("Parser", "[parser]")
             tokens_vector.emplace_back(wccff::lexer::token_type::semicolon, ";", location);
             wccff::parser::tokens tokens{ tokens_vector };
 
-            auto r = wccff::parser::parse_expression(tokens);
+            wccff::compilation_context context;
+            auto r = wccff::parser::parse_expression(tokens, context);
             REQUIRE(r.has_value());
-            REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::binary_node>>(r.value()) == true);
-            auto &exp = std::get<std::unique_ptr<wccff::parser::binary_node>>(r.value());
+            REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(r.value()) == true);
+            auto &exp = std::get<const wccff::parser::binary_node *>(r.value());
 
-            REQUIRE(std::holds_alternative<wccff::parser::plus_operator>(exp->op));
+            REQUIRE(exp->op == wccff::parser::binary_operator::plus);
             REQUIRE(std::holds_alternative<wccff::parser::int_constant>(exp->left));
             auto &left = std::get<wccff::parser::int_constant>(exp->left);
             REQUIRE(left.value == 1);
@@ -147,12 +156,13 @@ TEST_CASE("Parser", "[parser]")
             tokens_vector.emplace_back(wccff::lexer::token_type::semicolon, ";", location);
             wccff::parser::tokens tokens{ tokens_vector };
 
-            auto r = wccff::parser::parse_expression(tokens);
+            wccff::compilation_context context;
+            auto r = wccff::parser::parse_expression(tokens, context);
             REQUIRE(r.has_value());
-            REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::binary_node>>(r.value()) == true);
-            auto &exp = std::get<std::unique_ptr<wccff::parser::binary_node>>(r.value());
+            REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(r.value()) == true);
+            auto &exp = std::get<const wccff::parser::binary_node *>(r.value());
 
-            REQUIRE(std::holds_alternative<wccff::parser::subtract_operator>(exp->op));
+            REQUIRE(exp->op == wccff::parser::binary_operator::subtract);
             REQUIRE(std::holds_alternative<wccff::parser::int_constant>(exp->left));
             auto &left = std::get<wccff::parser::int_constant>(exp->left);
             REQUIRE(left.value == 2);
@@ -172,12 +182,13 @@ TEST_CASE("Parser", "[parser]")
             tokens_vector.emplace_back(wccff::lexer::token_type::semicolon, ";", location);
             wccff::parser::tokens tokens{ tokens_vector };
 
-            auto r = wccff::parser::parse_expression(tokens);
+            wccff::compilation_context context;
+            auto r = wccff::parser::parse_expression(tokens, context);
             REQUIRE(r.has_value());
-            REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::binary_node>>(r.value()) == true);
-            auto &exp = std::get<std::unique_ptr<wccff::parser::binary_node>>(r.value());
+            REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(r.value()) == true);
+            auto &exp = std::get<const wccff::parser::binary_node *>(r.value());
 
-            REQUIRE(std::holds_alternative<wccff::parser::multiply_operator>(exp->op));
+            REQUIRE(exp->op == wccff::parser::binary_operator::multiply);
             REQUIRE(std::holds_alternative<wccff::parser::int_constant>(exp->left));
             auto &left = std::get<wccff::parser::int_constant>(exp->left);
             REQUIRE(left.value == 2);
@@ -205,17 +216,18 @@ TEST_CASE("Parser", "[parser]")
             tokens_vector.emplace_back(wccff::lexer::token_type::semicolon, ";", location);
             wccff::parser::tokens tokens{ tokens_vector };
 
-            auto r = wccff::parser::parse_expression(tokens);
+            wccff::compilation_context context;
+            auto r = wccff::parser::parse_expression(tokens, context);
             REQUIRE(r.has_value());
-            REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::binary_node>>(r.value()) == true);
-            auto &exp = std::get<std::unique_ptr<wccff::parser::binary_node>>(r.value());
+            REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(r.value()) == true);
+            auto &exp = std::get<const wccff::parser::binary_node *>(r.value());
 
-            REQUIRE(std::holds_alternative<wccff::parser::subtract_operator>(exp->op));
+            REQUIRE(exp->op == wccff::parser::binary_operator::subtract);
 
-            REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::binary_node>>(exp->left));
-            auto &left = std::get<std::unique_ptr<wccff::parser::binary_node>>(exp->left);
+            REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(exp->left));
+            auto &left = std::get<const wccff::parser::binary_node *>(exp->left);
 
-            REQUIRE(std::holds_alternative<wccff::parser::plus_operator>(left->op));
+            REQUIRE(left->op == wccff::parser::binary_operator::plus);
             REQUIRE(std::holds_alternative<wccff::parser::int_constant>(left->left));
             REQUIRE(std::get<wccff::parser::int_constant>(left->left).value == 1);
             REQUIRE(std::holds_alternative<wccff::parser::int_constant>(left->right));
@@ -244,17 +256,18 @@ TEST_CASE("Parser", "[parser]")
             tokens_vector.emplace_back(wccff::lexer::token_type::semicolon, ";", location);
             wccff::parser::tokens tokens{ tokens_vector };
 
-            auto r = wccff::parser::parse_expression(tokens);
+            wccff::compilation_context context;
+            auto r = wccff::parser::parse_expression(tokens, context);
             REQUIRE(r.has_value());
-            REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::binary_node>>(r.value()) == true);
-            auto &exp = std::get<std::unique_ptr<wccff::parser::binary_node>>(r.value());
+            REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(r.value()) == true);
+            auto &exp = std::get<const wccff::parser::binary_node *>(r.value());
 
-            REQUIRE(std::holds_alternative<wccff::parser::subtract_operator>(exp->op));
+            REQUIRE(exp->op == wccff::parser::binary_operator::subtract);
 
-            REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::binary_node>>(exp->left));
-            auto &left = std::get<std::unique_ptr<wccff::parser::binary_node>>(exp->left);
+            REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(exp->left));
+            auto &left = std::get<const wccff::parser::binary_node *>(exp->left);
 
-            REQUIRE(std::holds_alternative<wccff::parser::multiply_operator>(left->op));
+            REQUIRE(left->op == wccff::parser::binary_operator::multiply);
             REQUIRE(std::holds_alternative<wccff::parser::int_constant>(left->left));
             REQUIRE(std::get<wccff::parser::int_constant>(left->left).value == 1);
             REQUIRE(std::holds_alternative<wccff::parser::int_constant>(left->right));
@@ -283,20 +296,21 @@ TEST_CASE("Parser", "[parser]")
             tokens_vector.emplace_back(wccff::lexer::token_type::semicolon, ";", location);
             wccff::parser::tokens tokens{ tokens_vector };
 
-            auto r = wccff::parser::parse_expression(tokens);
+            wccff::compilation_context context;
+            auto r = wccff::parser::parse_expression(tokens, context);
             REQUIRE(r.has_value());
-            REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::binary_node>>(r.value()) == true);
-            auto &exp = std::get<std::unique_ptr<wccff::parser::binary_node>>(r.value());
+            REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(r.value()) == true);
+            auto &exp = std::get<const wccff::parser::binary_node *>(r.value());
 
-            REQUIRE(std::holds_alternative<wccff::parser::plus_operator>(exp->op));
+            REQUIRE(exp->op == wccff::parser::binary_operator::plus);
 
             REQUIRE(std::holds_alternative<wccff::parser::int_constant>(exp->left));
             REQUIRE(std::get<wccff::parser::int_constant>(exp->left).value == 2);
 
-            REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::binary_node>>(exp->right));
-            auto &right = std::get<std::unique_ptr<wccff::parser::binary_node>>(exp->right);
+            REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(exp->right));
+            auto &right = std::get<const wccff::parser::binary_node *>(exp->right);
 
-            REQUIRE(std::holds_alternative<wccff::parser::multiply_operator>(right->op));
+            REQUIRE(right->op == wccff::parser::binary_operator::multiply);
             REQUIRE(std::holds_alternative<wccff::parser::int_constant>(right->left));
             REQUIRE(std::get<wccff::parser::int_constant>(right->left).value == 3);
             REQUIRE(std::holds_alternative<wccff::parser::int_constant>(right->right));
@@ -323,17 +337,18 @@ TEST_CASE("Parser", "[parser]")
             tokens_vector.emplace_back(wccff::lexer::token_type::semicolon, ";", location);
             wccff::parser::tokens tokens{ tokens_vector };
 
-            auto r = wccff::parser::parse_expression(tokens);
+            wccff::compilation_context context;
+            auto r = wccff::parser::parse_expression(tokens, context);
             REQUIRE(r.has_value());
-            REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::binary_node>>(r.value()) == true);
-            auto &exp = std::get<std::unique_ptr<wccff::parser::binary_node>>(r.value());
+            REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(r.value()) == true);
+            auto &exp = std::get<const wccff::parser::binary_node *>(r.value());
 
-            REQUIRE(std::holds_alternative<wccff::parser::multiply_operator>(exp->op));
+            REQUIRE(exp->op == wccff::parser::binary_operator::multiply);
 
-            REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::binary_node>>(exp->left));
-            auto &left = std::get<std::unique_ptr<wccff::parser::binary_node>>(exp->left);
+            REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(exp->left));
+            auto &left = std::get<const wccff::parser::binary_node *>(exp->left);
 
-            REQUIRE(std::holds_alternative<wccff::parser::plus_operator>(left->op));
+            REQUIRE(left->op == wccff::parser::binary_operator::plus);
             REQUIRE(std::holds_alternative<wccff::parser::int_constant>(left->left));
             REQUIRE(std::get<wccff::parser::int_constant>(left->left).value == 1);
             REQUIRE(std::holds_alternative<wccff::parser::int_constant>(left->right));
@@ -365,9 +380,10 @@ TEST_CASE("Parser complex test", "[parser]")
 
         wccff::parser::tokens tokens{ tokens_vector };
 
-        auto r = wccff::parser::parse(tokens);
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse(tokens, context);
         REQUIRE(r.has_value());
-        REQUIRE(r->f.function_name.name == "main");
+        REQUIRE(context.symbols.text(r->f.function_name.name) == "main");
         REQUIRE(std::holds_alternative<wccff::parser::return_node>(r->f.body));
         auto ret_node = std::move(std::get<wccff::parser::return_node>(r->f.body));
         REQUIRE(std::holds_alternative<wccff::parser::int_constant>(ret_node.e));
@@ -387,12 +403,13 @@ TEST_CASE("Binary Operators", "[parser]")
         tokens_vector.emplace_back(wccff::lexer::token_type::semicolon, ";", location);
 
         wccff::parser::tokens tokens{ tokens_vector };
-        auto r = wccff::parser::parse_expression(tokens);
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse_expression(tokens, context);
         REQUIRE(r.has_value());
-        REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::binary_node>>(r.value()));
-        const auto &exp = std::get<std::unique_ptr<wccff::parser::binary_node>>(r.value());
+        REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(r.value()));
+        const auto &exp = std::get<const wccff::parser::binary_node *>(r.value());
 
-        REQUIRE(std::holds_alternative<wccff::parser::bitwise_and_operator>(exp->op));
+        REQUIRE(exp->op == wccff::parser::binary_operator::bitwise_and);
         REQUIRE(std::holds_alternative<wccff::parser::int_constant>(exp->left));
         REQUIRE(std::get<wccff::parser::int_constant>(exp->left).value == 1);
         REQUIRE(std::holds_alternative<wccff::parser::int_constant>(exp->right));
@@ -409,12 +426,13 @@ TEST_CASE("Binary Operators", "[parser]")
         tokens_vector.emplace_back(wccff::lexer::token_type::semicolon, ";", location);
 
         wccff::parser::tokens tokens{ tokens_vector };
-        auto r = wccff::parser::parse_expression(tokens);
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse_expression(tokens, context);
         REQUIRE(r.has_value());
-        REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::binary_node>>(r.value()));
-        const auto &exp = std::get<std::unique_ptr<wccff::parser::binary_node>>(r.value());
+        REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(r.value()));
+        const auto &exp = std::get<const wccff::parser::binary_node *>(r.value());
 
-        REQUIRE(std::holds_alternative<wccff::parser::bitwise_or_operator>(exp->op));
+        REQUIRE(exp->op == wccff::parser::binary_operator::bitwise_or);
         REQUIRE(std::holds_alternative<wccff::parser::int_constant>(exp->left));
         REQUIRE(std::get<wccff::parser::int_constant>(exp->left).value == 1);
         REQUIRE(std::holds_alternative<wccff::parser::int_constant>(exp->right));
@@ -430,12 +448,13 @@ TEST_CASE("Binary Operators", "[parser]")
         tokens_vector.emplace_back(wccff::lexer::token_type::semicolon, ";", location);
 
         wccff::parser::tokens tokens{ tokens_vector };
-        auto r = wccff::parser::parse_expression(tokens);
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse_expression(tokens, context);
         REQUIRE(r.has_value());
-        REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::binary_node>>(r.value()));
-        const auto &exp = std::get<std::unique_ptr<wccff::parser::binary_node>>(r.value());
+        REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(r.value()));
+        const auto &exp = std::get<const wccff::parser::binary_node *>(r.value());
 
-        REQUIRE(std::holds_alternative<wccff::parser::bitwise_xor_operator>(exp->op));
+        REQUIRE(exp->op == wccff::parser::binary_operator::bitwise_xor);
         REQUIRE(std::holds_alternative<wccff::parser::int_constant>(exp->left));
         REQUIRE(std::get<wccff::parser::int_constant>(exp->left).value == 1);
         REQUIRE(std::holds_alternative<wccff::parser::int_constant>(exp->right));
@@ -451,12 +470,13 @@ TEST_CASE("Binary Operators", "[parser]")
         tokens_vector.emplace_back(wccff::lexer::token_type::semicolon, ";", location);
 
         wccff::parser::tokens tokens{ tokens_vector };
-        auto r = wccff::parser::parse_expression(tokens);
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse_expression(tokens, context);
         REQUIRE(r.has_value());
-        REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::binary_node>>(r.value()));
-        const auto &exp = std::get<std::unique_ptr<wccff::parser::binary_node>>(r.value());
+        REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(r.value()));
+        const auto &exp = std::get<const wccff::parser::binary_node *>(r.value());
 
-        REQUIRE(std::holds_alternative<wccff::parser::left_shift_operator>(exp->op));
+        REQUIRE(exp->op == wccff::parser::binary_operator::left_shift);
         REQUIRE(std::holds_alternative<wccff::parser::int_constant>(exp->left));
         REQUIRE(std::get<wccff::parser::int_constant>(exp->left).value == 1);
         REQUIRE(std::holds_alternative<wccff::parser::int_constant>(exp->right));
@@ -472,15 +492,326 @@ TEST_CASE("Binary Operators", "[parser]")
         tokens_vector.emplace_back(wccff::lexer::token_type::semicolon, ";", location);
 
         wccff::parser::tokens tokens{ tokens_vector };
-        auto r = wccff::parser::parse_expression(tokens);
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse_expression(tokens, context);
         REQUIRE(r.has_value());
-        REQUIRE(std::holds_alternative<std::unique_ptr<wccff::parser::binary_node>>(r.value()));
-        const auto &exp = std::get<std::unique_ptr<wccff::parser::binary_node>>(r.value());
+        REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(r.value()));
+        const auto &exp = std::get<const wccff::parser::binary_node *>(r.value());
 
-        REQUIRE(std::holds_alternative<wccff::parser::right_shift_operator>(exp->op));
+        REQUIRE(exp->op == wccff::parser::binary_operator::right_shift);
         REQUIRE(std::holds_alternative<wccff::parser::int_constant>(exp->left));
         REQUIRE(std::get<wccff::parser::int_constant>(exp->left).value == 1);
         REQUIRE(std::holds_alternative<wccff::parser::int_constant>(exp->right));
         REQUIRE(std::get<wccff::parser::int_constant>(exp->right).value == 2);
     }
 }
+
+TEST_CASE("Operator tables", "[parser]")
+{
+    using wccff::lexer::token_type;
+    using namespace wccff::parser;
+
+    REQUIRE(operators_of(token_type::negation_operator).unary == unary_operator::negate);
+    REQUIRE(operators_of(token_type::negation_operator).binary == binary_operator::subtract);
+    REQUIRE(operators_of(token_type::not_operator).binary.has_value() == false);
+    REQUIRE(operators_of(token_type::semicolon).unary.has_value() == false);
+    REQUIRE(operators_of(token_type::semicolon).binary.has_value() == false);
+
+    REQUIRE(is_binary_operator(token_type::or_operator));
+    REQUIRE(is_binary_operator(token_type::close_parenthesis) == false);
+    REQUIRE(get_precedence(token_type::multiplication_operator) > get_precedence(token_type::plus_operator));
+    REQUIRE(get_precedence(token_type::and_operator) > get_precedence(token_type::or_operator));
+    REQUIRE(get_precedence(token_type::end_of_file) == 0);
+
+    REQUIRE(info(binary_operator::logical_or).short_circuit);
+    REQUIRE(info(binary_operator::less_than).relational);
+    REQUIRE(info(binary_operator::subtract).commutative == false);
+    REQUIRE(pretty_print(binary_operator::less_than_or_equal, 2) == "  Less Than or Equals");
+}
+
+TEST_CASE("Constant folding", "[parser]")
+{
+    using namespace wccff::parser;
+    constexpr auto int_min = std::numeric_limits<int32_t>::min();
+    constexpr auto int_max = std::numeric_limits<int32_t>::max();
+
+    wccff::compilation_context context;
+    auto parse_return = [&context](std::string_view source, bool fold) {
+        wccff::lexer::token_stream stream{ source };
+        tokens tokens{ stream };
+        auto r = parse(tokens, context, options{ fold });
+        REQUIRE(r.has_value());
+        return std::get<return_node>(r->f.body).e;
+    };
+
+    SECTION("The arithmetic wraps around")
+    {
+        REQUIRE(fold_constant(binary_operator::plus, int_max, 1) == int_min);
+        REQUIRE(fold_constant(binary_operator::subtract, int_min, 1) == int_max);
+        REQUIRE(fold_constant(binary_operator::multiply, 65536, 65536) == 0);
+        REQUIRE(fold_constant(unary_operator::negate, int_min) == int_min);
+        REQUIRE(fold_constant(binary_operator::left_shift, 1, 31) == int_min);
+        REQUIRE(fold_constant(binary_operator::right_shift, -8, 1) == -4);
+        REQUIRE(fold_constant(binary_operator::remainder, -7, 2) == -1);
+        REQUIRE(fold_constant(unary_operator::bitwise_complement, 0) == -1);
+        REQUIRE(fold_constant(binary_operator::logical_or, 0, 5) == 1);
+    }
+
+    SECTION("Undefined results aren't folded")
+    {
+        REQUIRE(fold_constant(binary_operator::divide, 1, 0).has_value() == false);
+        REQUIRE(fold_constant(binary_operator::remainder, 1, 0).has_value() == false);
+        REQUIRE(fold_constant(binary_operator::divide, int_min, -1).has_value() == false);
+        REQUIRE(fold_constant(binary_operator::remainder, int_min, -1).has_value() == false);
+        REQUIRE(fold_constant(binary_operator::left_shift, 1, 32).has_value() == false);
+        REQUIRE(fold_constant(binary_operator::right_shift, 1, -1).has_value() == false);
+    }
+
+    SECTION("Constant expressions become a single constant")
+    {
+        auto e = parse_return("int main(void) { return (1 + 2) * -3 << 2 == ~-37 || 7 / 2; }", true);
+        REQUIRE(std::holds_alternative<int_constant>(e));
+        REQUIRE(std::get<int_constant>(e).value == 1);
+
+        e = parse_return("int main(void) { return 1 + 2; }", false);
+        REQUIRE(std::holds_alternative<const binary_node *>(e));
+    }
+
+    SECTION("The operators that can't be folded keep their folded operands")
+    {
+        auto e = parse_return("int main(void) { return (2 + 3) / (1 - 1); }", true);
+        REQUIRE(std::holds_alternative<const binary_node *>(e));
+        const auto *division = std::get<const binary_node *>(e);
+        REQUIRE(division->op == binary_operator::divide);
+        REQUIRE(std::get<int_constant>(division->left).value == 5);
+        REQUIRE(std::get<int_constant>(division->right).value == 0);
+    }
+}
+
+TEST_CASE("Parser over a token stream", "[parser]")
+{
+    SECTION("Tokens are lexed on demand")
+    {
+        wccff::lexer::token_stream stream{ "int main(void) { return 1 + 2; }" };
+        wccff::parser::tokens tokens{ stream };
+
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse(tokens, context);
+        REQUIRE(r.has_value());
+        REQUIRE(context.symbols.text(r->f.function_name.name) == "main");
+        auto &ret_node = std::get<wccff::parser::return_node>(r->f.body);
+        REQUIRE(std::holds_alternative<const wccff::parser::binary_node *>(ret_node.e));
+    }
+
+    SECTION("Lookahead doesn't consume tokens")
+    {
+        wccff::lexer::token_stream stream{ "1 + 2" };
+        wccff::parser::tokens tokens{ stream };
+
+        REQUIRE(tokens.has_tokens(3));
+        REQUIRE(tokens.has_tokens(4) == false);
+        REQUIRE(tokens.peek().type() == wccff::lexer::token_type::constant);
+        REQUIRE(tokens.peek(1).type() == wccff::lexer::token_type::plus_operator);
+        REQUIRE(tokens.next().text() == "1");
+        REQUIRE(tokens.peek().type() == wccff::lexer::token_type::plus_operator);
+    }
+
+    SECTION("Consumed tokens are dropped")
+    {
+        std::string input = "int main(void) { return 0";
+        for (int i = 0; i < 1000; i++)
+        {
+            input += " + 1";
+        }
+        input += "; }";
+        wccff::lexer::token_stream stream{ input };
+        wccff::parser::tokens tokens{ stream };
+
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse(tokens, context);
+        REQUIRE(r.has_value());
+        REQUIRE(tokens.previous_token().type() == wccff::lexer::token_type::close_brace);
+    }
+
+    SECTION("Locations are resolved in diagnostics")
+    {
+        wccff::lexer::token_stream stream{ "int main(void)\n{\n    retrn 1; }" };
+        wccff::parser::tokens tokens{ stream };
+
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse(tokens, context);
+        REQUIRE(r.has_value() == false);
+        REQUIRE(r.error().message.find("2:4") != std::string::npos);
+    }
+
+    SECTION("Lexer errors are reported")
+    {
+        wccff::lexer::token_stream stream{ "int main(void) { return 1 @ 2; }" };
+        wccff::parser::tokens tokens{ stream };
+
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse(tokens, context);
+        REQUIRE(r.has_value() == false);
+        REQUIRE(tokens.error().has_value());
+        REQUIRE(tokens.error()->input.starts_with("@"));
+    }
+
+    SECTION("Lexer errors after the program are reported")
+    {
+        wccff::lexer::token_stream stream{ "int main(void) { return 1; } @" };
+        wccff::parser::tokens tokens{ stream };
+
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse(tokens, context);
+        REQUIRE(r.has_value() == false);
+        REQUIRE(tokens.error().has_value());
+    }
+}
+
+TEST_CASE("Token cursor", "[parser]")
+{
+    using wccff::lexer::token_type;
+
+    SECTION("The tokens end with an end of file token")
+    {
+        wccff::lexer::token_stream stream{ "1 + 2" };
+        wccff::parser::tokens tokens{ stream };
+
+        REQUIRE(tokens.peek(2).type() == token_type::constant);
+        REQUIRE(tokens.peek(3).type() == token_type::end_of_file);
+        REQUIRE(tokens.peek(100).type() == token_type::end_of_file);
+        REQUIRE(tokens.next().text() == "1");
+        REQUIRE(tokens.next().type() == token_type::plus_operator);
+        REQUIRE(tokens.next().text() == "2");
+        REQUIRE(tokens.next().type() == token_type::end_of_file);
+        REQUIRE(tokens.next().type() == token_type::end_of_file);
+        REQUIRE(tokens.previous_token().text() == "2");
+    }
+
+    SECTION("Copied tokens")
+    {
+        wccff::parser::tokens tokens{ std::vector<wccff::lexer::token>{} };
+        REQUIRE(tokens.peek().type() == token_type::end_of_file);
+        REQUIRE(tokens.has_tokens() == false);
+    }
+
+    SECTION("Accept and expect")
+    {
+        wccff::lexer::token_stream stream{ "( x" };
+        wccff::parser::tokens tokens{ stream };
+
+        REQUIRE(tokens.accept(token_type::close_parenthesis) == false);
+        REQUIRE(tokens.accept(token_type::open_parenthesis));
+        auto wrong = tokens.expect(token_type::constant, "Constant");
+        REQUIRE(wrong.has_value() == false);
+        REQUIRE(wrong.error().message == "Parse failure at: 0:2. Expected Constant found Identifier");
+        auto name = tokens.expect(token_type::identifier, "Identifier");
+        REQUIRE(name.has_value());
+        REQUIRE(name->text() == "x");
+        auto end = tokens.expect(token_type::semicolon, "';'");
+        REQUIRE(end.has_value() == false);
+        REQUIRE(end.error().message == "0:2: Error: Unexpected end of tokens after 'x'");
+    }
+
+    SECTION("Truncated programs")
+    {
+        for (std::string_view source :
+             { "int", "int main(void) {", "int main(void) { return 1", "int main(void) { return (1" })
+        {
+            INFO(source);
+            wccff::lexer::token_stream stream{ source };
+            wccff::parser::tokens tokens{ stream };
+            wccff::compilation_context context;
+            auto r = wccff::parser::parse(tokens, context);
+            REQUIRE(r.has_value() == false);
+            REQUIRE(r.error().message.find("Unexpected end of tokens after") != std::string::npos);
+        }
+
+        wccff::lexer::token_stream stream{ "" };
+        wccff::parser::tokens tokens{ stream };
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse(tokens, context);
+        REQUIRE(r.has_value() == false);
+        REQUIRE(r.error().message.find("the input is empty") != std::string::npos);
+    }
+}
+
+TEST_CASE("Deep expressions", "[parser]")
+{
+    constexpr int depth = 100000;
+
+    SECTION("Nested unary operators and parentheses")
+    {
+        std::string input;
+        for (int i = 0; i < depth; i++)
+        {
+            input += "-(";
+        }
+        input += "1";
+        input.append(depth, ')');
+        wccff::parser::tokens tokens{ wccff::lexer::token_stream{ input } };
+
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse_expression(tokens, context);
+        REQUIRE(r.has_value());
+        REQUIRE(tokens.has_tokens() == false);
+        REQUIRE(wccff::parser::flatten(r.value()).size() == depth + 1);
+    }
+
+    SECTION("Long chain of binary operators")
+    {
+        std::string input = "1";
+        for (int i = 0; i < depth; i++)
+        {
+            input += " + 1";
+        }
+        wccff::parser::tokens tokens{ wccff::lexer::token_stream{ input } };
+
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse_expression(tokens, context);
+        REQUIRE(r.has_value());
+        auto flat = wccff::parser::flatten(r.value());
+        REQUIRE(flat.size() == 2 * depth + 1);
+        // Left associative, so the right operand of every + is a constant
+        REQUIRE(flat.kind(flat.right(flat.root())) == wccff::parser::node_kind::constant);
+    }
+
+    SECTION("Unbalanced parentheses")
+    {
+        std::string input(depth, '(');
+        input += "1";
+        wccff::parser::tokens tokens{ wccff::lexer::token_stream{ input } };
+
+        wccff::compilation_context context;
+        auto r = wccff::parser::parse_expression(tokens, context);
+        REQUIRE(r.has_value() == false);
+        REQUIRE(r.error().message.find("Unexpected end of tokens after '1'") != std::string::npos);
+    }
+}
+
+TEST_CASE("Pretty printing appends to the buffer of the context", "[parser]")
+{
+    wccff::parser::tokens tokens{ wccff::lexer::token_stream{ "int main(void) { return -(1 + ~2); }" } };
+    wccff::compilation_context compilation;
+    auto p = wccff::parser::parse(tokens, compilation);
+    REQUIRE(p.has_value());
+
+    std::string expected = "  Function(main)\n"
+                           "      Return\n"
+                           "          Unary(Negate\n"
+                           "                Binary(Plus\n"
+                           "                       Constant(1)\n"
+                           "                       Unary(Complement\n"
+                           "                             Constant(2)\n"
+                           "                       )\n"
+                           "                )\n"
+                           "          )";
+    REQUIRE(wccff::parser::pretty_print(compilation.symbols, p.value(), 2) == expected);
+
+    fmt::memory_buffer out;
+    wccff::print_context context{ out, compilation.symbols, 2 };
+    context.write("Program\n");
+    wccff::parser::pretty_print(context, p.value());
+    REQUIRE(context.indent == 2);
+    REQUIRE(fmt::to_string(out) == "Program\n" + expected);
+}
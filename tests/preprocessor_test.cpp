@@ -0,0 +1,289 @@
+#include "../pp_tokens.h"
+#include "../preprocessor.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+/**
+ * Preprocesses the source and joins its tokens with single spaces, so the tests don't depend on the layout.
+ */
+static std::string run(std::string_view source, const wccff::preprocessor::options &options = {})
+{
+    auto output = wccff::preprocessor::preprocess(source, "test.c", options);
+    if (output.has_value() == false)
+    {
+        return output.error().message;
+    }
+    std::deque<std::string> storage;
+    auto tokens = wccff::preprocessor::tokenize(output.value(), 0, "output", storage);
+    REQUIRE(tokens.has_value());
+    std::string result;
+    for (const auto &t : tokens.value())
+    {
+        result += result.empty() || t.text.empty() ? "" : " ";
+        result += t.text;
+    }
+    return result;
+}
+
+TEST_CASE("Preprocessor macros", "[preprocessor]")
+{
+    SECTION("Object-like")
+    {
+        REQUIRE(run("#define N 2\nint main(void) { return N; }") == "int main ( void ) { return 2 ; }");
+        REQUIRE(run("#define A B\n#define B 3\nA") == "3");
+        REQUIRE(run("#define A 1\n#undef A\nA") == "A");
+    }
+
+    SECTION("Function-like")
+    {
+        REQUIRE(run("#define ADD(a, b) ((a) + (b))\nADD(1, 2 * 3)") == "( ( 1 ) + ( 2 * 3 ) )");
+        REQUIRE(run("#define F(x) x\nF((1, 2))") == "( 1 , 2 )");
+        REQUIRE(run("#define F(x) x\nF") == "F");
+        REQUIRE(run("#define F (x)\nF") == "( x )");
+        REQUIRE(run("#define F(x) x\nF(\n1\n)") == "1");
+    }
+
+    SECTION("A macro isn't expanded inside itself")
+    {
+        REQUIRE(run("#define A A + 1\nA") == "A + 1");
+        REQUIRE(run("#define A B\n#define B A\nA B") == "A B");
+        REQUIRE(run("#define f(x) x * f(x)\nf(2)") == "2 * f ( 2 )");
+    }
+
+    SECTION("Stringify")
+    {
+        REQUIRE(run("#define S(x) #x\nS(a  +   b)") == "\"a + b\"");
+        REQUIRE(run("#define S(x) #x\nS(\"q\\n\")") == "\"\\\"q\\\\n\\\"\"");
+    }
+
+    SECTION("Paste")
+    {
+        REQUIRE(run("#define CAT(a, b) a ## b\nCAT(x, 1) CAT(<, <=) CAT(, y) CAT(z,)") == "x1 <<= y z");
+        REQUIRE(run("#define CAT a ## b\nCAT") == "ab");
+        REQUIRE(run("#define hash_hash # ## #\n"
+                    "#define mkstr(a) # a\n"
+                    "#define in_between(a) mkstr(a)\n"
+                    "#define join(c, d) in_between(c hash_hash d)\n"
+                    "join(x, y)") == "\"x ## y\"");
+        REQUIRE(run("#define CAT(a, b) a ## b\nCAT(+, /)").ends_with(
+          "Pasting \"+\" and \"/\" does not give a valid preprocessing token"));
+    }
+
+    SECTION("Encoding prefixes are part of the literal")
+    {
+        REQUIRE(run("#define L 1\n#define u8 2\nL'\\0' u8\"a\" u\"b\" U'c' L u8") == "L'\\0' u8\"a\" u\"b\" U'c' 1 2");
+    }
+
+    SECTION("Variadic")
+    {
+        REQUIRE(run("#define F(a, ...) a: __VA_ARGS__\nF(1, 2, 3)") == "1 : 2 , 3");
+        REQUIRE(run("#define F(a, ...) a: __VA_ARGS__\nF(1)") == "1 :");
+    }
+
+    SECTION("Builtin")
+    {
+        REQUIRE(run("\n__LINE__ __FILE__") == "2 \"test.c\"");
+        REQUIRE(run("__STDC__ __STDC_VERSION__") == "1 201710L");
+    }
+
+    SECTION("Command line")
+    {
+        wccff::preprocessor::options options;
+        options.defines = { "A", "B=(2)" };
+        REQUIRE(run("A B", options) == "1 ( 2 )");
+    }
+
+    SECTION("Errors")
+    {
+        REQUIRE(run("#define F(a, b) a\nF(1)") == "test.c:2: Error: Macro \"F\" requires 2 arguments, but 1 given");
+        REQUIRE(run("#define F(a) a\nF(1") == "test.c:2: Error: Unterminated argument list invoking macro \"F\"");
+        REQUIRE(run("#define 1 2") == "test.c:1: Error: Macro names must be identifiers");
+    }
+}
+
+TEST_CASE("Preprocessor conditionals", "[preprocessor]")
+{
+    SECTION("Groups")
+    {
+        REQUIRE(run("#if 0\na\n#elif 1\nb\n#else\nc\n#endif") == "b");
+        REQUIRE(run("#if 1\na\n#elif 1\nb\n#else\nc\n#endif") == "a");
+        REQUIRE(run("#if 0\na\n#elif 0\nb\n#else\nc\n#endif") == "c");
+        REQUIRE(run("#define X\n#ifdef X\na\n#endif\n#ifndef X\nb\n#endif") == "a");
+        REQUIRE(run("#if 0\n#if 1\na\n#else\nb\n#endif\nc\n#endif\nd") == "d");
+        REQUIRE(run("#if 0\nit's skipped\n#endif\na") == "a");
+    }
+
+    SECTION("Expressions")
+    {
+        REQUIRE(run("#if 1 + 2 * 3 == 7 && (10 >> 1) == 5\na\n#endif") == "a");
+        REQUIRE(run("#if -1 < 0 && ~0 == -1 && !0 && 7 % 4 == 3\na\n#endif") == "a");
+        REQUIRE(run("#if 0x10 == 16 && 010 == 8 && 'A' == 65 && '\\n' == 10\na\n#endif") == "a");
+        REQUIRE(run("#if 1 ? 0 : 1\na\n#else\nb\n#endif") == "b");
+        REQUIRE(run("#if 0 && 1 / 0\na\n#else\nb\n#endif") == "b");
+        REQUIRE(run("#define N 4\n#if N > 3 && defined N && defined(N) && !defined M\na\n#endif") == "a");
+        REQUIRE(run("#if UNDEFINED\na\n#else\nb\n#endif") == "b");
+    }
+
+    SECTION("Unsigned expressions")
+    {
+        REQUIRE(run("#if -1 > 0u\na\n#else\nb\n#endif") == "a");
+        REQUIRE(run("#if -1 > 0\na\n#else\nb\n#endif") == "b");
+        REQUIRE(run("#if ~0u / 2 == 0x7fffffffffffffff\na\n#endif") == "a");
+        REQUIRE(run("#if ~0 / 2 == 0\na\n#endif") == "a");
+        REQUIRE(run("#if 0xffffffffffffffff > 0 && -1 >> 63 == -1 && -1u >> 63 == 1\na\n#endif") == "a");
+        REQUIRE(run("#if (1 ? -1 : 0u) > 0 && (-1 < 0u) - 1 < 0\na\n#endif") == "a");
+    }
+
+    SECTION("Errors")
+    {
+        REQUIRE(run("#if 1 / 0\n#endif") == "test.c:1: Error: Division by zero in preprocessor expression");
+        REQUIRE(run("#if 1\n") == "test.c:2: Error: Unterminated conditional directive");
+        REQUIRE(run("#endif") == "test.c:1: Error: #endif without #if");
+        REQUIRE(run("#else\n") == "test.c:1: Error: #else without #if");
+        REQUIRE(run("#if 1\n#else\n#else\n#endif") == "test.c:3: Error: #else after #else");
+        REQUIRE(run("#error stop here") == "test.c:1: Error: #error stop here");
+        REQUIRE(run("#if\n#endif") == "test.c:1: Error: #if with no expression");
+        REQUIRE(run("#foo") == "test.c:1: Error: Invalid preprocessing directive #foo");
+    }
+}
+
+TEST_CASE("Preprocessor includes", "[preprocessor]")
+{
+    auto directory = std::filesystem::temp_directory_path() / "wccff_preprocessor";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory / "include");
+    std::filesystem::create_directories(directory / "next");
+    std::ofstream{ directory / "local.h" } << "#define LOCAL 1\nint local;\n";
+    std::ofstream{ directory / "include" / "system.h" } << "#ifndef SYSTEM_H\n#define SYSTEM_H\nint system;\n#endif\n";
+    std::ofstream{ directory / "self.h" } << "#include \"self.h\"\n";
+    std::ofstream{ directory / "once.h" } << "#pragma once\nint once;\n";
+    std::ofstream{ directory / "guard.h" } << "#if !defined(GUARD_H)\n#define GUARD_H\nint guard;\n#endif\n";
+    std::ofstream{ directory / "include" / "wrap.h" } << "#include_next <wrap.h>\nint wrapper;\n";
+    std::ofstream{ directory / "next" / "wrap.h" } << "int wrapped;\n";
+    std::ofstream{ directory / "no_guard.h" } << "#ifndef NO_GUARD_H\n#define NO_GUARD_H\n#endif\nint no_guard;\n";
+
+    wccff::preprocessor::options options;
+    options.include_paths = { directory / "include", directory / "next" };
+    auto main = (directory / "main.c").string();
+
+    SECTION("Quoted includes are found next to the source")
+    {
+        auto output = wccff::preprocessor::preprocess("#include \"local.h\"\nLOCAL", main, options);
+        REQUIRE(output.has_value());
+        REQUIRE(output->find("int local;") != std::string::npos);
+        REQUIRE(output->ends_with("1\n"));
+    }
+
+    SECTION("Include paths")
+    {
+        auto output = wccff::preprocessor::preprocess("#include <system.h>\n#include \"system.h\"\n", main, options);
+        REQUIRE(output.has_value());
+        REQUIRE(output->find("int system;") == output->rfind("int system;"));
+    }
+
+    SECTION("Include next")
+    {
+        auto output = wccff::preprocessor::preprocess("#include <wrap.h>\n", main, options);
+        REQUIRE(output.has_value());
+        REQUIRE(output->find("int wrapped;") < output->find("int wrapper;"));
+    }
+
+    SECTION("Computed include")
+    {
+        auto output = wccff::preprocessor::preprocess("#define H <system.h>\n#include H\n", main, options);
+        REQUIRE(output.has_value());
+        REQUIRE(output->find("int system;") != std::string::npos);
+    }
+
+    SECTION("Headers included once")
+    {
+        auto count = [](const std::string &text, std::string_view word) {
+            std::size_t n = 0;
+            for (auto pos = text.find(word); pos != std::string::npos; pos = text.find(word, pos + 1))
+            {
+                n++;
+            }
+            return n;
+        };
+        auto output = wccff::preprocessor::preprocess(
+          "#include \"once.h\"\n#include \"once.h\"\n#include \"guard.h\"\n#include \"./guard.h\"\n"
+          "#include \"no_guard.h\"\n#include \"no_guard.h\"\n",
+          main,
+          options);
+        REQUIRE(output.has_value());
+        REQUIRE(count(output.value(), "int once;") == 1);
+        REQUIRE(count(output.value(), "int guard;") == 1);
+        REQUIRE(count(output.value(), "int no_guard;") == 2);
+
+        // The guard is only used while its macro is defined
+        output = wccff::preprocessor::preprocess("#include \"guard.h\"\n#undef GUARD_H\n#include \"guard.h\"\n", main);
+        REQUIRE(output.has_value());
+        REQUIRE(count(output.value(), "int guard;") == 2);
+    }
+
+    SECTION("Header cache")
+    {
+        options.header_cache_directory = directory / "cache";
+        auto source = "#include \"local.h\"\n#include <system.h>\nLOCAL\n";
+        auto first = wccff::preprocessor::preprocess(source, main, options);
+        REQUIRE(first.has_value());
+        REQUIRE(std::filesystem::is_empty(directory / "cache") == false);
+        auto second = wccff::preprocessor::preprocess(source, main, options);
+        REQUIRE(second.has_value());
+        REQUIRE(second.value() == first.value());
+    }
+
+    SECTION("Builtin headers of gcc")
+    {
+        auto output = wccff::preprocessor::preprocess("#include <stddef.h>\n#include <stdint.h>\n", main, options);
+        REQUIRE(output.has_value());
+    }
+
+    SECTION("Errors")
+    {
+        auto missing = wccff::preprocessor::preprocess("#include \"missing.h\"\n", main, options);
+        REQUIRE(missing.has_value() == false);
+        REQUIRE(missing.error().message == main + ":1: Error: missing.h: No such file or directory");
+
+        auto recursive = wccff::preprocessor::preprocess("#include \"self.h\"\n", main, options);
+        REQUIRE(recursive.has_value() == false);
+        REQUIRE(recursive.error().message.ends_with("#include nested too deeply"));
+    }
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Preprocessor output layout", "[preprocessor]")
+{
+    SECTION("Lines are kept")
+    {
+        auto output = wccff::preprocessor::preprocess("#define A 1\n\nint a = A;\n/* two\nlines */ int b;\n", "test.c");
+        REQUIRE(output.has_value());
+        REQUIRE(output.value() == "\n\nint a = 1 ;\n\n         int b;\n");
+    }
+
+    SECTION("Columns are kept")
+    {
+        auto output = wccff::preprocessor::preprocess("  int  x =\t1;\n", "test.c");
+        REQUIRE(output.has_value());
+        REQUIRE(output.value() == "  int  x = 1;\n");
+
+        // The tokens after an expansion are still apart, even when the expansion is longer than the macro name
+        output = wccff::preprocessor::preprocess("#define P +\n#define LONG 1 + 2\nP+ a\nLONG+b", "test.c");
+        REQUIRE(output.has_value());
+        REQUIRE(output.value() == "\n\n+ + a\n1 + 2 +b\n");
+    }
+
+    SECTION("Comments and splices")
+    {
+        REQUIRE(run("a/**/b // c\nd") == "a b d");
+        REQUIRE(run("#define L 1 \\\n + 2\nL") == "1 + 2");
+        auto output = wccff::preprocessor::preprocess("in\\\nt a;\nb", "test.c");
+        REQUIRE(output.has_value());
+        REQUIRE(output.value() == "int a;\n\nb\n");
+    }
+}
@@ -0,0 +1,141 @@
+#include "../hash_consing.h"
+#include "../serialized_ast.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <string>
+
+static wccff::parser::program parse_program(wccff::compilation_context &context, std::string_view source)
+{
+    wccff::parser::tokens tokens{ wccff::lexer::token_stream{ source } };
+    auto r = wccff::parser::parse(tokens, context);
+    REQUIRE(r.has_value());
+    return r.value();
+}
+
+TEST_CASE("Serialized programs are read in place", "[serialized_ast]")
+{
+    using namespace wccff::parser;
+    wccff::compilation_context context;
+
+    auto p = parse_program(context, "int main(void) { return -(1 + 300) * ~-70000 || 2147483647 > -2147483647 - 1; }");
+    auto bytes = serialize(p, context.symbols);
+    auto serialized = serialized_program::open(bytes);
+    REQUIRE(serialized.has_value());
+    REQUIRE(serialized->identifier_count() == 1);
+    REQUIRE(serialized->function_name() == "main");
+
+    auto reader = serialized->return_expression();
+    auto root = reader.next();
+    REQUIRE(root.kind == node_kind::binary);
+    REQUIRE(static_cast<binary_operator>(root.op) == binary_operator::logical_or);
+    auto product = reader.next();
+    REQUIRE(static_cast<binary_operator>(product.op) == binary_operator::multiply);
+    auto negation = reader.next();
+    REQUIRE(negation.kind == node_kind::unary);
+    REQUIRE(static_cast<unary_operator>(negation.op) == unary_operator::negate);
+
+    auto rebuilt = deserialize(serialized.value(), context);
+    REQUIRE(pretty_print(context.symbols, rebuilt) == pretty_print(context.symbols, p));
+    // The constants are varints, 1 takes a single byte
+    REQUIRE(serialize(parse_program(context, "int main(void) { return 1; }"), context.symbols).size() < bytes.size());
+}
+
+TEST_CASE("Invalid serialized programs are rejected", "[serialized_ast]")
+{
+    using namespace wccff::parser;
+    wccff::compilation_context context;
+
+    auto bytes = serialize(parse_program(context, "int main(void) { return 1 + 2; }"), context.symbols);
+    REQUIRE(serialized_program::open(bytes).has_value());
+
+    SECTION("Truncated")
+    {
+        for (std::size_t size = 0; size < bytes.size(); size++)
+        {
+            INFO(size);
+            REQUIRE(serialized_program::open(std::string_view{ bytes }.substr(0, size)).has_value() == false);
+        }
+    }
+
+    SECTION("Wrong magic")
+    {
+        bytes[0] = 'X';
+        REQUIRE(serialized_program::open(bytes).error().message == "Not a serialized AST");
+    }
+
+    SECTION("Other version")
+    {
+        bytes[8] = static_cast<char>(serialized_ast_version + 1);
+        REQUIRE(serialized_program::open(bytes).error().message == "Unsupported version 3, expected 2");
+    }
+
+    SECTION("Invalid operator")
+    {
+        // The binary node is right after the name and the statement kind
+        auto op = bytes.size() - 5;
+        REQUIRE(bytes[op - 1] == static_cast<char>(node_kind::binary));
+        bytes[op] = static_cast<char>(binary_operators.size());
+        REQUIRE(serialized_program::open(bytes).error().message == "Invalid operator 18");
+    }
+}
+
+TEST_CASE("Shared nodes are serialized once", "[serialized_ast]")
+{
+    using namespace wccff::parser;
+    wccff::compilation_context context;
+
+    // a + a, where a is the previous link of the chain, so the tree of the expression has 2^31 leaves
+    hash_consing_builder builder{ context.ast };
+    auto e = builder.binary(binary_operator::plus, builder.constant(1), builder.constant(2));
+    for (int i = 0; i < 30; i++)
+    {
+        // The parser builds a + a again for the right side of (a + a) + (a + a), which shares it
+        builder.binary(binary_operator::plus, e, e);
+        e = builder.binary(binary_operator::plus, e, e);
+    }
+    program p;
+    p.f.function_name = identifier{ context.symbols.intern("main") };
+    p.f.body = return_node{ e };
+
+    auto bytes = serialize(p, context.symbols);
+    REQUIRE(bytes.size() < 300);
+    auto serialized = serialized_program::open(bytes);
+    REQUIRE(serialized.has_value());
+
+    hash_consing_builder rebuilt{ context.ast };
+    replay(serialized->return_expression(), rebuilt);
+    REQUIRE(rebuilt.size() == builder.size());
+
+    auto body = std::get<return_node>(deserialize(serialized.value(), context).f.body);
+    const auto *root = std::get<const binary_node *>(body.e);
+    REQUIRE(std::get<const binary_node *>(root->left) == std::get<const binary_node *>(root->right));
+    REQUIRE(std::get<const binary_node *>(root->left)->shared);
+
+    SECTION("A reference must be to a shared node read before it")
+    {
+        // The last bytes are the reference of the root's right side, to the start of its left side
+        REQUIRE(bytes[bytes.size() - 2] == 3);
+        bytes.back() = 0;
+        REQUIRE(serialized_program::open(bytes).error().message == "Invalid reference");
+    }
+}
+
+TEST_CASE("Serialized programs are memory mapped", "[serialized_ast]")
+{
+    using namespace wccff::parser;
+    wccff::compilation_context context;
+
+    auto file = std::filesystem::temp_directory_path() / "wccff_serialized_ast.wast";
+    auto p = parse_program(context, "int main(void) { return (1 << 4) - 3; }");
+    REQUIRE(store(file, p, context.symbols).has_value());
+
+    auto loaded = load(file);
+    REQUIRE(loaded.has_value());
+    REQUIRE(loaded->buffer.is_mapped());
+    REQUIRE(loaded->program.function_name() == "main");
+    REQUIRE(pretty_print(context.symbols, deserialize(loaded->program, context)) == pretty_print(context.symbols, p));
+
+    std::filesystem::remove(file);
+    REQUIRE(load(file).has_value() == false);
+}
@@ -0,0 +1,113 @@
+#include "../source_buffer.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+static std::filesystem::path temporary_file(std::string_view name)
+{
+    auto path = std::filesystem::temp_directory_path() / name;
+    std::filesystem::remove(path);
+    return path;
+}
+
+TEST_CASE("Source buffer", "[lexer]")
+{
+    SECTION("Regular file is mapped")
+    {
+        auto path = temporary_file("wccff_source_buffer.c");
+        std::ofstream{ path } << "int main(void) { return 2; }";
+
+        auto buffer = wccff::lexer::source_buffer::open(path);
+        REQUIRE(buffer.has_value());
+        REQUIRE(buffer->is_mapped());
+        REQUIRE(buffer->view() == "int main(void) { return 2; }");
+
+        // Moving the buffer keeps the mapping
+        auto data = buffer->view().data();
+        auto moved = std::move(buffer.value());
+        REQUIRE(moved.view().data() == data);
+        std::filesystem::remove(path);
+    }
+
+    SECTION("Empty file")
+    {
+        auto path = temporary_file("wccff_source_buffer_empty.c");
+        std::ofstream{ path };
+
+        auto buffer = wccff::lexer::source_buffer::open(path);
+        REQUIRE(buffer.has_value());
+        REQUIRE(buffer->view().empty());
+        std::filesystem::remove(path);
+    }
+
+    SECTION("Content is followed by zeros")
+    {
+        auto path = temporary_file("wccff_source_buffer_page.c");
+        // A file filling whole pages has nothing mapped after it, unless the padding is reserved
+        auto size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        std::ofstream{ path } << std::string(size, 'a');
+
+        auto mapped = wccff::lexer::source_buffer::open(path);
+        REQUIRE(mapped.has_value());
+        REQUIRE(mapped->is_mapped());
+        wccff::lexer::source_buffer copied{ std::string(size, 'a') };
+        wccff::lexer::source_buffer empty;
+        for (const auto *buffer : { &mapped.value(), &copied, &empty })
+        {
+            auto view = buffer->view();
+            for (std::size_t i = 0; i < wccff::lexer::source_buffer::padding; i++)
+            {
+                REQUIRE(view.data()[view.size() + i] == '\0');
+            }
+        }
+        std::filesystem::remove(path);
+    }
+
+    SECTION("Missing file")
+    {
+        auto buffer = wccff::lexer::source_buffer::open(temporary_file("wccff_source_buffer_missing.c"));
+        REQUIRE(buffer.has_value() == false);
+    }
+
+    SECTION("Pipe is read into memory")
+    {
+        auto path = temporary_file("wccff_source_buffer_fifo");
+        REQUIRE(::mkfifo(path.c_str(), 0600) == 0);
+        std::thread writer{ [&path] { std::ofstream{ path } << "return 3;"; } };
+
+        auto buffer = wccff::lexer::source_buffer::open(path);
+        writer.join();
+        REQUIRE(buffer.has_value());
+        REQUIRE(buffer->is_mapped() == false);
+        REQUIRE(buffer->view() == "return 3;");
+        std::filesystem::remove(path);
+    }
+}
+
+TEST_CASE("Input stream", "[lexer]")
+{
+    auto path = temporary_file("wccff_input_stream_fifo");
+    REQUIRE(::mkfifo(path.c_str(), 0600) == 0);
+    std::thread writer{ [&path] { std::ofstream{ path } << "int main(void) { return 3; }"; } };
+
+    auto stream = wccff::lexer::input_stream::open(path, 8);
+    REQUIRE(stream.has_value());
+    std::string content;
+    while (stream->at_end() == false)
+    {
+        REQUIRE(stream->refill().has_value());
+        REQUIRE(stream->data().size() <= 8);
+        // Keeps the last byte, it's moved to the beginning of the window by the next refill
+        auto consumed = stream->data().size() > 1 ? stream->data().size() - 1 : 0;
+        content += stream->data().substr(0, consumed);
+        stream->consume(consumed);
+    }
+    content += stream->data();
+    writer.join();
+    REQUIRE(content == "int main(void) { return 3; }");
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,50 @@
+#include "../symbol.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+
+TEST_CASE("Symbol interner", "[symbol]")
+{
+    wccff::symbol_interner interner;
+
+    SECTION("Same text, same symbol")
+    {
+        auto a = interner.intern("main");
+        std::string text{ "main" };
+        auto b = interner.intern(text);
+        REQUIRE(a == b);
+        REQUIRE(interner.size() == 1);
+    }
+
+    SECTION("Different text, different symbol")
+    {
+        auto a = interner.intern("a");
+        auto b = interner.intern("b");
+        REQUIRE(a != b);
+        REQUIRE(interner.text(a) == "a");
+        REQUIRE(interner.text(b) == "b");
+    }
+
+    SECTION("Text outlives the interned string")
+    {
+        wccff::symbol s;
+        {
+            std::string text{ "a_long_identifier_that_doesnt_fit_the_small_string_buffer" };
+            s = interner.intern(text);
+        }
+        for (int i = 0; i < 1000; i++)
+        {
+            interner.intern(std::to_string(i));
+        }
+        REQUIRE(interner.text(s) == "a_long_identifier_that_doesnt_fit_the_small_string_buffer");
+        REQUIRE(interner.intern("999") == interner.intern(std::string{ "999" }));
+    }
+
+    SECTION("Clear")
+    {
+        interner.intern("a");
+        interner.clear();
+        REQUIRE(interner.size() == 0);
+        REQUIRE(interner.text(interner.intern("b")) == "b");
+    }
+}
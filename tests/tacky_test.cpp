@@ -1,15 +1,22 @@
+#include "../hash_consing.h"
 #include "../parser.h"
 #include "../tacky.h"
+#include <algorithm>
 #include <catch2/catch_test_macros.hpp>
+#include <map>
+#include <regex>
+#include <string>
 
 TEST_CASE("Tacky", "[tacky]")
 {
+    wccff::compilation_context context;
+
     SECTION("Identifier")
     {
-        wccff::parser::identifier id{ "foo" };
+        wccff::parser::identifier id{ context.symbols.intern("foo") };
 
         auto result = wccff::tacky::process_identifier(id);
-        REQUIRE(result.name == "foo");
+        REQUIRE(context.symbols.text(result.name) == "foo");
     }
 
     SECTION("Constant")
@@ -24,35 +31,36 @@ TEST_CASE("Tacky", "[tacky]")
     {
         SECTION("Negate Operator")
         {
-            wccff::parser::negate_operator c;
+            auto c = wccff::parser::unary_operator::negate;
 
             auto result = wccff::tacky::process_unary_operator(c);
-            REQUIRE(std::holds_alternative<wccff::tacky::negate_operator>(result));
+            REQUIRE(result == wccff::tacky::unary_operator::negate);
         }
         SECTION("Bitwise Complement Operator")
         {
-            wccff::parser::bitwise_complement_operator c;
+            auto c = wccff::parser::unary_operator::bitwise_complement;
 
             auto result = wccff::tacky::process_unary_operator(c);
-            REQUIRE(std::holds_alternative<wccff::tacky::binary_complement_operator>(result));
+            REQUIRE(result == wccff::tacky::unary_operator::complement);
         }
     }
     SECTION("Unary Node")
     {
         auto inner_expression = wccff::parser::int_constant{ 42 };
-        auto node = std::make_unique<wccff::parser::unary_node>(wccff::parser::negate_operator{}, inner_expression);
+        auto node = context.ast.create<wccff::parser::unary_node>(wccff::parser::unary_operator::negate,
+                                                                  inner_expression);
 
         std::vector<wccff::tacky::instruction> instructions;
-        auto result = wccff::tacky::process_unary_node(node, instructions);
+        auto result = wccff::tacky::process_unary_node(node, instructions, context.symbols);
 
         REQUIRE(instructions.size() == 1);
         REQUIRE(std::holds_alternative<wccff::tacky::unary_statement>(instructions.at(0)));
         auto instruction = std::get<wccff::tacky::unary_statement>(instructions.at(0));
-        REQUIRE(std::holds_alternative<wccff::tacky::negate_operator>(instruction.op));
+        REQUIRE(instruction.op == wccff::tacky::unary_operator::negate);
         REQUIRE(std::holds_alternative<wccff::tacky::constant>(instruction.src));
         REQUIRE(std::get<wccff::tacky::constant>(instruction.src).value == 42);
         REQUIRE(std::holds_alternative<wccff::tacky::var>(instruction.dst));
-        REQUIRE(std::get<wccff::tacky::var>(instruction.dst).id.name == "tacky-1");
+        REQUIRE(context.symbols.text(std::get<wccff::tacky::var>(instruction.dst).id.name) == "tacky-1");
     }
 }
 
@@ -61,31 +69,32 @@ TEST_CASE("process_binary_operator", "[tacky]")
     using wccff::tacky::process_binary_operator;
     using namespace wccff;
 
-    REQUIRE(std::holds_alternative<tacky::plus_operator>(process_binary_operator(parser::plus_operator{})));
-    REQUIRE(std::holds_alternative<tacky::subtract_operator>(process_binary_operator(parser::subtract_operator{})));
-    REQUIRE(std::holds_alternative<tacky::multiply_operator>(process_binary_operator(parser::multiply_operator{})));
-    REQUIRE(std::holds_alternative<tacky::divide_operator>(process_binary_operator(parser::divide_operator{})));
-    REQUIRE(std::holds_alternative<tacky::remainder_operator>(process_binary_operator(parser::remainder_operator{})));
+    REQUIRE(process_binary_operator(parser::binary_operator::plus) == tacky::binary_operator::plus);
+    REQUIRE(process_binary_operator(parser::binary_operator::subtract) == tacky::binary_operator::subtract);
+    REQUIRE(process_binary_operator(parser::binary_operator::multiply) == tacky::binary_operator::multiply);
+    REQUIRE(process_binary_operator(parser::binary_operator::divide) == tacky::binary_operator::divide);
+    REQUIRE(process_binary_operator(parser::binary_operator::remainder) == tacky::binary_operator::remainder);
 }
 
 TEST_CASE("process_binary_node", "[tacky]")
 {
     using namespace wccff;
+    compilation_context context;
 
     SECTION("Plus Operator")
     {
         auto left = wccff::parser::int_constant{ 42 };
         auto right = wccff::parser::int_constant{ 24 };
-        auto binary_expr = std::make_unique<parser::binary_node>(parser::plus_operator{}, left, right);
+        auto binary_expr = context.ast.create<parser::binary_node>(parser::binary_operator::plus, left, right);
 
         std::vector<wccff::tacky::instruction> instructions;
-        auto result = tacky::process_binary_node(binary_expr, instructions);
+        auto result = tacky::process_binary_node(binary_expr, instructions, context.symbols);
 
         REQUIRE(instructions.size() == 1);
         REQUIRE(std::holds_alternative<tacky::binary_statement>(instructions.at(0)));
         auto inst = std::get<tacky::binary_statement>(instructions.at(0));
 
-        REQUIRE(std::holds_alternative<tacky::plus_operator>(inst.op));
+        REQUIRE(inst.op == tacky::binary_operator::plus);
         REQUIRE(std::holds_alternative<tacky::constant>(inst.src1));
         REQUIRE(std::get<tacky::constant>(inst.src1).value == 42);
         REQUIRE(std::get<tacky::constant>(inst.src2).value == 24);
@@ -96,16 +105,16 @@ TEST_CASE("process_binary_node", "[tacky]")
     {
         auto left = wccff::parser::int_constant{ 1 };
         auto right = wccff::parser::int_constant{ 2 };
-        auto binary_expr = std::make_unique<parser::binary_node>(parser::bitwise_and_operator{}, left, right);
+        auto binary_expr = context.ast.create<parser::binary_node>(parser::binary_operator::bitwise_and, left, right);
 
         std::vector<wccff::tacky::instruction> instructions;
-        auto result = tacky::process_binary_node(binary_expr, instructions);
+        auto result = tacky::process_binary_node(binary_expr, instructions, context.symbols);
 
         REQUIRE(instructions.size() == 1);
         REQUIRE(std::holds_alternative<tacky::binary_statement>(instructions.at(0)));
         auto inst = std::get<tacky::binary_statement>(instructions.at(0));
 
-        REQUIRE(std::holds_alternative<tacky::binary_and_operator>(inst.op));
+        REQUIRE(inst.op == tacky::binary_operator::bitwise_and);
         REQUIRE(std::holds_alternative<tacky::constant>(inst.src1));
         REQUIRE(std::get<tacky::constant>(inst.src1).value == 1);
         REQUIRE(std::get<tacky::constant>(inst.src2).value == 2);
@@ -116,16 +125,16 @@ TEST_CASE("process_binary_node", "[tacky]")
     {
         auto left = wccff::parser::int_constant{ 1 };
         auto right = wccff::parser::int_constant{ 2 };
-        auto binary_expr = std::make_unique<parser::binary_node>(parser::bitwise_or_operator{}, left, right);
+        auto binary_expr = context.ast.create<parser::binary_node>(parser::binary_operator::bitwise_or, left, right);
 
         std::vector<wccff::tacky::instruction> instructions;
-        auto result = tacky::process_binary_node(binary_expr, instructions);
+        auto result = tacky::process_binary_node(binary_expr, instructions, context.symbols);
 
         REQUIRE(instructions.size() == 1);
         REQUIRE(std::holds_alternative<tacky::binary_statement>(instructions.at(0)));
         auto inst = std::get<tacky::binary_statement>(instructions.at(0));
 
-        REQUIRE(std::holds_alternative<tacky::binary_or_operator>(inst.op));
+        REQUIRE(inst.op == tacky::binary_operator::bitwise_or);
         REQUIRE(std::holds_alternative<tacky::constant>(inst.src1));
         REQUIRE(std::get<tacky::constant>(inst.src1).value == 1);
         REQUIRE(std::get<tacky::constant>(inst.src2).value == 2);
@@ -136,16 +145,16 @@ TEST_CASE("process_binary_node", "[tacky]")
     {
         auto left = wccff::parser::int_constant{ 1 };
         auto right = wccff::parser::int_constant{ 2 };
-        auto binary_expr = std::make_unique<parser::binary_node>(parser::bitwise_xor_operator{}, left, right);
+        auto binary_expr = context.ast.create<parser::binary_node>(parser::binary_operator::bitwise_xor, left, right);
 
         std::vector<wccff::tacky::instruction> instructions;
-        auto result = tacky::process_binary_node(binary_expr, instructions);
+        auto result = tacky::process_binary_node(binary_expr, instructions, context.symbols);
 
         REQUIRE(instructions.size() == 1);
         REQUIRE(std::holds_alternative<tacky::binary_statement>(instructions.at(0)));
         auto inst = std::get<tacky::binary_statement>(instructions.at(0));
 
-        REQUIRE(std::holds_alternative<tacky::binary_xor_operator>(inst.op));
+        REQUIRE(inst.op == tacky::binary_operator::bitwise_xor);
         REQUIRE(std::holds_alternative<tacky::constant>(inst.src1));
         REQUIRE(std::get<tacky::constant>(inst.src1).value == 1);
         REQUIRE(std::get<tacky::constant>(inst.src2).value == 2);
@@ -156,16 +165,16 @@ TEST_CASE("process_binary_node", "[tacky]")
     {
         auto left = wccff::parser::int_constant{ 1 };
         auto right = wccff::parser::int_constant{ 2 };
-        auto binary_expr = std::make_unique<parser::binary_node>(parser::left_shift_operator{}, left, right);
+        auto binary_expr = context.ast.create<parser::binary_node>(parser::binary_operator::left_shift, left, right);
 
         std::vector<wccff::tacky::instruction> instructions;
-        auto result = tacky::process_binary_node(binary_expr, instructions);
+        auto result = tacky::process_binary_node(binary_expr, instructions, context.symbols);
 
         REQUIRE(instructions.size() == 1);
         REQUIRE(std::holds_alternative<tacky::binary_statement>(instructions.at(0)));
         auto inst = std::get<tacky::binary_statement>(instructions.at(0));
 
-        REQUIRE(std::holds_alternative<tacky::left_shift_operator>(inst.op));
+        REQUIRE(inst.op == tacky::binary_operator::left_shift);
         REQUIRE(std::holds_alternative<tacky::constant>(inst.src1));
         REQUIRE(std::get<tacky::constant>(inst.src1).value == 1);
         REQUIRE(std::get<tacky::constant>(inst.src2).value == 2);
@@ -176,16 +185,16 @@ TEST_CASE("process_binary_node", "[tacky]")
     {
         auto left = wccff::parser::int_constant{ 1 };
         auto right = wccff::parser::int_constant{ 2 };
-        auto binary_expr = std::make_unique<parser::binary_node>(parser::right_shift_operator{}, left, right);
+        auto binary_expr = context.ast.create<parser::binary_node>(parser::binary_operator::right_shift, left, right);
 
         std::vector<wccff::tacky::instruction> instructions;
-        auto result = tacky::process_binary_node(binary_expr, instructions);
+        auto result = tacky::process_binary_node(binary_expr, instructions, context.symbols);
 
         REQUIRE(instructions.size() == 1);
         REQUIRE(std::holds_alternative<tacky::binary_statement>(instructions.at(0)));
         auto inst = std::get<tacky::binary_statement>(instructions.at(0));
 
-        REQUIRE(std::holds_alternative<tacky::right_shift_operator>(inst.op));
+        REQUIRE(inst.op == tacky::binary_operator::right_shift);
         REQUIRE(std::holds_alternative<tacky::constant>(inst.src1));
         REQUIRE(std::get<tacky::constant>(inst.src1).value == 1);
         REQUIRE(std::get<tacky::constant>(inst.src2).value == 2);
@@ -196,16 +205,16 @@ TEST_CASE("process_binary_node", "[tacky]")
     {
         auto left = wccff::parser::int_constant{ 1 };
         auto right = wccff::parser::int_constant{ 2 };
-        auto binary_expr = std::make_unique<parser::binary_node>(parser::equals_operator{}, left, right);
+        auto binary_expr = context.ast.create<parser::binary_node>(parser::binary_operator::equals, left, right);
 
         std::vector<wccff::tacky::instruction> instructions;
-        auto result = tacky::process_binary_node(binary_expr, instructions);
+        auto result = tacky::process_binary_node(binary_expr, instructions, context.symbols);
 
         REQUIRE(instructions.size() == 1);
         REQUIRE(std::holds_alternative<tacky::binary_statement>(instructions.at(0)));
         auto inst = std::get<tacky::binary_statement>(instructions.at(0));
 
-        REQUIRE(std::holds_alternative<tacky::equal_operator>(inst.op));
+        REQUIRE(inst.op == tacky::binary_operator::equal);
         REQUIRE(std::holds_alternative<tacky::constant>(inst.src1));
         REQUIRE(std::get<tacky::constant>(inst.src1).value == 1);
         REQUIRE(std::get<tacky::constant>(inst.src2).value == 2);
@@ -216,16 +225,16 @@ TEST_CASE("process_binary_node", "[tacky]")
     {
         auto left = wccff::parser::int_constant{ 1 };
         auto right = wccff::parser::int_constant{ 2 };
-        auto binary_expr = std::make_unique<parser::binary_node>(parser::not_equals_operator{}, left, right);
+        auto binary_expr = context.ast.create<parser::binary_node>(parser::binary_operator::not_equals, left, right);
 
         std::vector<wccff::tacky::instruction> instructions;
-        auto result = tacky::process_binary_node(binary_expr, instructions);
+        auto result = tacky::process_binary_node(binary_expr, instructions, context.symbols);
 
         REQUIRE(instructions.size() == 1);
         REQUIRE(std::holds_alternative<tacky::binary_statement>(instructions.at(0)));
         auto inst = std::get<tacky::binary_statement>(instructions.at(0));
 
-        REQUIRE(std::holds_alternative<tacky::not_equal_operator>(inst.op));
+        REQUIRE(inst.op == tacky::binary_operator::not_equal);
         REQUIRE(std::holds_alternative<tacky::constant>(inst.src1));
         REQUIRE(std::get<tacky::constant>(inst.src1).value == 1);
         REQUIRE(std::get<tacky::constant>(inst.src2).value == 2);
@@ -235,16 +244,16 @@ TEST_CASE("process_binary_node", "[tacky]")
     {
         auto left = wccff::parser::int_constant{ 1 };
         auto right = wccff::parser::int_constant{ 2 };
-        auto binary_expr = std::make_unique<parser::binary_node>(parser::less_than_operator{}, left, right);
+        auto binary_expr = context.ast.create<parser::binary_node>(parser::binary_operator::less_than, left, right);
 
         std::vector<wccff::tacky::instruction> instructions;
-        auto result = tacky::process_binary_node(binary_expr, instructions);
+        auto result = tacky::process_binary_node(binary_expr, instructions, context.symbols);
 
         REQUIRE(instructions.size() == 1);
         REQUIRE(std::holds_alternative<tacky::binary_statement>(instructions.at(0)));
         auto inst = std::get<tacky::binary_statement>(instructions.at(0));
 
-        REQUIRE(std::holds_alternative<tacky::less_than_operator>(inst.op));
+        REQUIRE(inst.op == tacky::binary_operator::less_than);
         REQUIRE(std::holds_alternative<tacky::constant>(inst.src1));
         REQUIRE(std::get<tacky::constant>(inst.src1).value == 1);
         REQUIRE(std::get<tacky::constant>(inst.src2).value == 2);
@@ -254,16 +263,17 @@ TEST_CASE("process_binary_node", "[tacky]")
     {
         auto left = wccff::parser::int_constant{ 1 };
         auto right = wccff::parser::int_constant{ 2 };
-        auto binary_expr = std::make_unique<parser::binary_node>(parser::less_than_or_equal_operator{}, left, right);
+        auto binary_expr =
+          context.ast.create<parser::binary_node>(parser::binary_operator::less_than_or_equal, left, right);
 
         std::vector<wccff::tacky::instruction> instructions;
-        auto result = tacky::process_binary_node(binary_expr, instructions);
+        auto result = tacky::process_binary_node(binary_expr, instructions, context.symbols);
 
         REQUIRE(instructions.size() == 1);
         REQUIRE(std::holds_alternative<tacky::binary_statement>(instructions.at(0)));
         auto inst = std::get<tacky::binary_statement>(instructions.at(0));
 
-        REQUIRE(std::holds_alternative<tacky::less_than_or_equal_operator>(inst.op));
+        REQUIRE(inst.op == tacky::binary_operator::less_than_or_equal);
         REQUIRE(std::holds_alternative<tacky::constant>(inst.src1));
         REQUIRE(std::get<tacky::constant>(inst.src1).value == 1);
         REQUIRE(std::get<tacky::constant>(inst.src2).value == 2);
@@ -273,16 +283,16 @@ TEST_CASE("process_binary_node", "[tacky]")
     {
         auto left = wccff::parser::int_constant{ 1 };
         auto right = wccff::parser::int_constant{ 2 };
-        auto binary_expr = std::make_unique<parser::binary_node>(parser::greater_than_operator{}, left, right);
+        auto binary_expr = context.ast.create<parser::binary_node>(parser::binary_operator::greater_than, left, right);
 
         std::vector<wccff::tacky::instruction> instructions;
-        auto result = tacky::process_binary_node(binary_expr, instructions);
+        auto result = tacky::process_binary_node(binary_expr, instructions, context.symbols);
 
         REQUIRE(instructions.size() == 1);
         REQUIRE(std::holds_alternative<tacky::binary_statement>(instructions.at(0)));
         auto inst = std::get<tacky::binary_statement>(instructions.at(0));
 
-        REQUIRE(std::holds_alternative<tacky::greater_than_operator>(inst.op));
+        REQUIRE(inst.op == tacky::binary_operator::greater_than);
         REQUIRE(std::holds_alternative<tacky::constant>(inst.src1));
         REQUIRE(std::get<tacky::constant>(inst.src1).value == 1);
         REQUIRE(std::get<tacky::constant>(inst.src2).value == 2);
@@ -292,19 +302,219 @@ TEST_CASE("process_binary_node", "[tacky]")
     {
         auto left = wccff::parser::int_constant{ 1 };
         auto right = wccff::parser::int_constant{ 2 };
-        auto binary_expr = std::make_unique<parser::binary_node>(parser::greater_than_or_equal_operator{}, left, right);
+        auto binary_expr =
+          context.ast.create<parser::binary_node>(parser::binary_operator::greater_than_or_equal, left, right);
 
         std::vector<wccff::tacky::instruction> instructions;
-        auto result = tacky::process_binary_node(binary_expr, instructions);
+        auto result = tacky::process_binary_node(binary_expr, instructions, context.symbols);
 
         REQUIRE(instructions.size() == 1);
         REQUIRE(std::holds_alternative<tacky::binary_statement>(instructions.at(0)));
         auto inst = std::get<tacky::binary_statement>(instructions.at(0));
 
-        REQUIRE(std::holds_alternative<tacky::greater_than_or_equal_operator>(inst.op));
+        REQUIRE(inst.op == tacky::binary_operator::greater_than_or_equal);
         REQUIRE(std::holds_alternative<tacky::constant>(inst.src1));
         REQUIRE(std::get<tacky::constant>(inst.src1).value == 1);
         REQUIRE(std::get<tacky::constant>(inst.src2).value == 2);
         REQUIRE(std::holds_alternative<tacky::var>(inst.dst));
     }
 }
+
+/**
+ * Numbers the temporaries and labels by their first use, so two lowerings can be compared.
+ */
+static std::string normalize_names(const std::string &text)
+{
+    static const std::regex name{ "(tacky-|and_false_|and_end_|or_true_|or_end_)([0-9]+)" };
+    std::map<std::string, std::size_t> numbers;
+    std::string result;
+    auto last = text.cbegin();
+    for (auto it = std::sregex_iterator(text.begin(), text.end(), name); it != std::sregex_iterator{}; ++it)
+    {
+        result.append(last, (*it)[0].first);
+        auto [number, inserted] = numbers.try_emplace(it->str(), numbers.size());
+        result += (*it)[1].str() + std::to_string(number->second);
+        last = (*it)[0].second;
+    }
+    result.append(last, text.cend());
+    return result;
+}
+
+TEST_CASE("Flat expressions lower like the trees", "[tacky]")
+{
+    for (std::string_view source : { "42",
+                                     "-(-(~(!7)))",
+                                     "1 + 2 * -3 / 4 % 5",
+                                     "(1 && 2) || !(3 < 4) && ~5",
+                                     "1 || 2 || 3 && 4 && (5 || 0)" })
+    {
+        INFO(source);
+        wccff::compilation_context context;
+        wccff::parser::tokens tree_tokens{ wccff::lexer::token_stream{ source } };
+        auto tree = wccff::parser::parse_expression(tree_tokens, context);
+        REQUIRE(tree.has_value());
+        wccff::parser::tokens flat_tokens{ wccff::lexer::token_stream{ source } };
+        auto flat = wccff::parser::parse_flat_expression(flat_tokens);
+        REQUIRE(flat.has_value());
+
+        std::vector<wccff::tacky::instruction> from_tree;
+        auto tree_value = wccff::tacky::process_expression(tree.value(), from_tree, context.symbols);
+        std::vector<wccff::tacky::instruction> from_flat;
+        auto flat_value = wccff::tacky::process_expression(flat.value(), from_flat, context.symbols);
+        REQUIRE(from_flat.size() == from_tree.size());
+        auto print = [&context](const auto &instructions, const auto &value) {
+            return normalize_names(wccff::tacky::pretty_print(context.symbols, instructions) +
+                                   wccff::tacky::pretty_print(context.symbols, value));
+        };
+        REQUIRE(print(from_flat, flat_value) == print(from_tree, tree_value));
+    }
+}
+
+TEST_CASE("Deep expressions are lowered", "[tacky]")
+{
+    constexpr int depth = 100000;
+    std::string input;
+    for (int i = 0; i < depth; i++)
+    {
+        input += "!(1 && ";
+    }
+    input += "1";
+    input.append(depth, ')');
+
+    wccff::compilation_context context;
+    wccff::parser::tokens tree_tokens{ wccff::lexer::token_stream{ input } };
+    auto tree = wccff::parser::parse_expression(tree_tokens, context);
+    REQUIRE(tree.has_value());
+    std::vector<wccff::tacky::instruction> instructions;
+    wccff::tacky::process_expression(tree.value(), instructions, context.symbols);
+    // The && are 7 instructions each, the ! one
+    REQUIRE(instructions.size() == 8 * depth);
+}
+
+TEST_CASE("Shared subexpressions are lowered once", "[tacky]")
+{
+    wccff::compilation_context context;
+    auto lower = [&context](std::string_view source) {
+        wccff::parser::tokens tokens{ wccff::lexer::token_stream{ source } };
+        wccff::parser::hash_consing_builder builder{ context.ast };
+        auto e = wccff::parser::parse_expression(tokens, builder);
+        REQUIRE(e.has_value());
+        std::vector<wccff::tacky::instruction> instructions;
+        wccff::tacky::process_expression(e.value(), instructions, context.symbols);
+        return instructions;
+    };
+    auto additions = [](const std::vector<wccff::tacky::instruction> &instructions) {
+        return std::count_if(instructions.begin(), instructions.end(), [](const auto &i) {
+            return std::holds_alternative<wccff::tacky::binary_statement>(i) &&
+                   std::get<wccff::tacky::binary_statement>(i).op == wccff::tacky::binary_operator::plus;
+        });
+    };
+
+    SECTION("The value of a shared node is reused")
+    {
+        auto instructions = lower("(1 + 2) * (1 + 2) - -(1 + 2)");
+        REQUIRE(instructions.size() == 4);
+        REQUIRE(additions(instructions) == 1);
+    }
+
+    SECTION("A value computed before && is reused inside it")
+    {
+        REQUIRE(additions(lower("(1 + 2) - (0 && (1 + 2))")) == 1);
+    }
+
+    SECTION("A value computed in the right operand of && isn't reused after it")
+    {
+        REQUIRE(additions(lower("(0 && (1 + 2)) - (1 + 2)")) == 2);
+        REQUIRE(additions(lower("(1 || (1 + 2) * (1 + 2)) - (1 + 2)")) == 2);
+    }
+}
+
+TEST_CASE("Serialized programs lower like the trees", "[tacky]")
+{
+    for (std::string_view source : { "int main(void) { return 42; }",
+                                     "int main(void) { return -(-(~(!7))); }",
+                                     "int main(void) { return 1 + 2 * -3 / 4 % 5; }",
+                                     "int main(void) { return (1 && 2) || !(3 < 4) && ~5; }",
+                                     "int main(void) { return 1 || 2 || 3 && 4 && (5 || 0); }" })
+    {
+        INFO(source);
+        wccff::compilation_context context;
+        wccff::parser::tokens tokens{ wccff::lexer::token_stream{ source } };
+        auto program = wccff::parser::parse(tokens, context);
+        REQUIRE(program.has_value());
+        auto bytes = wccff::parser::serialize(program.value(), context.symbols);
+        auto serialized = wccff::parser::serialized_program::open(bytes);
+        REQUIRE(serialized.has_value());
+
+        auto from_tree = wccff::tacky::process(program.value(), context.symbols);
+        auto from_bytes = wccff::tacky::process(serialized.value(), context.symbols);
+        REQUIRE(normalize_names(wccff::tacky::pretty_print(context.symbols, from_bytes)) ==
+                normalize_names(wccff::tacky::pretty_print(context.symbols, from_tree)));
+    }
+}
+
+TEST_CASE("Serialized shared nodes lower like the DAGs", "[tacky]")
+{
+    for (std::string_view source : { "int main(void) { return (1 + 2) * (1 + 2) - -(1 + 2); }",
+                                     "int main(void) { return (1 + 2) - (0 && (1 + 2)); }",
+                                     "int main(void) { return (0 && (1 + 2)) - (1 + 2); }",
+                                     "int main(void) { return (1 || (1 + 2) * (1 + 2)) - (1 + 2) * (1 + 2); }",
+                                     "int main(void) { return (0 && -(1 + 2)) + (1 || -(1 + 2) + (1 + 2)); }" })
+    {
+        INFO(source);
+        wccff::compilation_context context;
+        wccff::parser::tokens tokens{ wccff::lexer::token_stream{ source } };
+        auto program = wccff::parser::parse(tokens, context, { .share_subexpressions = true });
+        REQUIRE(program.has_value());
+        auto bytes = wccff::parser::serialize(program.value(), context.symbols);
+        auto serialized = wccff::parser::serialized_program::open(bytes);
+        REQUIRE(serialized.has_value());
+
+        auto from_tree = wccff::tacky::process(program.value(), context.symbols);
+        auto from_bytes = wccff::tacky::process(serialized.value(), context.symbols);
+        REQUIRE(normalize_names(wccff::tacky::pretty_print(context.symbols, from_bytes)) ==
+                normalize_names(wccff::tacky::pretty_print(context.symbols, from_tree)));
+    }
+}
+
+TEST_CASE("Programs lowered while parsing match the trees", "[tacky]")
+{
+    for (std::string_view source : { "int main(void) { return 42; }",
+                                     "int main(void) { return -(-(~(!7))); }",
+                                     "int main(void) { return 1 + 2 * -3 / 4 % 5 << 2 >= 3 != 1; }",
+                                     "int main(void) { return (1 && 2) || !(3 < 4) && ~5; }",
+                                     "int main(void) { return 1 || 2 || 3 && 4 && (5 || 0); }",
+                                     "int main(void) { return (1 || 2 && (3 || 4)) + (5 && (6 || 7 && 8)); }" })
+    {
+        INFO(source);
+        wccff::compilation_context context;
+        wccff::parser::tokens tree_tokens{ wccff::lexer::token_stream{ source } };
+        auto program = wccff::parser::parse(tree_tokens, context);
+        REQUIRE(program.has_value());
+        wccff::parser::tokens tokens{ wccff::lexer::token_stream{ source } };
+        auto lowered = wccff::tacky::parse_and_lower(tokens, context);
+        REQUIRE(lowered.has_value());
+
+        auto from_tree = wccff::tacky::process(program.value(), context.symbols);
+        REQUIRE(context.symbols.text(lowered->function.name.name) == "main");
+        REQUIRE(normalize_names(wccff::tacky::pretty_print(context.symbols, lowered.value())) ==
+                normalize_names(wccff::tacky::pretty_print(context.symbols, from_tree)));
+    }
+
+    for (std::string_view source : { "int main(void) { return 1 + ; }",
+                                     "int main(void) { return (1 && 2; }",
+                                     "int main(void) { return 1 }",
+                                     "int main(void) { return 1; } 2",
+                                     "int main(void) { return 1 @ 2; }" })
+    {
+        INFO(source);
+        wccff::compilation_context context;
+        wccff::parser::tokens tree_tokens{ wccff::lexer::token_stream{ source } };
+        auto program = wccff::parser::parse(tree_tokens, context);
+        REQUIRE(program.has_value() == false);
+        wccff::parser::tokens tokens{ wccff::lexer::token_stream{ source } };
+        auto lowered = wccff::tacky::parse_and_lower(tokens, context);
+        REQUIRE(lowered.has_value() == false);
+        REQUIRE(lowered.error().message == program.error().message);
+    }
+}
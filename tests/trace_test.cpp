@@ -0,0 +1,39 @@
+#include "../trace.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+TEST_CASE("Trace", "[trace]")
+{
+    using wccff::trace::category;
+    using wccff::trace::level;
+
+    SECTION("Names")
+    {
+        REQUIRE(wccff::trace::level_from_string("debug") == level::debug);
+        REQUIRE(wccff::trace::level_from_string("loud").has_value() == false);
+        REQUIRE(wccff::trace::category_from_string("tacky") == category::tacky);
+        REQUIRE(wccff::trace::category_from_string("linker").has_value() == false);
+        REQUIRE(wccff::trace::to_string(category::emit) == "emit");
+    }
+
+    SECTION("Levels")
+    {
+        wccff::trace::set_level(level::off);
+        wccff::trace::set_level(category::parser, level::info);
+        REQUIRE(wccff::trace::enabled(category::parser, level::error));
+        REQUIRE(wccff::trace::enabled(category::parser, level::info));
+        REQUIRE(wccff::trace::enabled(category::parser, level::debug) == false);
+        REQUIRE(wccff::trace::enabled(category::lexer, level::error) == false);
+        wccff::trace::set_level(level::off);
+    }
+
+    SECTION("Arguments are only evaluated when the trace is enabled")
+    {
+        int evaluated = 0;
+        auto argument = [&evaluated] { return ++evaluated; };
+
+        wccff::trace::set_level(level::off);
+        WCCFF_TRACE(lexer, verbose, "{}", argument());
+        REQUIRE(evaluated == 0);
+    }
+}
@@ -0,0 +1,71 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+
+namespace wccff::trace {
+
+constexpr std::array<std::string_view, category_count> category_names{
+    "driver", "preprocessor", "lexer", "parser", "tacky", "codegen", "emit",
+};
+
+constexpr std::array<std::string_view, 5> level_names{
+    "off", "error", "info", "debug", "verbose",
+};
+
+void set_level(level l)
+{
+    levels.fill(l);
+}
+
+void set_level(category c, level l)
+{
+    levels[static_cast<std::size_t>(c)] = l;
+}
+
+std::string_view to_string(category c)
+{
+    return category_names[static_cast<std::size_t>(c)];
+}
+
+std::optional<level> level_from_string(std::string_view name)
+{
+    for (std::size_t i = 0; i < level_names.size(); i++)
+    {
+        if (level_names[i] == name)
+        {
+            return static_cast<level>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<category> category_from_string(std::string_view name)
+{
+    for (std::size_t i = 0; i < category_names.size(); i++)
+    {
+        if (category_names[i] == name)
+        {
+            return static_cast<category>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+} // namespace wccff::trace
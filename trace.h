@@ -0,0 +1,127 @@
+/*
+ * Will Compile C for Food, a toy C compiler
+ * Copyright (C) 2024  João Pires
+ * https://github.com/jpires/will-compile-c-for-food
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fmt/format.h>
+#include <iterator>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+/**
+ * Trace points above this level are removed at compile time.
+ * 0 removes all of them, 4 keeps them all. The build sets it through the WCCFF_TRACE_MAX_LEVEL cache variable.
+ */
+#ifndef WCCFF_TRACE_MAX_LEVEL
+#define WCCFF_TRACE_MAX_LEVEL 4
+#endif
+
+namespace wccff::trace {
+
+enum class level : uint8_t
+{
+    off,
+    error,
+    info,
+    debug,
+    verbose,
+};
+
+enum class category : uint8_t
+{
+    driver,
+    preprocessor,
+    lexer,
+    parser,
+    tacky,
+    codegen,
+    emit,
+};
+constexpr std::size_t category_count = 7;
+
+/**
+ * The level each category is traced at, everything is off by default.
+ */
+inline std::array<level, category_count> levels{};
+
+constexpr bool compiled_in(level l)
+{
+    return static_cast<int>(l) <= WCCFF_TRACE_MAX_LEVEL;
+}
+
+inline bool enabled(category c, level l)
+{
+    return l <= levels[static_cast<std::size_t>(c)];
+}
+
+void set_level(level l);
+void set_level(category c, level l);
+
+std::string_view to_string(category c);
+std::optional<level> level_from_string(std::string_view name);
+std::optional<category> category_from_string(std::string_view name);
+
+using clock = std::chrono::steady_clock;
+
+/**
+ * Microseconds elapsed since start, for the trace messages that time a stage.
+ */
+inline double microseconds_since(clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(clock::now() - start).count();
+}
+
+template<typename... Args>
+void write(category c, fmt::format_string<Args...> format_str, Args &&...args)
+{
+    fmt::memory_buffer out;
+    fmt::format_to(std::back_inserter(out), "[{}] ", to_string(c));
+    fmt::format_to(std::back_inserter(out), format_str, std::forward<Args>(args)...);
+    out.push_back('\n');
+    std::fwrite(out.data(), 1, out.size(), stderr);
+}
+
+} // namespace wccff::trace
+
+/**
+ * Writes a trace message to stderr, when the category is enabled at the given level.
+ * The arguments are only evaluated when the message is written, and trace points above WCCFF_TRACE_MAX_LEVEL
+ * don't generate any code.
+ *
+ * Example: WCCFF_TRACE(lexer, verbose, "Found {}", type);
+ */
+#define WCCFF_TRACE(cat, lvl, ...)                                                                                     \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (::wccff::trace::compiled_in(::wccff::trace::level::lvl))                                         \
+        {                                                                                                              \
+            if (::wccff::trace::enabled(::wccff::trace::category::cat, ::wccff::trace::level::lvl))                    \
+            {                                                                                                          \
+                ::wccff::trace::write(::wccff::trace::category::cat, __VA_ARGS__);                                     \
+            }                                                                                                          \
+        }                                                                                                              \
+    } while (false)
+
+#endif // TRACE_H
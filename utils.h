@@ -19,15 +19,63 @@
 
 #ifndef UTILS_H
 #define UTILS_H
+#include "symbol.h"
+#include <cstdint>
 #include <fmt/format.h>
+#include <iterator>
+#include <string>
+#include <utility>
 
 namespace wccff {
-template<typename... Args>
-auto format_indented(int indent, fmt::format_string<Args...> format_str, Args &&...args)
+
+/**
+ * Where the pretty printers write. A dump is appended to a single buffer, the indentation of the lines is kept here
+ * instead of in prefix strings.
+ */
+struct print_context
+{
+    fmt::memory_buffer &out;
+    // The names of the symbols that are printed
+    const symbol_interner &symbols;
+    int32_t indent = 0;
+
+    template<typename... Args>
+    void write(fmt::format_string<Args...> format_str, Args &&...args)
+    {
+        fmt::format_to(std::back_inserter(out), format_str, std::forward<Args>(args)...);
+    }
+
+    /**
+     * Same as write, at the start of an indented line.
+     */
+    template<typename... Args>
+    void write_indented(fmt::format_string<Args...> format_str, Args &&...args)
+    {
+        fmt::format_to(std::back_inserter(out), "{:{}}", "", indent);
+        write(format_str, std::forward<Args>(args)...);
+    }
+};
+
+/**
+ * Pretty prints a node into a string, for the callers that need one.
+ */
+template<typename Node>
+std::string print_to_string(const symbol_interner &symbols, const Node &node, int32_t indent = 0)
+{
+    fmt::memory_buffer out;
+    print_context context{ out, symbols, indent };
+    pretty_print(context, node);
+    return fmt::to_string(out);
+}
+
+/**
+ * Same as above, for the nodes that have no names.
+ */
+template<typename Node>
+std::string print_to_string(const Node &node, int32_t indent = 0)
 {
-    auto prefix = fmt::format("{:{}}", "", indent);
-    auto msg = fmt::format(format_str, std::forward<Args>(args)...);
-    return fmt::format("{}{}", prefix, msg);
+    static const symbol_interner no_names;
+    return print_to_string(no_names, node, indent);
 }
 } // namespace wccff
 